@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -8,6 +9,7 @@
 #define APP_CMD_H_INCLUDED
 #pragma once
 
+#include "app/util/undo_buffer.h"
 #include "base/disable_copying.h"
 #include "undo/undo_command.h"
 
@@ -32,6 +34,11 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Called by DocUndo when this command is far from the current
+    // undo state, so it can compress its data (or move it to disk)
+    // to reduce its memSize(). See UndoBuffer::pack().
+    void packMemory(const UndoBuffer::State state);
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,6 +48,7 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onPackMemory(const UndoBuffer::State state);
 
   private:
     Context* m_ctx;
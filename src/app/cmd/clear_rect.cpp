@@ -77,11 +77,13 @@ void ClearRect::clear()
             m_offsetX + m_copy->width() - 1,
             m_offsetY + m_copy->height() - 1,
             m_bgcolor);
+  m_dstImage->image()->incrementVersion();
 }
 
 void ClearRect::restore()
 {
   copy_image(m_dstImage->image(), m_copy.get(), m_offsetX, m_offsetY);
+  m_dstImage->image()->incrementVersion();
 }
 
 } // namespace cmd
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -14,6 +14,7 @@
 #include "doc/image.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 namespace cmd {
@@ -30,9 +31,10 @@ CopyRect::CopyRect(Image* dst, const Image* src, const gfx::Clip& clip)
   // Fill m_data with "src" data
 
   int lineSize = src->bytesPerPixel() * m_clip.size.w;
-  m_data.resize(lineSize * m_clip.size.h);
+  base::buffer& data = m_data.buffer();
+  data.resize(lineSize * m_clip.size.h);
 
-  auto it = m_data.begin();
+  auto it = data.begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = src->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
@@ -66,7 +68,7 @@ void CopyRect::swap()
   int lineSize = this->lineSize();
   std::vector<uint8_t> tmp(lineSize);
 
-  auto it = m_data.begin();
+  auto it = m_data.buffer().begin();
   for (int v=0; v<m_clip.size.h; ++v) {
     uint8_t* addr = image->getPixelAddress(
       m_clip.dst.x, m_clip.dst.y+v);
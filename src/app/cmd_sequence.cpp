@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -80,6 +80,12 @@ size_t CmdSequence::onMemSize() const
   return size;
 }
 
+void CmdSequence::onPackMemory(const UndoBuffer::State state)
+{
+  for (auto it = m_cmds.begin(), end=m_cmds.end(); it!=end; ++it)
+    (*it)->packMemory(state);
+}
+
 void CmdSequence::executeAndAdd(Cmd* cmd)
 {
   addAndExecute(context(), cmd);
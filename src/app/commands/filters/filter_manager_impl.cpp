@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -28,6 +28,7 @@
 #include "app/ui/timeline/timeline.h"
 #include "app/ui_context.h"
 #include "app/util/cel_ops.h"
+#include "app/util/parallel_for.h"
 #include "app/util/range_utils.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
@@ -35,21 +36,171 @@
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "doc/rgbmap.h"
 #include "doc/sprite.h"
 #include "filters/filter.h"
 #include "ui/manager.h"
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <string>
+#include <thread>
 
 namespace app {
 
 using namespace std;
 using namespace ui;
 
+// Source/destination images of a cel that is being filtered in
+// FilterManagerImpl::applyToCelsInParallel().
+struct FilterManagerImpl::CelJob {
+  Cel* cel;
+  ImageRef src;
+  ImageRef dst;
+  Target target;
+};
+
+namespace {
+
+// FilterManager used by each thread in
+// FilterManagerImpl::applyToCelsInParallel() to apply the filter to
+// individual rows of different cels. It works like the
+// FilterManagerImpl::applyStep() (with the same mask/bounds), but
+// the palette/picks are accessed through the main FilterManagerImpl
+// using a mutex.
+class RowsFilterManager : public FilterManager
+                        , public FilterIndexedData {
+public:
+  RowsFilterManager(FilterManagerImpl* parent,
+                    std::mutex& parentMutex,
+                    base::task_token& token,
+                    const gfx::Rect& bounds,
+                    doc::Mask* mask)
+    : m_parent(parent)
+    , m_parentMutex(parentMutex)
+    , m_token(token)
+    , m_pixelFormat(parent->pixelFormat())
+    , m_isMaskActive(parent->isMaskActive())
+    , m_bounds(bounds)
+    , m_mask(mask && mask->bitmap() ? mask: nullptr) {
+  }
+
+  ~RowsFilterManager() {
+    m_maskBits.unlock();
+  }
+
+  void applyRow(Filter* filter, const Image* src, Image* dst,
+                const Target target, const int row) {
+    m_src = src;
+    m_dst = dst;
+    m_target = target;
+    m_row = row;
+
+    if (m_mask) {
+      const int x = m_bounds.x - m_mask->bounds().x;
+      const int y = m_bounds.y - m_mask->bounds().y + m_row;
+      if ((x >= m_bounds.w) ||
+          (y >= m_bounds.h))
+        return;
+
+      m_maskBits = m_mask->bitmap()
+        ->lockBits<BitmapTraits>(Image::ReadLock,
+          gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
+
+      m_maskIterator = m_maskBits.begin();
+    }
+
+    switch (m_pixelFormat) {
+      case IMAGE_RGB:       filter->applyToRgba(this); break;
+      case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+      case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+    }
+  }
+
+  // FilterManager implementation
+  doc::PixelFormat pixelFormat() const override { return m_pixelFormat; }
+  const void* getSourceAddress() override {
+    return m_src->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
+  }
+  void* getDestinationAddress() override {
+    return m_dst->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
+  }
+  int getWidth() override { return m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return this; }
+  bool skipPixel() override {
+    bool skip = false;
+    if (m_mask) {
+      if (!*m_maskIterator)
+        skip = true;
+      ++m_maskIterator;
+    }
+    return skip;
+  }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return m_bounds.x; }
+  int y() const override { return m_bounds.y+m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_isMaskActive; }
+  base::task_token& taskToken() const override { return m_token; }
+
+  // FilterIndexedData implementation
+  const doc::Palette* getPalette() const override {
+    const std::lock_guard lock(m_parentMutex);
+    return m_parent->getPalette();
+  }
+
+  // RgbMap implementations fill their tables lazily from mapColor(),
+  // so each thread uses its own copy of the sprite RgbMap.
+  const doc::RgbMap* getRgbMap() const override {
+    const std::lock_guard lock(m_parentMutex);
+    const doc::RgbMap* rgbmap = m_parent->getRgbMap();
+    if (!m_rgbmap ||
+        m_rgbmap->rgbmapAlgorithm() != rgbmap->rgbmapAlgorithm()) {
+      m_rgbmap.reset(Sprite::MakeRgbMap(rgbmap->rgbmapAlgorithm()));
+    }
+    m_rgbmap->regenerateMap(m_parent->sprite()->palette(m_parent->frame()),
+                            rgbmap->maskIndex(),
+                            rgbmap->fitCriteria());
+    return m_rgbmap.get();
+  }
+
+  doc::Palette* getNewPalette() override {
+    const std::lock_guard lock(m_parentMutex);
+    return m_parent->getNewPalette();
+  }
+
+  doc::PalettePicks getPalettePicks() override {
+    const std::lock_guard lock(m_parentMutex);
+    return m_parent->getPalettePicks();
+  }
+
+private:
+  FilterManagerImpl* m_parent;
+  std::mutex& m_parentMutex;
+  base::task_token& m_token;
+  const doc::PixelFormat m_pixelFormat;
+  const bool m_isMaskActive;
+  const gfx::Rect m_bounds;
+  doc::Mask* m_mask;
+  const Image* m_src = nullptr;
+  Image* m_dst = nullptr;
+  Target m_target = 0;
+  int m_row = 0;
+  doc::ImageBits<doc::BitmapTraits> m_maskBits;
+  doc::ImageBits<doc::BitmapTraits>::iterator m_maskIterator;
+  mutable std::unique_ptr<doc::RgbMap> m_rgbmap;
+};
+
+} // anonymous namespace
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_reader(context)
   , m_site(*const_cast<Site*>(m_reader.site()))
@@ -219,44 +370,7 @@ void FilterManagerImpl::apply()
   }
 
   if (!cancelled) {
-    gfx::Rect output;
-    if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
-                                  m_bounds, output)) {
-      if (m_cel->layer()->isTilemap()) {
-        modify_tilemap_cel_region(
-          *m_tx,
-          m_cel, nullptr,
-          gfx::Region(output),
-          m_site.tilesetMode(),
-          [this](const doc::ImageRef& origTile,
-                 const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
-            return ImageRef(
-              crop_image(m_dst.get(),
-                         tileBoundsInCanvas.x,
-                         tileBoundsInCanvas.y,
-                         tileBoundsInCanvas.w,
-                         tileBoundsInCanvas.h,
-                         m_dst->maskColor()));
-          });
-      }
-      else if (m_cel->layer()->isBackground()) {
-        (*m_tx)(
-          new cmd::CopyRegion(
-            m_cel->image(),
-            m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-      else {
-        // Patch "m_cel"
-        (*m_tx)(
-          new cmd::PatchCel(
-            m_cel, m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-    }
-
+    addChangesToTransaction();
     result = CommandResult(CommandResult::kOk);
   }
   else {
@@ -267,6 +381,48 @@ void FilterManagerImpl::apply()
   m_reader.context()->setCommandResult(result);
 }
 
+// Adds the changes between m_src and m_dst in m_cel to the transaction.
+void FilterManagerImpl::addChangesToTransaction()
+{
+  gfx::Rect output;
+  if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
+                                m_bounds, output)) {
+    if (m_cel->layer()->isTilemap()) {
+      modify_tilemap_cel_region(
+        *m_tx,
+        m_cel, nullptr,
+        gfx::Region(output),
+        m_site.tilesetMode(),
+        [this](const doc::ImageRef& origTile,
+               const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
+          return ImageRef(
+            crop_image(m_dst.get(),
+                       tileBoundsInCanvas.x,
+                       tileBoundsInCanvas.y,
+                       tileBoundsInCanvas.w,
+                       tileBoundsInCanvas.h,
+                       m_dst->maskColor()));
+        });
+    }
+    else if (m_cel->layer()->isBackground()) {
+      (*m_tx)(
+        new cmd::CopyRegion(
+          m_cel->image(),
+          m_dst.get(),
+          gfx::Region(output),
+          position()));
+    }
+    else {
+      // Patch "m_cel"
+      (*m_tx)(
+        new cmd::PatchCel(
+          m_cel, m_dst.get(),
+          gfx::Region(output),
+          position()));
+    }
+  }
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   applyToPaletteIfNeeded();
@@ -322,29 +478,127 @@ void FilterManagerImpl::applyToTarget()
   }
 
   // For each target image
-  for (auto it = cels.begin();
-       it != cels.end() && !cancelled;
-       ++it) {
-    Image* image = (*it)->image();
-
-    // Avoid applying the filter two times to the same image
-    if (visited.find(image->id()) == visited.end()) {
-      visited.insert(image->id());
-      applyToCel(*it);
-    }
+  if (!applyToCelsInParallel(cels)) {
+    for (auto it = cels.begin();
+         it != cels.end() && !cancelled;
+         ++it) {
+      Image* image = (*it)->image();
+
+      // Avoid applying the filter two times to the same image
+      if (visited.find(image->id()) == visited.end()) {
+        visited.insert(image->id());
+        applyToCel(*it);
+      }
 
-    // Is there a delegate to know if the process was cancelled by the user?
-    if (m_progressDelegate)
-      cancelled = m_progressDelegate->isCancelled();
+      // Is there a delegate to know if the process was cancelled by the user?
+      if (m_progressDelegate)
+        cancelled = m_progressDelegate->isCancelled();
 
-    // Make progress
-    m_progressBase += m_progressWidth;
+      // Make progress
+      m_progressBase += m_progressWidth;
+    }
   }
 
   // Reset m_oldPalette to avoid restoring the color palette
   m_oldPalette.reset(nullptr);
 }
 
+// Applies the filter to all the given cels using several threads,
+// where each thread takes the next row of any cel. Returns false if
+// the filter cannot be applied in parallel, in that case the cels
+// must be processed one by one with applyToCel().
+bool FilterManagerImpl::applyToCelsInParallel(const CelList& cels)
+{
+  const int ncpus = int(std::thread::hardware_concurrency());
+  if (ncpus < 2 || !m_filter->canApplyToRowsInParallel())
+    return false;
+
+  // Avoid applying the filter two times to the same image
+  CelList uniqueCels;
+  std::set<ObjectId> visited;
+  for (Cel* cel : cels) {
+    // Cels in tilemap layers share tiles, so the result of each cel
+    // depends on the changes to the tileset done by previous cels.
+    if (cel->layer()->isTilemap())
+      return false;
+
+    if (visited.insert(cel->image()->id()).second)
+      uniqueCels.push_back(cel);
+  }
+
+  std::mutex mutex;
+  base::task_token token;
+  const int total = int(uniqueCels.size());
+
+  // Cels are processed in batches to limit the memory used by the
+  // source/destination images. The changes of each batch are added
+  // to the transaction in the same order as applyToCel() would do.
+  for (int first=0; first<total && !token.canceled(); first+=ncpus) {
+    const int last = std::min(first+ncpus, total);
+
+    std::vector<CelJob> jobs;
+    jobs.reserve(last-first);
+    for (int i=first; i<last; ++i) {
+      init(uniqueCels[i]);
+      begin();
+      applyToPaletteIfNeeded();
+      jobs.push_back(CelJob{ m_cel, m_src, m_dst, m_target });
+    }
+
+    const int h = m_bounds.h;
+    const int nrows = int(jobs.size()) * h;
+    const int nthreads = std::min(ncpus, nrows);
+    std::atomic<int> done(0);
+
+    // One RowsFilterManager for each thread
+    std::vector<std::unique_ptr<RowsFilterManager>> rowsMgrs(nthreads);
+    for (auto& rowsMgr : rowsMgrs)
+      rowsMgr = std::make_unique<RowsFilterManager>(this, mutex, token, m_bounds, m_mask);
+
+    // The current thread (thread 0) reports the progress and checks
+    // if the user cancelled the process (cancelling the token skips
+    // the remaining rows in all threads).
+    parallel_for(
+      nrows, nthreads,
+      [&](const int i, const int thread) {
+        if (token.canceled())
+          return;
+
+        const CelJob& job = jobs[i / h];
+        rowsMgrs[thread]->applyRow(m_filter, job.src.get(), job.dst.get(),
+                                   job.target, i % h);
+        ++done;
+
+        if (thread == 0) {
+          token.set_progress(m_progressBase + m_progressWidth * float(done) / float(h));
+          if (m_progressDelegate) {
+            m_progressDelegate->reportProgress(token.progress());
+            if (m_progressDelegate->isCancelled())
+              token.cancel();
+          }
+        }
+      });
+
+    m_progressBase += m_progressWidth * float(last-first);
+
+    if (!token.canceled()) {
+      for (const CelJob& job : jobs) {
+        m_cel = job.cel;
+        m_src = job.src;
+        m_dst = job.dst;
+        m_target = job.target;
+        addChangesToTransaction();
+      }
+    }
+  }
+
+  ASSERT(m_reader.context());
+  m_reader.context()->setCommandResult(
+    CommandResult(token.canceled() ? CommandResult::kCanceled:
+                                     CommandResult::kOk));
+  return true;
+}
+
 void FilterManagerImpl::initTransaction()
 {
   ASSERT(!m_tx);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "app/tx.h"
 #include "base/exception.h"
 #include "base/task.h"
+#include "doc/cel_list.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
@@ -126,9 +127,13 @@ namespace app {
     doc::PalettePicks getPalettePicks() override;
 
   private:
+    struct CelJob;
+
     void init(doc::Cel* cel);
     void apply();
     void applyToCel(doc::Cel* cel);
+    bool applyToCelsInParallel(const doc::CelList& cels);
+    void addChangesToTransaction();
     bool updateBounds(doc::Mask* mask);
 
     // Returns true if the palette was changed (true when the filter
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -44,6 +44,8 @@ DataRecovery::DataRecovery(Context* ctx)
     m_config.keepEditedSpriteDataFor = pref.general.keepEditedSpriteDataFor();
   else
     m_config.keepEditedSpriteDataFor = 0;
+  m_config.compressionLevel =
+    std::clamp(pref.general.dataRecoveryCompressionLevel(), -1, 9);
 
   ResourceFinder rf;
   rf.includeUserDir(base::join_path("sessions", ".").c_str());
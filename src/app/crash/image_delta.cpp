@@ -0,0 +1,197 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/crash/image_delta.h"
+
+#include "base/debug.h"
+#include "base/serialization.h"
+#include "doc/cancel_io.h"
+#include "doc/image.h"
+#include "gfx/rect.h"
+
+#include "zlib.h"
+
+#include <city.h>
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+
+namespace app {
+namespace crash {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+using namespace doc;
+
+namespace {
+
+int tile_columns(const Image* image, const int tileSize)
+{
+  return (image->width() + tileSize - 1) / tileSize;
+}
+
+int tile_rows(const Image* image, const int tileSize)
+{
+  return (image->height() + tileSize - 1) / tileSize;
+}
+
+gfx::Rect tile_bounds(const Image* image, const int tileSize, const int tileIndex)
+{
+  const int cols = tile_columns(image, tileSize);
+  return gfx::Rect((tileIndex % cols) * tileSize,
+                   (tileIndex / cols) * tileSize,
+                   tileSize, tileSize).createIntersection(image->bounds());
+}
+
+} // anonymous namespace
+
+bool calculate_image_tile_hashes(const Image* image,
+                                 ImageTileHashes& hashes)
+{
+  // Bitmap images don't have one byte (or more) per pixel
+  if (image->pixelFormat() == IMAGE_BITMAP)
+    return false;
+
+  const int ts = IMAGE_DELTA_TILE_SIZE;
+  const int cols = tile_columns(image, ts);
+  const int rows = tile_rows(image, ts);
+  const int bpp = image->bytesPerPixel();
+
+  hashes.resize(cols * rows);
+
+  // Hash the image row by row (which is cache friendly), each row of
+  // pixels updates the hashes of all tiles in the same row of tiles.
+  for (int ty=0; ty<rows; ++ty) {
+    uint64_t* tileHashes = &hashes[ty*cols];
+    std::fill(tileHashes, tileHashes+cols, 0);
+
+    const int y2 = std::min((ty+1)*ts, image->height());
+    for (int y=ty*ts; y<y2; ++y) {
+      const char* addr = (const char*)image->getPixelAddress(0, y);
+      for (int tx=0; tx<cols; ++tx) {
+        const int w = std::min(ts, image->width() - tx*ts);
+        tileHashes[tx] = CityHash64WithSeed(addr, w*bpp, tileHashes[tx]);
+        addr += w*bpp;
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<int> get_modified_tiles(const ImageTileHashes& a,
+                                    const ImageTileHashes& b)
+{
+  ASSERT(a.size() == b.size());
+  std::vector<int> tiles;
+  for (int i=0; i<int(std::min(a.size(), b.size())); ++i) {
+    if (a[i] != b[i])
+      tiles.push_back(i);
+  }
+  return tiles;
+}
+
+bool write_image_delta(std::ostream& os,
+                       const Image* image,
+                       const ObjectVersion baseVersion,
+                       const std::vector<int>& tiles,
+                       CancelIO* cancel,
+                       const int compressionLevel)
+{
+  const int ts = IMAGE_DELTA_TILE_SIZE;
+  const int bpp = image->bytesPerPixel();
+
+  write32(os, baseVersion);
+  write8(os, image->pixelFormat());
+  write32(os, image->width());
+  write32(os, image->height());
+  write16(os, ts);
+  write32(os, tiles.size());
+
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> compressed;
+  for (const int tileIndex : tiles) {
+    if (cancel && cancel->isCanceled())
+      return false;
+
+    const gfx::Rect bounds = tile_bounds(image, ts, tileIndex);
+    const int rowBytes = bounds.w * bpp;
+    raw.resize(rowBytes * bounds.h);
+    for (int y=0; y<bounds.h; ++y) {
+      const uint8_t* src = image->getPixelAddress(bounds.x, bounds.y+y);
+      std::copy(src, src+rowBytes, &raw[y*rowBytes]);
+    }
+
+    uLongf size = compressBound(uLong(raw.size()));
+    compressed.resize(size);
+    if (compress2(&compressed[0], &size, &raw[0], uLong(raw.size()),
+                  compressionLevel) != Z_OK)
+      return false;
+
+    write32(os, tileIndex);
+    write32(os, size);
+    if (os.write((const char*)&compressed[0], size).fail())
+      return false;
+  }
+  return true;
+}
+
+ObjectVersion read_image_delta_base(std::istream& is)
+{
+  return read32(is);
+}
+
+bool read_image_delta_tiles(std::istream& is, Image* image)
+{
+  const int pixelFormat = read8(is);
+  const int width = read32(is);
+  const int height = read32(is);
+  const int ts = read16(is);
+  const int ntiles = read32(is);
+  if (pixelFormat != image->pixelFormat() ||
+      width != image->width() ||
+      height != image->height() ||
+      ts < 1 || !is)
+    return false;
+
+  const int bpp = image->bytesPerPixel();
+  const int maxTiles = tile_columns(image, ts) * tile_rows(image, ts);
+
+  std::vector<uint8_t> raw;
+  std::vector<uint8_t> compressed;
+  for (int i=0; i<ntiles; ++i) {
+    const int tileIndex = read32(is);
+    const uLong size = read32(is);
+    if (!is || tileIndex < 0 || tileIndex >= maxTiles ||
+        size == 0 || size > compressBound(uLong(ts)*ts*bpp))
+      return false;
+
+    compressed.resize(size);
+    if (is.read((char*)&compressed[0], size).fail())
+      return false;
+
+    const gfx::Rect bounds = tile_bounds(image, ts, tileIndex);
+    const int rowBytes = bounds.w * bpp;
+    uLongf rawSize = rowBytes * bounds.h;
+    raw.resize(rawSize);
+    if (uncompress(&raw[0], &rawSize, &compressed[0], size) != Z_OK ||
+        rawSize != raw.size())
+      return false;
+
+    for (int y=0; y<bounds.h; ++y) {
+      const uint8_t* src = &raw[y*rowBytes];
+      std::copy(src, src+rowBytes, image->getPixelAddress(bounds.x, bounds.y+y));
+    }
+  }
+  return true;
+}
+
+} // namespace crash
+} // namespace app
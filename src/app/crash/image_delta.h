@@ -0,0 +1,62 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CRASH_IMAGE_DELTA_H_INCLUDED
+#define APP_CRASH_IMAGE_DELTA_H_INCLUDED
+#pragma once
+
+#include "doc/object_version.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace doc {
+  class CancelIO;
+  class Image;
+}
+
+namespace app {
+namespace crash {
+
+  // Images are divided in tiles of this size (in pixels) to detect
+  // which parts were modified since the last full backup of the
+  // image.
+  const int IMAGE_DELTA_TILE_SIZE = 64;
+
+  // One hash per tile (tiles are ordered row by row).
+  typedef std::vector<uint64_t> ImageTileHashes;
+
+  // Returns false if the image cannot be saved as a delta (e.g. it's
+  // a bitmap image).
+  bool calculate_image_tile_hashes(const doc::Image* image,
+                                   ImageTileHashes& hashes);
+
+  // Returns the indexes of the tiles with different hashes.
+  std::vector<int> get_modified_tiles(const ImageTileHashes& a,
+                                      const ImageTileHashes& b);
+
+  // Writes the given tiles of the image. The delta is applied over
+  // the image saved with the "baseVersion" (the last full backup).
+  bool write_image_delta(std::ostream& os,
+                         const doc::Image* image,
+                         const doc::ObjectVersion baseVersion,
+                         const std::vector<int>& tiles,
+                         doc::CancelIO* cancel,
+                         const int compressionLevel);
+
+  // Reads the version of the full image that must be loaded to apply
+  // the delta, and then read_image_delta_tiles() can be called.
+  doc::ObjectVersion read_image_delta_base(std::istream& is);
+
+  // Applies the tiles of the delta to the given base image. Returns
+  // false if the delta doesn't match the image or is broken.
+  bool read_image_delta_tiles(std::istream& is, doc::Image* image);
+
+} // namespace crash
+} // namespace app
+
+#endif
@@ -12,6 +12,7 @@
 #include "app/crash/read_document.h"
 
 #include "app/console.h"
+#include "app/crash/image_delta.h"
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
 #include "app/doc.h"
@@ -48,6 +49,7 @@
 
 #include <fstream>
 #include <map>
+#include <memory>
 
 namespace app {
 namespace crash {
@@ -101,6 +103,13 @@ public:
         continue;
       }
 
+      // Deltas of images are stored separately because the "img"
+      // file with the same ID contains the full image.
+      if (fn.compare(0, 5, "imgd-") == 0) {
+        m_imageDeltaVersions[id].add(ver);
+        continue;
+      }
+
       ObjVersions& versions = m_objVersions[id];
       versions.add(ver);
 
@@ -150,7 +159,9 @@ private:
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
 
-    ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage));
+    ImageRef image(loadImageWithDelta(imageId));
+    if (!image)
+      image.reset(loadObject<Image*>("img", imageId, &Reader::readImage));
     return m_images[imageId] = image;
   }
 
@@ -162,6 +173,53 @@ private:
     return m_celdatas[celdataId] = celData;
   }
 
+  // Loads the full image referenced by the latest valid delta of the
+  // image, and applies the delta over it. Deltas that are older than
+  // the latest full image are ignored (they can be there if the
+  // process crashed after the image was compacted, before the old
+  // delta was deleted).
+  Image* loadImageWithDelta(ObjectId imageId) {
+    auto it = m_imageDeltaVersions.find(imageId);
+    if (it == m_imageDeltaVersions.end())
+      return nullptr;
+
+    const ObjectVersion fullVer = m_objVersions[imageId].newer();
+    const ObjVersions& versions = it->second;
+    for (size_t i=0; i<versions.size(); ++i) {
+      ObjectVersion ver = versions[i];
+      if (!ver || ver <= fullVer)
+        continue;
+
+      RECO_TRACE("RECO: Restoring imgd #%d v%d\n", imageId, ver);
+
+      std::ifstream s(FSTREAM_PATH(objFilename("imgd", imageId, ver)), std::ifstream::binary);
+      if (read32(s) != MAGIC_NUMBER)
+        continue;
+
+      ObjectVersion baseVer = read_image_delta_base(s);
+      std::ifstream base(FSTREAM_PATH(objFilename("img", imageId, baseVer)), std::ifstream::binary);
+      if (read32(base) != MAGIC_NUMBER)
+        continue;
+
+      std::unique_ptr<Image> image(readImage(base));
+      if (image && read_image_delta_tiles(s, image.get())) {
+        RECO_TRACE("RECO: imgd #%d v%d restored successfully\n", imageId, ver);
+        return image.release();
+      }
+      RECO_TRACE("RECO: imgd #%d v%d was not restored\n", imageId, ver);
+    }
+    return nullptr;
+  }
+
+  std::string objFilename(const char* prefix, ObjectId id, ObjectVersion ver) const {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return base::join_path(m_dir, fn);
+  }
+
   template<typename T>
   T loadObject(const char* prefix, ObjectId id, T (Reader::*readMember)(std::ifstream&)) {
     const ObjVersions& versions = m_objVersions[id];
@@ -173,13 +231,7 @@ private:
 
       RECO_TRACE("RECO: Restoring %s #%d v%d\n", prefix, id, ver);
 
-      std::string fn = prefix;
-      fn.push_back('-');
-      fn += base::convert_to<std::string>(id);
-      fn.push_back('.');
-      fn += base::convert_to<std::string>(ver);
-
-      std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, fn)), std::ifstream::binary);
+      std::ifstream s(FSTREAM_PATH(objFilename(prefix, id, ver)), std::ifstream::binary);
       T obj = nullptr;
       if (read32(s) == MAGIC_NUMBER)
         obj = (this->*readMember)(s);
@@ -598,6 +650,7 @@ private:
   ObjectVersion m_docId;
   ObjVersionsMap m_objVersions;
   ObjVersions* m_docVersions;
+  ObjVersionsMap m_imageDeltaVersions;
   DocumentInfo* m_loadInfo;
   std::vector<std::pair<ObjectId, ObjectId> > m_celsToLoad;
   std::map<ObjectId, ImageRef> m_images;
@@ -652,7 +705,8 @@ Doc* read_document_with_raw_images(const std::string& dir,
     if (t)
       t->set_progress((i++) / fns.size());
 
-    if (fn.compare(0, 3, "img") != 0)
+    // Only full images (skip "imgd" deltas)
+    if (fn.compare(0, 4, "img-") != 0)
       continue;
 
     std::ifstream s(FSTREAM_PATH(base::join_path(dir, fn)), std::ifstream::binary);
@@ -0,0 +1,117 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+// The crash module is compiled only with data recovery enabled
+#ifdef ENABLE_DATA_RECOVERY
+
+#include "app/context.h"
+#include "app/crash/read_document.h"
+#include "app/crash/write_document.h"
+#include "app/doc.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/task.h"
+#include "doc/doc.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+static std::string read_file(const std::string& fn)
+{
+  std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+  return std::string(std::istreambuf_iterator<char>(s),
+                     std::istreambuf_iterator<char>());
+}
+
+static void write_file(const std::string& fn, const std::string& data)
+{
+  std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
+  s.write(data.data(), data.size());
+}
+
+static void delete_dir(const std::string& dir)
+{
+  if (!base::is_directory(dir))
+    return;
+  for (const auto& fn : base::list_files(dir, base::ItemType::Files))
+    base::delete_file(base::join_path(dir, fn));
+  base::remove_directory(dir);
+}
+
+// Restores the image of the first cel from the backup.
+static void expect_restored_image(const std::string& dir,
+                                  const Image* expected)
+{
+  base::task_token token;
+  std::unique_ptr<Doc> doc(crash::read_document(dir, &token));
+  ASSERT_TRUE(doc != nullptr);
+  const Cel* cel = doc->sprite()->root()->firstLayer()->cel(0);
+  ASSERT_TRUE(cel != nullptr);
+  EXPECT_TRUE(is_same_image(expected, cel->image()));
+}
+
+TEST(Crash, ImageDeltas)
+{
+  app::Context ctx;
+  const std::string dir = "_crash_test_session";
+  delete_dir(dir);
+  base::make_directory(dir);
+
+  std::unique_ptr<Doc> doc(
+    ctx.documents().add(256, 256, ColorMode::RGB, 256));
+  Image* image = doc->sprite()->root()->firstLayer()->cel(0)->image();
+  clear_image(image, rgba(255, 0, 0, 255));
+  image->incrementVersion();
+
+  // Full image
+  ASSERT_TRUE(crash::write_document(dir, doc.get(), nullptr));
+  expect_restored_image(dir, image);
+
+  // Modifying one tile saves a delta
+  put_pixel(image, 3, 4, rgba(0, 0, 255, 255));
+  image->incrementVersion();
+  ASSERT_TRUE(crash::write_document(dir, doc.get(), nullptr));
+
+  const std::string deltaFn =
+    base::join_path(dir, fmt::format("imgd-{}.{}", image->id(), image->version()));
+  ASSERT_TRUE(base::is_file(deltaFn));
+  const std::string deltaData = read_file(deltaFn);
+  expect_restored_image(dir, image);
+
+  // Modifying most tiles saves the full image again (compaction) and
+  // removes the old delta
+  fill_rect(image, 0, 0, 199, 199, rgba(0, 255, 0, 255));
+  image->incrementVersion();
+  ASSERT_TRUE(crash::write_document(dir, doc.get(), nullptr));
+  EXPECT_FALSE(base::is_file(deltaFn));
+  expect_restored_image(dir, image);
+
+  // If the process crashed before the old delta was deleted, the
+  // delta must be ignored because it's older than the full image
+  write_file(deltaFn, deltaData);
+  expect_restored_image(dir, image);
+
+  // A new delta over the compacted image
+  put_pixel(image, 250, 250, rgba(0, 0, 0, 255));
+  image->incrementVersion();
+  ASSERT_TRUE(crash::write_document(dir, doc.get(), nullptr));
+  expect_restored_image(dir, image);
+
+  crash::delete_document_internals(doc.get());
+  doc->close();
+  delete_dir(dir);
+}
+
+#endif // ENABLE_DATA_RECOVERY
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -16,6 +16,11 @@ namespace crash {
   struct RecoveryConfig {
     double dataRecoveryPeriod;
     int keepEditedSpriteDataFor;
+
+    // ZLib compression level of backups, by default Z_BEST_SPEED
+    // because backups are saved frequently (it's independent of the
+    // level used to save .aseprite files).
+    int compressionLevel;
   };
 
 } // namespace crash
@@ -278,7 +278,7 @@ bool Session::saveDocumentChanges(Doc* doc)
   }
 
   // Save document information
-  return write_document(dir, doc, &reader);
+  return write_document(dir, doc, &reader, m_config->compressionLevel);
 }
 
 void Session::removeDocument(Doc* doc)
@@ -11,6 +11,7 @@
 
 #include "app/crash/write_document.h"
 
+#include "app/crash/image_delta.h"
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
 #include "app/doc.h"
@@ -55,17 +56,35 @@ using namespace doc;
 
 namespace {
 
+// Information about the backup of an image, used to save only the
+// tiles that were modified since its last full backup.
+struct ImageBackup {
+  ObjectVersion version = 0;        // Last saved version (full or delta)
+  ObjectVersion baseVersion = 0;    // Version of the last full backup
+  ObjectVersion deltaVersion = 0;   // Version of the last delta (0 if there is no delta)
+  PixelFormat pixelFormat = IMAGE_RGB;
+  gfx::Size size;
+  color_t maskColor = 0;
+  ImageTileHashes baseHashes;       // Hashes of the tiles in the last full backup
+};
+
+typedef std::map<ObjectId, ImageBackup> ImageBackupsMap;
+
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
+static std::map<ObjectId, ImageBackupsMap> g_imageBackups;
 static std::map<ObjectId, base::paths> g_deleteFiles;
 
 class Writer {
 public:
-  Writer(const std::string& dir, Doc* doc, doc::CancelIO* cancel)
+  Writer(const std::string& dir, Doc* doc, doc::CancelIO* cancel,
+         const int compressionLevel)
     : m_dir(dir)
     , m_doc(doc)
     , m_objVersions(g_docVersions[doc->id()])
+    , m_imageBackups(g_imageBackups[doc->id()])
     , m_deleteFiles(g_deleteFiles[doc->id()])
-    , m_cancel(cancel) {
+    , m_cancel(cancel)
+    , m_compressionLevel(compressionLevel) {
   }
 
   bool saveDocument() {
@@ -109,7 +128,7 @@ public:
         if (cel->link())        // Skip link
           continue;
 
-        if (!saveObject("img", cel->image(), &Writer::writeImage))
+        if (!saveImage(cel->image()))
           return false;
 
         if (!saveObject("celdata", cel->data(), &Writer::writeCelData))
@@ -293,7 +312,13 @@ private:
   }
 
   bool writeImage(std::ofstream& s, Image* img) {
-    return write_image(s, img, m_cancel);
+    return write_image(s, img, m_cancel, m_compressionLevel);
+  }
+
+  bool writeImageDelta(std::ofstream& s, Image* img) {
+    const ImageBackup& backup = m_imageBackups[img->id()];
+    return write_image_delta(s, img, backup.baseVersion, m_deltaTiles, m_cancel,
+                             m_compressionLevel);
   }
 
   bool writePalette(std::ofstream& s, Palette* pal) {
@@ -302,7 +327,7 @@ private:
   }
 
   bool writeTileset(std::ofstream& s, Tileset* tileset) {
-    write_tileset(s, tileset);
+    write_tileset(s, tileset, nullptr, m_compressionLevel);
     return true;
   }
 
@@ -316,26 +341,78 @@ private:
     return true;
   }
 
-  template<typename T>
-  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+  // Saves the modified tiles of the image since its last full backup
+  // in a "imgd" file (a delta), or the full image in a "img" file if
+  // the delta would be too big. In this way modifying a small part of
+  // a big image doesn't write/compress the whole image again.
+  bool saveImage(Image* img) {
     if (isCanceled())
       return false;
 
-    if (!obj->version())
-      obj->incrementVersion();
+    if (!img->version())
+      img->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+    ImageBackup& backup = m_imageBackups[img->id()];
+    if (backup.version == img->version())
       return true;
 
+    ImageTileHashes hashes;
+    const bool hasHashes = calculate_image_tile_hashes(img, hashes);
+    if (hasHashes &&
+        backup.baseVersion &&
+        backup.baseVersion == m_objVersions[img->id()].newer() &&
+        backup.pixelFormat == img->pixelFormat() &&
+        backup.size == img->size() &&
+        backup.maskColor == img->maskColor() &&
+        backup.baseHashes.size() == hashes.size()) {
+      m_deltaTiles = get_modified_tiles(backup.baseHashes, hashes);
+
+      // Each delta contains all the modified tiles since the last
+      // full backup, so when more than a quarter of the image was
+      // modified we write the full image again (compacting the
+      // backup of this image).
+      if (m_deltaTiles.size() * 4 <= hashes.size()) {
+        if (!writeObjectFile(objFilename("imgd", img->id(), img->version()),
+                             img, &Writer::writeImageDelta))
+          return false;
+
+        if (backup.deltaVersion)
+          m_deleteFiles.push_back(objFilename("imgd", img->id(), backup.deltaVersion));
+
+        backup.version = backup.deltaVersion = img->version();
+        RECO_TRACE(" - Saved imgd #%d v%d (%d tiles)\n",
+                   img->id(), img->version(), int(m_deltaTiles.size()));
+        return true;
+      }
+    }
+
+    // Full backup
+    if (!saveObject("img", img, &Writer::writeImage))
+      return false;
+
+    if (backup.deltaVersion)
+      m_deleteFiles.push_back(objFilename("imgd", img->id(), backup.deltaVersion));
+
+    backup.version = backup.baseVersion = img->version();
+    backup.deltaVersion = 0;
+    backup.pixelFormat = img->pixelFormat();
+    backup.size = img->size();
+    backup.maskColor = img->maskColor();
+    backup.baseHashes = std::move(hashes);
+    return true;
+  }
+
+  std::string objFilename(const char* prefix, ObjectId id, ObjectVersion ver) const {
     std::string fn = prefix;
     fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
-
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return base::join_path(m_dir, fn);
+  }
 
+  template<typename T>
+  bool writeObjectFile(const std::string& fullfn, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
     std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
     if (!(this->*writeMember)(s, obj)) // Write the object
@@ -348,6 +425,25 @@ private:
     // Write the magic number
     s.seekp(0);
     write32(s, MAGIC_NUMBER);
+    return true;
+  }
+
+  template<typename T>
+  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+    if (isCanceled())
+      return false;
+
+    if (!obj->version())
+      obj->incrementVersion();
+
+    ObjVersions& versions = m_objVersions[obj->id()];
+    if (versions.newer() == obj->version())
+      return true;
+
+    std::string oldfn = objFilename(prefix, obj->id(), versions.older());
+    if (!writeObjectFile(objFilename(prefix, obj->id(), obj->version()),
+                         obj, writeMember))
+      return false;
 
     // Remove the older version
     if (versions.older() && base::is_file(oldfn))
@@ -378,8 +474,11 @@ private:
   std::string m_dir;
   Doc* m_doc;
   ObjVersionsMap& m_objVersions;
+  ImageBackupsMap& m_imageBackups;
   base::paths& m_deleteFiles;
   doc::CancelIO* m_cancel;
+  int m_compressionLevel;
+  std::vector<int> m_deltaTiles; // Tiles to save in writeImageDelta()
 };
 
 } // anonymous namespace
@@ -389,9 +488,10 @@ private:
 
 bool write_document(const std::string& dir,
                     Doc* doc,
-                    doc::CancelIO* cancel)
+                    doc::CancelIO* cancel,
+                    const int compressionLevel)
 {
-  Writer writer(dir, doc, cancel);
+  Writer writer(dir, doc, cancel, compressionLevel);
   return writer.saveDocument();
 }
 
@@ -406,6 +506,11 @@ void delete_document_internals(Doc* doc)
     if (it != g_docVersions.end())
       g_docVersions.erase(it);
   }
+  {
+    auto it = g_imageBackups.find(doc->id());
+    if (it != g_imageBackups.end())
+      g_imageBackups.erase(it);
+  }
   {
     auto it = g_deleteFiles.find(doc->id());
     if (it != g_deleteFiles.end())
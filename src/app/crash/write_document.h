@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -19,7 +20,10 @@ namespace app {
 
   namespace crash {
 
-    bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
+    // The compression level is the zlib level used to compress
+    // images (-1 for the default level).
+    bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel,
+                        const int compressionLevel = -1);
     void delete_document_internals(Doc* doc);
 
   } // namespace crash
@@ -11,6 +11,7 @@
 
 #include "app/doc_observer.h"
 #include "app/extra_cel.h"
+#include "app/file/compressed_images_cache.h"
 #include "app/file/format_options.h"
 #include "app/transformation.h"
 #include "base/disable_copying.h"
@@ -178,6 +179,9 @@ namespace app {
     void setFormatOptions(const FormatOptionsPtr& format_options);
     FormatOptionsPtr formatOptions() const { return m_format_options; }
 
+    // Compressed cels/tilesets from the last .aseprite save
+    CompressedImagesCache& compressedImagesCache() { return m_compressedImagesCache; }
+
     //////////////////////////////////////////////////////////////////////
     // Boundaries
 
@@ -277,6 +281,10 @@ namespace app {
     // Data to save the file in the same format that it was loaded
     FormatOptionsPtr m_format_options;
 
+    // Compressed data of cels and tilesets saved in the last
+    // .aseprite file (to compress only modified images next time).
+    CompressedImagesCache m_compressedImagesCache;
+
     // Extra cel used to draw extra stuff (e.g. editor's pen preview, pixels in movement, etc.)
     ExtraCelRef m_extraCel;
 
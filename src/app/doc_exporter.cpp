@@ -21,6 +21,7 @@
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
+#include "app/util/parallel_for.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
@@ -29,8 +30,6 @@
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/images_map.h"
-#include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -48,12 +47,15 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -88,6 +90,59 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Calls func(i, imageBuf) for each i in [0, n) from several threads
+// (one for each CPU core, including the current one). Each thread
+// has its own ImageBuffer to render samples. Items are processed in
+// any order, so func() must save its result in the i-th element of
+// some container to keep a deterministic output. onProgress(done)
+// is called only from the current thread.
+template<typename Func, typename ProgressFunc>
+void for_each_sample_in_parallel(const int n,
+                                 base::task_token& token,
+                                 Func&& func,
+                                 ProgressFunc&& onProgress)
+{
+  const int nthreads = parallel_for_threads(n);
+  std::vector<doc::ImageBufferPtr> imageBufs(nthreads);
+  std::atomic<int> done(0);
+
+  parallel_for(
+    n, nthreads,
+    [&](const int i, const int thread) {
+      if (token.canceled())
+        return;
+
+      doc::ImageBufferPtr& imageBuf = imageBufs[thread];
+      if (!imageBuf)
+        imageBuf = std::make_shared<doc::ImageBuffer>();
+
+      func(i, imageBuf);
+      ++done;
+
+      if (thread == 0)
+        onProgress(int(done));
+    });
+}
+
+// Maximum number of bytes of sample renders to keep in memory to
+// compare samples with the same hash (see findDuplicatedSamples()).
+const std::size_t kMaxKeptRendersSize = 256*1024*1024;
+
+// Number of threads to render each sample when "n" samples are
+// rendered in parallel (see render::Render::setThreads()), so a few
+// big samples can use all CPU cores too.
+int render_threads_per_sample(const int n)
+{
+  return std::max(1, int(std::thread::hardware_concurrency()) / std::max(1, n));
+}
+
+// Result of rendering and shrinking a sample to trim it.
+struct ShrunkSample {
+  bool done = false;
+  bool nonEmpty = false;
+  gfx::Rect bounds;
+};
+
 } // anonymous namespace
 
 namespace app {
@@ -236,6 +291,16 @@ public:
   void setDuplicated() { m_isDuplicated = true; }
 
   ImageRef createRender(ImageBufferPtr& imageBuf) {
+    RestoreVisibleLayers layersVisibility;
+    showSelectedLayers(layersVisibility);
+    return createRenderWithCurrentVisibility(imageBuf);
+  }
+
+  // Same as createRender() but the visibility of layers must be
+  // already changed with showSelectedLayers(), so it can be called
+  // from several threads at the same time.
+  ImageRef createRenderWithCurrentVisibility(ImageBufferPtr& imageBuf,
+                                             const int renderThreads = 1) const {
     ASSERT(m_sprite);
 
     // We use the m_image as it is, it doesn't require a special
@@ -250,17 +315,24 @@ public:
                     imageBuf));
     render->setMaskColor(m_sprite->transparentColor());
     clear_image(render.get(), m_sprite->transparentColor());
-    renderSample(render.get(), 0, 0, false);
+    renderSample(render.get(), 0, 0, false, renderThreads);
     return render;
   }
 
-  void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
-    RestoreVisibleLayers layersVisibility;
+  void showSelectedLayers(RestoreVisibleLayers& layersVisibility) const {
     if (m_selLayers)
       layersVisibility.showSelectedLayers(m_sprite,
                                           *m_selLayers);
+  }
 
+  // Renders the sample with the current visibility of layers (see
+  // showSelectedLayers()). Samples of the same sprite/layers can be
+  // rendered from several threads in different areas of "dst", and
+  // each one can be rendered with "renderThreads" threads too.
+  void renderSample(doc::Image* dst, int x, int y, bool extrude,
+                    const int renderThreads = 1) const {
     render::Render render;
+    render.setThreads(renderThreads);
 
     // 1) We cannot use the Preferences because this is called from a non-UI thread
     // 2) We should use the new blend mode always when we're saving files
@@ -367,14 +439,12 @@ class DocExporter::SimpleLayoutSamples : public DocExporter::LayoutSamples {
 public:
   SimpleLayoutSamples(SpriteSheetType type,
                       int maxCols, int maxRows,
-                      bool splitLayers, bool splitTags,
-                      bool mergeDups)
+                      bool splitLayers, bool splitTags)
     : m_type(type)
     , m_maxCols(maxCols)
     , m_maxRows(maxRows)
     , m_splitLayers(splitLayers)
-    , m_splitTags(splitTags)
-    , m_mergeDups(mergeDups) {
+    , m_splitTags(splitTags) {
   }
 
   void layoutSamples(Samples& samples,
@@ -392,7 +462,6 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -417,21 +486,11 @@ public:
         continue;
       }
 
-      if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
-          sample.setDuplicated();
-          sample.setSharedBounds(samples[j].sharedBounds());
-          ++i;
-          continue;
-        }
-        else {
-          duplicates[sampleRender] = i;
-        }
+      // Duplicated samples share the bounds of the original sample
+      // (see DocExporter::findDuplicatedSamples())
+      if (sample.isDuplicated()) {
+        ++i;
+        continue;
       }
 
       const Sprite* sprite = sample.sprite();
@@ -523,7 +582,6 @@ private:
   int m_maxRows;
   bool m_splitLayers;
   bool m_splitTags;
-  bool m_mergeDups;
 };
 
 class DocExporter::BestFitLayoutSamples : public DocExporter::LayoutSamples {
@@ -534,7 +592,6 @@ public:
                      int& width, int& height,
                      base::task_token& token) override {
     gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
 
     uint32_t i = 0;
     for (auto& sample : samples) {
@@ -543,26 +600,15 @@ public:
       token.set_progress_range(0.2f, 0.3f);
       token.set_progress(float(i) / samples.size());
 
-      if (sample.isEmpty()) {
+      // Duplicated samples share the bounds of the original sample
+      // (see DocExporter::findDuplicatedSamples())
+      if (sample.isEmpty() ||
+          sample.isDuplicated()) {
         ++i;
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
-        sample.setDuplicated();
-        sample.setSharedBounds(samples[j].sharedBounds());
-      }
-      else {
-        duplicates[sampleRender] = i;
-        pr.add(sample.requiredSize());
-      }
+      pr.add(sample.requiredSize());
       ++i;
     }
 
@@ -941,11 +987,78 @@ void DocExporter::captureSamples(Samples& samples,
       }
     }
 
+    std::vector<frame_t> frames;
+    for (frame_t frame : item.getSelectedFrames())
+      frames.push_back(frame);
+
+    // The reference color to trim cels depends on the visibility of
+    // the background layer before we show the selected layers.
+    const bool trimWithFirstPixel =
+      (m_trimCels &&
+       ((layer &&
+         layer->isBackground()) ||
+        (!layer &&
+         sprite->backgroundLayer() &&
+         sprite->backgroundLayer()->isVisible())));
+
+    // All samples of this item use the same visible layers, so we can
+    // render and shrink them in parallel.
+    RestoreVisibleLayers layersVisibility;
+    std::vector<ShrunkSample> shrunkSamples(frames.size());
+    if ((m_ignoreEmptyCels || m_trimCels) &&
+        !item.isOneImageOnly()) {
+      if (item.selLayers)
+        layersVisibility.showSelectedLayers(sprite, *item.selLayers);
+
+      // Indexes of frames that must be rendered to be trimmed
+      std::vector<int> toShrink;
+      for (int k=0; k<int(frames.size()); ++k) {
+        if (layer && layer->isImage()) {
+          const Cel* cel = layer->cel(frames[k]);
+          // Ignore empty cels
+          if (!cel && m_ignoreEmptyCels)
+            continue;
+          // Linked cels will re-use the bounds of the original sample
+          if (cel && cel->link() && m_mergeDuplicates)
+            continue;
+        }
+        toShrink.push_back(k);
+      }
+
+      const gfx::Size sampleSize =
+        (item.splitGrid ? sprite->gridBounds().size():
+                          sprite->size());
+
+      const int renderThreads =
+        render_threads_per_sample(int(toShrink.size()));
+      for_each_sample_in_parallel(
+        int(toShrink.size()), token,
+        [&](const int i, doc::ImageBufferPtr& imageBuf) {
+          const int k = toShrink[i];
+          const Sample sample(
+            sampleSize, doc, sprite, nullptr, item.selLayers.get(),
+            frames[k], nullptr, std::string(),
+            m_innerPadding, m_extrude);
+
+          ShrunkSample& shrunk = shrunkSamples[k];
+          shrunk.nonEmpty = shrinkSample(sample, spriteBounds,
+                                         trimWithFirstPixel,
+                                         imageBuf, shrunk.bounds,
+                                         renderThreads);
+          shrunk.done = true;
+        },
+        [](int){ });
+      if (token.canceled())
+        return;
+    }
+
     frame_t outputFrame = 0;
-    for (frame_t frame : item.getSelectedFrames()) {
+    for (int k=0; k<int(frames.size()); ++k) {
       if (token.canceled())
         return;
 
+      const frame_t frame = frames[k];
+
       const Tag* innerTag = (tag ? tag: sprite->tags().innerTag(frame));
       const Tag* outerTag = sprite->tags().outerTag(frame);
       FilenameInfo fnInfo;
@@ -1012,31 +1125,19 @@ void DocExporter::captureSamples(Samples& samples,
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
-
-        gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
-
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
-          }
-          else {
-            refColor = sprite->transparentColor();
-          }
+        // This sample can be a linked cel that wasn't rendered
+        // (e.g. when the original cel is outside the tag range).
+        ShrunkSample& shrunk = shrunkSamples[k];
+        if (!shrunk.done) {
+          shrunk.nonEmpty = shrinkSample(sample, spriteBounds,
+                                         trimWithFirstPixel,
+                                         m_sampleBuf, shrunk.bounds,
+                                         render_threads_per_sample(1));
+          shrunk.done = true;
         }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
-
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
+
+        gfx::Rect frameBounds = shrunk.bounds;
+        if (!shrunk.nonEmpty) {
           // If shrink_bounds() returns false, it's because the whole
           // image is transparent (equal to the mask color).
 
@@ -1105,6 +1206,144 @@ void DocExporter::captureSamples(Samples& samples,
                "InTextureBounds:", sample.inTextureBounds());
     }
   }
+
+  // Packed sheets always merge duplicated samples
+  if (m_mergeDuplicates ||
+      m_sheetType == SpriteSheetType::Packed) {
+    findDuplicatedSamples(samples, token);
+  }
+}
+
+void DocExporter::findDuplicatedSamples(Samples& samples,
+                                        base::task_token& token)
+{
+  std::vector<Sample*> candidates;
+  for (auto& sample : samples) {
+    if (!sample.isEmpty())
+      candidates.push_back(&sample);
+  }
+
+  // Calculate the hash of each rendered sample in parallel. We
+  // change the visibility of layers only once for each group of
+  // consecutive samples with the same sprite/layers. Renders are kept
+  // (up to kMaxKeptRendersSize bytes) to compare samples with the
+  // same hash without rendering them again.
+  const int n = int(candidates.size());
+  std::vector<uint64_t> hashes(n);
+  std::vector<ImageRef> renders(n);
+  std::atomic<std::size_t> keptRendersSize(0);
+  for (int i=0; i<n; ) {
+    const Sample* first = candidates[i];
+    int j = i+1;
+    while (j < n &&
+           candidates[j]->sprite() == first->sprite() &&
+           candidates[j]->selectedLayers() == first->selectedLayers())
+      ++j;
+
+    RestoreVisibleLayers layersVisibility;
+    first->showSelectedLayers(layersVisibility);
+
+    for_each_sample_in_parallel(
+      j-i, token,
+      [&](const int k, doc::ImageBufferPtr& imageBuf) {
+        const Sample* sample = candidates[i+k];
+        const gfx::Rect& bounds = sample->trimmedBounds();
+        const std::size_t size =
+          std::size_t(bounds.w) * bounds.h *
+          bytes_per_pixel_for_colormode(sample->sprite()->colorMode());
+
+        // Kept renders need their own ImageBuffer
+        doc::ImageBufferPtr sampleBuf;
+        if ((keptRendersSize += size) <= kMaxKeptRendersSize)
+          sampleBuf = std::make_shared<doc::ImageBuffer>();
+        else
+          keptRendersSize -= size;
+
+        ImageRef sampleRender(
+          sample->createRenderWithCurrentVisibility(sampleBuf ? sampleBuf: imageBuf));
+        hashes[i+k] = calculate_image_hash(sampleRender.get(),
+                                           sampleRender->bounds());
+        if (sampleBuf)
+          renders[i+k] = sampleRender;
+      },
+      [](int){ });
+    if (token.canceled())
+      return;
+
+    i = j;
+  }
+
+  // Samples with a unique hash will not be compared
+  {
+    std::unordered_map<uint64_t, int> hashCount;
+    for (const uint64_t hash : hashes)
+      ++hashCount[hash];
+    for (int i=0; i<n; ++i)
+      if (hashCount[hashes[i]] == 1)
+        renders[i].reset();
+  }
+
+  // Samples are rendered again only when two hashes collide and we
+  // couldn't keep their renders from the previous step, and we keep
+  // the renders of the original samples to compare them with the
+  // next ones.
+  auto getRender = [&](const int i) -> const ImageRef& {
+    if (!renders[i]) {
+      // Each render has its own ImageBuffer as we keep them
+      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
+      renders[i] = candidates[i]->createRender(sampleBuf);
+    }
+    return renders[i];
+  };
+
+  // Merge duplicated samples in order, so the first sample with
+  // some specific content is the original one.
+  std::unordered_multimap<uint64_t, int> originals;
+  for (int i=0; i<n; ++i) {
+    if (token.canceled())
+      return;
+
+    int original = -1;
+    auto range = originals.equal_range(hashes[i]);
+    for (auto it=range.first; it!=range.second; ++it) {
+      if (is_same_image(getRender(i).get(),
+                        getRender(it->second).get())) {
+        original = it->second;
+        break;
+      }
+    }
+
+    if (original >= 0) {
+      Sample* sample = candidates[i];
+      sample->setDuplicated();
+      sample->setSharedBounds(candidates[original]->sharedBounds());
+      renders[i].reset();
+    }
+    else {
+      originals.insert(std::make_pair(hashes[i], i));
+    }
+  }
+}
+
+bool DocExporter::shrinkSample(const Sample& sample,
+                               const gfx::Rect& spriteBounds,
+                               const bool trimWithFirstPixel,
+                               doc::ImageBufferPtr& imageBuf,
+                               gfx::Rect& frameBounds,
+                               const int renderThreads) const
+{
+  ImageRef sampleRender(
+    sample.createRenderWithCurrentVisibility(imageBuf, renderThreads));
+
+  const doc::color_t refColor =
+    (trimWithFirstPixel ? get_pixel(sampleRender.get(), 0, 0):
+                          sample.sprite()->transparentColor());
+
+  return algorithm::shrink_bounds(sampleRender.get(),
+                                  refColor,
+                                  nullptr,       // layer
+                                  spriteBounds,  // startBounds
+                                  frameBounds);  // output bounds
 }
 
 void DocExporter::layoutSamples(Samples& samples,
@@ -1125,8 +1364,7 @@ void DocExporter::layoutSamples(Samples& samples,
       SimpleLayoutSamples layout(
         m_sheetType,
         m_textureColumns, m_textureRows,
-        m_splitLayers, m_splitTags,
-        m_mergeDuplicates);
+        m_splitLayers, m_splitTags);
       layout.layoutSamples(
         samples, m_borderPadding, m_shapePadding,
         width, height, token);
@@ -1273,18 +1511,19 @@ void DocExporter::renderTexture(Context* ctx,
 {
   textureImage->clear(textureImage->maskColor());
 
-  int i = 0;
+  // Samples that must be rendered in the texture (their positions in
+  // the texture don't overlap)
+  std::vector<const Sample*> toRender;
+  toRender.reserve(samples.size());
+
   for (const auto& sample : samples) {
     if (token.canceled())
       return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
 
     if (sample.isLinked() ||
         sample.isDuplicated() ||
-        sample.isEmpty()) {
-      ++i;
+        sample.isEmpty())
       continue;
-    }
 
     // Make the sprite compatible with the texture so the render()
     // works correctly.
@@ -1304,12 +1543,43 @@ void DocExporter::renderTexture(Context* ctx,
         .execute(ctx);
     }
 
-    sample.renderSample(
-      textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
-      m_extrude);
-    ++i;
+    toRender.push_back(&sample);
+  }
+
+  // Render consecutive samples with the same sprite/layers in
+  // parallel (we cannot render samples with different visible layers
+  // of the same sprite at the same time).
+  const int n = int(toRender.size());
+  for (int i=0; i<n; ) {
+    const Sample* first = toRender[i];
+    int j = i+1;
+    while (j < n &&
+           toRender[j]->sprite() == first->sprite() &&
+           toRender[j]->selectedLayers() == first->selectedLayers())
+      ++j;
+
+    RestoreVisibleLayers layersVisibility;
+    first->showSelectedLayers(layersVisibility);
+
+    const int renderThreads = render_threads_per_sample(j-i);
+    for_each_sample_in_parallel(
+      j-i, token,
+      [&](const int k, doc::ImageBufferPtr&) {
+        const Sample* sample = toRender[i+k];
+        sample->renderSample(
+          textureImage,
+          sample->inTextureBounds().x+m_innerPadding,
+          sample->inTextureBounds().y+m_innerPadding,
+          m_extrude,
+          renderThreads);
+      },
+      [&](const int done) {
+        token.set_progress(0.6f + 0.2f * (i+done) / n);
+      });
+    if (token.canceled())
+      return;
+
+    i = j;
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -115,6 +115,14 @@ namespace app {
       const bool splitGrid);
     void captureSamples(Samples& samples,
                         base::task_token& token);
+    void findDuplicatedSamples(Samples& samples,
+                               base::task_token& token);
+    bool shrinkSample(const Sample& sample,
+                      const gfx::Rect& spriteBounds,
+                      const bool trimWithFirstPixel,
+                      doc::ImageBufferPtr& imageBuf,
+                      gfx::Rect& frameBounds,
+                      const int renderThreads = 1) const;
     void layoutSamples(Samples& samples,
                        base::task_token& token);
     gfx::Size calculateSheetSize(const Samples& samples,
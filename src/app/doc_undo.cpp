@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,12 +18,15 @@
 #include "app/context.h"
 #include "app/doc_undo_observer.h"
 #include "app/pref/preferences.h"
+#include "app/util/undo_buffer.h"
 #include "base/mem_utils.h"
 #include "base/scoped_value.h"
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
 #include <stdexcept>
 
 #define UNDO_TRACE(...)
@@ -61,8 +64,9 @@ void DocUndo::add(CmdTransaction* cmd)
     clearRedo();
   }
 
+  const undo::UndoState* oldState = currentState();
   m_undoHistory.add(cmd);
-  m_totalUndoSize += cmd->memSize();
+  updateUndoMemory(currentState() && currentState()->prev() == oldState);
 
   notify_observers(&DocUndoObserver::onAddUndoState, this);
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
@@ -107,14 +111,10 @@ void DocUndo::undo()
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
-  {
-    const undo::UndoState* state = nextUndo();
-    ASSERT(state);
-    const Cmd* cmd = STATE_CMD(state);
-    m_totalUndoSize -= cmd->memSize();
-    m_undoHistory.undo();
-    m_totalUndoSize += cmd->memSize();
-  }
+  ASSERT(nextUndo());
+  m_undoHistory.undo();
+  updateUndoMemory(true);
+
   // This notification could execute a script that modifies the sprite
   // again (e.g. a script that is listening the "change" event, check
   // the SpriteEvents class). If the sprite is modified, the "cmd" is
@@ -129,14 +129,10 @@ void DocUndo::redo()
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
-  {
-    const undo::UndoState* state = nextRedo();
-    ASSERT(state);
-    const Cmd* cmd = STATE_CMD(state);
-    m_totalUndoSize -= cmd->memSize();
-    m_undoHistory.redo();
-    m_totalUndoSize += cmd->memSize();
-  }
+  ASSERT(nextRedo());
+  m_undoHistory.redo();
+  updateUndoMemory(true);
+
   notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
@@ -290,16 +286,92 @@ void DocUndo::moveToState(const undo::UndoState* state)
 
   // Recalculate the total undo size
   size_t oldSize = m_totalUndoSize;
-  m_totalUndoSize = 0;
-  const undo::UndoState* s = m_undoHistory.firstState();
-  while (s) {
-    m_totalUndoSize += STATE_CMD(s)->memSize();
-    s = s->next();
-  }
+  updateUndoMemory(false);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 }
 
+void DocUndo::updateUndoMemory(const bool onlyNearStates)
+{
+  int compressAfter = 0;
+  int moveToDiskAfter = 0;
+  if (App::instance()) {
+    compressAfter = App::instance()->preferences().undo.compressAfter();
+    moveToDiskAfter = App::instance()->preferences().undo.moveToDiskAfter();
+  }
+
+  // Sizes of states packed in previous calls
+  if (!m_packingStates.empty()) {
+    const bool finished = !UndoBuffer::hasPendingTasks();
+    for (const undo::UndoState* s : m_packingStates)
+      updateStateSize(s);
+    if (finished)
+      m_packingStates.clear();
+  }
+
+  auto packState = [this, compressAfter, moveToDiskAfter,
+                    onlyNearStates](const undo::UndoState* s,
+                                    const int distance) {
+    UndoBuffer::State state = UndoBuffer::State::Raw;
+    if (moveToDiskAfter > 0 &&
+        (onlyNearStates ? distance == moveToDiskAfter:
+                          distance >= moveToDiskAfter))
+      state = UndoBuffer::State::OnDisk;
+    else if (compressAfter > 0 &&
+             (onlyNearStates ? distance == compressAfter:
+                               (distance >= compressAfter &&
+                                (moveToDiskAfter <= 0 ||
+                                 distance < moveToDiskAfter))))
+      state = UndoBuffer::State::Compressed;
+
+    if (state != UndoBuffer::State::Raw) {
+      STATE_CMD(s)->packMemory(state);
+      if (std::find(m_packingStates.begin(), m_packingStates.end(), s)
+          == m_packingStates.end())
+        m_packingStates.push_back(s);
+    }
+  };
+
+  // Distance from the current state in both directions (the current
+  // state is 0, and if there is no current state the first state is
+  // 1). When the current state moves just one step, only the states
+  // at the compress/move to disk distances must be packed now.
+  const int maxDistance =
+    (onlyNearStates ? std::max(compressAfter, moveToDiskAfter):
+                      std::numeric_limits<int>::max());
+  const undo::UndoState* current = currentState();
+  int distance = 0;
+  for (auto s=current; s && distance<=maxDistance; s=s->prev(), ++distance)
+    packState(s, distance);
+
+  distance = 1;
+  for (auto s=(current ? current->next(): firstState());
+       s && distance<=maxDistance; s=s->next(), ++distance) {
+    packState(s, distance);
+  }
+
+  if (onlyNearStates) {
+    // New state, or the state that was undone/redone (it was
+    // unpacked)
+    if (current)
+      updateStateSize(current);
+    if (auto next = nextRedo())
+      updateStateSize(next);
+  }
+  else {
+    for (auto s=firstState(); s; s=s->next())
+      updateStateSize(s);
+  }
+}
+
+void DocUndo::updateStateSize(const undo::UndoState* state)
+{
+  const size_t size = STATE_CMD(state)->memSize();
+  size_t& knownSize = m_stateSizes[state];
+  m_totalUndoSize = m_totalUndoSize - knownSize + size;
+  knownSize = size;
+}
+
 const undo::UndoState* DocUndo::nextUndo() const
 {
   return m_undoHistory.currentState();
@@ -324,7 +396,15 @@ void DocUndo::onDeleteUndoState(undo::UndoState* state)
              base::get_pretty_memory_size(cmd->memSize()).c_str(),
              base::get_pretty_memory_size(m_totalUndoSize).c_str());
 
-  m_totalUndoSize -= cmd->memSize();
+  auto it = m_stateSizes.find(state);
+  if (it != m_stateSizes.end()) {
+    m_totalUndoSize -= it->second;
+    m_stateSizes.erase(it);
+  }
+  m_packingStates.erase(
+    std::remove(m_packingStates.begin(), m_packingStates.end(), state),
+    m_packingStates.end());
+
   notify_observers(&DocUndoObserver::onDeleteUndoState, this, state);
 
   // Mark this document as impossible to match the version on disk
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,8 @@
 
 #include <iosfwd>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace app {
   using namespace doc;
@@ -101,6 +103,16 @@ namespace app {
     void moveToState(const undo::UndoState* state);
 
   private:
+    // Packs the undo information of states that are far from the
+    // current one (see Cmd::packMemory()), and updates
+    // m_totalUndoSize. If onlyNearStates is true, the current state
+    // was moved just one step (add/undo/redo), so only the states
+    // that crossed the compress/move to disk distances are packed.
+    void updateUndoMemory(const bool onlyNearStates);
+
+    // Updates the known size of the given state in m_totalUndoSize.
+    void updateStateSize(const undo::UndoState* state);
+
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
 
@@ -112,6 +124,12 @@ namespace app {
     Context* m_ctx = nullptr;
     size_t m_totalUndoSize = 0;
 
+    // Known size of each state (the sum is m_totalUndoSize), and
+    // states that were packed in background tasks (their size can
+    // change until all tasks are finished).
+    std::unordered_map<const undo::UndoState*, size_t> m_stateSizes;
+    std::vector<const undo::UndoState*> m_packingStates;
+
     // True when we are undoing/redoing. Used to avoid adding new undo
     // information when we are moving through the undo history.
     bool m_undoing = false;
@@ -11,9 +11,11 @@
 
 #include "app/context.h"
 #include "app/doc.h"
+#include "app/file/compressed_images_cache.h"
 #include "app/file/file.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "app/util/parallel_for.h"
 #include "base/cfile.h"
 #include "base/exception.h"
 #include "base/file_handle.h"
@@ -24,15 +26,22 @@
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
 #include "doc/doc.h"
+#include "doc/image_hash.h"
 #include "fixmath/fixmath.h"
 #include "fmt/format.h"
 #include "ui/alert.h"
 #include "ver/info.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
 
@@ -88,6 +97,10 @@ public:
     return m_fop->config().cacheCompressedTilesets;
   }
 
+  bool loadCelsLazily() const override {
+    return m_fop->config().loadCelsLazily;
+  }
+
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
@@ -99,6 +112,9 @@ public:
   virtual gfx::Size getImageSize() const = 0;
   virtual int getScanlineSize() const = 0;
   virtual const uint8_t* getScanlineAddress(int y) const = 0;
+  // Hash of the pixels to compare them with the cached compressed
+  // data (the data is cached from the previous save).
+  virtual uint64_t hash() const = 0;
 };
 
 class ImageScanlines : public ScanlinesGen {
@@ -115,6 +131,9 @@ public:
   const uint8_t* getScanlineAddress(int y) const override {
     return m_image->getPixelAddress(0, y);
   }
+  uint64_t hash() const override {
+    return calculate_image_hash(m_image, m_image->bounds());
+  }
 };
 
 class TilesetScanlines : public ScanlinesGen {
@@ -140,10 +159,74 @@ public:
     else
       return nullptr;
   }
+  uint64_t hash() const override {
+    uint64_t value = ImageHash::initialValue(getImageSize());
+    for (tile_index ti=0; ti<m_tileset->size(); ++ti) {
+      ImageRef image = m_tileset->get(ti);
+      value = ImageHash::combine(
+        value, (image ? calculate_image_hash(image.get(), image->bounds()): 0));
+    }
+    return value;
+  }
+};
+
+// Images (cels and tilesets) that are compressed in parallel before
+// writing the file. The compressed data is kept in memory, and then
+// written in order in each chunk. Images with the same pixels (same
+// hash) as in the last save are taken from the document cache.
+class CompressedImages {
+public:
+  CompressedImages(const int level,
+                   CompressedImagesCache* cache,
+                   const std::size_t cacheSize)
+    : m_level(level)
+    , m_cache(cache) {
+    if (m_cache)
+      m_cache->startSave(cacheSize);
+  }
+
+  int level() const { return m_level; }
+
+  // Adds an image to be compressed (only once for each ID, e.g. for
+  // linked cels).
+  void add(const ObjectId id,
+           std::unique_ptr<ScanlinesGen>&& gen,
+           const PixelFormat pixelFormat);
+
+  // Returns the compressed data of the given image, or nullptr if it
+  // wasn't compressed.
+  const base::buffer* get(const ObjectId id) const;
+
+  // Compresses all images that are not in the cache using one
+  // thread for each CPU core (the hash of each image is calculated
+  // in the same threads to look for it in the cache).
+  void compress(FileOp* fop,
+                const double fromProgress,
+                const double toProgress);
+
+  // Saves the compressed data of all images in the document cache
+  // (and removes the old images from it).
+  void updateCache();
+
+private:
+  struct Item {
+    ObjectId id;
+    uint64_t hash;
+    std::unique_ptr<ScanlinesGen> gen;
+    PixelFormat pixelFormat;
+    CompressedDataPtr data;
+  };
+  int m_level;
+  CompressedImagesCache* m_cache;
+  std::vector<Item> m_items;
+  std::unordered_map<ObjectId, size_t> m_index;
 };
 
 } // anonymous namespace
 
+static void ase_file_add_compressed_images(FileOp* fop,
+                                           const Sprite* sprite,
+                                           CompressedImages& compressedImages);
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
                                     const frame_t firstFrame, const frame_t totalFrames);
 static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header);
@@ -159,6 +242,7 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f,  FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   const CompressedImages& compressedImages,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame);
@@ -173,6 +257,7 @@ static void ase_file_write_color2_chunk(FILE* f, dio::AsepriteFrameHeader* frame
 static void ase_file_write_palette_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Palette* pal, int from, int to);
 static void ase_file_write_layer_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Layer* layer, int child_level);
 static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                     const CompressedImages& compressedImages,
                                      const Cel* cel,
                                      const LayerImage* layer,
                                      const layer_t layer_index,
@@ -206,10 +291,12 @@ static void ase_file_write_external_files_chunk(FILE* f, FileOp* fop,
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          const CompressedImages& compressedImages,
                                           const Tilesets* tilesets);
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
+                                         const CompressedImages& compressedImages,
                                          const Tileset* tileset,
                                          const tileset_index si);
 static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
@@ -281,7 +368,7 @@ FileFormat* CreateAseFormat()
 bool AseFormat::onLoad(FileOp* fop)
 {
   FileHandle handle(open_file_with_exception(fop->filename(), "rb"));
-  dio::StdioFileInterface fileInterface(handle.get());
+  dio::BufferedFileInterface fileInterface(handle.get());
 
   DecodeDelegate delegate(fop);
   dio::AsepriteDecoder decoder;
@@ -368,10 +455,31 @@ bool AseFormat::onSave(FileOp* fop)
     }
   }
 
+  // Compress all cels and tilesets in parallel (this is the slowest
+  // part of the save process), so then we just write the compressed
+  // data in order. The document keeps a cache of compressed images,
+  // so we only compress the images that were modified since the
+  // last save.
+  CompressedImagesCache* cache = nullptr;
+  const std::size_t cacheSize =
+    std::size_t(fop->config().compressedImagesCacheSize) * 1024 * 1024;
+  if (cacheSize > 0)
+    cache = &fop->document()->compressedImagesCache();
+  else
+    fop->document()->compressedImagesCache().clear();
+
+  CompressedImages compressedImages(fop->config().compressionLevel,
+                                    cache, cacheSize);
+  ase_file_add_compressed_images(fop, sprite, compressedImages);
+  compressedImages.compress(fop, 0.0, 0.9);
+
   // Write frames
   int outputFrame = 0;
   dio::AsepriteExternalFiles ext_files;
   for (frame_t frame : fop->roi().framesSequence()) {
+    if (fop->isStop())
+      break;
+
     // Prepare the frame header
     dio::AsepriteFrameHeader frame_header;
     ase_file_prepare_frame_header(f, &frame_header);
@@ -416,7 +524,7 @@ bool AseFormat::onSave(FileOp* fop)
 
       // Write tilesets
       ase_file_write_tileset_chunks(f, fop, &frame_header, ext_files,
-                                    sprite->tilesets());
+                                    compressedImages, sprite->tilesets());
 
       // Writer frame tags
       if (sprite->tags().size() > 0) {
@@ -446,19 +554,15 @@ bool AseFormat::onSave(FileOp* fop)
 
     // Write cel chunks
     ase_file_write_cels(f, fop, &frame_header, ext_files,
-                        sprite, sprite->root(),
+                        compressedImages, sprite, sprite->root(),
                         0, frame);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
 
     // Progress
-    if (fop->roi().frames() > 1)
-      fop->setProgress(float(outputFrame+1) / float(fop->roi().frames()));
+    fop->setProgress(0.9f + 0.1f * float(outputFrame+1) / float(fop->roi().frames()));
     ++outputFrame;
-
-    if (fop->isStop())
-      break;
   }
 
   // Write the missing field (filesize) of the header.
@@ -469,12 +573,51 @@ bool AseFormat::onSave(FileOp* fop)
     return false;
   }
   else {
+    if (!fop->isStop())
+      compressedImages.updateCache();
     return true;
   }
 }
 
 #endif  // ENABLE_SAVE
 
+static void ase_file_add_compressed_images(FileOp* fop,
+                                           const Sprite* sprite,
+                                           CompressedImages& compressedImages)
+{
+  // Embedded tilesets without cached compressed data
+  for (const Tileset* tileset : *sprite->tilesets()) {
+    if (tileset &&
+        tileset->externalFilename().empty() &&
+        (tileset->compressedData().empty() ||
+         tileset->compressedDataVersion() != tileset->version())) {
+      compressedImages.add(tileset->id(),
+                           std::make_unique<TilesetScanlines>(tileset),
+                           tileset->sprite()->pixelFormat());
+    }
+  }
+
+  // Cels in the same order they are written in the file. Linked cels
+  // are compressed only once (as they share the same image ID).
+  const LayerList layers = sprite->allLayers();
+  for (frame_t frame : fop->roi().framesSequence()) {
+    for (const Layer* layer : layers) {
+      if (!layer->isImage())
+        continue;
+
+      const Cel* cel = layer->cel(frame);
+      if (!cel || !cel->image())
+        continue;
+
+      const Image* image = cel->image();
+      compressedImages.add(image->id(),
+                           std::make_unique<ImageScanlines>(image),
+                           (layer->isTilemap() ? IMAGE_TILEMAP:
+                                                 image->pixelFormat()));
+    }
+  }
+}
+
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
                                     const frame_t firstFrame, const frame_t totalFrames)
 {
@@ -593,6 +736,7 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   const CompressedImages& compressedImages,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame)
@@ -600,7 +744,7 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isImage()) {
     const Cel* cel = layer->cel(frame);
     if (cel) {
-      ase_file_write_cel_chunk(f, frame_header, cel,
+      ase_file_write_cel_chunk(f, frame_header, compressedImages, cel,
                                static_cast<const LayerImage*>(layer),
                                layer_index, sprite, fop->roi().fromFrame());
 
@@ -621,7 +765,8 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isGroup()) {
     for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
       layer_index =
-        ase_file_write_cels(f, fop, frame_header, ext_files, sprite, child,
+        ase_file_write_cels(f, fop, frame_header, ext_files,
+                            compressedImages, sprite, child,
                             layer_index, frame);
     }
   }
@@ -874,9 +1019,9 @@ static void write_raw_image(FILE* f, ScanlinesGen* gen, PixelFormat pixelFormat)
 //////////////////////////////////////////////////////////////////////
 
 template<typename ImageTraits>
-static void write_compressed_image_templ(FILE* f,
-                                         ScanlinesGen* gen,
-                                         base::buffer* compressedOutput)
+static void compress_image_templ(const ScanlinesGen* gen,
+                                 const int compressionLevel,
+                                 base::buffer& output)
 {
   PixelIO<ImageTraits> pixel_io;
   z_stream zstream;
@@ -885,14 +1030,18 @@ static void write_compressed_image_templ(FILE* f,
   zstream.zalloc = (alloc_func)0;
   zstream.zfree  = (free_func)0;
   zstream.opaque = (voidpf)0;
-  err = deflateInit(&zstream, Z_DEFAULT_COMPRESSION);
+  err = deflateInit(&zstream, compressionLevel);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateInit().", err);
 
   std::vector<uint8_t> scanline(gen->getScanlineSize());
-  std::vector<uint8_t> compressed(4096);
 
+  // Reserve the maximum size of the compressed data, so in general
+  // we don't need to resize the output buffer.
   const gfx::Size imgSize = gen->getImageSize();
+  output.resize(deflateBound(&zstream, uLong(scanline.size()) * imgSize.h));
+  std::size_t outputBytes = 0;
+
   for (y=0; y<imgSize.h; ++y) {
     typename ImageTraits::address_t address =
       (typename ImageTraits::address_t)gen->getScanlineAddress(y);
@@ -904,68 +1053,178 @@ static void write_compressed_image_templ(FILE* f,
     int flush = (y == imgSize.h-1 ? Z_FINISH: Z_NO_FLUSH);
 
     do {
-      zstream.next_out = (Bytef*)&compressed[0];
-      zstream.avail_out = compressed.size();
+      if (outputBytes == output.size())
+        output.resize(2*output.size() + 4096);
+
+      zstream.next_out = (Bytef*)&output[outputBytes];
+      zstream.avail_out = output.size() - outputBytes;
 
       // Compress
       err = deflate(&zstream, flush);
       if (err != Z_OK && err != Z_STREAM_END && err != Z_BUF_ERROR)
         throw base::Exception("ZLib error %d in deflate().", err);
 
-      int output_bytes = compressed.size() - zstream.avail_out;
-      if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
-          throw base::Exception("Error writing compressed image pixels.\n");
-
-        // Save the whole compressed buffer to re-use in following
-        // save options (so we don't have to re-compress the whole
-        // tileset)
-        if (compressedOutput) {
-          std::size_t n = compressedOutput->size();
-          compressedOutput->resize(n + output_bytes);
-          std::copy(compressed.begin(),
-                    compressed.begin() + output_bytes,
-                    compressedOutput->begin() + n);
-        }
-      }
+      outputBytes = output.size() - zstream.avail_out;
     } while (zstream.avail_out == 0);
   }
 
+  // Release the unused capacity reserved with deflateBound() (the
+  // compressed data can be kept in memory for a long time, e.g. in
+  // the CompressedImagesCache).
+  output.resize(outputBytes);
+  output.shrink_to_fit();
+
   err = deflateEnd(&zstream);
   if (err != Z_OK)
     throw base::Exception("ZLib error %d in deflateEnd().", err);
 }
 
-static void write_compressed_image(FILE* f,
-                                   ScanlinesGen* gen,
-                                   PixelFormat pixelFormat,
-                                   base::buffer* compressedOutput = nullptr)
+static void compress_image(const ScanlinesGen* gen,
+                           const PixelFormat pixelFormat,
+                           const int compressionLevel,
+                           base::buffer& output)
 {
   switch (pixelFormat) {
     case IMAGE_RGB:
-      write_compressed_image_templ<RgbTraits>(f, gen, compressedOutput);
+      compress_image_templ<RgbTraits>(gen, compressionLevel, output);
       break;
 
     case IMAGE_GRAYSCALE:
-      write_compressed_image_templ<GrayscaleTraits>(f, gen, compressedOutput);
+      compress_image_templ<GrayscaleTraits>(gen, compressionLevel, output);
       break;
 
     case IMAGE_INDEXED:
-      write_compressed_image_templ<IndexedTraits>(f, gen, compressedOutput);
+      compress_image_templ<IndexedTraits>(gen, compressionLevel, output);
       break;
 
     case IMAGE_TILEMAP:
-      write_compressed_image_templ<TilemapTraits>(f, gen, compressedOutput);
+      compress_image_templ<TilemapTraits>(gen, compressionLevel, output);
       break;
   }
 }
 
+static void write_compressed_data(FILE* f, const base::buffer& data)
+{
+  if (data.empty())
+    return;
+
+  if ((fwrite(&data[0], 1, data.size(), f) != data.size())
+      || ferror(f))
+    throw base::Exception("Error writing compressed image pixels.\n");
+}
+
+// Writes the compressed data of the given image that was compressed
+// previously with CompressedImages::compress(), or compresses it now
+// if it's not available.
+static void write_compressed_image(FILE* f,
+                                   const CompressedImages& compressedImages,
+                                   const ObjectId id,
+                                   const ScanlinesGen* gen,
+                                   const PixelFormat pixelFormat,
+                                   base::buffer* compressedOutput = nullptr)
+{
+  const base::buffer* data = compressedImages.get(id);
+  base::buffer tmp;
+  if (!data) {
+    compress_image(gen, pixelFormat, compressedImages.level(), tmp);
+    data = &tmp;
+  }
+
+  write_compressed_data(f, *data);
+
+  // Save the whole compressed buffer to re-use in following save
+  // operations (so we don't have to re-compress the whole tileset)
+  if (compressedOutput)
+    *compressedOutput = *data;
+}
+
+void CompressedImages::add(const ObjectId id,
+                           std::unique_ptr<ScanlinesGen>&& gen,
+                           const PixelFormat pixelFormat)
+{
+  if (m_index.find(id) != m_index.end())
+    return;
+
+  m_index[id] = m_items.size();
+  m_items.push_back(Item{ id, 0, std::move(gen), pixelFormat, nullptr });
+}
+
+const base::buffer* CompressedImages::get(const ObjectId id) const
+{
+  auto it = m_index.find(id);
+  if (it != m_index.end())
+    return m_items[it->second].data.get();
+  else
+    return nullptr;
+}
+
+void CompressedImages::compress(FileOp* fop,
+                                const double fromProgress,
+                                const double toProgress)
+{
+  const int n = int(m_items.size());
+  std::atomic<int> done(0);
+  std::mutex errorMutex;
+  std::string errorMsg;
+
+  // Each thread compresses the next image in the list, the results
+  // are saved in the same Item, so then they are written in order.
+  //
+  // We compare the pixels (the hash) and not the image version to
+  // use the cached data, as some functions could modify the pixels
+  // without incrementing the version (e.g. a color profile
+  // conversion), and saving the old pixels would be data loss.
+  parallel_for(
+    n,
+    [&](const int i, const int thread) {
+      if (fop->isStop())
+        return;
+
+      Item* item = &m_items[i];
+      try {
+        if (m_cache) {
+          item->hash = item->gen->hash();
+          item->data = m_cache->get(item->id, item->hash, m_level);
+        }
+        if (!item->data) {
+          auto data = std::make_shared<base::buffer>();
+          compress_image(item->gen.get(), item->pixelFormat, m_level, *data);
+          item->data = data;
+        }
+      }
+      catch (const std::exception& ex) {
+        std::lock_guard lock(errorMutex);
+        if (errorMsg.empty())
+          errorMsg = ex.what();
+      }
+      ++done;
+
+      if (thread == 0)
+        fop->setProgress(fromProgress + (toProgress - fromProgress) * done / n);
+    });
+
+  if (!errorMsg.empty())
+    throw base::Exception(errorMsg);
+}
+
+void CompressedImages::updateCache()
+{
+  if (!m_cache)
+    return;
+
+  for (const Item& item : m_items) {
+    if (item.data)
+      m_cache->set(item.id, item.hash, m_level, item.data);
+  }
+  m_cache->endSave();
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
 static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                     const CompressedImages& compressedImages,
                                      const Cel* cel,
                                      const LayerImage* layer,
                                      const layer_t layer_index,
@@ -1037,7 +1296,8 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
         fputw(image->height(), f);
 
         ImageScanlines scan(image);
-        write_compressed_image(f, &scan, image->pixelFormat());
+        write_compressed_image(f, compressedImages, image->id(),
+                               &scan, image->pixelFormat());
       }
       else {
         // Width and height
@@ -1062,7 +1322,8 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       ase_file_write_padding(f, 10);
 
       ImageScanlines scan(image);
-      write_compressed_image(f, &scan, IMAGE_TILEMAP);
+      write_compressed_image(f, compressedImages, image->id(),
+                             &scan, IMAGE_TILEMAP);
     }
   }
 }
@@ -1413,13 +1674,14 @@ static void ase_file_write_external_files_chunk(
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          const CompressedImages& compressedImages,
                                           const Tilesets* tilesets)
 {
   tileset_index si = 0;
   for (const Tileset* tileset : *tilesets) {
     if (tileset) {
       ase_file_write_tileset_chunk(f, fop, frame_header, ext_files,
-                                   tileset, si);
+                                   compressedImages, tileset, si);
 
       ase_file_write_user_data_chunk(f, fop, frame_header, ext_files, &tileset->userData());
 
@@ -1436,6 +1698,7 @@ static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
                                          const dio::AsepriteExternalFiles& ext_files,
+                                         const CompressedImages& compressedImages,
                                          const Tileset* tileset,
                                          const tileset_index si)
 {
@@ -1508,7 +1771,8 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
       if (fop->config().cacheCompressedTilesets)
         compressedDataPtr = &compressedData;
 
-      write_compressed_image(f, &gen, tileset->sprite()->pixelFormat(),
+      write_compressed_image(f, compressedImages, tileset->id(),
+                             &gen, tileset->sprite()->pixelFormat(),
                              compressedDataPtr);
 
       // As we've just compressed the tileset, we can cache this same
@@ -0,0 +1,119 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/compressed_images_cache.h"
+
+namespace app {
+
+std::atomic<std::size_t> CompressedImagesCache::s_totalSize(0);
+
+CompressedImagesCache::~CompressedImagesCache()
+{
+  s_totalSize -= m_size;
+}
+
+CompressedDataPtr CompressedImagesCache::get(const doc::ObjectId id,
+                                             const uint64_t hash,
+                                             const int compressionLevel) const
+{
+  const std::lock_guard lock(m_mutex);
+  auto it = m_entries.find(id);
+  if (it != m_entries.end() &&
+      it->second.hash == hash &&
+      it->second.compressionLevel == compressionLevel) {
+    return it->second.data;
+  }
+  return nullptr;
+}
+
+void CompressedImagesCache::startSave(const std::size_t maxSize)
+{
+  const std::lock_guard lock(m_mutex);
+  m_maxSize = maxSize;
+  for (auto& it : m_entries)
+    it.second.used = false;
+}
+
+void CompressedImagesCache::set(const doc::ObjectId id,
+                                const uint64_t hash,
+                                const int compressionLevel,
+                                const CompressedDataPtr& data)
+{
+  // Keep a copy without the unused capacity of the compression
+  // buffer (it can be as big as the uncompressed image).
+  CompressedDataPtr exactData = data;
+  if (data->capacity() > data->size())
+    exactData = std::make_shared<const base::buffer>(data->begin(), data->end());
+  const std::size_t dataSize = exactData->size();
+
+  const std::lock_guard lock(m_mutex);
+
+  // Remove the old data of this object
+  auto it = m_entries.find(id);
+  if (it != m_entries.end())
+    removeEntry(it);
+
+  // Make room removing objects that weren't used in this save yet
+  for (it=m_entries.begin(); it!=m_entries.end() &&
+         s_totalSize + dataSize > m_maxSize; ) {
+    if (!it->second.used)
+      it = removeEntry(it);
+    else
+      ++it;
+  }
+
+  // The cache is full
+  if (s_totalSize + dataSize > m_maxSize)
+    return;
+
+  Entry& entry = m_entries[id];
+  entry.hash = hash;
+  entry.compressionLevel = compressionLevel;
+  entry.data = exactData;
+  entry.used = true;
+  m_size += dataSize;
+  s_totalSize += dataSize;
+}
+
+void CompressedImagesCache::endSave()
+{
+  const std::lock_guard lock(m_mutex);
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    if (!it->second.used)
+      it = removeEntry(it);
+    else
+      ++it;
+  }
+}
+
+void CompressedImagesCache::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  s_totalSize -= m_size;
+  m_size = 0;
+}
+
+std::size_t CompressedImagesCache::size() const
+{
+  const std::lock_guard lock(m_mutex);
+  return m_size;
+}
+
+CompressedImagesCache::Entries::iterator
+CompressedImagesCache::removeEntry(Entries::iterator it)
+{
+  const std::size_t dataSize = it->second.data->size();
+  m_size -= dataSize;
+  s_totalSize -= dataSize;
+  return m_entries.erase(it);
+}
+
+} // namespace app
@@ -0,0 +1,88 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_COMPRESSED_IMAGES_CACHE_H_INCLUDED
+#define APP_FILE_COMPRESSED_IMAGES_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace app {
+
+  typedef std::shared_ptr<const base::buffer> CompressedDataPtr;
+
+  // Compressed pixels of the cels and tilesets of a document from
+  // the last time it was saved as a .aseprite file. Objects that
+  // didn't change (same ID and hash of the pixels) don't need to be
+  // compressed again in the next save.
+  //
+  // The memory used by the caches of all documents is limited by the
+  // maximum size given in startSave(), images that don't fit are not
+  // cached (they are compressed again in the next save).
+  class CompressedImagesCache {
+  public:
+    CompressedImagesCache() { }
+    ~CompressedImagesCache();
+
+    // Returns the compressed data of the given object if it was
+    // compressed with the same pixels (hash) and compression level,
+    // or nullptr if it's not in the cache.
+    CompressedDataPtr get(const doc::ObjectId id,
+                          const uint64_t hash,
+                          const int compressionLevel) const;
+
+    // Starts/ends a new save operation. All objects that weren't
+    // used with set() between these calls are removed from the cache
+    // in endSave() (e.g. deleted cels). The data of new objects is
+    // cached only if the total size of all caches doesn't exceed
+    // maxSize bytes.
+    void startSave(const std::size_t maxSize);
+    void set(const doc::ObjectId id,
+             const uint64_t hash,
+             const int compressionLevel,
+             const CompressedDataPtr& data);
+    void endSave();
+
+    void clear();
+
+    // Bytes used by this cache, and by the caches of all documents.
+    std::size_t size() const;
+    static std::size_t totalSize() { return s_totalSize; }
+
+  private:
+    struct Entry {
+      uint64_t hash = 0;
+      int compressionLevel = 0;
+      CompressedDataPtr data;
+      bool used = false;
+    };
+
+    using Entries = std::unordered_map<doc::ObjectId, Entry>;
+
+    Entries::iterator removeEntry(Entries::iterator it);
+
+    mutable std::mutex m_mutex;
+    Entries m_entries;
+    std::size_t m_size = 0;
+    std::size_t m_maxSize = 0;
+
+    static std::atomic<std::size_t> s_totalSize;
+
+    DISABLE_COPYING(CompressedImagesCache);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/file/compressed_images_cache.h"
+
+using namespace app;
+
+static CompressedDataPtr make_data(const std::size_t size,
+                                   const std::size_t capacity)
+{
+  auto data = std::make_shared<base::buffer>();
+  data->reserve(capacity);
+  data->resize(size, 1);
+  return data;
+}
+
+TEST(CompressedImagesCache, ExactSize)
+{
+  CompressedImagesCache cache;
+  cache.startSave(1024);
+  cache.set(1, 1, 6, make_data(10, 500));
+  cache.endSave();
+
+  auto data = cache.get(1, 1, 6);
+  ASSERT_TRUE(data != nullptr);
+  EXPECT_EQ(std::size_t(10), data->size());
+  EXPECT_EQ(std::size_t(10), data->capacity());
+  EXPECT_EQ(std::size_t(10), cache.size());
+}
+
+TEST(CompressedImagesCache, MaxSize)
+{
+  const std::size_t totalSize = CompressedImagesCache::totalSize();
+  {
+    CompressedImagesCache cache;
+    cache.startSave(totalSize + 100);
+    cache.set(1, 1, 6, make_data(40, 40));
+    cache.set(2, 1, 6, make_data(40, 40));
+    cache.set(3, 1, 6, make_data(40, 40));  // Doesn't fit
+    cache.endSave();
+    EXPECT_TRUE(cache.get(1, 1, 6) != nullptr);
+    EXPECT_TRUE(cache.get(2, 1, 6) != nullptr);
+    EXPECT_TRUE(cache.get(3, 1, 6) == nullptr);
+    EXPECT_EQ(std::size_t(80), cache.size());
+    EXPECT_EQ(totalSize + 80, CompressedImagesCache::totalSize());
+
+    // Objects not used in the new save are removed to make room
+    cache.startSave(totalSize + 100);
+    cache.set(2, 2, 6, make_data(40, 40));
+    cache.set(3, 1, 6, make_data(40, 40));
+    cache.endSave();
+    EXPECT_TRUE(cache.get(1, 1, 6) == nullptr);
+    EXPECT_TRUE(cache.get(2, 1, 6) == nullptr);
+    EXPECT_TRUE(cache.get(2, 2, 6) != nullptr);
+    EXPECT_TRUE(cache.get(3, 1, 6) != nullptr);
+    EXPECT_EQ(std::size_t(80), cache.size());
+  }
+  EXPECT_EQ(totalSize, CompressedImagesCache::totalSize());
+}
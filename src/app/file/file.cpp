@@ -153,31 +153,34 @@ public:
                    doc::Image* dst) const override {
     const bool needResize = this->needResize();
 
-    if (needResize &&
-        (!m_tmpUnscaledRender ||
-         m_tmpUnscaledRender->size() != frameBounds.size())) {
+    // The temporary unscaled image is local so this function can be
+    // called from several threads at the same time.
+    doc::ImageRef tmpUnscaledRender;
+    if (needResize) {
       auto spec = m_sprite->spec();
       spec.setSize(frameBounds.size());
       spec.setColorMode(dst->colorMode());
-      m_tmpUnscaledRender.reset(doc::Image::create(spec));
+      tmpUnscaledRender.reset(doc::Image::create(spec));
     }
 
     render::Render render;
     render.setNewBlend(m_newBlend);
     render.setBgOptions(render::BgOptions::MakeNone());
     render.renderSprite(
-      (needResize ? m_tmpUnscaledRender.get(): dst),
+      (needResize ? tmpUnscaledRender.get(): dst),
       m_sprite, frame,
       gfx::Clip(gfx::Point(0, 0), frameBounds));
 
     if (needResize) {
+      // The nearest neighbor method doesn't use the RgbMap, so we
+      // avoid Sprite::rgbMap() which regenerates a shared map.
       doc::algorithm::resize_image(
-        m_tmpUnscaledRender.get(),
+        tmpUnscaledRender.get(),
         dst,
         doc::algorithm::RESIZE_METHOD_NEAREST_NEIGHBOR,
         palette(frame),
-        m_sprite->rgbMap(frame),
-        m_tmpUnscaledRender->maskColor());
+        nullptr,
+        tmpUnscaledRender->maskColor());
     }
   }
 
@@ -198,7 +201,6 @@ private:
   const bool m_supportAnimation;
   const bool m_newBlend;
   doc::ImageRef m_tmpScaledImage = nullptr;
-  mutable doc::ImageRef m_tmpUnscaledRender = nullptr;
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
 };
 
@@ -1015,6 +1017,8 @@ void FileOp::operate(IFileOpProgress* progress)
       // For each frame in the sprite.
       render::Render render;
       render.setNewBlend(m_config.newBlend);
+      // Render big frames in tiles using all CPU cores
+      render.setThreads(0);
 
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.framesSequence()) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -138,7 +138,8 @@ namespace app {
     virtual const uint8_t* getScanline(int y) const = 0;
 
     // In case that the encoder supports animation and needs to render
-    // a full frame renders.
+    // a full frame renders. It can be called from several threads at
+    // the same time (each one with its own "dst" image).
     virtual void renderFrame(const doc::frame_t frame,
                              const gfx::Rect& frameBounds,
                              doc::Image* dst) const = 0;
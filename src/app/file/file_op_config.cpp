@@ -12,6 +12,8 @@
 
 #include "app/color_spaces.h"
 
+#include <algorithm>
+
 namespace app {
 
 void FileOpConfig::fillFromPreferences()
@@ -27,6 +29,9 @@ void FileOpConfig::fillFromPreferences()
   rgbMapAlgorithm = pref.quantization.rgbmapAlgorithm();
   fitCriteria = pref.quantization.fitCriteria();
   cacheCompressedTilesets = pref.tileset.cacheCompressedTilesets();
+  compressionLevel = std::clamp(pref.saveFile.compressionLevel(), -1, 9);
+  compressedImagesCacheSize = std::max(0, pref.saveFile.compressedImagesCacheSize());
+  loadCelsLazily = pref.experimental.lazyLoadCels();
 }
 
 } // namespace app
@@ -47,6 +47,21 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // ZLib compression level used to save cels and tilesets in
+    // .aseprite files, from 0 (no compression, fastest) to 9 (best
+    // compression, slowest), or -1 to use the default level (6).
+    int compressionLevel = -1;
+
+    // Maximum size (in MB) of the compressed data of cels and
+    // tilesets saved in .aseprite files that is kept in memory (for
+    // all documents), so the next save only compresses the images
+    // that were modified. 0 disables the cache.
+    int compressedImagesCacheSize = 64;
+
+    // True if the pixels of compressed cels in .aseprite files are
+    // inflated only when each cel is used for the first time.
+    bool loadCelsLazily = false;
+
     void fillFromPreferences();
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -84,6 +84,192 @@ TEST(File, SeveralSizes)
   }
 }
 
+// Cels are compressed in parallel before writing them in order, so
+// we check that each cel is loaded in the right layer/frame.
+TEST(File, SeveralLayersAndFrames)
+{
+  app::Context ctx;
+  const int w = 37, h = 23;
+  const int nlayers = 5, nframes = 7;
+  std::string fn = "test_layers_frames.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(w, h, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+
+    Sprite* sprite = doc->sprite();
+    sprite->setTotalFrames(nframes);
+    for (int i=1; i<nlayers; ++i)
+      sprite->root()->addLayer(new LayerImage(sprite));
+
+    int i = 0;
+    for (Layer* layer : sprite->root()->layers()) {
+      auto layerImage = static_cast<LayerImage*>(layer);
+      for (frame_t frame=0; frame<nframes; ++frame, ++i) {
+        if (Cel* oldCel = layerImage->cel(frame)) {
+          layerImage->removeCel(oldCel);
+          delete oldCel;
+        }
+
+        // A linked cel in the last frame
+        if (frame == nframes-1) {
+          layerImage->addCel(Cel::MakeLink(frame, layerImage->cel(0)));
+          continue;
+        }
+
+        ImageRef image(Image::create(IMAGE_RGB, w, h));
+        std::srand(i);
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x)
+            put_pixel_fast<RgbTraits>(image.get(), x, y, std::rand());
+        layerImage->addCel(new Cel(frame, image));
+      }
+    }
+
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+
+  {
+    std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(nframes, sprite->totalFrames());
+    ASSERT_EQ(nlayers, sprite->root()->layersCount());
+
+    int i = 0;
+    for (Layer* layer : sprite->root()->layers()) {
+      for (frame_t frame=0; frame<nframes; ++frame, ++i) {
+        Cel* cel = layer->cel(frame);
+        ASSERT_TRUE(cel != nullptr);
+
+        if (frame == nframes-1) {
+          ASSERT_EQ(layer->cel(0), cel->link());
+          continue;
+        }
+
+        std::srand(i);
+        for (int y=0; y<h; ++y)
+          for (int x=0; x<w; ++x)
+            ASSERT_EQ(color_t(std::rand()),
+                      get_pixel_fast<RgbTraits>(cel->image(), x, y));
+      }
+    }
+
+    doc->close();
+  }
+}
+
+TEST(File, SaveModifiedImages)
+{
+  app::Context ctx;
+  std::string fn = "test_modified_images.ase";
+
+  std::unique_ptr<Doc> doc(
+    ctx.documents().add(8, 8, doc::ColorMode::RGB, 256));
+  doc->setFilename(fn);
+
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(2);
+  auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  ImageRef image1(Image::create(IMAGE_RGB, 8, 8));
+  clear_image(image1.get(), rgba(255, 0, 0, 255));
+  layer->addCel(new Cel(1, image1));
+  Image* image0 = layer->cel(0)->image();
+
+  save_document(&ctx, doc.get());
+
+  // Both images must be in the cache after saving the file
+  auto& cache = doc->compressedImagesCache();
+  const int level = FileOpConfig().compressionLevel;
+  auto hash = [](const Image* image) {
+    return calculate_image_hash(image, image->bounds());
+  };
+  auto data1 = cache.get(image1->id(), hash(image1.get()), level);
+  ASSERT_TRUE(data1 != nullptr);
+  ASSERT_TRUE(cache.get(image0->id(), hash(image0), level) != nullptr);
+
+  // Modify one pixel of the first image
+  put_pixel(image0, 3, 4, rgba(0, 0, 255, 255));
+  image0->incrementVersion();
+  ASSERT_TRUE(cache.get(image0->id(), hash(image0), level) == nullptr);
+
+  save_document(&ctx, doc.get());
+
+  // The second image wasn't compressed again
+  EXPECT_EQ(data1, cache.get(image1->id(), hash(image1.get()), level));
+  EXPECT_TRUE(cache.get(image0->id(), hash(image0), level) != nullptr);
+
+  // Modify the pixels without incrementing the version (the cached
+  // data cannot be used)
+  put_pixel(image1.get(), 5, 6, rgba(0, 255, 0, 255));
+
+  save_document(&ctx, doc.get());
+  doc->close();
+
+  doc.reset(load_document(&ctx, fn));
+  layer = static_cast<LayerImage*>(doc->sprite()->root()->firstLayer());
+  EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(layer->cel(0)->image(), 3, 4));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(layer->cel(1)->image(), 3, 4));
+  EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(layer->cel(1)->image(), 5, 6));
+  doc->close();
+}
+
+TEST(File, LoadCelsLazily)
+{
+  app::Context ctx;
+  const int w = 16, h = 8;
+  std::string fn = "test_lazy_cels.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(w, h, doc::ColorMode::INDEXED, 256));
+    doc->setFilename(fn);
+    Sprite* sprite = doc->sprite();
+    sprite->setTotalFrames(3);
+
+    auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+    for (frame_t frame=1; frame<3; ++frame) {
+      ImageRef image(Image::create(IMAGE_INDEXED, w, h));
+      clear_image(image.get(), frame);
+      layer->addCel(new Cel(frame, image));
+    }
+    put_pixel(layer->cel(1)->image(), 2, 3, 5);
+
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+
+  FileOpConfig config;
+  config.loadCelsLazily = true;
+  std::unique_ptr<FileOp> fop(
+    FileOp::createLoadDocumentOperation(&ctx, fn, 0, &config));
+  fop->operate();
+  fop->done();
+  fop->postLoad();
+  ASSERT_FALSE(fop->hasError());
+
+  std::unique_ptr<Doc> doc(fop->releaseDocument());
+  Layer* layer = doc->sprite()->root()->firstLayer();
+  for (frame_t frame=1; frame<3; ++frame) {
+    Cel* cel = layer->cel(frame);
+    ASSERT_TRUE(cel != nullptr);
+    EXPECT_FALSE(cel->data()->isImageLoaded());
+    EXPECT_EQ(gfx::Rect(0, 0, w, h), cel->bounds());
+  }
+
+  // Only the accessed cel is loaded
+  Image* image = layer->cel(1)->image();
+  EXPECT_TRUE(layer->cel(1)->data()->isImageLoaded());
+  EXPECT_FALSE(layer->cel(2)->data()->isImageLoaded());
+  EXPECT_EQ(gfx::Size(w, h), image->size());
+  EXPECT_EQ(5, get_pixel(image, 2, 3));
+  EXPECT_EQ(1, get_pixel(image, 3, 3));
+  EXPECT_EQ(2, get_pixel(layer->cel(2)->image(), 2, 3));
+
+  doc->close();
+}
+
 TEST(File, CustomProperties)
 {
   app::Context ctx;
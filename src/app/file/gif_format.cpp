@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "app/modules/gui.h"
 #include "app/pref/preferences.h"
 #include "app/util/autocrop.h"
+#include "app/util/parallel_for.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "doc/doc.h"
@@ -35,6 +36,10 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include <gif_lib.h>
 
@@ -129,6 +134,21 @@ GifEncoderDurationFix::~GifEncoderDurationFix()
   fix_last_frame_duration = false;
 }
 
+// Maximum memory used by the frames that are encoded in parallel (see
+// GifEncoder::encode()).
+static const std::size_t kMaxBatchSize = 128*1024*1024;
+static std::size_t max_batch_size = kMaxBatchSize;
+
+GifEncoderMaxBatchSize::GifEncoderMaxBatchSize(std::size_t size)
+{
+  max_batch_size = size;
+}
+
+GifEncoderMaxBatchSize::~GifEncoderMaxBatchSize()
+{
+  max_batch_size = kMaxBatchSize;
+}
+
 struct GifFilePtr {
 public:
 #if GIFLIB_MAJOR >= 5
@@ -1078,13 +1098,6 @@ public:
         m_globalColormap = createColorMap(&m_globalColormapPalette);
       }
     }
-
-    // Create the 3 temporary images (previous/current/next) to
-    // compare pixels between them.
-    for (int i=0; i<3; ++i)
-      m_images[i].reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
-                                      m_spriteBounds.w,
-                                      m_spriteBounds.h));
   }
 
   ~GifEncoder() {
@@ -1097,152 +1110,295 @@ public:
     if (m_loop >= 0)
       writeLoopExtension();
 
-    // Previous and next images are used to decide the best disposal
-    // method (e.g. if it's more convenient to restore the background
-    // color or to restore the previous frame to reach the next one).
-    m_previousImage = m_images[0].get();
-    m_currentImage = m_images[1].get();
-    m_nextImage = m_images[2].get();
-
-    auto frame_beg = m_fop->roi().framesSequence().begin();
-#if _DEBUG
-    auto frame_end = m_fop->roi().framesSequence().end();
-#endif
-    auto frame_it = frame_beg;
-
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
-    gifframe_t nframes = totalFrames();
-    for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
-      ASSERT(frame_it != frame_end);
-      frame_t frame = *frame_it;
-      ++frame_it;
-
-      if (gifFrame == 0)
-        renderFrame(frame, m_nextImage);
-      else
-        std::swap(m_previousImage, m_currentImage);
-
-      // Render next frame
-      std::swap(m_currentImage, m_nextImage);
-      if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
-
-      gfx::Rect frameBounds = m_spriteBounds;
-      DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+    const gifframe_t nframes = totalFrames();
+    std::vector<frame_t> frames;
+    frames.reserve(nframes);
+    for (frame_t frame : m_fop->roi().framesSequence())
+      frames.push_back(frame);
+    ASSERT(int(frames.size()) == nframes);
+
+    // Frames are processed in batches: the rendering, the difference
+    // between frames, and the quantization of each frame are done in
+    // parallel, and then frames are written in order. Bounds and
+    // disposal methods depend on the previous frame, so they are
+    // calculated in order too (the output is the same as encoding
+    // frame by frame).
+    //
+    // Each frame in the batch keeps its render (RGB or indexed), its
+    // RGB delta image, and its quantized image in memory, so the size
+    // of the batch is limited by max_batch_size too (with big sprites
+    // we process just one frame each time, as the old encoder).
+    const std::size_t frameSize =
+      std::size_t(m_spriteBounds.w) * m_spriteBounds.h *
+      ((m_preservePaletteOrder ? 1: 4) + 4 + 1);
+    const gifframe_t framesPerBatch =
+      std::clamp(gifframe_t(max_batch_size / std::max<std::size_t>(1, frameSize)),
+                 1, 2*parallel_for_threads(nframes));
+
+    // Rendered frames (previous/current/next images are used to
+    // decide the best disposal method, e.g. if it's more convenient
+    // to restore the background color or to restore the previous
+    // frame to reach the next one).
+    std::map<gifframe_t, ImageRef> renders;
+
+    for (gifframe_t batchBeg=0; batchBeg<nframes; batchBeg+=framesPerBatch) {
+      const gifframe_t batchEnd = std::min(nframes, batchBeg+framesPerBatch);
+
+      // Render the frames that we need to process this batch
+      std::vector<std::pair<frame_t, Image*>> toRender;
+      auto addRender = [&](const gifframe_t gifFrame) {
+        if (gifFrame < 0 || renders.find(gifFrame) != renders.end())
+          return;
+        ImageRef image(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                                     m_spriteBounds.w,
+                                     m_spriteBounds.h));
+        toRender.push_back(std::make_pair(frames[gifFrame], image.get()));
+        renders[gifFrame] = image;
+      };
+      for (gifframe_t gifFrame=std::max(0, batchBeg-1); gifFrame<batchEnd; ++gifFrame) {
+        addRender(gifFrame);
+        addRender(nextGifFrame(gifFrame, nframes));
+      }
+      parallel_for(
+        int(toRender.size()),
+        [this, &toRender](const int i, const int) {
+          renderFrame(toRender[i].first, toRender[i].second);
+        });
+
+      auto getRender = [&renders](const gifframe_t gifFrame) -> const Image* {
+        if (gifFrame < 0)
+          return nullptr;
+        auto it = renders.find(gifFrame);
+        ASSERT(it != renders.end());
+        return it->second.get();
+      };
 
       // Creation of the deltaImage (difference image result respect
-      // to current VS previous frame image).  At the same time we
-      // must scan the next image, to check if some pixel turns to
-      // transparent (0), if the case, we need to force disposal
-      // method of the current image to RESTORE_BG.  Further, at the
-      // same time, we must check if we can go without color zero (0).
-
-      calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
-
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
+      // to current VS previous frame image).
+      std::vector<FrameData> data(batchEnd-batchBeg);
+      for (gifframe_t gifFrame=batchBeg; gifFrame<batchEnd; ++gifFrame) {
+        FrameData& d = data[gifFrame-batchBeg];
+        d.frame = frames[gifFrame];
+        d.previousImage = getRender(gifFrame-1);
+        d.currentImage = getRender(gifFrame);
+        d.nextImage = getRender(nextGifFrame(gifFrame, nframes));
+        if (!d.nextImage)
+          d.nextImage = emptyImage();
+      }
+      parallel_for(
+        int(data.size()),
+        [this, batchBeg, &data](const int i, const int) {
+          calculateDeltaImage(batchBeg+i, data[i]);
+        });
+
+      for (gifframe_t gifFrame=batchBeg; gifFrame<batchEnd; ++gifFrame)
+        calculateFrameBoundsDisposal(gifFrame, data[gifFrame-batchBeg]);
+
+      parallel_for(
+        int(data.size()),
+        [this, &data](const int i, const int) {
+          quantizeFrame(data[i]);
+        });
+
+      for (gifframe_t gifFrame=batchBeg; gifFrame<batchEnd; ++gifFrame) {
+        writeImage(gifFrame, data[gifFrame-batchBeg],
+                   // Only the last frame in the animation needs the fix
+                   (fix_last_frame_duration && gifFrame == nframes-1));
+
+        m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      }
 
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      // Discard rendered frames that will not be used anymore
+      for (auto it=renders.begin(); it!=renders.end(); ) {
+        if (it->first < batchEnd-1 &&
+            it->first != nextGifFrame(nframes-1, nframes))
+          it = renders.erase(it);
+        else
+          ++it;
+      }
     }
     return true;
   }
 
 private:
 
-  void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
-                                              gfx::Rect& frameBounds,
-                                              DisposalMethod& disposal) {
-    if (gifFrame == 0) {
-      m_deltaImage.reset(Image::createCopy(m_currentImage));
-      frameBounds = m_spriteBounds;
+  // Information of one GIF frame used between the parallel and the
+  // serial steps of the encoding.
+  struct FrameData {
+    frame_t frame = 0;
+    const Image* previousImage = nullptr;
+    const Image* currentImage = nullptr;
+    const Image* nextImage = nullptr;
+
+    // Changed pixels respect to the previous frame (or pixels that
+    // are cleared in the next frame), and its bounds.
+    std::unique_ptr<Image> deltaImage;
+    bool hasDelta = false;
+    int x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+
+    // True if a pixel of this frame is cleared in the next one.
+    bool pixelClearing = false;
+
+    gfx::Rect frameBounds;
+    DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+
+    // Quantized image with its local colormap (nullptr if the frame
+    // uses the global colormap).
+    ImageRef frameImage;
+    std::unique_ptr<Palette> localPalette;
+    int localTransparent = -1;
+    Remap remap = Remap(256);
+  };
+
+  // Returns the GIF frame that is used as the "next image" of the
+  // given frame, or -1 to use an empty image. For the last frame we
+  // use the same image that was left in the temporary buffers by the
+  // old serial encoder (so the output is exactly the same).
+  static gifframe_t nextGifFrame(const gifframe_t gifFrame,
+                                 const gifframe_t nframes) {
+    if (gifFrame+1 < nframes)
+      return gifFrame+1;
+    else if (nframes >= 3)
+      return nframes-3;
+    else
+      return -1;
+  }
+
+  const Image* emptyImage() {
+    if (!m_emptyImage) {
+      m_emptyImage.reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
+                                       m_spriteBounds.w,
+                                       m_spriteBounds.h));
+    }
+    return m_emptyImage.get();
+  }
 
+  // Creation of the deltaImage (difference image result respect to
+  // current VS previous frame image). At the same time we must scan
+  // the next image, to check if some pixel turns to transparent (0),
+  // if the case, we need to force disposal method of the current
+  // image to RESTORE_BG. This function can be called from several
+  // threads (it only modifies the given FrameData).
+  void calculateDeltaImage(const gifframe_t gifFrame,
+                           FrameData& d) const {
+    if (gifFrame == 0) {
       // The first frame (frame 0) is good to force to disposal = DO_NOT_DISPOSE,
       // but when the next frame (frame 1) has a "pixel clearing",
       // we must change disposal to RESTORE_BGCOLOR.
 
       // "Pixel clearing" detection:
       if (!m_hasBackground && !m_preservePaletteOrder) {
-        const LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
+        const LockImageBits<RgbTraits> bits2(d.currentImage);
+        const LockImageBits<RgbTraits> bits3(d.nextImage);
         typename LockImageBits<RgbTraits>::const_iterator it2, it3, end2, end3;
         for (it2 = bits2.begin(), end2 = bits2.end(),
              it3 = bits3.begin(), end3 = bits3.end();
               it2 != end2 && it3 != end3; ++it2, ++it3) {
           if (rgba_geta(*it2) != 0 && rgba_geta(*it3) == 0) {
-            disposal = DisposalMethod::RESTORE_BGCOLOR;
+            d.pixelClearing = true;
             break;
           }
         }
       }
+      return;
+    }
+
+    if (m_preservePaletteOrder)
+      return;
+
+    int i = 0;
+    int x, y;
+    int x1 = m_spriteBounds.w - 1;
+    int y1 = m_spriteBounds.h - 1;
+    int x2 = 0;
+    int y2 = 0;
+    const LockImageBits<RgbTraits> bits1(d.previousImage);
+    const LockImageBits<RgbTraits> bits2(d.currentImage);
+    const LockImageBits<RgbTraits> bits3(d.nextImage);
+    d.deltaImage.reset(Image::create(PixelFormat::IMAGE_RGB, m_spriteBounds.w, m_spriteBounds.h));
+    clear_image(d.deltaImage.get(), 0);
+    LockImageBits<RgbTraits> deltaBits(d.deltaImage.get());
+    typename LockImageBits<RgbTraits>::iterator deltaIt;
+    typename LockImageBits<RgbTraits>::const_iterator it1, it2, it3, end1, end2;
+
+    for (it1 = bits1.begin(), end1 = bits1.end(),
+         it2 = bits2.begin(), end2 = bits2.end(),
+         it3 = bits3.begin(),
+         deltaIt = deltaBits.begin();
+         it1 != end1 && it2 != end2; ++it1, ++it2, ++it3, ++deltaIt, ++i) {
+      x = i % m_spriteBounds.w;
+      y = i / m_spriteBounds.w;
+      // While we are checking color differences,
+      // we enlarge the frameBounds where the color differences take place
+      if ((rgba_geta(*it2) != 0 && *it1 != *it2) || rgba_geta(*it3) == 0) {
+        d.hasDelta = true;
+        *deltaIt = (rgba_geta(*it2) ? *it2 : 0);
+        if (x < x1) x1 = x;
+        if (x > x2) x2 = x;
+        if (y < y1) y1 = y;
+        if (y > y2) y2 = y;
+      }
+
+      // We need to change disposal mode DO_NOT_DISPOSE to RESTORE_BGCOLOR only
+      // if we found a "pixel clearing" in the next Image. RESTORE_BGCOLOR is
+      // our way to clear pixels.
+      if (rgba_geta(*it2) != 0 && rgba_geta(*it3) == 0)
+        d.pixelClearing = true;
+    }
+
+    d.x1 = x1;
+    d.y1 = y1;
+    d.x2 = x2;
+    d.y2 = y2;
+  }
+
+  // Calculates the frame bounds and the disposal method of the given
+  // frame. It must be called in order as it depends on the bounds
+  // and disposal method of the previous frame.
+  void calculateFrameBoundsDisposal(const gifframe_t gifFrame,
+                                    FrameData& d) {
+    gfx::Rect frameBounds = m_spriteBounds;
+    DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
+
+    if (gifFrame == 0) {
+      d.deltaImage.reset(Image::createCopy(d.currentImage));
+
+      if (!m_hasBackground && !m_preservePaletteOrder) {
+        if (d.pixelClearing)
+          disposal = DisposalMethod::RESTORE_BGCOLOR;
+      }
       else if (m_preservePaletteOrder)
         disposal = DisposalMethod::RESTORE_BGCOLOR;
     }
     else {
-      int x1 = 0;
-      int y1 = 0;
-      int x2 = 0;
-      int y2 = 0;
-
       if (!m_preservePaletteOrder) {
+        int x1, y1, x2, y2;
+
         // When m_lastDisposal was RESTORE_BGBOLOR it implies
         // we will have to cover with colors the entire previous frameBounds plus
         // the current frameBounds due to color changes, so we must start with
         // a frameBounds equal to the previous frame iteration (saved in m_lastFrameBounds).
         // Then we must cover all the resultant frameBounds with full color
-        // in m_currentImage, the output image will be saved in deltaImage.
+        // in the current image, the output image will be saved in deltaImage.
         if (m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-          x1 = m_lastFrameBounds.x;
-          y1 = m_lastFrameBounds.y;
-          x2 = m_lastFrameBounds.x + m_lastFrameBounds.w - 1;
-          y2 = m_lastFrameBounds.y + m_lastFrameBounds.h - 1;
+          x1 = std::min(m_lastFrameBounds.x, d.x1);
+          y1 = std::min(m_lastFrameBounds.y, d.y1);
+          x2 = std::max(m_lastFrameBounds.x + m_lastFrameBounds.w - 1, d.x2);
+          y2 = std::max(m_lastFrameBounds.y + m_lastFrameBounds.h - 1, d.y2);
         }
         else {
-          x1 = m_spriteBounds.w - 1;
-          y1 = m_spriteBounds.h - 1;
+          x1 = d.x1;
+          y1 = d.y1;
+          x2 = d.x2;
+          y2 = d.y2;
         }
 
-        int i = 0;
-        int x, y;
-        const LockImageBits<RgbTraits> bits1(m_previousImage);
-        LockImageBits<RgbTraits> bits2(m_currentImage);
-        const LockImageBits<RgbTraits> bits3(m_nextImage);
-        m_deltaImage.reset(Image::create(PixelFormat::IMAGE_RGB, m_spriteBounds.w, m_spriteBounds.h));
-        clear_image(m_deltaImage.get(), 0);
-        LockImageBits<RgbTraits> deltaBits(m_deltaImage.get());
-        typename LockImageBits<RgbTraits>::iterator deltaIt;
-        typename LockImageBits<RgbTraits>::iterator it2, end2;
-        typename LockImageBits<RgbTraits>::const_iterator it1, it3, end1, deltaEnd;
-
-        bool previousImageMatchsCurrent = true;
-        for (it1 = bits1.begin(), end1 = bits1.end(),
-             it2 = bits2.begin(), end2 = bits2.end(),
-             it3 = bits3.begin(),
-             deltaIt = deltaBits.begin();
-             it1 != end1 && it2 != end2; ++it1, ++it2, ++it3, ++deltaIt, ++i) {
-          x = i % m_spriteBounds.w;
-          y = i / m_spriteBounds.w;
-          // While we are checking color differences,
-          // we enlarge the frameBounds where the color differences take place
-          if ((rgba_geta(*it2) != 0 && *it1 != *it2) || rgba_geta(*it3) == 0) {
-            previousImageMatchsCurrent = false;
-            *it2 = (rgba_geta(*it2) ? *it2 : 0);
-            *deltaIt = *it2;
-            if (x < x1) x1 = x;
-            if (x > x2) x2 = x;
-            if (y < y1) y1 = y;
-            if (y > y2) y2 = y;
-          }
+        if (d.pixelClearing)
+          disposal = DisposalMethod::RESTORE_BGCOLOR;
 
-          // We need to change disposal mode DO_NOT_DISPOSE to RESTORE_BGCOLOR only
-          // if we found a "pixel clearing" in the next Image. RESTORE_BGCOLOR is
-          // our way to clear pixels.
-          if (rgba_geta(*it2) != 0 && rgba_geta(*it3) == 0) {
-            disposal = DisposalMethod::RESTORE_BGCOLOR;
-          }
-        }
-        if (previousImageMatchsCurrent)
+        if (!d.hasDelta)
           frameBounds = gfx::Rect(m_lastFrameBounds);
         else
           frameBounds = gfx::Rect(x1, y1, x2-x1+1, y2-y1+1);
@@ -1252,15 +1408,15 @@ private:
 
       // We need to conditionate the deltaImage to the next step: 'writeImage()'
       // To do it, we need to crop deltaImage in frameBounds.
-      // If disposal method changed to RESTORE_BGCOLOR deltaImage we need to reproduce ALL the colors of m_currentImage
+      // If disposal method changed to RESTORE_BGCOLOR deltaImage we need to reproduce ALL the colors of the current image
       // contained in frameBounds (so, we will overwrite delta image with a cropped current image).
       // In the other hand, if disposal is still DO_NOT_DISPOSAL, delta image will be a cropped image
       // from itself in frameBounds.
       if (disposal == DisposalMethod::RESTORE_BGCOLOR || m_lastDisposal == DisposalMethod::RESTORE_BGCOLOR) {
-        m_deltaImage.reset(crop_image(m_currentImage, frameBounds, 0));
+        d.deltaImage.reset(crop_image(d.currentImage, frameBounds, 0));
       }
       else {
-        m_deltaImage.reset(crop_image(m_deltaImage.get(), frameBounds, 0));
+        d.deltaImage.reset(crop_image(d.deltaImage.get(), frameBounds, 0));
         disposal = DisposalMethod::DO_NOT_DISPOSE;
       }
       m_lastFrameBounds = frameBounds;
@@ -1271,6 +1427,9 @@ private:
       frameBounds = gfx::Rect(0, 0, 1, 1);
 
     m_lastDisposal = disposal;
+
+    d.frameBounds = frameBounds;
+    d.disposal = disposal;
   }
 
   doc::frame_t totalFrames() const {
@@ -1366,36 +1525,35 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Converts the delta image of the given frame to an indexed image
+  // and calculates its local colormap. This function can be called
+  // from several threads (it only modifies the given FrameData).
+  void quantizeFrame(FrameData& d) const {
+    const gfx::Rect& frameBounds = d.frameBounds;
+    int transparentIndex = m_transparentIndex;
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(d.deltaImage.get(), transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
-    ImageRef frameImage(Image::create(IMAGE_INDEXED,
-                                      frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+    octree.regenerateMap(&framePalette, transparentIndex);
+    d.frameImage.reset(Image::create(IMAGE_INDEXED,
+                                     frameBounds.w,
+                                     frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = d.remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
-      LockImageBits<IndexedTraits> dstBits(frameImage.get());
+      const LockImageBits<RgbTraits> srcBits(d.deltaImage.get());
+      LockImageBits<IndexedTraits> dstBits(d.frameImage.get());
 
       auto srcIt = srcBits.begin();
       auto dstIt = dstBits.begin();
@@ -1414,13 +1572,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1443,34 +1601,46 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
-        Palette reducedPalette(0, usedNColors);
+      if (!m_globalColormap) {
+        d.localPalette = std::make_unique<Palette>(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
           if (usedColors[i]) {
-            reducedPalette.setEntry(j, framePalette.getEntry(i));
+            d.localPalette->setEntry(j, framePalette.getEntry(i));
             remap.map(i, j);
             ++j;
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      d.frameImage.reset(Image::createCopy(d.deltaImage.get()));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    d.localTransparent = localTransparent;
+  }
+
+  void writeImage(const gifframe_t gifFrame,
+                  const FrameData& d,
+                  const bool fixDuration) {
+    const gfx::Rect& frameBounds = d.frameBounds;
+    const Image* frameImage = d.frameImage.get();
+    const Remap& remap = d.remap;
+    ColorMapObject* colormap = m_globalColormap;
+    if (d.localPalette)
+      colormap = createColorMap(d.localPalette.get());
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, d.frame, d.localTransparent,
+                   d.disposal, fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1488,8 +1658,8 @@ private:
       // Need to perform 4 passes on the images.
       for (int i=0; i<4; ++i)
         for (int y=interlaced_offset[i]; y<frameBounds.h; y+=interlaced_jumps[i]) {
-          IndexedTraits::address_t addr =
-            (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+          IndexedTraits::const_address_t addr =
+            (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
           for (int i=0; i<frameBounds.w; ++i, ++addr)
             scanline[i] = remap[*addr];
@@ -1501,8 +1671,8 @@ private:
     else {
       // Write all image scanlines (not interlaced in this case).
       for (int y=0; y<frameBounds.h; ++y) {
-        IndexedTraits::address_t addr =
-          (IndexedTraits::address_t)frameImage->getPixelAddress(0, y);
+        IndexedTraits::const_address_t addr =
+          (IndexedTraits::const_address_t)frameImage->getPixelAddress(0, y);
 
         for (int i=0; i<frameBounds.w; ++i, ++addr)
           scanline[i] = remap[*addr];
@@ -1516,9 +1686,12 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  // Returns the palette to quantize the given image, and the index
+  // of the transparent color in "transparentIndex" (or -1).
+  static Palette calculatePalette(const Image* image,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(image);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1534,7 +1707,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1544,12 +1717,12 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
 
-  void renderFrame(frame_t frame, Image* dst) {
+  void renderFrame(frame_t frame, Image* dst) const {
     if (m_preservePaletteOrder)
       clear_image(dst, m_bgIndex);
     else
@@ -1602,12 +1775,9 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
-  Image* m_previousImage;
-  Image* m_currentImage;
-  Image* m_nextImage;
-  std::unique_ptr<Image> m_deltaImage;
+  // Empty image used as the "next image" of the last frame in short
+  // animations.
+  ImageRef m_emptyImage;
 };
 
 bool GifFormat::onSave(FileOp* fop)
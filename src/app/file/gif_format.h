@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -8,6 +9,8 @@
 #define APP_FILE_GIF_FORMAT_H_INCLUDED
 #pragma once
 
+#include <cstddef>
+
 namespace app {
 
   class GifEncoderDurationFix {
@@ -16,6 +19,14 @@ namespace app {
     ~GifEncoderDurationFix();
   };
 
+  // Changes the maximum memory used by the frames that are encoded in
+  // parallel (e.g. 1 to encode one frame at a time in tests).
+  class GifEncoderMaxBatchSize {
+  public:
+    GifEncoderMaxBatchSize(std::size_t size);
+    ~GifEncoderMaxBatchSize();
+  };
+
 } // namespace app
 
 #endif
@@ -0,0 +1,141 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+// GIF files are encoded only with ENABLE_SAVE
+#ifdef ENABLE_SAVE
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/gif_format.h"
+#include "app/file/gif_options.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "doc/doc.h"
+#include "doc/primitives.h"
+#include "fmt/format.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+static std::string read_file(const std::string& fn)
+{
+  std::ifstream s(FSTREAM_PATH(fn), std::ifstream::binary);
+  return std::string(std::istreambuf_iterator<char>(s),
+                     std::istreambuf_iterator<char>());
+}
+
+// Creates a sprite where a square moves in each frame over a pattern
+// that changes in each frame too. Without a background layer the
+// pixels of the square are cleared in the next frame (pixel clearing
+// frames).
+static Doc* make_doc(Context* ctx,
+                     const ColorMode colorMode,
+                     const bool background,
+                     const int nframes)
+{
+  const int w = 32, h = 24;
+  Doc* doc = ctx->documents().add(w, h, colorMode, 256);
+  Sprite* sprite = doc->sprite();
+  sprite->setTotalFrames(nframes);
+
+  auto layer = static_cast<LayerImage*>(sprite->root()->firstLayer());
+  if (background)
+    layer->configureAsBackground();
+
+  auto color = [colorMode](const int i) -> color_t {
+    if (colorMode == ColorMode::INDEXED)
+      return 1 + (i % 255);
+    return rgba((i*37) & 255, (i*59) & 255, (i*83) & 255, 255);
+  };
+
+  for (frame_t frame=0; frame<nframes; ++frame) {
+    Image* image;
+    if (frame == 0) {
+      image = layer->cel(0)->image();
+    }
+    else {
+      ImageRef img(Image::create(sprite->pixelFormat(), w, h));
+      layer->addCel(new Cel(frame, img));
+      image = img.get();
+    }
+
+    clear_image(image, background ? color(200): 0);
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        if ((x+y+frame) % 5 == 0)
+          put_pixel(image, x, y, color(x*3 + y*7 + frame*11));
+
+    fill_rect(image, frame*4, frame*3, frame*4+9, frame*3+7, color(frame+100));
+  }
+  return doc;
+}
+
+// Encodes the document with the default batches of frames (rendered
+// and quantized in parallel) and with one frame per batch, and
+// checks that both files are equal.
+static void expect_same_gif_with_batches(Context* ctx, Doc* doc)
+{
+  const std::string fn = "test_gif_batches.gif";
+  doc->setFilename(fn);
+
+  ASSERT_EQ(0, save_document(ctx, doc));
+  const std::string batched = read_file(fn);
+
+  {
+    GifEncoderMaxBatchSize oneFramePerBatch(1);
+    ASSERT_EQ(0, save_document(ctx, doc));
+  }
+  const std::string serial = read_file(fn);
+
+  EXPECT_FALSE(batched.empty());
+  EXPECT_EQ(serial.size(), batched.size());
+  EXPECT_TRUE(serial == batched);
+
+  base::delete_file(fn);
+}
+
+TEST(GifFormat, BatchesGiveSameFile)
+{
+  app::Context ctx;
+
+  struct Case {
+    ColorMode colorMode;
+    bool background;
+    bool preservePaletteOrder;
+  };
+  const Case cases[] = {
+    { ColorMode::RGB, true, false },
+    { ColorMode::RGB, false, false },
+    { ColorMode::INDEXED, true, true },
+    { ColorMode::INDEXED, false, true },  // Preserve palette order
+    { ColorMode::INDEXED, false, false },
+  };
+
+  for (const Case& c : cases) {
+    for (int nframes : { 1, 2, 3, 7 }) {
+      SCOPED_TRACE(fmt::format("colorMode={} background={} preservePaletteOrder={} nframes={}",
+                               int(c.colorMode), c.background,
+                               c.preservePaletteOrder, nframes));
+
+      std::unique_ptr<Doc> doc(make_doc(&ctx, c.colorMode, c.background, nframes));
+      doc->setFormatOptions(
+        std::make_shared<GifOptions>(false, true, c.preservePaletteOrder));
+
+      expect_same_gif_with_batches(&ctx, doc.get());
+      doc->close();
+    }
+  }
+}
+
+#endif // ENABLE_SAVE
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -59,6 +59,13 @@ namespace app {
     virtual void setBgOptions(const render::BgOptions& bg) = 0;
     virtual void setProjection(const render::Projection& projection) = 0;
 
+    // Cache of rendered frames used by renderSprite() (nullptr to
+    // disable it).
+    virtual void setCache(render::RenderCache* cache) = 0;
+
+    // Cache of pre-composited groups (nullptr to disable it).
+    virtual void setGroupCache(render::RenderCache* cache) = 0;
+
     // ----------------------------------------------------------------------
     // Advance configuration (for preview/brushes purposes)
 
@@ -119,6 +119,16 @@ void ShaderRenderer::setProjection(const render::Projection& projection)
   m_proj = projection;
 }
 
+void ShaderRenderer::setCache(render::RenderCache* cache)
+{
+  // TODO impl
+}
+
+void ShaderRenderer::setGroupCache(render::RenderCache* cache)
+{
+  // TODO impl
+}
+
 void ShaderRenderer::setSelectedLayer(const doc::Layer* layer)
 {
   // TODO impl
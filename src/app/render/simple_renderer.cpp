@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -20,6 +20,10 @@ using namespace doc;
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
+
+  // Big areas (e.g. when the editor is maximized) are rendered in
+  // tiles using one thread per CPU core.
+  m_render.setThreads(0);
 }
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
@@ -47,6 +51,16 @@ void SimpleRenderer::setProjection(const render::Projection& projection)
   m_render.setProjection(projection);
 }
 
+void SimpleRenderer::setCache(render::RenderCache* cache)
+{
+  m_render.setCache(cache);
+}
+
+void SimpleRenderer::setGroupCache(render::RenderCache* cache)
+{
+  m_render.setGroupCache(cache);
+}
+
 void SimpleRenderer::setSelectedLayer(const doc::Layer* layer)
 {
   m_render.setSelectedLayer(layer);
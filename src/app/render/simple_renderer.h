@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -26,6 +26,8 @@ namespace app {
     void setNewBlendMethod(const bool newBlend) override;
     void setBgOptions(const render::BgOptions& bg) override;
     void setProjection(const render::Projection& projection) override;
+    void setCache(render::RenderCache* cache) override;
+    void setGroupCache(render::RenderCache* cache) override;
 
     void setSelectedLayer(const doc::Layer* layer) override;
     void setPreviewImage(const doc::Layer* layer,
@@ -34,6 +34,7 @@
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
+#include "doc/image_traits.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "render/render.h"
@@ -41,6 +42,8 @@
 #include <algorithm>
 #include <cstring>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace app {
 namespace script {
@@ -98,8 +101,93 @@ struct ImageObj {
     else
       return nullptr;
   }
+
+  // Must be called after modifying the pixels of the image.
+  void notifyChange(lua_State* L) {
+    image(L)->incrementVersion();
+
+    // Rehash tileset
+    if (tilesetId) {
+      if (doc::Tileset* ts = tileset(L)) {
+        ts->incrementVersion();
+        ts->notifyTileContentChange(ti);
+      }
+    }
+  }
 };
 
+// Returns the rectangle specified in the given argument (or the whole
+// image if it's not specified) for functions that read/write several
+// pixels at once (e.g. Image:getPixels()).
+gfx::Rect get_pixels_rect_arg(lua_State* L, int index, const doc::Image* img)
+{
+  if (lua_isnoneornil(L, index))
+    return img->bounds();
+
+  const gfx::Rect rc = convert_args_into_rect(L, index);
+  if (rc.isEmpty() || !img->bounds().contains(rc))
+    luaL_error(L, "the rectangle (%d, %d, %d, %d) is outside the image bounds",
+               rc.x, rc.y, rc.w, rc.h);
+  return rc;
+}
+
+template<typename ImageTraits>
+void push_pixels_templ(lua_State* L, const doc::Image* img, const gfx::Rect& rc)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  lua_createtable(L, rc.w*rc.h, 0);
+  lua_Integer i = 1;
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    auto addr = (const pixel_t*)img->getPixelAddress(rc.x, y);
+    for (int x=0; x<rc.w; ++x, ++addr, ++i) {
+      lua_pushinteger(L, *addr);
+      lua_rawseti(L, -2, i);
+    }
+  }
+}
+
+// Returns the index of the first element of the table that is not an
+// integer (in this case the image is not modified), or 0 if all
+// pixels were set.
+template<typename ImageTraits>
+lua_Integer set_pixels_templ(lua_State* L, const int index,
+                             doc::Image* img, const gfx::Rect& rc)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  // Validate all the table before modifying the image
+  std::vector<pixel_t> pixels(size_t(rc.w) * rc.h);
+  for (size_t i=0; i<pixels.size(); ++i) {
+    lua_rawgeti(L, index, lua_Integer(i+1));
+    int isnum;
+    const lua_Integer color = lua_tointegerx(L, -1, &isnum);
+    lua_pop(L, 1);
+    if (!isnum)
+      return lua_Integer(i+1);
+    pixels[i] = pixel_t(color);
+  }
+
+  const pixel_t* src = pixels.data();
+  for (int y=rc.y; y<rc.y2(); ++y, src+=rc.w) {
+    std::copy(src, src+rc.w,
+              (pixel_t*)img->getPixelAddress(rc.x, y));
+  }
+  return 0;
+}
+
+template<typename ImageTraits, typename Map>
+void map_pixels_templ(doc::Image* img, const gfx::Rect& rc, Map&& map)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    auto addr = (pixel_t*)img->getPixelAddress(rc.x, y);
+    for (int x=rc.x; x<rc.x2(); ++x, ++addr)
+      *addr = pixel_t(map(*addr, x, y));
+  }
+}
+
 void render_sprite(Image* dst,
                    const Sprite* sprite,
                    const frame_t frame,
@@ -255,6 +343,7 @@ int Image_clear(lua_State* L)
     color = convert_args_into_pixel_color(L, i, img->pixelFormat());
 
   doc::fill_rect(img, rc, color); // Clips the rectangle to the image bounds
+  img->incrementVersion();
   return 0;
 }
 
@@ -270,14 +359,7 @@ int Image_drawPixel(lua_State* L)
   else
     color = convert_args_into_pixel_color(L, 4, img->pixelFormat());
   doc::put_pixel(img, x, y, color);
-
-  // Rehash tileset
-  if (obj->tilesetId) {
-    if (doc::Tileset* ts = obj->tileset(L)) {
-      ts->incrementVersion();
-      ts->notifyTileContentChange(obj->ti);
-    }
-  }
+  obj->notifyChange(L);
   return 0;
 }
 
@@ -397,6 +479,169 @@ int Image_getPixel(lua_State* L)
   return 1;
 }
 
+int Image_getPixels(lua_State* L)
+{
+  const auto obj = get_obj<ImageObj>(L, 1);
+  const doc::Image* img = obj->image(L);
+  const gfx::Rect rc = get_pixels_rect_arg(L, 2, img);
+
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB:       push_pixels_templ<RgbTraits>(L, img, rc); break;
+    case IMAGE_GRAYSCALE: push_pixels_templ<GrayscaleTraits>(L, img, rc); break;
+    case IMAGE_INDEXED:   push_pixels_templ<IndexedTraits>(L, img, rc); break;
+    case IMAGE_TILEMAP:   push_pixels_templ<TilemapTraits>(L, img, rc); break;
+    default:
+      return luaL_error(L, "unsupported image color mode");
+  }
+  return 1;
+}
+
+int Image_setPixels(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  const gfx::Rect rc = get_pixels_rect_arg(L, 3, img);
+
+  const lua_Integer n = lua_rawlen(L, 2);
+  if (n != lua_Integer(rc.w) * rc.h)
+    return luaL_error(L, "the table must contain %d pixels (it contains %d)",
+                      rc.w*rc.h, int(n));
+
+  lua_Integer invalid = 0;
+  switch (img->pixelFormat()) {
+    case IMAGE_RGB:       invalid = set_pixels_templ<RgbTraits>(L, 2, img, rc); break;
+    case IMAGE_GRAYSCALE: invalid = set_pixels_templ<GrayscaleTraits>(L, 2, img, rc); break;
+    case IMAGE_INDEXED:   invalid = set_pixels_templ<IndexedTraits>(L, 2, img, rc); break;
+    case IMAGE_TILEMAP:   invalid = set_pixels_templ<TilemapTraits>(L, 2, img, rc); break;
+    default:
+      return luaL_error(L, "unsupported image color mode");
+  }
+  if (invalid)
+    return luaL_error(L, "the pixel at index %d is not an integer", int(invalid));
+
+  obj->notifyChange(L);
+  return 0;
+}
+
+int Image_getBytes(lua_State* L)
+{
+  const auto obj = get_obj<ImageObj>(L, 1);
+  const doc::Image* img = obj->image(L);
+  const gfx::Rect rc = get_pixels_rect_arg(L, 2, img);
+  const size_t rowBytes = size_t(rc.w) * img->bytesPerPixel();
+
+  luaL_Buffer b;
+  char* dst = luaL_buffinitsize(L, &b, rowBytes * rc.h);
+  for (int y=rc.y; y<rc.y2(); ++y, dst+=rowBytes)
+    std::memcpy(dst, img->getPixelAddress(rc.x, y), rowBytes);
+  luaL_pushresultsize(&b, rowBytes * rc.h);
+  return 1;
+}
+
+int Image_setBytes(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  size_t bytes_size;
+  const char* bytes = luaL_checklstring(L, 2, &bytes_size);
+  const gfx::Rect rc = get_pixels_rect_arg(L, 3, img);
+  const size_t rowBytes = size_t(rc.w) * img->bytesPerPixel();
+  const size_t bytes_needed = rowBytes * rc.h;
+
+  if (bytes_size != bytes_needed)
+    return luaL_error(L, "Data size does not match: given %d, needed %d.",
+                      int(bytes_size), int(bytes_needed));
+
+  for (int y=rc.y; y<rc.y2(); ++y, bytes+=rowBytes)
+    std::memcpy(img->getPixelAddress(rc.x, y), bytes, rowBytes);
+  obj->notifyChange(L);
+  return 0;
+}
+
+// Image:mapPixels(table [, rectangle]) replaces each pixel value with
+// the value associated in the table (pixels with values that are not
+// in the table are kept), and Image:mapPixels(function [, rectangle])
+// replaces each pixel with the result of function(pixel, x, y) (or
+// keeps the pixel if the function returns nil).
+int Image_mapPixels(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  doc::Image* img = obj->image(L);
+  const gfx::Rect rc = get_pixels_rect_arg(L, 3, img);
+
+  if (lua_istable(L, 2)) {
+    std::unordered_map<doc::color_t, doc::color_t> table;
+    lua_pushnil(L);
+    while (lua_next(L, 2) != 0) {
+      if (lua_isinteger(L, -2) && lua_isinteger(L, -1))
+        table[doc::color_t(lua_tointeger(L, -2))] = doc::color_t(lua_tointeger(L, -1));
+      lua_pop(L, 1);
+    }
+
+    if (img->pixelFormat() == IMAGE_INDEXED) {
+      // Use a lookup table for indexed images
+      std::vector<doc::color_t> lut(256);
+      for (int i=0; i<256; ++i) {
+        auto it = table.find(i);
+        lut[i] = (it != table.end() ? it->second: i);
+      }
+      map_pixels_templ<IndexedTraits>(
+        img, rc, [&lut](doc::color_t c, int, int) { return lut[c]; });
+    }
+    else {
+      auto map = [&table](doc::color_t c, int, int) {
+        auto it = table.find(c);
+        return (it != table.end() ? it->second: c);
+      };
+      switch (img->pixelFormat()) {
+        case IMAGE_RGB:       map_pixels_templ<RgbTraits>(img, rc, map); break;
+        case IMAGE_GRAYSCALE: map_pixels_templ<GrayscaleTraits>(img, rc, map); break;
+        case IMAGE_TILEMAP:   map_pixels_templ<TilemapTraits>(img, rc, map); break;
+        default:
+          return luaL_error(L, "unsupported image color mode");
+      }
+    }
+    obj->notifyChange(L);
+  }
+  else if (lua_isfunction(L, 2)) {
+    // Errors in the function are caught (to notify the modified
+    // pixels) and raised again.
+    bool error = false;
+    auto map = [L, &error](doc::color_t c, int x, int y) -> doc::color_t {
+      if (error)
+        return c;
+      lua_pushvalue(L, 2);
+      lua_pushinteger(L, c);
+      lua_pushinteger(L, x);
+      lua_pushinteger(L, y);
+      if (lua_pcall(L, 3, 1, 0) != LUA_OK) {
+        error = true;           // Keep the error message in the stack
+        return c;
+      }
+      if (lua_isinteger(L, -1))
+        c = doc::color_t(lua_tointeger(L, -1));
+      lua_pop(L, 1);
+      return c;
+    };
+    switch (img->pixelFormat()) {
+      case IMAGE_RGB:       map_pixels_templ<RgbTraits>(img, rc, map); break;
+      case IMAGE_GRAYSCALE: map_pixels_templ<GrayscaleTraits>(img, rc, map); break;
+      case IMAGE_INDEXED:   map_pixels_templ<IndexedTraits>(img, rc, map); break;
+      case IMAGE_TILEMAP:   map_pixels_templ<TilemapTraits>(img, rc, map); break;
+      default:
+        return luaL_error(L, "unsupported image color mode");
+    }
+    obj->notifyChange(L);
+    if (error)
+      return lua_error(L);
+  }
+  else {
+    return luaL_error(L, "Image:mapPixels() expects a table or a function");
+  }
+  return 0;
+}
+
 int Image_isEqual(lua_State* L)
 {
   auto objA = get_obj<ImageObj>(L, 1);
@@ -690,6 +935,7 @@ int Image_set_bytes(lua_State* L)
 
   if (bytes_size == bytes_needed) {
     std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    img->incrementVersion();
   }
   else {
     lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
@@ -746,6 +992,11 @@ const luaL_Reg Image_methods[] = {
   { "clear", Image_clear },
   { "getPixel", Image_getPixel },
   { "drawPixel", Image_drawPixel }, { "putPixel", Image_drawPixel },
+  { "getPixels", Image_getPixels },
+  { "setPixels", Image_setPixels },
+  { "getBytes", Image_getBytes },
+  { "setBytes", Image_setBytes },
+  { "mapPixels", Image_mapPixels },
   { "drawImage", Image_drawImage }, { "putImage", Image_drawImage }, // TODO putImage is deprecated
   { "drawSprite", Image_drawSprite }, { "putSprite", Image_drawSprite }, // TODO putSprite is deprecated
   { "pixels", Image_pixels },
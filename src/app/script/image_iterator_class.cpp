@@ -27,10 +27,12 @@ namespace {
 
 template<typename ImageTraits>
 struct ImageIteratorObj {
+  doc::Image* image;
   typename doc::LockImageBits<ImageTraits> bits;
   typename doc::LockImageBits<ImageTraits>::iterator begin, next, end;
   ImageIteratorObj(const doc::Image* image, const gfx::Rect& bounds)
-    : bits(image, bounds),
+    : image(const_cast<doc::Image*>(image)),
+      bits(image, bounds),
       begin(bits.begin()),
       next(begin),
       end(bits.end()) {
@@ -63,6 +65,7 @@ int ImageIterator_call(lua_State* L)
   // Set value
   else {
     *obj->begin = lua_tointeger(L, 2);
+    obj->image->incrementVersion();
     return 1;
   }
 }
@@ -0,0 +1,383 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/thumbnail_cache.h"
+
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/process.h"
+#include "base/serialization.h"
+#include "base/string.h"
+#include "doc/image.h"
+#include "doc/image_io.h"
+#include "doc/palette.h"
+#include "doc/palette_io.h"
+#include "doc/string_io.h"
+#include "fmt/format.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
+
+namespace app {
+
+using namespace base::serialization;
+using namespace base::serialization::little_endian;
+
+namespace {
+
+const uint32_t kMagicNumber = 0x48544341; // "ACTH"
+const uint16_t kFileVersion = 2;
+
+uint32_t calc_checksum(const std::string& data)
+{
+  return uint32_t(crc32(0, (const Bytef*)data.data(), uInt(data.size())));
+}
+
+// Replaces the "dst" file with "src" in one step, so other instances
+// of the program see the old or the new file (never a missing or
+// half-written file).
+bool replace_file(const std::string& src, const std::string& dst)
+{
+#ifdef _WIN32
+  return (MoveFileExW(base::from_utf8(src).c_str(),
+                      base::from_utf8(dst).c_str(),
+                      MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+  return (std::rename(src.c_str(), dst.c_str()) == 0);
+#endif
+}
+
+} // anonymous namespace
+
+// static
+ThumbnailCache::FileInfo ThumbnailCache::FileInfo::fromFile(const std::string& path)
+{
+  FileInfo info;
+  info.modificationTime = base::get_modification_time(path);
+  info.size = base::file_size(path);
+  return info;
+}
+
+ThumbnailCache::ThumbnailCache(const std::string& filename,
+                               const std::size_t maxSize)
+  : m_filename(filename)
+  , m_maxSize(maxSize)
+{
+  load();
+
+  const std::lock_guard lock(m_mutex);
+  shrink();
+}
+
+void ThumbnailCache::setMaxSize(const std::size_t maxSize)
+{
+  const std::lock_guard lock(m_mutex);
+  m_maxSize = maxSize;
+  shrink();
+}
+
+bool ThumbnailCache::get(const std::string& path,
+                         const FileInfo& info,
+                         std::unique_ptr<doc::Image>& image,
+                         std::unique_ptr<doc::Palette>& palette)
+{
+  std::shared_ptr<const std::string> data;
+  Entry entryToRead;
+  FileInfo fileInfo;
+  {
+    const std::lock_guard lock(m_mutex);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end())
+      return false;
+
+    Entry& entry = it->second;
+
+    // The file was modified, the thumbnail must be generated again
+    if (entry.info != info) {
+      removeEntry(it);
+      return false;
+    }
+
+    // The last use is saved with the next added/removed entry (we
+    // don't rewrite the whole file just because a thumbnail was used)
+    entry.lastUse = ++m_useCounter;
+    data = entry.data;
+    if (!data) {
+      entryToRead = entry;
+      fileInfo = m_fileInfo;
+    }
+  }
+
+  // Read the data from the cache file without locking the cache (so
+  // other threads can add thumbnails in the meantime)
+  if (!data) {
+    auto newData = std::make_shared<std::string>();
+    const bool ok = readData(fileInfo, entryToRead, *newData);
+
+    const std::lock_guard lock(m_mutex);
+    auto it = m_entries.find(path);
+    // Check that the entry wasn't replaced/loaded/saved while we were
+    // reading its data
+    if (it != m_entries.end() &&
+        it->second.info == entryToRead.info &&
+        it->second.offset == entryToRead.offset &&
+        it->second.checksum == entryToRead.checksum &&
+        m_fileInfo == fileInfo) {
+      if (!ok) {
+        removeEntry(it);
+        return false;
+      }
+      if (!it->second.data)
+        it->second.data = newData;
+    }
+    if (!ok)
+      return false;
+    data = newData;
+  }
+
+  try {
+    std::istringstream s(*data);
+    image.reset(doc::read_image(s, false));
+    if (read8(s))
+      palette.reset(doc::read_palette(s));
+    else
+      palette.reset();
+    return (image && s);
+  }
+  catch (const std::exception&) {
+    return false;
+  }
+}
+
+void ThumbnailCache::set(const std::string& path,
+                         const FileInfo& info,
+                         const doc::Image* image,
+                         const doc::Palette* palette)
+{
+  std::ostringstream s;
+  doc::write_image(s, image);
+  if (palette) {
+    write8(s, 1);
+    doc::write_palette(s, palette);
+  }
+  else
+    write8(s, 0);
+
+  auto data = std::make_shared<std::string>(s.str());
+
+  const std::lock_guard lock(m_mutex);
+  auto it = m_entries.find(path);
+  if (it != m_entries.end())
+    removeEntry(it);
+
+  Entry entry;
+  entry.info = info;
+  entry.lastUse = ++m_useCounter;
+  entry.dataSize = uint32_t(data->size());
+  entry.checksum = calc_checksum(*data);
+  entry.data = data;
+  m_size += entry.dataSize;
+  m_entries[path] = std::move(entry);
+  m_modified = true;
+
+  shrink();
+}
+
+void ThumbnailCache::save()
+{
+  const std::lock_guard lock(m_mutex);
+  if (!m_modified)
+    return;
+
+  // Load all the data from the old cache file before overwriting it
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ) {
+    Entry& entry = it->second;
+    if (!entry.data) {
+      auto newData = std::make_shared<std::string>();
+      if (!readData(m_fileInfo, entry, *newData)) {
+        m_size -= entry.dataSize;
+        it = m_entries.erase(it);
+        continue;
+      }
+      entry.data = newData;
+    }
+    ++it;
+  }
+
+  // Write a new cache file and then replace the old one (the
+  // temporary file name is unique for each process in case that other
+  // instance is saving the cache at the same time)
+  const std::string tmpFilename =
+    fmt::format("{}.{}.tmp", m_filename, base::get_current_process_id());
+  uint64_t offset = 0;
+  {
+    std::ofstream s(FSTREAM_PATH(tmpFilename), std::ofstream::binary);
+    write32(s, kMagicNumber);
+    write16(s, kFileVersion);
+    write32(s, uint32_t(m_entries.size()));
+    for (const auto& it : m_entries) {
+      const Entry& entry = it.second;
+      const base::Time& t = entry.info.modificationTime;
+      doc::write_string(s, it.first);
+      write16(s, t.year);
+      write8(s, t.month);
+      write8(s, t.day);
+      write8(s, t.hour);
+      write8(s, t.minute);
+      write8(s, t.second);
+      write64(s, entry.info.size);
+      write64(s, entry.lastUse);
+      write32(s, entry.dataSize);
+      write32(s, entry.checksum);
+    }
+
+    offset = uint64_t(s.tellp());
+    for (const auto& it : m_entries)
+      s.write(it.second.data->data(), it.second.data->size());
+
+    if (!s) {
+      s.close();
+      if (base::is_file(tmpFilename))
+        base::delete_file(tmpFilename);
+      return;
+    }
+  }
+
+  if (!replace_file(tmpFilename, m_filename)) {
+    if (base::is_file(tmpFilename))
+      base::delete_file(tmpFilename);
+    return;
+  }
+  m_fileInfo = FileInfo::fromFile(m_filename);
+
+  // Now the data can be read again from the new cache file
+  for (auto& it : m_entries) {
+    Entry& entry = it.second;
+    entry.offset = offset;
+    entry.data.reset();
+    offset += entry.dataSize;
+  }
+  m_modified = false;
+}
+
+void ThumbnailCache::load()
+{
+  std::ifstream s(FSTREAM_PATH(m_filename), std::ifstream::binary);
+  if (!s ||
+      read32(s) != kMagicNumber ||
+      read16(s) != kFileVersion)
+    return;
+
+  std::vector<std::pair<std::string, Entry>> entries;
+  const uint32_t n = read32(s);
+  for (uint32_t i=0; i<n && s; ++i) {
+    std::string path = doc::read_string(s);
+    Entry entry;
+    const int year = read16(s);
+    const int month = read8(s);
+    const int day = read8(s);
+    const int hour = read8(s);
+    const int minute = read8(s);
+    const int second = read8(s);
+    entry.info.modificationTime = base::Time(year, month, day,
+                                             hour, minute, second);
+    entry.info.size = read64(s);
+    entry.lastUse = read64(s);
+    entry.dataSize = read32(s);
+    entry.checksum = read32(s);
+    entries.emplace_back(std::move(path), std::move(entry));
+  }
+  if (!s)
+    return;
+
+  // Check that the file contains the data of all entries
+  uint64_t offset = uint64_t(s.tellg());
+  uint64_t totalSize = 0;
+  for (const auto& it : entries)
+    totalSize += it.second.dataSize;
+  const FileInfo fileInfo = FileInfo::fromFile(m_filename);
+  if (offset + totalSize > fileInfo.size)
+    return;
+
+  const std::lock_guard lock(m_mutex);
+  m_fileInfo = fileInfo;
+  for (auto& it : entries) {
+    Entry& entry = it.second;
+    entry.offset = offset;
+    offset += entry.dataSize;
+    m_size += entry.dataSize;
+    m_useCounter = std::max(m_useCounter, entry.lastUse);
+    m_entries[it.first] = std::move(entry);
+  }
+}
+
+// This function doesn't access the entries (m_mutex isn't needed),
+// "fileInfo" is the cache file time/size of the given entry offset.
+bool ThumbnailCache::readData(const FileInfo& fileInfo,
+                              const Entry& entry,
+                              std::string& data) const
+{
+  if (entry.dataSize == 0)
+    return false;
+
+  // Other instance replaced the cache file, so the offsets of our
+  // index are not valid anymore
+  if (FileInfo::fromFile(m_filename) != fileInfo)
+    return false;
+
+  std::ifstream s(FSTREAM_PATH(m_filename), std::ifstream::binary);
+  if (!s)
+    return false;
+
+  data.resize(entry.dataSize);
+  s.seekg(entry.offset);
+  s.read(&data[0], entry.dataSize);
+  return (s && calc_checksum(data) == entry.checksum);
+}
+
+void ThumbnailCache::removeEntry(Entries::iterator it)
+{
+  m_size -= it->second.dataSize;
+  m_entries.erase(it);
+  m_modified = true;
+}
+
+void ThumbnailCache::shrink()
+{
+  if (m_size <= m_maxSize)
+    return;
+
+  // Remove the least recently used entries
+  std::vector<Entries::iterator> lru;
+  lru.reserve(m_entries.size());
+  for (auto it=m_entries.begin(); it!=m_entries.end(); ++it)
+    lru.push_back(it);
+  std::sort(lru.begin(), lru.end(),
+            [](const Entries::iterator& a, const Entries::iterator& b) {
+              return a->second.lastUse < b->second.lastUse;
+            });
+
+  for (auto it : lru) {
+    if (m_size <= m_maxSize)
+      break;
+    removeEntry(it);
+  }
+}
+
+} // namespace app
@@ -0,0 +1,118 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_THUMBNAIL_CACHE_H_INCLUDED
+#define APP_THUMBNAIL_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/time.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace doc {
+  class Image;
+  class Palette;
+}
+
+namespace app {
+
+  // Persistent cache of the thumbnails generated for the file
+  // selector. Each thumbnail is saved with the modification time and
+  // size of its file, so it's re-used only if the file wasn't
+  // modified. When the cache is bigger than its maximum size, the
+  // least recently used thumbnails are removed.
+  //
+  // The cache file contains an index (path/time/size of each file)
+  // followed by the thumbnails data, which is loaded only when a
+  // thumbnail is requested. Other instances of the program can
+  // replace the cache file at any time, so the data is read only if
+  // the cache file wasn't modified since it was loaded/saved, and
+  // each thumbnail has a checksum to detect data from other entries.
+  class ThumbnailCache {
+  public:
+    // Information to know if a file was modified.
+    struct FileInfo {
+      base::Time modificationTime;
+      uint64_t size = 0;
+
+      static FileInfo fromFile(const std::string& path);
+
+      bool operator==(const FileInfo& other) const {
+        return (modificationTime == other.modificationTime &&
+                size == other.size);
+      }
+      bool operator!=(const FileInfo& other) const {
+        return !operator==(other);
+      }
+    };
+
+    // Loads the index of the given cache file (if it exists).
+    ThumbnailCache(const std::string& filename,
+                   const std::size_t maxSize);
+
+    void setMaxSize(const std::size_t maxSize);
+    std::size_t maxSize() const { return m_maxSize; }
+    std::size_t size() const { return m_size; }
+
+    // Returns true and the thumbnail image/palette of the given file
+    // if it's in the cache and the file wasn't modified.
+    bool get(const std::string& path,
+             const FileInfo& info,
+             std::unique_ptr<doc::Image>& image,
+             std::unique_ptr<doc::Palette>& palette);
+
+    // Adds the thumbnail of the given file to the cache. It can be
+    // called from any thread.
+    void set(const std::string& path,
+             const FileInfo& info,
+             const doc::Image* image,
+             const doc::Palette* palette);
+
+    // Saves the cache file (if the cache was modified).
+    void save();
+
+  private:
+    struct Entry {
+      FileInfo info;
+      // Used to remove the least recently used entries
+      uint64_t lastUse = 0;
+      // Position of the data in the cache file (if it's not loaded)
+      uint64_t offset = 0;
+      uint32_t dataSize = 0;
+      uint32_t checksum = 0;
+      // Data of the thumbnail (nullptr if it's not loaded)
+      std::shared_ptr<const std::string> data;
+    };
+    using Entries = std::unordered_map<std::string, Entry>;
+
+    void load();
+    bool readData(const FileInfo& fileInfo,
+                  const Entry& entry,
+                  std::string& data) const;
+    void removeEntry(Entries::iterator it);
+    void shrink();
+
+    std::string m_filename;
+    // Cache file time/size when it was loaded/saved
+    FileInfo m_fileInfo;
+    std::size_t m_maxSize;
+    std::size_t m_size = 0;
+    uint64_t m_useCounter = 0;
+    bool m_modified = false;
+    Entries m_entries;
+    mutable std::mutex m_mutex;
+
+    DISABLE_COPYING(ThumbnailCache);
+  };
+
+} // namespace app
+
+#endif
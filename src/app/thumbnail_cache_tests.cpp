@@ -0,0 +1,136 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/thumbnail_cache.h"
+#include "base/fs.h"
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+
+using namespace app;
+using namespace doc;
+
+static ThumbnailCache::FileInfo file_info(int second, uint64_t size)
+{
+  ThumbnailCache::FileInfo info;
+  info.modificationTime = base::Time(2024, 5, 10, 12, 30, second);
+  info.size = size;
+  return info;
+}
+
+TEST(ThumbnailCache, SaveAndLoad)
+{
+  const std::string fn = "_thumbnails_test.cache";
+  if (base::is_file(fn))
+    base::delete_file(fn);
+
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 32, 16));
+  std::unique_ptr<Image> b(Image::create(IMAGE_INDEXED, 8, 8));
+  Palette pal(frame_t(0), 4);
+  clear_image(a.get(), rgba(255, 0, 0, 255));
+  clear_image(b.get(), 2);
+  put_pixel(a.get(), 3, 4, rgba(0, 0, 255, 128));
+  put_pixel(b.get(), 5, 6, 3);
+  pal.setEntry(2, rgba(0, 255, 0, 255));
+
+  {
+    ThumbnailCache cache(fn, 1024*1024);
+    cache.set("a.aseprite", file_info(1, 100), a.get(), nullptr);
+    cache.set("b.aseprite", file_info(2, 200), b.get(), &pal);
+    cache.save();
+  }
+
+  ThumbnailCache cache(fn, 1024*1024);
+  std::unique_ptr<Image> image;
+  std::unique_ptr<Palette> palette;
+
+  ASSERT_TRUE(cache.get("a.aseprite", file_info(1, 100), image, palette));
+  EXPECT_EQ(IMAGE_RGB, image->pixelFormat());
+  EXPECT_TRUE(is_same_image(a.get(), image.get()));
+  EXPECT_EQ(nullptr, palette);
+
+  ASSERT_TRUE(cache.get("b.aseprite", file_info(2, 200), image, palette));
+  EXPECT_EQ(IMAGE_INDEXED, image->pixelFormat());
+  EXPECT_TRUE(is_same_image(b.get(), image.get()));
+  ASSERT_NE(nullptr, palette);
+  EXPECT_EQ(4, palette->size());
+  EXPECT_EQ(rgba(0, 255, 0, 255), palette->getEntry(2));
+
+  // Modified files are not used
+  EXPECT_FALSE(cache.get("a.aseprite", file_info(1, 101), image, palette));
+  EXPECT_FALSE(cache.get("b.aseprite", file_info(3, 200), image, palette));
+  EXPECT_FALSE(cache.get("c.aseprite", file_info(1, 100), image, palette));
+  EXPECT_EQ(std::size_t(0), cache.size());
+
+  base::delete_file(fn);
+}
+
+TEST(ThumbnailCache, RemoveLeastRecentlyUsed)
+{
+  std::unique_ptr<Image> img(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(img.get(), rgba(0, 0, 0, 255));
+
+  ThumbnailCache cache("_thumbnails_test_lru.cache", 1024*1024);
+  cache.set("a", file_info(1, 1), img.get(), nullptr);
+  const std::size_t entrySize = cache.size();
+  cache.set("b", file_info(1, 1), img.get(), nullptr);
+  cache.set("c", file_info(1, 1), img.get(), nullptr);
+  EXPECT_EQ(3*entrySize, cache.size());
+
+  // Use "a" so "b" is the least recently used
+  std::unique_ptr<Image> image;
+  std::unique_ptr<Palette> palette;
+  EXPECT_TRUE(cache.get("a", file_info(1, 1), image, palette));
+
+  cache.setMaxSize(2*entrySize);
+  EXPECT_EQ(2*entrySize, cache.size());
+  EXPECT_TRUE(cache.get("a", file_info(1, 1), image, palette));
+  EXPECT_FALSE(cache.get("b", file_info(1, 1), image, palette));
+  EXPECT_TRUE(cache.get("c", file_info(1, 1), image, palette));
+}
+
+TEST(ThumbnailCache, FileReplacedByOtherInstance)
+{
+  const std::string fn = "_thumbnails_test_replaced.cache";
+  if (base::is_file(fn))
+    base::delete_file(fn);
+
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 32, 16));
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(a.get(), rgba(255, 0, 0, 255));
+  clear_image(b.get(), rgba(0, 0, 255, 255));
+  {
+    ThumbnailCache cache(fn, 1024*1024);
+    cache.set("a", file_info(1, 1), a.get(), nullptr);
+    cache.save();
+  }
+
+  // Only the index of the file is loaded here
+  ThumbnailCache cache(fn, 1024*1024);
+
+  // Other instance replaces the cache file
+  {
+    ThumbnailCache other(fn, 1024*1024);
+    other.set("b", file_info(1, 1), b.get(), nullptr);
+    other.set("a", file_info(1, 1), b.get(), nullptr);
+    other.save();
+  }
+
+  // The old offsets cannot be used to read the new file
+  std::unique_ptr<Image> image;
+  std::unique_ptr<Palette> palette;
+  EXPECT_FALSE(cache.get("a", file_info(1, 1), image, palette));
+
+  ThumbnailCache newCache(fn, 1024*1024);
+  ASSERT_TRUE(newCache.get("a", file_info(1, 1), image, palette));
+  EXPECT_TRUE(is_same_image(b.get(), image.get()));
+  ASSERT_TRUE(newCache.get("b", file_info(1, 1), image, palette));
+  EXPECT_TRUE(is_same_image(b.get(), image.get()));
+
+  base::delete_file(fn);
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,7 +16,10 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/pref/preferences.h"
+#include "app/resource_finder.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/log.h"
 #include "base/thread.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image.h"
@@ -38,10 +41,27 @@
 
 namespace app {
 
+static os::SurfaceRef make_thumbnail_surface(const Image* thumbnailImage,
+                                             const Palette* palette)
+{
+  os::SurfaceRef thumbnail =
+    os::instance()->makeRgbaSurface(
+      thumbnailImage->width(),
+      thumbnailImage->height());
+
+  convert_image_to_surface(
+    thumbnailImage, palette, thumbnail.get(),
+    0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
+
+  return thumbnail;
+}
+
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
+  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue,
+         ThumbnailCache* cache)
     : m_queue(queue)
+    , m_cache(cache)
     , m_fop(nullptr)
     , m_isDone(false)
     , m_thread([this]{ loadBgThread(); }) {
@@ -150,6 +170,14 @@ private:
             thumbnailImage.get(), palette.get(),
             cs, gfx::ColorSpace::MakeSRGB());
         }
+
+        // Save the thumbnail in the persistent cache (the palette is
+        // needed only for indexed images)
+        if (m_cache && !m_fop->isStop()) {
+          m_cache->set(
+            m_item.filename, m_item.fileInfo, thumbnailImage.get(),
+            (thumbnailImage->pixelFormat() == IMAGE_INDEXED ? palette.get(): nullptr));
+        }
       }
 
       // Close file
@@ -158,13 +186,7 @@ private:
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
         os::SurfaceRef thumbnail =
-          os::instance()->makeRgbaSurface(
-            thumbnailImage->width(),
-            thumbnailImage->height());
-
-        convert_image_to_surface(
-          thumbnailImage.get(), palette.get(), thumbnail.get(),
-          0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
+          make_thumbnail_surface(thumbnailImage.get(), palette.get());
 
         {
           const std::lock_guard lock(m_mutex);
@@ -224,6 +246,7 @@ private:
   }
 
   base::concurrent_queue<Item>& m_queue;
+  ThumbnailCache* m_cache;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
@@ -249,6 +272,46 @@ ThumbnailGenerator::ThumbnailGenerator()
   int n = std::thread::hardware_concurrency()-1;
   if (n < 1) n = 1;
   m_maxWorkers = n;
+
+  auto& cacheSize = Preferences::instance().fileSelector.thumbnailCacheSize;
+  onCacheSizeChange(cacheSize());
+  m_cacheSizeConn = cacheSize.AfterChange.connect(
+    [this](const int size){ onCacheSizeChange(size); });
+}
+
+ThumbnailGenerator::~ThumbnailGenerator()
+{
+  stopAllWorkers();
+  {
+    const std::lock_guard lock(m_workersAccess);
+    m_workers.clear();
+  }
+
+  if (m_cache) {
+    try {
+      m_cache->save();
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "THUMB: Error saving thumbnails cache: %s\n", ex.what());
+    }
+  }
+}
+
+// The cache is created the first time that its size is > 0, and then
+// it's kept (workers use it) with the new maximum size (0 removes all
+// thumbnails from the cache).
+void ThumbnailGenerator::onCacheSizeChange(const int cacheSize)
+{
+  const std::size_t maxSize = std::size_t(std::max(0, cacheSize))*1024*1024;
+  if (m_cache) {
+    m_cache->setMaxSize(maxSize);
+  }
+  else if (maxSize > 0) {
+    ResourceFinder rf;
+    rf.includeUserDir("thumbnails.cache");
+    m_cache = std::make_unique<ThumbnailCache>(
+      rf.getFirstOrCreateDefault(), maxSize);
+  }
 }
 
 bool ThumbnailGenerator::checkWorkers()
@@ -299,6 +362,23 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
     return;
   }
 
+  // Use the thumbnail from the persistent cache if the file wasn't
+  // modified since it was generated.
+  ThumbnailCache::FileInfo fileInfo;
+  if (m_cache) {
+    fileInfo = ThumbnailCache::FileInfo::fromFile(fileitem->fileName());
+
+    std::unique_ptr<Image> image;
+    std::unique_ptr<Palette> palette;
+    if (m_cache->get(fileitem->fileName(), fileInfo, image, palette)) {
+      THUMB_TRACE("Thumbnail from cache for %s\n",
+                  fileitem->fileName().c_str());
+
+      fileitem->setThumbnail(make_thumbnail_surface(image.get(), palette.get()));
+      return;
+    }
+  }
+
   // Set a starting progress so we don't enqueue the same item two times.
   fileitem->setThumbnailProgress(0.00001);
 
@@ -318,7 +398,8 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
     return;
   }
 
-  m_remainingItems.push(Item(fileitem, fop.get()));
+  m_remainingItems.push(Item(fileitem, fop.get(),
+                            fileitem->fileName(), fileInfo));
   fop.release();
 
   startWorker();
@@ -348,7 +429,8 @@ void ThumbnailGenerator::startWorker()
 {
   const std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(m_remainingItems,
+                                                 m_cache.get()));
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,10 +9,13 @@
 #define APP_THUMBNAIL_GENERATOR_H_INCLUDED
 #pragma once
 
+#include "app/thumbnail_cache.h"
 #include "base/concurrent_queue.h"
+#include "obs/connection.h"
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 namespace base {
@@ -26,6 +29,8 @@ namespace app {
   class ThumbnailGenerator {
     ThumbnailGenerator();
   public:
+    ~ThumbnailGenerator();
+
     static ThumbnailGenerator* instance();
 
     // Generate a thumbnail for the given file-item.  It must be called
@@ -45,6 +50,7 @@ namespace app {
 
   private:
     void startWorker();
+    void onCacheSizeChange(const int cacheSize);
 
     class Worker;
     using WorkerPtr = std::unique_ptr<Worker>;
@@ -53,14 +59,23 @@ namespace app {
     struct Item {
       IFileItem* fileitem;
       FileOp* fop;
+      // Used to save the generated thumbnail in the cache
+      std::string filename;
+      ThumbnailCache::FileInfo fileInfo;
       Item() : fileitem(nullptr), fop(nullptr) { }
-      Item(const Item& item) : fileitem(item.fileitem), fop(item.fop) { }
-      Item(IFileItem* fileitem, FileOp* fop)
-        : fileitem(fileitem), fop(fop) {
+      Item(const Item& item) = default;
+      Item& operator=(const Item& item) = default;
+      Item(IFileItem* fileitem, FileOp* fop,
+           const std::string& filename,
+           const ThumbnailCache::FileInfo& fileInfo)
+        : fileitem(fileitem), fop(fop)
+        , filename(filename), fileInfo(fileInfo) {
       }
     };
 
     int m_maxWorkers;
+    std::unique_ptr<ThumbnailCache> m_cache;
+    obs::scoped_connection m_cacheSizeConn;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
@@ -582,83 +582,133 @@ void Editor::updateEditor(const bool restoreScrollPos)
   View::getView(this)->updateView(restoreScrollPos);
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw,
+                                        const std::vector<gfx::Point>& deltas)
 {
-  // Clip from sprite and apply zoom
-  gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
-  rc = m_proj.apply(rc);
-
-  gfx::Rect dest(dx + m_padding.x + rc.x,
-                 dy + m_padding.y + rc.y, 0, 0);
-
-  // Clip from graphics/screen
-  const gfx::Rect& clip = g->getClipBounds();
-  if (dest.x < clip.x) {
-    rc.x += clip.x - dest.x;
-    rc.w -= clip.x - dest.x;
-    dest.x = clip.x;
-  }
-  if (dest.y < clip.y) {
-    rc.y += clip.y - dest.y;
-    rc.h -= clip.y - dest.y;
-    dest.y = clip.y;
-  }
-  if (dest.x+rc.w > clip.x+clip.w) {
-    rc.w = clip.x+clip.w-dest.x;
-  }
-  if (dest.y+rc.h > clip.y+clip.h) {
-    rc.h = clip.y+clip.h-dest.y;
-  }
+  const auto& pref = Preferences::instance();
+  const bool newEngine = isUsingNewRenderEngine();
 
-  if (rc.isEmpty())
-    return;
+  // Each copy of the sprite that will be drawn on the screen (just
+  // one if tiled mode is disabled).
+  struct Copy {
+    gfx::Point delta;
+    // rc2 is the rectangle used to create a temporal rendered image of the sprite
+    gfx::Rect rc2;
+    // Destination rectangle on the screen
+    gfx::Rect dest;
+    // Index of the rectangle that is rendered to draw this copy
+    int renderIndex;
+  };
+  std::vector<Copy> copies;
+  copies.reserve(deltas.size());
 
   // Bounds of pixels from the sprite canvas that will be exposed in
   // this render cycle.
-  gfx::Rect expose = m_proj.remove(rc);
-
-  // If the zoom level is less than 100%, we add extra pixels to
-  // the exposed area. Those pixels could be shown in the
-  // rendering process depending on each cel position.
-  // E.g. when we are drawing in a cel with position < (0,0)
-  if (m_proj.scaleX() < 1.0)
-    expose.enlargeXW(int(1./m_proj.scaleX()));
-  // If the zoom level is more than %100 we add an extra pixel to
-  // expose just in case the zoom requires to display it.  Note:
-  // this is really necessary to avoid showing invalid destination
-  // areas in ToolLoopImpl.
-  else if (m_proj.scaleX() > 1.0)
-    expose.enlargeXW(1);
-
-  if (m_proj.scaleY() < 1.0)
-    expose.enlargeYH(int(1./m_proj.scaleY()));
-  else if (m_proj.scaleY() > 1.0)
-    expose.enlargeYH(1);
-
-  expose &= m_sprite->bounds();
-
-  const int maxw = std::max(0, m_sprite->width()-expose.x);
-  const int maxh = std::max(0, m_sprite->height()-expose.y);
-  expose.w = std::clamp(expose.w, 0, maxw);
-  expose.h = std::clamp(expose.h, 0, maxh);
-  if (expose.isEmpty())
-    return;
+  gfx::Region exposeRgn;
 
-  // rc2 is the rectangle used to create a temporal rendered image of the sprite
-  const auto& pref = Preferences::instance();
-  const bool newEngine = isUsingNewRenderEngine();
-  gfx::Rect rc2;
-  if (newEngine) {
-    rc2 = expose;               // New engine, exposed rectangle (without zoom)
-    dest.x = dx + m_padding.x + m_proj.applyX(rc2.x);
-    dest.y = dy + m_padding.y + m_proj.applyY(rc2.y);
-    dest.w = m_proj.applyX(rc2.w);
-    dest.h = m_proj.applyY(rc2.h);
+  for (const gfx::Point& delta : deltas) {
+    const int dx = delta.x;
+    const int dy = delta.y;
+
+    // Clip from sprite and apply zoom
+    gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
+    rc = m_proj.apply(rc);
+
+    gfx::Rect dest(dx + m_padding.x + rc.x,
+                   dy + m_padding.y + rc.y, 0, 0);
+
+    // Clip from graphics/screen
+    const gfx::Rect& clip = g->getClipBounds();
+    if (dest.x < clip.x) {
+      rc.x += clip.x - dest.x;
+      rc.w -= clip.x - dest.x;
+      dest.x = clip.x;
+    }
+    if (dest.y < clip.y) {
+      rc.y += clip.y - dest.y;
+      rc.h -= clip.y - dest.y;
+      dest.y = clip.y;
+    }
+    if (dest.x+rc.w > clip.x+clip.w) {
+      rc.w = clip.x+clip.w-dest.x;
+    }
+    if (dest.y+rc.h > clip.y+clip.h) {
+      rc.h = clip.y+clip.h-dest.y;
+    }
+
+    if (rc.isEmpty())
+      continue;
+
+    gfx::Rect expose = m_proj.remove(rc);
+
+    // If the zoom level is less than 100%, we add extra pixels to
+    // the exposed area. Those pixels could be shown in the
+    // rendering process depending on each cel position.
+    // E.g. when we are drawing in a cel with position < (0,0)
+    if (m_proj.scaleX() < 1.0)
+      expose.enlargeXW(int(1./m_proj.scaleX()));
+    // If the zoom level is more than %100 we add an extra pixel to
+    // expose just in case the zoom requires to display it.  Note:
+    // this is really necessary to avoid showing invalid destination
+    // areas in ToolLoopImpl.
+    else if (m_proj.scaleX() > 1.0)
+      expose.enlargeXW(1);
+
+    if (m_proj.scaleY() < 1.0)
+      expose.enlargeYH(int(1./m_proj.scaleY()));
+    else if (m_proj.scaleY() > 1.0)
+      expose.enlargeYH(1);
+
+    expose &= m_sprite->bounds();
+
+    const int maxw = std::max(0, m_sprite->width()-expose.x);
+    const int maxh = std::max(0, m_sprite->height()-expose.y);
+    expose.w = std::clamp(expose.w, 0, maxw);
+    expose.h = std::clamp(expose.h, 0, maxh);
+    if (expose.isEmpty())
+      continue;
+
+    gfx::Rect rc2;
+    if (newEngine) {
+      rc2 = expose;               // New engine, exposed rectangle (without zoom)
+      dest.x = dx + m_padding.x + m_proj.applyX(rc2.x);
+      dest.y = dy + m_padding.y + m_proj.applyY(rc2.y);
+      dest.w = m_proj.applyX(rc2.w);
+      dest.h = m_proj.applyY(rc2.h);
+    }
+    else {
+      rc2 = rc;                   // Old engine, same rectangle with zoom
+      dest.w = rc.w;
+      dest.h = rc.h;
+    }
+
+    exposeRgn |= gfx::Region(expose);
+    copies.push_back({ delta, rc2, dest, -1 });
   }
-  else {
-    rc2 = rc;                   // Old engine, same rectangle with zoom
-    dest.w = rc.w;
-    dest.h = rc.h;
+
+  if (copies.empty())
+    return;
+
+  // In tiled mode several copies show the same part of the sprite
+  // (or overlapped parts), so we render the union of those parts
+  // just once and draw each copy from it. Two rectangles are joined
+  // only if the union is not bigger than rendering both of them, so
+  // we never render more pixels than rendering each copy.
+  std::vector<gfx::Rect> renderRects;
+  for (Copy& copy : copies) {
+    for (int i=0; i<int(renderRects.size()); ++i) {
+      const gfx::Rect u = (renderRects[i] | copy.rc2);
+      if (int64_t(u.w)*u.h <= int64_t(renderRects[i].w)*renderRects[i].h +
+                              int64_t(copy.rc2.w)*copy.rc2.h) {
+        renderRects[i] = u;
+        copy.renderIndex = i;
+        break;
+      }
+    }
+    if (copy.renderIndex < 0) {
+      copy.renderIndex = int(renderRects.size());
+      renderRects.push_back(copy.rc2);
+    }
   }
 
   // Convert the render to a os::Surface
@@ -668,7 +718,7 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     // Generate a "expose sprite pixels" notification. This is used by
     // tool managers that need to validate this region (copy pixels from
     // the original cel) before it can be used by the RenderEngine.
-    m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
+    m_document->notifyExposeSpritePixels(m_sprite, exposeRgn);
 
     m_renderEngine->setNewBlendMethod(pref.experimental.newBlend());
     m_renderEngine->setRefLayersVisiblity(true);
@@ -713,35 +763,60 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         m_layer, m_frame);
     }
 
-    // Render background first (e.g. new ShaderRenderer will paint the
-    // background on the screen first and then composite the rendered
-    // sprite on it.)
-    if (renderProperties.renderBgOnScreen) {
-      m_renderEngine->setProjection(m_proj);
-      m_renderEngine->renderCheckeredBackground(
-        g->getInternalSurface(),
-        m_sprite,
-        gfx::Clip(dest.x + g->getInternalDeltaX(),
-                  dest.y + g->getInternalDeltaY(),
-                  m_proj.apply(rc2)));
-    }
+    // Reuse frames rendered in previous loops of the animation
+    m_renderEngine->setCacheSize(
+      m_isPlaying ? std::size_t(std::max(0, pref.editor.playbackCacheSize()))*1024*1024: 0);
+    m_renderEngine->setGroupCacheSize(
+      std::size_t(std::max(0, pref.editor.groupCacheSize()))*1024*1024);
+
+    for (int i=0; i<int(renderRects.size()); ++i) {
+      const gfx::Rect& renderRect = renderRects[i];
+
+      // Render background first (e.g. new ShaderRenderer will paint the
+      // background on the screen first and then composite the rendered
+      // sprite on it.)
+      if (renderProperties.renderBgOnScreen) {
+        m_renderEngine->setProjection(m_proj);
+        for (const Copy& copy : copies) {
+          if (copy.renderIndex == i) {
+            m_renderEngine->renderCheckeredBackground(
+              g->getInternalSurface(),
+              m_sprite,
+              gfx::Clip(copy.dest.x + g->getInternalDeltaX(),
+                        copy.dest.y + g->getInternalDeltaY(),
+                        m_proj.apply(copy.rc2)));
+          }
+        }
+      }
 
-    // Create a temporary surface to draw the sprite on it
-    if (!rendered ||
-        rendered->width() < rc2.w ||
-        rendered->height() < rc2.h ||
-        rendered->colorSpace() != m_document->osColorSpace()) {
-      const int maxw = std::max(rc2.w, rendered ? rendered->width(): 0);
-      const int maxh = std::max(rc2.h, rendered ? rendered->height(): 0);
-      rendered = os::instance()->makeRgbaSurface(
-        maxw, maxh, m_document->osColorSpace());
-    }
+      // Create a temporary surface to draw the sprite on it
+      if (!rendered ||
+          rendered->width() < renderRect.w ||
+          rendered->height() < renderRect.h ||
+          rendered->colorSpace() != m_document->osColorSpace()) {
+        const int maxw = std::max(renderRect.w, rendered ? rendered->width(): 0);
+        const int maxh = std::max(renderRect.h, rendered ? rendered->height(): 0);
+        rendered = os::instance()->makeRgbaSurface(
+          maxw, maxh, m_document->osColorSpace());
+      }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+      m_renderEngine->setProjection(
+        newEngine ? render::Projection(): m_proj);
+      m_renderEngine->renderSprite(
+        rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, renderRect));
+
+      // Draw all copies that use this same rendered surface
+      for (const Copy& copy : copies) {
+        if (copy.renderIndex == i) {
+          drawRenderedSpriteCopy(
+            g, rendered.get(),
+            gfx::Rect(copy.rc2).offset(-renderRect.origin()),
+            copy.dest, copy.delta);
+        }
+      }
+    }
 
+    m_renderEngine->setCacheSize(0);
     m_renderEngine->removeExtraImage();
 
     // If the checkered background is visible in this sprite, we save
@@ -750,12 +825,24 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       m_docPref.bg.forceSection();
   }
   catch (const std::exception& e) {
+    m_renderEngine->setCacheSize(0);
+    m_renderEngine->removeExtraImage();
     Console::showException(e);
   }
+}
+
+void Editor::drawRenderedSpriteCopy(ui::Graphics* g,
+                                    os::Surface* rendered,
+                                    const gfx::Rect& src,
+                                    const gfx::Rect& dest,
+                                    const gfx::Point& delta)
+{
+  const auto& pref = Preferences::instance();
+  const auto& renderProperties = m_renderEngine->properties();
 
   if (rendered && rendered->nativeHandle()) {
     os::Paint p;
-    if (newEngine) {
+    if (isUsingNewRenderEngine()) {
       os::Sampling sampling;
       p.srcEdges(os::Paint::SrcEdges::Fast); // Enable mipmaps if possible
 
@@ -783,15 +870,15 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
       else
         p.blendMode(os::BlendMode::Src);
 
-      g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, rc2.w, rc2.h),
+      g->drawSurface(rendered,
+                     src,
                      dest,
                      sampling,
                      &p);
     }
     else {
-      g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, dest.w, dest.h),
+      g->drawSurface(rendered,
+                     gfx::Rect(src.x, src.y, dest.w, dest.h),
                      gfx::Rect(dest.x, dest.y, dest.w, dest.h),
                      os::Sampling(os::Sampling::Filter::Nearest),
                      &p);
@@ -801,8 +888,8 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   // Draw grids
   {
     gfx::Rect enclosingRect(
-      m_padding.x + dx,
-      m_padding.y + dy,
+      m_padding.x + delta.x,
+      m_padding.y + delta.y,
       m_proj.applyX(m_sprite->width()),
       m_proj.applyY(m_sprite->height()));
 
@@ -896,35 +983,41 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_proj.applyY(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
+  // Positions of the main sprite at the center and its copies in
+  // tiled mode.
+  std::vector<gfx::Point> deltas;
+  deltas.reserve(9);
+  deltas.push_back(gfx::Point(0, 0));
 
   // Document preferences
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, 0);
+    deltas.push_back(gfx::Point(spriteRect.w, 0));
+    deltas.push_back(gfx::Point(spriteRect.w*2, 0));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w*3, spriteRect.h);
   }
 
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h*2);
+    deltas.push_back(gfx::Point(0, spriteRect.h));
+    deltas.push_back(gfx::Point(0, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w, spriteRect.h*3);
   }
 
   if (m_docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h*2);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h*2);
+    deltas.push_back(gfx::Point(spriteRect.w,   spriteRect.h));
+    deltas.push_back(gfx::Point(spriteRect.w*2, spriteRect.h));
+    deltas.push_back(gfx::Point(spriteRect.w,   spriteRect.h*2));
+    deltas.push_back(gfx::Point(spriteRect.w*2, spriteRect.h*2));
 
     enclosingRect = gfx::Rect(
       spriteRect.x, spriteRect.y,
       spriteRect.w*3, spriteRect.h*3);
   }
 
+  // Render the sprite just once and draw it in each position.
+  drawOneSpriteUnclippedRect(g, rc, deltas);
+
   // Draw slices
   if (m_docPref.show.slices())
     drawSlices(g);
@@ -2873,6 +2966,7 @@ void Editor::stop()
       backToPreviousState();
 
     m_isPlaying = false;
+    m_renderEngine->clearCache();
 
     ASSERT(m_state && dynamic_cast<PlayState*>(m_state.get()));
     if (m_state)
@@ -41,6 +41,7 @@
 
 #include <memory>
 #include <set>
+#include <vector>
 
 namespace doc {
   class Layer;
@@ -393,10 +394,17 @@ namespace app {
 
     void setCursor(const gfx::Point& mouseDisplayPos);
 
-    // Draws the specified portion of sprite in the editor.  Warning:
-    // You should setup the clip of the screen before calling this
-    // routine.
-    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
+    // Draws the specified portion of sprite in the editor at each
+    // of the given deltas (several deltas in tiled mode), rendering
+    // the sprite just once.  Warning: You should setup the clip of
+    // the screen before calling this routine.
+    void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc,
+                                    const std::vector<gfx::Point>& deltas);
+    void drawRenderedSpriteCopy(ui::Graphics* g,
+                                os::Surface* rendered,
+                                const gfx::Rect& src,
+                                const gfx::Rect& dest,
+                                const gfx::Point& delta);
 
     gfx::Point calcExtraPadding(const render::Projection& proj);
 
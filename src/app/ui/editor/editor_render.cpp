@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -77,6 +77,28 @@ void EditorRender::setProjection(const render::Projection& projection)
   m_renderer->setProjection(projection);
 }
 
+void EditorRender::setCacheSize(const std::size_t maxMemSize)
+{
+  if (maxMemSize > 0) {
+    m_cache.setMaxMemSize(maxMemSize);
+    m_renderer->setCache(&m_cache);
+  }
+  else {
+    m_renderer->setCache(nullptr);
+  }
+}
+
+void EditorRender::clearCache()
+{
+  m_cache.clear();
+}
+
+void EditorRender::setGroupCacheSize(const std::size_t maxMemSize)
+{
+  m_groupCache.setMaxMemSize(maxMemSize);
+  m_renderer->setGroupCache(maxMemSize > 0 ? &m_groupCache: nullptr);
+}
+
 void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
 {
   DocumentPreferences& docPref = Preferences::instance().document(doc);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,9 @@
 #include "render/extra_type.h"
 #include "render/onionskin_options.h"
 #include "render/projection.h"
+#include "render/render_cache.h"
+
+#include <cstddef>
 
 namespace doc {
   class Cel;
@@ -60,6 +63,16 @@ namespace app {
 
     void setProjection(const render::Projection& projection);
 
+    // Enables the cache of rendered frames with the given memory
+    // budget (e.g. to play animations), or disables it with 0 bytes
+    // (cached frames are kept until clearCache() is called).
+    void setCacheSize(const std::size_t maxMemSize);
+    void clearCache();
+
+    // Enables the cache of pre-composited groups with the given
+    // memory budget, or disables it with 0 bytes.
+    void setGroupCacheSize(const std::size_t maxMemSize);
+
     void setupBackground(Doc* doc, doc::PixelFormat pixelFormat);
     void setTransparentBackground();
 
@@ -107,6 +120,8 @@ namespace app {
 
   private:
     std::unique_ptr<Renderer> m_renderer;
+    render::RenderCache m_cache;
+    render::RenderCache m_groupCache;
   };
 
 } // namespace app
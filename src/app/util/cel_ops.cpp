@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,7 @@
 #include "app/cmd/set_cel_position.h"
 #include "app/cmd_sequence.h"
 #include "app/doc.h"
+#include "app/util/parallel_for.h"
 #include "doc/algorithm/fill_selection.h"
 #include "doc/algorithm/flip_image.h"
 #include "doc/algorithm/resize_image.h"
@@ -46,6 +47,8 @@
 #include <algorithm>
 #include <cmath>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #define OPS_TRACE(...) // TRACE(__VA_ARGS__)
@@ -149,16 +152,51 @@ private:
   doc::algorithm::FlipType m_flipType;
 };
 
+// Minimum number of tiles that each thread must process in
+// process_tiles(), so we don't create threads to crop just a few
+// tiles (e.g. when we paint with a small brush).
+const int kMinTilesPerThread = 64;
+
+// Maximum number of tiles prepared at the same time, to limit the
+// memory used by the prepared tile images.
+const int kMaxTilesPerBatch = 4096;
+
+// Processes "n" tiles in batches: prepareTile(i) is called from
+// several threads to crop/preprocess/hash the tile "i" (so it cannot
+// modify the tileset or any other shared state), and then
+// mergeTile(i) is called from the current thread for each tile of
+// the batch in order, so the tileset is modified in the same order
+// as if all tiles were processed one after another.
+template<typename PrepareFunc, typename MergeFunc>
+void process_tiles(const int n,
+                   PrepareFunc&& prepareTile,
+                   MergeFunc&& mergeTile)
+{
+  for (int i0=0; i0<n; i0+=kMaxTilesPerBatch) {
+    const int i1 = std::min(n, i0+kMaxTilesPerBatch);
+    parallel_for(
+      i1-i0, parallel_for_threads(i1-i0, kMinTilesPerThread),
+      [i0, &prepareTile](const int i, const int) {
+        prepareTile(i0+i);
+      });
+
+    for (int i=i0; i<i1; ++i)
+      mergeTile(i);
+  }
+}
+
 // This is a terrible way to find tiles, i.e. flipping several times
 // the image, instead of searching for flipped hashes. In the future
-// we could try to improve it.
+// we could try to improve it. The "hash" is the hash of the
+// non-flipped tileImage (calculated when the tile is prepared).
 bool find_tile(doc::Tileset* tileset,
                doc::ImageRef& tileImage,
+               const uint64_t hash,
                doc::tile_index& tileIndex,
                doc::tile_flags& tileFlags)
 {
   // Find without flags
-  if (tileset->findTileIndex(tileImage, tileIndex)) {
+  if (tileset->findTileIndex(tileImage, hash, tileIndex)) {
     tileFlags = 0;
     return true;
   }
@@ -519,51 +557,93 @@ void draw_image_into_new_tilemap_cel(
     ASSERT(tilemapBounds.h == newTilemap->height());
   }
 
-  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds))) {
-    const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePt);
-    doc::ImageRef tileImage(
-      doc::crop_image(srcImage,
-                      tilePtInCanvas.x-srcImagePos.x,
-                      tilePtInCanvas.y-srcImagePos.y,
-                      tileSize.w, tileSize.h,
-                      srcImage->maskColor()));
-    if (grid.hasMask())
-      mask_image(tileImage.get(), grid.mask().get());
+  struct PreparedTile {
+    doc::ImageRef image;
+    uint64_t hash;
+  };
+
+  const std::vector<gfx::Point> tilePts =
+    grid.tilesInCanvasRegion(gfx::Region(canvasBounds));
+  std::vector<PreparedTile> preparedTiles(tilePts.size());
+
+  // Tiles that were already found/added in the tileset in this
+  // function, so we look up the tileset just once for each different
+  // tile image.
+  std::unordered_multimap<uint64_t,
+                          std::pair<doc::ImageRef, doc::tile_t>> knownTiles;
+
+  process_tiles(
+    int(tilePts.size()),
+    // Crop, preprocess, and hash each tile (in parallel)
+    [&](const int i) {
+      const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePts[i]);
+      doc::ImageRef tileImage(
+        doc::crop_image(srcImage,
+                        tilePtInCanvas.x-srcImagePos.x,
+                        tilePtInCanvas.y-srcImagePos.y,
+                        tileSize.w, tileSize.h,
+                        srcImage->maskColor()));
+      if (grid.hasMask())
+        mask_image(tileImage.get(), grid.mask().get());
 
-    preprocess_transparent_pixels(tileImage.get());
+      preprocess_transparent_pixels(tileImage.get());
 
-    doc::tile_index tileIndex;
-    doc::tile_flags tileFlag = 0;
+      preparedTiles[i].hash = calculate_image_hash(tileImage.get(),
+                                                   tileImage->bounds());
+      preparedTiles[i].image = std::move(tileImage);
+    },
+    // Find/add each tile in the tileset (in order)
+    [&](const int i) {
+      const gfx::Point& tilePt = tilePts[i];
+      const uint64_t hash = preparedTiles[i].hash;
+      doc::ImageRef tileImage = std::move(preparedTiles[i].image);
+      doc::tile_t tile = doc::notile;
+
+      const auto range = knownTiles.equal_range(hash);
+      auto it = range.first;
+      for (; it != range.second; ++it) {
+        if (is_same_image(it->second.first.get(), tileImage.get())) {
+          tile = it->second.second;
+          break;
+        }
+      }
 
-    if (!find_tile(tileset, tileImage, tileIndex, tileFlag)) {
-      auto addTile = new cmd::AddTile(tileset, tileImage);
+      if (it == range.second) {
+        doc::tile_index tileIndex;
+        doc::tile_flags tileFlag = 0;
 
-      if (cmds)
-        cmds->executeAndAdd(addTile);
-      else {
-        // TODO a little hacky
-        addTile->execute(doc->context());
-      }
+        if (!find_tile(tileset, tileImage, hash, tileIndex, tileFlag)) {
+          auto addTile = new cmd::AddTile(tileset, tileImage);
 
-      tileIndex = addTile->tileIndex();
+          if (cmds)
+            cmds->executeAndAdd(addTile);
+          else {
+            // TODO a little hacky
+            addTile->execute(doc->context());
+          }
 
-      if (!cmds)
-        delete addTile;
+          tileIndex = addTile->tileIndex();
 
-      doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tileIndex);
-    }
+          if (!cmds)
+            delete addTile;
 
-    // We were using newTilemap->putPixel() directly but received a
-    // crash report about an "access violation". So now we've added
-    // some checks to the operation.
-    {
-      const int u = tilePt.x-tilemapBounds.x;
-      const int v = tilePt.y-tilemapBounds.y;
-      ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
-      doc::put_pixel(newTilemap.get(), u, v,
-                     doc::tile(tileIndex, tileFlag));
-    }
-  }
+          doc->notifyAfterAddTile(dstLayer, dstCel->frame(), tileIndex);
+        }
+
+        tile = doc::tile(tileIndex, tileFlag);
+        knownTiles.emplace(hash, std::make_pair(tileImage, tile));
+      }
+
+      // We were using newTilemap->putPixel() directly but received a
+      // crash report about an "access violation". So now we've added
+      // some checks to the operation.
+      {
+        const int u = tilePt.x-tilemapBounds.x;
+        const int v = tilePt.y-tilemapBounds.y;
+        ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
+        doc::put_pixel(newTilemap.get(), u, v, tile);
+      }
+    });
 
   doc->notifyTilesetChanged(tileset);
 
@@ -659,6 +739,17 @@ void modify_tilemap_cel_region(
                  });
     }
 
+    struct TileToPatch {
+      gfx::Point tilePt;
+      int u, v;
+      doc::tile_t t;
+      doc::tile_index ti;
+      doc::ImageRef existentTileImage;
+      doc::ImageRef tileImage;
+      uint64_t hash;
+    };
+    std::vector<TileToPatch> tilesToPatch;
+
     for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(regionToPatch)) {
       const int u = tilePt.x-newTilemapBounds.x;
       const int v = tilePt.y-newTilemapBounds.y;
@@ -673,76 +764,99 @@ void modify_tilemap_cel_region(
         continue;
       }
 
-      const gfx::Rect tileInCanvasRc(grid.tileToCanvas(tilePt), tileSize);
-      ImageRef tileImage(getTileImage(existentTileImage, tileInCanvasRc));
-      if (grid.hasMask())
-        mask_image(tileImage.get(), grid.mask().get());
-
-      preprocess_transparent_pixels(tileImage.get());
-
-      doc::tile_index tileIndex;
-      doc::tile_flags tileFlag = 0;
-
-      if (find_tile(tileset, tileImage, tileIndex, tileFlag)) {
-        // We can re-use an existent tile (tileIndex) from the tileset
-      }
-      else if (tilesetMode == TilesetMode::Auto &&
-               t != doc::notile &&
-               ti >= 0 && ti < tilesHistogram.size() &&
-               // If the tile is just used once, we can modify this
-               // same tile
-               tilesHistogram[ti] == 1) {
-        // Common case: Re-utilize the same tile in Auto mode.
-        tileIndex = ti;
-        cmds->executeAndAdd(
-          new cmd::CopyTileRegion(
-            existentTileImage.get(),
-            tileImage.get(),
-            gfx::Region(tileImage->bounds()), // TODO calculate better region
-            gfx::Point(0, 0),
-            false,
-            tileIndex,
-            tileset));
-      }
-      else {
-        auto addTile = new cmd::AddTile(tileset, tileImage);
-        cmds->executeAndAdd(addTile);
-
-        tileIndex = addTile->tileIndex();
-      }
-
-      // If the tile changed, we have to remove the old tile index
-      // (ti) from the histogram count.
-      if (tilesetMode == TilesetMode::Auto &&
-          t != doc::notile &&
-          ti >= 0 && ti < tilesHistogram.size() &&
-          ti != tileIndex) {
-        --tilesHistogram[ti];
-
-        // It indicates that the tile "ti" was modified to
-        // "tileIndex", so then, in case that we have to remove tiles,
-        // we can check the ones that were modified & are unused.
-        modifiedTileIndexes[ti] = true;
-      }
+      tilesToPatch.push_back({ tilePt, u, v, t, ti, existentTileImage, nullptr, 0 });
+    }
 
-      OPS_TRACE(" - tile %d -> %d\n",
-                (t == doc::notile ? -1: ti),
-                tileIndex);
+    // The existent tile of each tile to patch is not modified by the
+    // other tiles (a tile is modified in-place only when it's used
+    // just once), so we can get the new tile images (and their
+    // hashes) in parallel.
+    process_tiles(
+      int(tilesToPatch.size()),
+      [&](const int i) {
+        TileToPatch& p = tilesToPatch[i];
+        const gfx::Rect tileInCanvasRc(grid.tileToCanvas(p.tilePt), tileSize);
+        ImageRef tileImage(getTileImage(p.existentTileImage, tileInCanvasRc));
+        if (grid.hasMask())
+          mask_image(tileImage.get(), grid.mask().get());
+
+        preprocess_transparent_pixels(tileImage.get());
+
+        p.hash = calculate_image_hash(tileImage.get(), tileImage->bounds());
+        p.tileImage = std::move(tileImage);
+      },
+      [&](const int i) {
+        const int u = tilesToPatch[i].u;
+        const int v = tilesToPatch[i].v;
+        const doc::tile_t t = tilesToPatch[i].t;
+        const doc::tile_index ti = tilesToPatch[i].ti;
+        const doc::ImageRef existentTileImage = std::move(tilesToPatch[i].existentTileImage);
+        ImageRef tileImage = std::move(tilesToPatch[i].tileImage);
+        const uint64_t hash = tilesToPatch[i].hash;
+
+        doc::tile_index tileIndex;
+        doc::tile_flags tileFlag = 0;
+
+        if (find_tile(tileset, tileImage, hash, tileIndex, tileFlag)) {
+          // We can re-use an existent tile (tileIndex) from the tileset
+        }
+        else if (tilesetMode == TilesetMode::Auto &&
+                 t != doc::notile &&
+                 ti >= 0 && ti < tilesHistogram.size() &&
+                 // If the tile is just used once, we can modify this
+                 // same tile
+                 tilesHistogram[ti] == 1) {
+          // Common case: Re-utilize the same tile in Auto mode.
+          tileIndex = ti;
+          cmds->executeAndAdd(
+            new cmd::CopyTileRegion(
+              existentTileImage.get(),
+              tileImage.get(),
+              gfx::Region(tileImage->bounds()), // TODO calculate better region
+              gfx::Point(0, 0),
+              false,
+              tileIndex,
+              tileset));
+        }
+        else {
+          auto addTile = new cmd::AddTile(tileset, tileImage);
+          cmds->executeAndAdd(addTile);
 
-      const doc::tile_t tile = doc::tile(tileIndex, tileFlag);
-      if (t != tile) {
-        newTilemap->putPixel(u, v, tile);
-        tilePtsRgn |= gfx::Region(gfx::Rect(u, v, 1, 1));
+          tileIndex = addTile->tileIndex();
+        }
 
-        // We add the new one tileIndex in the histogram count.
+        // If the tile changed, we have to remove the old tile index
+        // (ti) from the histogram count.
         if (tilesetMode == TilesetMode::Auto &&
-            tile != doc::notile &&
-            tileIndex >= 0 && tileIndex < tilesHistogram.size() &&
+            t != doc::notile &&
+            ti >= 0 && ti < tilesHistogram.size() &&
             ti != tileIndex) {
-          ++tilesHistogram[tileIndex];
+          --tilesHistogram[ti];
+
+          // It indicates that the tile "ti" was modified to
+          // "tileIndex", so then, in case that we have to remove tiles,
+          // we can check the ones that were modified & are unused.
+          modifiedTileIndexes[ti] = true;
         }
-      }
-    }
+
+        OPS_TRACE(" - tile %d -> %d\n",
+                  (t == doc::notile ? -1: ti),
+                  tileIndex);
+
+        const doc::tile_t tile = doc::tile(tileIndex, tileFlag);
+        if (t != tile) {
+          newTilemap->putPixel(u, v, tile);
+          tilePtsRgn |= gfx::Region(gfx::Rect(u, v, 1, 1));
+
+          // We add the new one tileIndex in the histogram count.
+          if (tilesetMode == TilesetMode::Auto &&
+              tile != doc::notile &&
+              tileIndex >= 0 && tileIndex < tilesHistogram.size() &&
+              ti != tileIndex) {
+            ++tilesHistogram[tileIndex];
+          }
+        }
+      });
 
     if (newTilemap->width() != cel->image()->width() ||
         newTilemap->height() != cel->image()->height()) {
@@ -0,0 +1,103 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/util/cel_ops.h"
+#include "doc/doc.h"
+#include "doc/grid.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "gfx/region.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace app;
+using namespace doc;
+
+// Tiles are prepared (and hashed) in parallel and then merged in the
+// tileset in order, so the tile indexes must be the same as adding
+// each tile one after another.
+TEST(CelOps, DrawImageIntoNewTilemapCel)
+{
+  app::Context ctx;
+  const gfx::Size tileSize(8, 8);
+  const int w = 80*tileSize.w;  // 80x64 tiles (more than one batch)
+  const int h = 64*tileSize.h;
+  const int ndifferentTiles = 50;
+
+  std::unique_ptr<Doc> doc(ctx.documents().add(w, h, ColorMode::RGB, 256));
+  Sprite* sprite = doc->sprite();
+  const Grid grid(tileSize);
+  auto tileset = new Tileset(sprite, grid, 1);
+  const tileset_index tsi = sprite->tilesets()->add(tileset);
+  auto layer = new LayerTilemap(sprite, tsi);
+  sprite->root()->addLayer(layer);
+  auto cel = new Cel(frame_t(0), ImageRef(Image::create(IMAGE_TILEMAP, 1, 1)));
+  layer->addCel(cel);
+
+  // Image with a few different tiles repeated in random positions
+  // (and some empty tiles)
+  ImageRef srcImage(Image::create(IMAGE_RGB, w, h));
+  clear_image(srcImage.get(), 0);
+  std::mt19937 rng(1);
+  for (int v=0; v<h/tileSize.h; ++v) {
+    for (int u=0; u<w/tileSize.w; ++u) {
+      const int k = rng() % (ndifferentTiles+1);
+      if (k == ndifferentTiles)
+        continue;
+      const int x = u*tileSize.w;
+      const int y = v*tileSize.h;
+      fill_rect(srcImage.get(), x, y, x+tileSize.w-1, y+tileSize.h-1,
+                rgba(k*5, 255-k*5, 128, 255));
+      put_pixel(srcImage.get(), x+(k%tileSize.w), y+(k/tileSize.w)%tileSize.h,
+                rgba(0, 0, k, 128));
+    }
+  }
+
+  ImageRef newTilemap;
+  draw_image_into_new_tilemap_cel(
+    nullptr, layer, cel, srcImage.get(),
+    gfx::Point(0, 0), gfx::Point(0, 0), srcImage->bounds(),
+    newTilemap);
+  ASSERT_TRUE(newTilemap != nullptr);
+  ASSERT_EQ(w/tileSize.w, newTilemap->width());
+  ASSERT_EQ(h/tileSize.h, newTilemap->height());
+
+  // Add the same tiles one after another in other tileset
+  std::unique_ptr<Tileset> expected(new Tileset(sprite, grid, 1));
+  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(srcImage->bounds()))) {
+    const gfx::Point pt = grid.tileToCanvas(tilePt);
+    ImageRef tileImage(crop_image(srcImage.get(), pt.x, pt.y,
+                                  tileSize.w, tileSize.h,
+                                  srcImage->maskColor()));
+    preprocess_transparent_pixels(tileImage.get());
+
+    tile_index ti;
+    if (!expected->findTileIndex(tileImage, ti))
+      ti = expected->add(tileImage);
+
+    // The same index with the hash calculated before
+    tile_index ti2;
+    ASSERT_TRUE(expected->findTileIndex(
+                  tileImage,
+                  calculate_image_hash(tileImage.get(), tileImage->bounds()),
+                  ti2));
+    EXPECT_EQ(ti, ti2);
+
+    EXPECT_EQ(ti, tile_geti(get_pixel(newTilemap.get(), tilePt.x, tilePt.y)));
+  }
+  EXPECT_EQ(ndifferentTiles+1, expected->size());
+  EXPECT_EQ(expected->size(), tileset->size());
+
+  doc->close();
+}
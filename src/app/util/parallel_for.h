@@ -0,0 +1,90 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_PARALLEL_FOR_H_INCLUDED
+#define APP_UTIL_PARALLEL_FOR_H_INCLUDED
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+  // Returns the number of threads to process "n" items in parallel:
+  // one thread for each CPU core, but each thread must process at
+  // least minItemsPerThread items.
+  inline int parallel_for_threads(const int n,
+                                  const int minItemsPerThread = 1) {
+    return std::clamp(int(std::thread::hardware_concurrency()), 1,
+                      std::max(1, n / std::max(1, minItemsPerThread)));
+  }
+
+  // Calls func(i, thread) for each i in [0, n) from "nthreads"
+  // threads. Items are processed in any order, and "thread" is the
+  // index of the worker that processes the item (0 is the current
+  // thread, which is one of the workers), so func() can use data for
+  // each thread or report progress only from the current thread.
+  //
+  // If func() throws an exception, the remaining items are skipped
+  // and the first exception is thrown again from the current thread.
+  template<typename Func>
+  void parallel_for(const int n, const int nthreads, Func&& func) {
+    if (n <= 0)
+      return;
+
+    if (nthreads <= 1) {
+      for (int i=0; i<n; ++i)
+        func(i, 0);
+      return;
+    }
+
+    std::atomic<int> next(0);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto worker = [&](const int thread) {
+      int i;
+      while ((i = next++) < n) {
+        try {
+          func(i, thread);
+        }
+        catch (...) {
+          const std::lock_guard lock(errorMutex);
+          if (!error)
+            error = std::current_exception();
+          next = n;
+        }
+      }
+    };
+
+    const int nworkers = std::min(nthreads, n);
+    std::vector<std::thread> threads;
+    threads.reserve(nworkers-1);
+    for (int t=1; t<nworkers; ++t)
+      threads.emplace_back(worker, t);
+
+    worker(0);
+
+    for (auto& thread : threads)
+      thread.join();
+
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  template<typename Func>
+  void parallel_for(const int n, Func&& func) {
+    parallel_for(n, parallel_for_threads(n), std::forward<Func>(func));
+  }
+
+} // namespace app
+
+#endif
@@ -0,0 +1,61 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/util/parallel_for.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace app;
+
+TEST(ParallelFor, AllItemsOnce)
+{
+  for (int nthreads : { 1, 2, 4, 16 }) {
+    for (int n : { 0, 1, 3, 100, 1000 }) {
+      std::vector<std::atomic<int>> count(n);
+      std::atomic<int> badThread(0);
+      parallel_for(
+        n, nthreads,
+        [&](const int i, const int thread) {
+          ++count[i];
+          if (thread < 0 || thread >= nthreads)
+            ++badThread;
+        });
+      for (int i=0; i<n; ++i)
+        EXPECT_EQ(1, count[i]);
+      EXPECT_EQ(0, badThread);
+    }
+  }
+}
+
+TEST(ParallelFor, Exception)
+{
+  for (int nthreads : { 1, 4 }) {
+    std::atomic<int> done(0);
+    EXPECT_THROW(
+      parallel_for(
+        1000, nthreads,
+        [&](const int i, const int) {
+          if (i == 10)
+            throw std::runtime_error("error");
+          ++done;
+        }),
+      std::runtime_error);
+    EXPECT_LT(done, 1000);
+  }
+}
+
+TEST(ParallelFor, Threads)
+{
+  EXPECT_EQ(1, parallel_for_threads(0));
+  EXPECT_EQ(1, parallel_for_threads(1));
+  EXPECT_EQ(1, parallel_for_threads(63, 64));
+  EXPECT_LE(parallel_for_threads(1000), 1000);
+  EXPECT_GE(parallel_for_threads(1000), 1);
+}
@@ -0,0 +1,465 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/undo_buffer.h"
+
+#include "base/debug.h"
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/process.h"
+#include "base/string.h"
+#include "base/thread.h"
+#include "fmt/format.h"
+
+#include "zlib.h"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+  #include <io.h>
+#else
+  #include <unistd.h>
+#endif
+
+#define UNDOBUF_TRACE(...) // TRACEARGS
+
+namespace app {
+
+namespace {
+
+// Creates a new empty file with a random name in the temporary
+// directory. The file is created in exclusive mode, so we never
+// open a file (or a symlink) that already existed with that name.
+bool create_unique_temp_file(std::string& fn)
+{
+  std::random_device rd;
+  for (int tries=0; tries<16; ++tries) {
+    fn = base::join_path(
+      base::get_temp_path(),
+      fmt::format("aseprite-undo-{}-{:08x}.tmp",
+                  base::get_current_process_id(), rd()));
+#ifdef _WIN32
+    const int fd = _wopen(base::from_utf8(fn).c_str(),
+                          _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY,
+                          _S_IREAD | _S_IWRITE);
+    if (fd >= 0) {
+      _close(fd);
+      return true;
+    }
+#else
+    const int fd = open(fn.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0) {
+      close(fd);
+      return true;
+    }
+#endif
+    if (errno != EEXIST)
+      break;
+  }
+  fn.clear();
+  return false;
+}
+
+// Temporary file shared by all undo buffers moved to disk. Free
+// blocks (from buffers that were read again or deleted) are reused.
+class SwapFile {
+public:
+  struct Block {
+    std::streamoff offset = 0;
+    std::streamoff size = 0;
+  };
+
+  ~SwapFile() {
+    if (m_file.is_open()) {
+      m_file.close();
+      try {
+        base::delete_file(m_fn);
+      }
+      catch (...) {
+        // Ignore errors deleting the file
+      }
+    }
+  }
+
+  // Returns false if the data cannot be written (e.g. there is no
+  // space left on disk).
+  bool write(const base::buffer& data, Block& block) {
+    const std::lock_guard lock(m_mutex);
+    if (!m_file.is_open()) {
+      if (!create_unique_temp_file(m_fn))
+        return false;
+
+      m_file.open(FSTREAM_PATH(m_fn),
+                  std::ios::binary | std::ios::in | std::ios::out);
+      if (!m_file.is_open()) {
+        try {
+          base::delete_file(m_fn);
+        }
+        catch (...) {
+          // Ignore errors deleting the file
+        }
+        return false;
+      }
+    }
+
+    block = allocBlock(std::streamoff(data.size()));
+    m_file.seekp(block.offset);
+    m_file.write((const char*)data.data(), data.size());
+    if (!m_file) {
+      m_file.clear();
+      freeBlock(block);
+      return false;
+    }
+    UNDOBUF_TRACE("UNDOBUF: Write", block.size, "bytes at", block.offset);
+    return true;
+  }
+
+  void read(const Block& block, base::buffer& data) {
+    const std::lock_guard lock(m_mutex);
+    data.resize(block.size);
+    m_file.seekg(block.offset);
+    m_file.read((char*)data.data(), data.size());
+    if (!m_file) {
+      m_file.clear();
+      throw base::Exception("Error reading undo data from the temporary file %s",
+                            m_fn.c_str());
+    }
+    UNDOBUF_TRACE("UNDOBUF: Read", block.size, "bytes at", block.offset);
+  }
+
+  void free(const Block& block) {
+    const std::lock_guard lock(m_mutex);
+    freeBlock(block);
+  }
+
+private:
+  Block allocBlock(const std::streamoff size) {
+    // First fit
+    for (auto it=m_free.begin(); it!=m_free.end(); ++it) {
+      if (it->second >= size) {
+        Block block{ it->first, size };
+        if (it->second > size)
+          m_free[it->first + size] = it->second - size;
+        m_free.erase(it);
+        return block;
+      }
+    }
+    Block block{ m_end, size };
+    m_end += size;
+    return block;
+  }
+
+  void freeBlock(Block block) {
+    // Join with the next free block
+    auto next = m_free.find(block.offset + block.size);
+    if (next != m_free.end()) {
+      block.size += next->second;
+      m_free.erase(next);
+    }
+
+    // Join with the previous free block
+    auto it = m_free.lower_bound(block.offset);
+    if (it != m_free.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second == block.offset) {
+        block.offset = prev->first;
+        block.size += prev->second;
+        m_free.erase(prev);
+      }
+    }
+
+    if (block.offset + block.size == m_end)
+      m_end = block.offset;
+    else
+      m_free[block.offset] = block.size;
+  }
+
+  std::mutex m_mutex;
+  std::string m_fn;
+  std::fstream m_file;
+  std::streamoff m_end = 0;
+  std::map<std::streamoff, std::streamoff> m_free; // offset -> size
+};
+
+// Background thread to compress/move undo buffers to disk.
+class Worker {
+public:
+  ~Worker() {
+    {
+      const std::lock_guard lock(m_mutex);
+      m_done = true;
+      m_tasks.clear();
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void add(std::function<void()>&& task) {
+    const std::lock_guard lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+    if (!m_thread.joinable())
+      m_thread = std::thread([this]{ backgroundThread(); });
+    else
+      m_cv.notify_one();
+  }
+
+  void waitAll() {
+    std::unique_lock lock(m_mutex);
+    m_idle.wait(lock, [this]{ return m_tasks.empty() && !m_running; });
+  }
+
+  bool hasTasks() {
+    const std::lock_guard lock(m_mutex);
+    return !m_tasks.empty() || m_running;
+  }
+
+private:
+  void backgroundThread() {
+    base::this_thread::set_name("undo-buffers");
+
+    std::unique_lock lock(m_mutex);
+    while (!m_done) {
+      if (m_tasks.empty()) {
+        m_cv.wait(lock);
+        continue;
+      }
+
+      std::function<void()> task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+      m_running = true;
+
+      lock.unlock();
+      try {
+        task();
+      }
+      catch (...) {
+        // Ignore errors, the buffer stays in its previous state
+      }
+      task = nullptr;
+      lock.lock();
+
+      m_running = false;
+      m_idle.notify_all();
+    }
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::condition_variable m_idle;
+  std::deque<std::function<void()>> m_tasks;
+  std::thread m_thread;
+  bool m_running = false;
+  bool m_done = false;
+};
+
+// The swap file is created the first time it's used, and deleted
+// when the last buffer that references it is destroyed (buffers can
+// be destroyed after this static pointer, e.g. in documents that
+// are deleted at exit).
+const std::shared_ptr<SwapFile>& swap_file()
+{
+  static auto file = std::make_shared<SwapFile>();
+  return file;
+}
+
+// The swap file pointer is created before the worker, so the worker
+// is destroyed first and there are no tasks using the file after
+// that.
+Worker& worker()
+{
+  swap_file();
+  static Worker worker;
+  return worker;
+}
+
+} // anonymous namespace
+
+struct UndoBuffer::Data {
+  std::mutex mutex;
+  State state = State::Raw;
+  State target = State::Raw;     // State requested by pack()
+  bool queued = false;           // True if there is a task in the worker
+  base::buffer raw;              // Uncompressed data (State::Raw)
+  base::buffer packed;           // Packed data (State::Compressed)
+  bool isCompressed = false;     // False if "packed" is the raw data (it couldn't be compressed)
+  size_t rawSize = 0;
+  std::shared_ptr<SwapFile> swapFile; // Swap file (State::OnDisk)
+  SwapFile::Block block;         // Location in the swap file (State::OnDisk)
+  std::atomic<size_t> memSize { 0 }; // Last known memory usage
+
+  ~Data() {
+    if (state == State::OnDisk)
+      swapFile->free(block);
+  }
+
+  void runPackTask() {
+    const std::lock_guard lock(mutex);
+    queued = false;
+
+    if (state == State::Raw && target != State::Raw)
+      compress();
+    if (state == State::Compressed && target == State::OnDisk)
+      moveToDisk();
+    target = state;
+  }
+
+  void compress() {
+    ASSERT(state == State::Raw);
+    rawSize = raw.size();
+
+    uLongf size = compressBound(uLong(rawSize));
+    packed.resize(size);
+    if (compress2(packed.data(), &size, raw.data(), uLong(rawSize),
+                  Z_BEST_SPEED) == Z_OK &&
+        size < rawSize) {
+      packed.resize(size);
+      packed.shrink_to_fit();
+      isCompressed = true;
+    }
+    else {
+      packed = std::move(raw);
+      isCompressed = false;
+    }
+    base::buffer().swap(raw);
+    state = State::Compressed;
+    updateMemSize();
+
+    UNDOBUF_TRACE("UNDOBUF: Compress", rawSize, "->", packed.size());
+  }
+
+  void moveToDisk() {
+    ASSERT(state == State::Compressed);
+    std::shared_ptr<SwapFile> file = swap_file();
+    if (file->write(packed, block)) {
+      swapFile = std::move(file);
+      base::buffer().swap(packed);
+      state = State::OnDisk;
+      updateMemSize();
+    }
+  }
+
+  void unpack() {
+    if (state == State::OnDisk) {
+      swapFile->read(block, packed);
+      swapFile->free(block);
+      swapFile.reset();
+      state = State::Compressed;
+    }
+
+    if (state == State::Compressed) {
+      if (isCompressed) {
+        raw.resize(rawSize);
+        uLongf size = uLong(rawSize);
+        if (uncompress(raw.data(), &size, packed.data(), uLong(packed.size())) != Z_OK ||
+            size != rawSize) {
+          base::buffer().swap(raw);
+          throw base::Exception("Error decompressing undo data");
+        }
+      }
+      else {
+        raw = std::move(packed);
+      }
+      base::buffer().swap(packed);
+      state = State::Raw;
+    }
+    updateMemSize();
+  }
+
+  void updateMemSize() {
+    switch (state) {
+      case State::Raw:        memSize = raw.size(); break;
+      case State::Compressed: memSize = packed.size(); break;
+      case State::OnDisk:     memSize = 0; break;
+    }
+  }
+};
+
+UndoBuffer::UndoBuffer()
+  : m_data(std::make_shared<Data>())
+{
+}
+
+UndoBuffer::~UndoBuffer()
+{
+  // Avoid packing the data if there is a pending task
+  const std::lock_guard lock(m_data->mutex);
+  m_data->target = State::Raw;
+}
+
+base::buffer& UndoBuffer::buffer()
+{
+  const std::lock_guard lock(m_data->mutex);
+  // Cancel any pending task
+  m_data->target = State::Raw;
+  m_data->unpack();
+  return m_data->raw;
+}
+
+size_t UndoBuffer::memSize() const
+{
+  // If a background task is packing the buffer we don't want to
+  // wait, so we return the last known size. In other case we
+  // recalculate the size because the raw buffer can be modified by
+  // the caller of buffer().
+  std::unique_lock lock(m_data->mutex, std::try_to_lock);
+  if (lock.owns_lock())
+    m_data->updateMemSize();
+  return m_data->memSize;
+}
+
+UndoBuffer::State UndoBuffer::state() const
+{
+  const std::lock_guard lock(m_data->mutex);
+  return m_data->state;
+}
+
+void UndoBuffer::pack(const State state)
+{
+  const std::lock_guard lock(m_data->mutex);
+  Data* data = m_data.get();
+  if (int(state) <= int(data->state) ||
+      int(state) <= int(data->target) ||
+      (data->state == State::Raw && data->raw.empty()))
+    return;
+
+  data->target = state;
+  if (!data->queued) {
+    data->queued = true;
+    worker().add([data = m_data]{ data->runPackTask(); });
+  }
+}
+
+// static
+void UndoBuffer::waitPendingTasks()
+{
+  worker().waitAll();
+}
+
+// static
+bool UndoBuffer::hasPendingTasks()
+{
+  return worker().hasTasks();
+}
+
+} // namespace app
@@ -0,0 +1,69 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_UNDO_BUFFER_H_INCLUDED
+#define APP_UTIL_UNDO_BUFFER_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+
+#include <memory>
+
+namespace app {
+
+  // Buffer used by undo commands (e.g. cmd::CopyRegion) to save
+  // pixels. When the command is far from the current undo state, the
+  // buffer can be compressed and even moved to a temporary file in a
+  // background thread, so the undo history uses less memory. The
+  // original data is restored automatically when buffer() is called
+  // (i.e. when the command is undone/redone).
+  class UndoBuffer {
+  public:
+    enum class State {
+      Raw,                      // Uncompressed in memory
+      Compressed,               // Compressed in memory
+      OnDisk,                   // Compressed in the temporary swap file
+    };
+
+    UndoBuffer();
+    ~UndoBuffer();
+
+    // Returns the uncompressed data. If a background thread is
+    // compressing the buffer, we wait until it finishes, and then the
+    // data is decompressed (or read from disk) if it's needed. Throws
+    // a base::Exception if the data cannot be read from disk.
+    base::buffer& buffer();
+
+    // Returns the memory used by this buffer right now (it changes
+    // when a background task finishes).
+    size_t memSize() const;
+
+    State state() const;
+
+    // Compresses the buffer (Compressed), or compresses it and moves
+    // it to the temporary swap file (OnDisk) in a background thread.
+    // Does nothing if the buffer is already in that state (or in a
+    // more packed state).
+    void pack(const State state);
+
+    // Waits all the pending background tasks (used in tests).
+    static void waitPendingTasks();
+
+    // Returns true if a background task is (or will be) packing a
+    // buffer, i.e. the memSize() of some buffers can still change.
+    static bool hasPendingTasks();
+
+  private:
+    struct Data;
+    std::shared_ptr<Data> m_data;
+
+    DISABLE_COPYING(UndoBuffer);
+  };
+
+} // namespace app
+
+#endif
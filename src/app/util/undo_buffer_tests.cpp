@@ -0,0 +1,109 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/util/undo_buffer.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace app;
+
+static base::buffer random_data(const size_t size, const bool compressible)
+{
+  std::mt19937 rng(static_cast<uint32_t>(size));
+  base::buffer data(size);
+  for (size_t i=0; i<size; ++i)
+    data[i] = (compressible ? (i / 64) & 0xff: rng() & 0xff);
+  return data;
+}
+
+static void test_pack(const base::buffer& data, const UndoBuffer::State state)
+{
+  UndoBuffer buf;
+  buf.buffer() = data;
+  EXPECT_EQ(data.size(), buf.memSize());
+
+  buf.pack(state);
+  UndoBuffer::waitPendingTasks();
+  EXPECT_EQ(state, buf.state());
+  if (state == UndoBuffer::State::OnDisk) {
+    EXPECT_EQ(size_t(0), buf.memSize());
+  }
+  else {
+    EXPECT_LE(buf.memSize(), data.size());
+  }
+
+  // Packing again to a less packed state does nothing
+  buf.pack(UndoBuffer::State::Compressed);
+  UndoBuffer::waitPendingTasks();
+  EXPECT_EQ(state, buf.state());
+
+  EXPECT_EQ(data, buf.buffer());
+  EXPECT_EQ(UndoBuffer::State::Raw, buf.state());
+  EXPECT_EQ(data.size(), buf.memSize());
+}
+
+TEST(UndoBuffer, Compressed)
+{
+  test_pack(random_data(4096, true), UndoBuffer::State::Compressed);
+  test_pack(random_data(4096, false), UndoBuffer::State::Compressed);
+  test_pack(random_data(1, false), UndoBuffer::State::Compressed);
+
+  UndoBuffer buf;
+  buf.buffer() = random_data(64*1024, true);
+  buf.pack(UndoBuffer::State::Compressed);
+  UndoBuffer::waitPendingTasks();
+  EXPECT_LT(buf.memSize(), size_t(64*1024));
+}
+
+TEST(UndoBuffer, OnDisk)
+{
+  test_pack(random_data(4096, true), UndoBuffer::State::OnDisk);
+  test_pack(random_data(4096, false), UndoBuffer::State::OnDisk);
+
+  // Several buffers in the swap file at the same time (freed blocks
+  // are reused)
+  std::vector<base::buffer> data;
+  std::vector<std::unique_ptr<UndoBuffer>> bufs;
+  for (int i=0; i<16; ++i) {
+    data.push_back(random_data(1000 + i*100, (i & 1) == 1));
+    bufs.push_back(std::make_unique<UndoBuffer>());
+    bufs.back()->buffer() = data.back();
+    bufs.back()->pack(UndoBuffer::State::OnDisk);
+  }
+  for (int i=0; i<16; i+=2) {
+    EXPECT_EQ(data[i], bufs[i]->buffer());
+    bufs[i]->pack(UndoBuffer::State::OnDisk);
+  }
+  bufs.resize(8);
+  UndoBuffer::waitPendingTasks();
+  for (int i=0; i<8; ++i)
+    EXPECT_EQ(data[i], bufs[i]->buffer());
+}
+
+TEST(UndoBuffer, EmptyBuffer)
+{
+  UndoBuffer buf;
+  buf.pack(UndoBuffer::State::OnDisk);
+  UndoBuffer::waitPendingTasks();
+  EXPECT_EQ(UndoBuffer::State::Raw, buf.state());
+  EXPECT_EQ(size_t(0), buf.memSize());
+  EXPECT_TRUE(buf.buffer().empty());
+}
+
+TEST(UndoBuffer, CancelPendingTask)
+{
+  const base::buffer data = random_data(1024*1024, true);
+  UndoBuffer buf;
+  buf.buffer() = data;
+  buf.pack(UndoBuffer::State::OnDisk);
+  EXPECT_EQ(data, buf.buffer());
+  UndoBuffer::waitPendingTasks();
+  EXPECT_EQ(UndoBuffer::State::Raw, buf.state());
+}
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -27,7 +27,9 @@
 #include "gfx/color_space.h"
 #include "zlib.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <vector>
 
 namespace dio {
@@ -388,8 +390,13 @@ void AsepriteDecoder::readFrameHeader(AsepriteFrameHeader* frame_header)
 
 void AsepriteDecoder::readPadding(int bytes)
 {
-  for (int c=0; c<bytes; c++)
-    read8();
+  uint8_t buf[32];
+  while (bytes > 0) {
+    const int n = std::min(bytes, int(sizeof(buf)));
+    if (readBytes(buf, n) != size_t(n))
+      break;
+    bytes -= n;
+  }
 }
 
 std::string AsepriteDecoder::readString()
@@ -398,74 +405,30 @@ std::string AsepriteDecoder::readString()
   if (length == EOF)
     return "";
 
-  std::string string;
-  string.reserve(length+1);
-
-  for (int c=0; c<length; c++)
-    string.push_back(read8());
-
+  std::string string(length, 0);
+  if (length > 0) {
+    size_t n = readBytes((uint8_t*)&string[0], length);
+    string.resize(n);
+  }
   return string;
 }
 
 float AsepriteDecoder::readFloat()
 {
-  int b1, b2, b3, b4;
-
-  if ((b1 = read8()) == EOF)
-    return EOF;
-
-  if ((b2 = read8()) == EOF)
-    return EOF;
-
-  if ((b3 = read8()) == EOF)
-    return EOF;
-
-  if ((b4 = read8()) == EOF)
-    return EOF;
-
   // Little endian.
-  int v = ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
-  return *reinterpret_cast<float*>(&v);
+  const uint32_t v = read32();
+  float value;
+  std::memcpy(&value, &v, sizeof(value));
+  return value;
 }
 
 double AsepriteDecoder::readDouble()
 {
-  int b1, b2, b3, b4, b5, b6, b7, b8;
-
-  if ((b1 = read8()) == EOF)
-    return EOF;
-
-  if ((b2 = read8()) == EOF)
-    return EOF;
-
-  if ((b3 = read8()) == EOF)
-    return EOF;
-
-  if ((b4 = read8()) == EOF)
-    return EOF;
-
-  if ((b5 = read8()) == EOF)
-    return EOF;
-
-  if ((b6 = read8()) == EOF)
-    return EOF;
-
-  if ((b7 = read8()) == EOF)
-    return EOF;
-
-  if ((b8 = read8()) == EOF)
-    return EOF;
-
   // Little endian.
-  long long v = (((long long)b8 << 56) |
-                 ((long long)b7 << 48) |
-                 ((long long)b6 << 40) |
-                 ((long long)b5 << 32) |
-                 ((long long)b4 << 24) |
-                 ((long long)b3 << 16) |
-                 ((long long)b2 << 8) |
-                 (long long)b1);
-  return *reinterpret_cast<double*>(&v);
+  const uint64_t v = read64();
+  double value;
+  std::memcpy(&value, &v, sizeof(value));
+  return value;
 }
 
 doc::Palette* AsepriteDecoder::readColorChunk(doc::Palette* prevPal,
@@ -656,14 +619,19 @@ void read_raw_image_templ(FileInterface* f,
                           const AsepriteHeader* header)
 {
   PixelIO<ImageTraits> pixel_io;
-  int x, y;
-  int w = image->width();
-  int h = image->height();
-
-  for (y=0; y<h; ++y) {
-    for (x=0; x<w; ++x) {
-      doc::put_pixel_fast<ImageTraits>(image, x, y, pixel_io.read_pixel(f));
-    }
+  const int w = image->width();
+  const int h = image->height();
+  std::vector<uint8_t> scanline(image->widthBytes());
+
+  // Read each scanline with just one readBytes() call
+  for (int y=0; y<h; ++y) {
+    const size_t n = f->readBytes(&scanline[0], scanline.size());
+    if (n < scanline.size())
+      std::fill(scanline.begin()+n, scanline.end(), 0);
+
+    pixel_io.read_scanline(
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y),
+      w, &scanline[0]);
     delegate->progress((float)f->tell() / (float)header->size);
   }
 }
@@ -839,6 +807,89 @@ void read_compressed_image(FileInterface* f,
   }
 }
 
+// Used to read the compressed data of a cel from memory
+class MemoryFileInterface : public FileInterface {
+public:
+  MemoryFileInterface(const uint8_t* data, const size_t size)
+    : m_data(data)
+    , m_size(size)
+    , m_pos(0)
+    , m_ok(true) {
+  }
+
+  bool ok() const override { return m_ok; }
+  size_t tell() override { return m_pos; }
+  void seek(size_t absPos) override { m_pos = std::min(absPos, m_size); }
+
+  uint8_t read8() override {
+    if (m_pos < m_size)
+      return m_data[m_pos++];
+    m_ok = false;
+    return 0;
+  }
+
+  size_t readBytes(uint8_t* buf, size_t n) override {
+    const size_t n2 = std::min(n, m_size - m_pos);
+    std::copy(m_data+m_pos, m_data+m_pos+n2, buf);
+    m_pos += n2;
+    if (n2 != n)
+      m_ok = false;
+    return n2;
+  }
+
+  void write8(uint8_t value) override {
+    // Do nothing, it's read-only
+  }
+
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+};
+
+// Inflates the pixels of a compressed cel the first time the cel
+// image is accessed.
+class CompressedCelLoader : public doc::CelImageLoader {
+public:
+  CompressedCelLoader(const doc::PixelFormat pixelFormat,
+                      const gfx::Size& size,
+                      const doc::color_t maskColor,
+                      std::vector<uint8_t>&& data)
+    : m_pixelFormat(pixelFormat)
+    , m_size(size)
+    , m_maskColor(maskColor)
+    , m_data(std::move(data)) {
+  }
+
+  doc::ImageRef loadImage() override {
+    doc::ImageRef image(doc::Image::create(m_pixelFormat, m_size.w, m_size.h));
+    image->setMaskColor(m_maskColor);
+
+    // Errors are ignored, we read all the pixels we can (as in
+    // AsepriteDecoder::readCelChunk())
+    MemoryFileInterface f(m_data.data(), m_data.size());
+    DecodeDelegate delegate;
+    AsepriteHeader header;
+    header.size = m_data.size();
+    read_compressed_image(&f, &delegate, image.get(), &header, m_data.size());
+
+    m_data.clear();
+    m_data.shrink_to_fit();
+    return image;
+  }
+
+  int getMemSize() const override {
+    return sizeof(CompressedCelLoader) + int(m_data.size());
+  }
+
+private:
+  doc::PixelFormat m_pixelFormat;
+  gfx::Size m_size;
+  doc::color_t m_maskColor;
+  std::vector<uint8_t> m_data;
+};
+
 } // anonymous namespace
 
 //////////////////////////////////////////////////////////////////////
@@ -932,10 +983,26 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int h = read16();
 
       if (w > 0 && h > 0) {
-        doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+        if (delegate()->loadCelsLazily()) {
+          // Keep the compressed data to inflate it when it's needed
+          std::vector<uint8_t> data(chunk_end > f()->tell() ? chunk_end - f()->tell(): 0);
+          if (!data.empty())
+            data.resize(readBytes(&data[0], data.size()));
+
+          cel = std::make_unique<doc::Cel>(frame, doc::ImageRef(nullptr));
+          cel->data()->setImageLoader(
+            gfx::Size(w, h),
+            std::make_unique<CompressedCelLoader>(
+              pixelFormat, gfx::Size(w, h),
+              sprite->transparentColor(),
+              std::move(data)));
+        }
+        else {
+          doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
+          read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
 
-        cel = std::make_unique<doc::Cel>(frame, image);
+          cel = std::make_unique<doc::Cel>(frame, image);
+        }
         cel->setPosition(x, y);
         cel->setOpacity(opacity);
         cel->setZIndex(zIndex);
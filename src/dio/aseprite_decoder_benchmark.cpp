@@ -0,0 +1,199 @@
+// Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/string.h"
+#include "dio/aseprite_common.h"
+#include "dio/aseprite_decoder.h"
+#include "dio/decode_delegate.h"
+#include "dio/file_interface.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace dio;
+
+namespace {
+
+// Writes a .aseprite file with raw (uncompressed) RGB cels, so the
+// decoding time is dominated by the I/O calls.
+class SyntheticFile {
+public:
+  SyntheticFile(const int w, const int h,
+                const int nlayers, const int nframes)
+    : m_file(std::tmpfile()) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> pixels(4*w*h);
+    for (uint8_t& p : pixels)
+      p = rng();
+
+    // Header
+    const size_t celSize = 6+16+4+pixels.size();
+    std::string name = "Layer";
+    const size_t layerSize = 6+16+2+name.size();
+    const size_t frameSize = 16 + nlayers*celSize;
+    write32(128 + nframes*frameSize + nlayers*layerSize);
+    write16(ASE_FILE_MAGIC);
+    write16(nframes);
+    write16(w);
+    write16(h);
+    write16(32);                // depth
+    write32(ASE_FILE_FLAG_LAYER_WITH_OPACITY);
+    write16(100);               // speed
+    write32(0);
+    write32(0);
+    writePadding(4);            // transparent index + ignore
+    write16(256);               // ncolors
+    write8(1);                  // pixel width
+    write8(1);                  // pixel height
+    writePadding(128-36);
+
+    for (int frame=0; frame<nframes; ++frame) {
+      write32(frameSize + (frame == 0 ? nlayers*layerSize: 0));
+      write16(ASE_FILE_FRAME_MAGIC);
+      write16(nlayers * (frame == 0 ? 2: 1));
+      write16(100);             // duration
+      writePadding(2);
+      write32(nlayers * (frame == 0 ? 2: 1));
+
+      if (frame == 0) {
+        for (int i=0; i<nlayers; ++i) {
+          write32(layerSize);
+          write16(ASE_FILE_CHUNK_LAYER);
+          write16(1);           // visible
+          write16(ASE_FILE_LAYER_IMAGE);
+          write16(0);           // child level
+          writePadding(6);      // default size + blend mode
+          write8(255);          // opacity
+          writePadding(3);
+          write16(name.size());
+          std::fwrite(name.c_str(), 1, name.size(), m_file);
+        }
+      }
+
+      for (int i=0; i<nlayers; ++i) {
+        write32(celSize);
+        write16(ASE_FILE_CHUNK_CEL);
+        write16(i);             // layer index
+        writePadding(4);        // x, y
+        write8(255);            // opacity
+        write16(ASE_FILE_RAW_CEL);
+        writePadding(7);        // z-index + reserved
+        write16(w);
+        write16(h);
+        std::fwrite(&pixels[0], 1, pixels.size(), m_file);
+      }
+    }
+    std::fflush(m_file);
+  }
+
+  ~SyntheticFile() {
+    std::fclose(m_file);
+  }
+
+  FILE* file() const { return m_file; }
+
+private:
+  void write8(int v) { std::fputc(v & 0xff, m_file); }
+  void write16(int v) { write8(v); write8(v >> 8); }
+  void write32(size_t v) { write16(int(v)); write16(int(v >> 16)); }
+  void writePadding(int n) { while (n-- > 0) write8(0); }
+
+  FILE* m_file;
+};
+
+template<typename FileInterfaceType>
+bool decode(FILE* file)
+{
+  std::fseek(file, 0, SEEK_SET);
+  FileInterfaceType fi(file);
+  DecodeDelegate delegate;
+  AsepriteDecoder decoder;
+  decoder.initialize(&delegate, &fi);
+  return decoder.decode();
+}
+
+} // anonymous namespace
+
+template<typename FileInterfaceType>
+void BM_DecodeSynthetic(benchmark::State& state)
+{
+  const int size = state.range(0);
+  const int nlayers = state.range(1);
+  const int nframes = state.range(2);
+  SyntheticFile file(size, size, nlayers, nframes);
+
+  for (auto _ : state) {
+    if (!decode<FileInterfaceType>(file.file())) {
+      state.SkipWithError("Error decoding file");
+      break;
+    }
+  }
+  state.SetBytesProcessed(int64_t(state.iterations()) *
+                          nlayers * nframes * size * size * 4);
+}
+
+// Decodes all the .aseprite files in the directory specified in the
+// ASEPRITE_BENCHMARK_CORPUS environment variable.
+template<typename FileInterfaceType>
+void BM_DecodeCorpus(benchmark::State& state)
+{
+  const char* dir = std::getenv("ASEPRITE_BENCHMARK_CORPUS");
+  if (!dir) {
+    state.SkipWithError("ASEPRITE_BENCHMARK_CORPUS is not defined");
+    return;
+  }
+
+  std::vector<std::string> files;
+  for (const auto& fn : base::list_files(dir)) {
+    std::string ext = base::string_to_lower(base::get_file_extension(fn));
+    if (ext == "ase" || ext == "aseprite")
+      files.push_back(base::join_path(dir, fn));
+  }
+
+  int64_t bytes = 0;
+  for (auto _ : state) {
+    for (const auto& fn : files) {
+      base::FileHandle handle(base::open_file(fn, "rb"));
+      if (!handle)
+        continue;
+      decode<FileInterfaceType>(handle.get());
+      bytes += base::file_size(fn);
+    }
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(int64_t(state.iterations()) * files.size());
+}
+
+BENCHMARK_TEMPLATE(BM_DecodeSynthetic, StdioFileInterface)
+  ->Args({ 64, 4, 64 })
+  ->Args({ 256, 8, 32 })
+  ->Args({ 1024, 2, 4 })
+  ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_DecodeSynthetic, BufferedFileInterface)
+  ->Args({ 64, 4, 64 })
+  ->Args({ 256, 8, 32 })
+  ->Args({ 1024, 2, 4 })
+  ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_DecodeCorpus, StdioFileInterface)
+  ->UseRealTime();
+
+BENCHMARK_TEMPLATE(BM_DecodeCorpus, BufferedFileInterface)
+  ->UseRealTime();
+
+BENCHMARK_MAIN();
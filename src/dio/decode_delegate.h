@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -56,6 +56,13 @@ public:
   virtual bool cacheCompressedTilesets() const {
     return false;
   }
+
+  // Returns true if we want to keep the compressed pixels of cels in
+  // memory and inflate them only when each cel is accessed for the
+  // first time (see doc::CelImageLoader).
+  virtual bool loadCelsLazily() const {
+    return false;
+  }
 };
 
 } // namespace dio
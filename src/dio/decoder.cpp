@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -33,13 +33,14 @@ uint8_t Decoder::read8()
   return m_f->read8();
 }
 
+// Multi-byte values are read with one readBytes() call instead of
+// one read8() call for each byte.
+
 uint16_t Decoder::read16()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-
-  if (m_f->ok()) {
-    return ((b2 << 8) | b1); // Little endian
+  uint8_t b[2];
+  if (m_f->readBytes(b, 2) == 2 && m_f->ok()) {
+    return ((b[1] << 8) | b[0]); // Little endian
   }
   else
     return 0;
@@ -47,14 +48,13 @@ uint16_t Decoder::read16()
 
 uint32_t Decoder::read32()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-  int b3 = m_f->read8();
-  int b4 = m_f->read8();
-
-  if (m_f->ok()) {
+  uint8_t b[4];
+  if (m_f->readBytes(b, 4) == 4 && m_f->ok()) {
     // Little endian
-    return ((b4 << 24) | (b3 << 16) | (b2 << 8) | b1);
+    return ((uint32_t(b[3]) << 24) |
+            (uint32_t(b[2]) << 16) |
+            (uint32_t(b[1]) << 8) |
+            uint32_t(b[0]));
   }
   else
     return 0;
@@ -62,25 +62,17 @@ uint32_t Decoder::read32()
 
 uint64_t Decoder::read64()
 {
-  int b1 = m_f->read8();
-  int b2 = m_f->read8();
-  int b3 = m_f->read8();
-  int b4 = m_f->read8();
-  int b5 = m_f->read8();
-  int b6 = m_f->read8();
-  int b7 = m_f->read8();
-  int b8 = m_f->read8();
-
-  if (m_f->ok()) {
+  uint8_t b[8];
+  if (m_f->readBytes(b, 8) == 8 && m_f->ok()) {
     // Little endian
-    return (((long long)b8 << 56) |
-            ((long long)b7 << 48) |
-            ((long long)b6 << 40) |
-            ((long long)b5 << 32) |
-            ((long long)b4 << 24) |
-            ((long long)b3 << 16) |
-            ((long long)b2 << 8) |
-            (long long)b1);
+    return ((uint64_t(b[7]) << 56) |
+            (uint64_t(b[6]) << 48) |
+            (uint64_t(b[5]) << 40) |
+            (uint64_t(b[4]) << 32) |
+            (uint64_t(b[3]) << 24) |
+            (uint64_t(b[2]) << 16) |
+            (uint64_t(b[1]) << 8) |
+            uint64_t(b[0]));
   }
   else
     return 0;
@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +12,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <vector>
 
 namespace dio {
 
@@ -50,6 +52,38 @@ private:
   bool m_ok;
 };
 
+// Reads the file in big blocks, so reading bytes one by one doesn't
+// need a fgetc() call for each byte. It's read-only: write8() does
+// nothing. The FILE position must not be changed from outside
+// while this interface is being used.
+class BufferedFileInterface final : public FileInterface {
+public:
+  static constexpr size_t kDefaultBlockSize = 64*1024;
+
+  BufferedFileInterface(FILE* file,
+                        const size_t blockSize = kDefaultBlockSize);
+  bool ok() const override { return m_ok; }
+  size_t tell() override { return m_blockPos + m_pos; }
+  void seek(size_t absPos) override;
+  uint8_t read8() override {
+    if (m_pos < m_size)
+      return m_buf[m_pos++];
+    return readNextBlock8();
+  }
+  size_t readBytes(uint8_t* buf, size_t n) override;
+  void write8(uint8_t value) override;
+private:
+  bool readNextBlock();
+  uint8_t readNextBlock8();
+
+  FILE* m_file;
+  bool m_ok;
+  std::vector<uint8_t> m_buf;
+  size_t m_blockPos;            // File position of m_buf[0]
+  size_t m_pos;                 // Current position in m_buf
+  size_t m_size;                // Valid bytes in m_buf
+};
+
 } // namespace dio
 
 #endif
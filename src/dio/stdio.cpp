@@ -1,4 +1,5 @@
 // Aseprite Document IO Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -6,6 +7,9 @@
 
 #include "dio/file_interface.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace dio {
 
 StdioFileInterface::StdioFileInterface(FILE* file)
@@ -52,4 +56,80 @@ void StdioFileInterface::write8(uint8_t value)
   fputc(value, m_file);
 }
 
+BufferedFileInterface::BufferedFileInterface(FILE* file,
+                                             const size_t blockSize)
+  : m_file(file)
+  , m_ok(true)
+  , m_buf(std::max<size_t>(blockSize, 1))
+  , m_blockPos(ftell(file))
+  , m_pos(0)
+  , m_size(0)
+{
+}
+
+void BufferedFileInterface::seek(size_t absPos)
+{
+  // Seek inside the current block
+  if (absPos >= m_blockPos && absPos <= m_blockPos + m_size) {
+    m_pos = absPos - m_blockPos;
+    return;
+  }
+
+  fseek(m_file, absPos, SEEK_SET);
+  m_blockPos = absPos;
+  m_pos = m_size = 0;
+}
+
+size_t BufferedFileInterface::readBytes(uint8_t* buf, size_t n)
+{
+  size_t total = 0;
+  while (n > 0) {
+    if (m_pos == m_size) {
+      // Read big blocks directly in the output buffer
+      if (n >= m_buf.size()) {
+        const size_t n2 = fread(buf, 1, n, m_file);
+        m_blockPos += m_size + n2;
+        m_pos = m_size = 0;
+        if (n2 != n)
+          m_ok = false;
+        return total + n2;
+      }
+      if (!readNextBlock()) {
+        m_ok = false;
+        break;
+      }
+    }
+
+    const size_t n2 = std::min(n, m_size - m_pos);
+    std::memcpy(buf, &m_buf[m_pos], n2);
+    m_pos += n2;
+    buf += n2;
+    total += n2;
+    n -= n2;
+  }
+  return total;
+}
+
+void BufferedFileInterface::write8(uint8_t value)
+{
+  // Do nothing, this interface is read-only
+}
+
+bool BufferedFileInterface::readNextBlock()
+{
+  m_blockPos += m_size;
+  m_pos = 0;
+  m_size = fread(&m_buf[0], 1, m_buf.size(), m_file);
+  return (m_size > 0);
+}
+
+uint8_t BufferedFileInterface::readNextBlock8()
+{
+  if (readNextBlock())
+    return m_buf[m_pos++];
+
+  m_ok = false;
+  return 0;
+}
+
 } // namespace dio
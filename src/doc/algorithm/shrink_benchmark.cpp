@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,6 +12,7 @@
 
 #include "doc/color.h"
 #include "doc/image.h"
+#include "doc/primitives.h"
 
 #include <benchmark/benchmark.h>
 #include <memory>
@@ -31,6 +32,22 @@ void BM_ShrinkBounds(benchmark::State& state) {
   }
 }
 
+// Image with content in the middle half of the canvas (like a
+// sprite with transparent borders)
+void BM_ShrinkBoundsSprite(benchmark::State& state) {
+  const PixelFormat pixelFormat = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  std::unique_ptr<Image> img(Image::create(pixelFormat, w, h));
+  clear_image(img.get(), 0);
+  fill_rect(img.get(), w/4, h/4, 3*w/4, 3*h/4, rgba(1, 2, 3, 4));
+  gfx::Rect rc;
+  while (state.KeepRunning()) {
+    doc::algorithm::shrink_bounds(img.get(), 0, nullptr, rc);
+  }
+}
+
 #define DEFARGS(MODE)                      \
   ->Args({ MODE, 100, 100 })               \
   ->Args({ MODE, 200, 200 })               \
@@ -56,4 +73,10 @@ BENCHMARK(BM_ShrinkBounds)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
+BENCHMARK(BM_ShrinkBoundsSprite)
+  DEFARGS(IMAGE_RGB)
+  DEFARGS(IMAGE_INDEXED)
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,7 +21,10 @@
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
 
+#include <algorithm>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -59,112 +62,211 @@ bool is_same_pixel<BitmapTraits>(color_t pixel1, color_t pixel2)
   return pixel1 == pixel2;
 }
 
+// Returns the first column in [x1, x2) of the given row with a pixel
+// different from refpixel, or x2 if all pixels are equal.
 template<typename ImageTraits>
-bool shrink_bounds_left_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
+int find_first_pixel_in_row(const Image* image, int y, int x1, int x2, color_t refpixel)
 {
-  int u, v;
-  // Shrink left side
-  for (u=bounds.x; u<bounds.x2(); ++u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
+  if constexpr (std::is_same_v<ImageTraits, BitmapTraits>) {
+    for (int x=x1; x<x2; ++x) {
+      if (!is_same_pixel<ImageTraits>(get_pixel_fast<ImageTraits>(image, x, y), refpixel))
+        return x;
+    }
+  }
+  else if (x1 < x2) {
+    auto ptr = get_pixel_read_address_fast<ImageTraits>(image, x1, y);
+    for (int x=x1; x<x2; ++x, ++ptr) {
+      ASSERT(ptr == get_pixel_read_address_fast<ImageTraits>(image, x, y));
       if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+        return x;
     }
-    ++bounds.x;
-    --bounds.w;
   }
-  return (!bounds.isEmpty());
+  return x2;
 }
 
+// Returns the last column in [x1, x2) of the given row with a pixel
+// different from refpixel, or x1-1 if all pixels are equal.
 template<typename ImageTraits>
-bool shrink_bounds_right_templ(const Image* image, gfx::Rect& bounds, color_t refpixel, int rowPixels)
+int find_last_pixel_in_row(const Image* image, int y, int x1, int x2, color_t refpixel)
 {
-  int u, v;
-  // Shrink right side
-  for (u=bounds.x2()-1; u>=bounds.x; --u) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u, v=bounds.y);
-    for (; v<bounds.y2(); ++v, ptr+=rowPixels) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
+  if constexpr (std::is_same_v<ImageTraits, BitmapTraits>) {
+    for (int x=x2-1; x>=x1; --x) {
+      if (!is_same_pixel<ImageTraits>(get_pixel_fast<ImageTraits>(image, x, y), refpixel))
+        return x;
+    }
+  }
+  else if (x1 < x2) {
+    auto ptr = get_pixel_read_address_fast<ImageTraits>(image, x2-1, y);
+    for (int x=x2-1; x>=x1; --x, --ptr) {
+      ASSERT(ptr == get_pixel_read_address_fast<ImageTraits>(image, x, y));
       if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+        return x;
     }
-    --bounds.w;
   }
-  return (!bounds.isEmpty());
+  return x1-1;
 }
 
+// Scans the image row by row (instead of column by column, which
+// jumps between rows for each pixel). Full rows are only scanned
+// until the top and bottom rows with content are found, the rows
+// between them are scanned only outside the [left, right) range of
+// columns found so far.
 template<typename ImageTraits>
-bool shrink_bounds_top_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_rows_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
-  int u, v;
+  const int x1 = bounds.x;
+  const int x2 = bounds.x2();
+  int y1 = bounds.y;
+  int y2 = bounds.y2();
+  int left = x2;
+  int right = x1;
+
   // Shrink top side
-  for (v=bounds.y; v<bounds.y2(); ++v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+  for (; y1<y2; ++y1) {
+    left = find_first_pixel_in_row<ImageTraits>(image, y1, x1, x2, refpixel);
+    if (left < x2) {
+      right = find_last_pixel_in_row<ImageTraits>(image, y1, left, x2, refpixel)+1;
+      break;
     }
-    ++bounds.y;
-    --bounds.h;
   }
-  return (!bounds.isEmpty());
-}
+  if (y1 == y2) {
+    bounds = gfx::Rect(x1, y1, 0, 0);
+    return false;
+  }
 
-template<typename ImageTraits>
-bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
-{
-  int u, v;
   // Shrink bottom side
-  for (v=bounds.y2()-1; v>=bounds.y; --v) {
-    auto ptr = get_pixel_address_fast<ImageTraits>(image, u=bounds.x, v);
-    for (; u<bounds.x2(); ++u, ++ptr) {
-      ASSERT(ptr == get_pixel_address_fast<ImageTraits>(image, u, v));
-      if (!is_same_pixel<ImageTraits>(*ptr, refpixel))
-        return (!bounds.isEmpty());
+  for (--y2; y2>y1; --y2) {
+    const int x = find_first_pixel_in_row<ImageTraits>(image, y2, x1, x2, refpixel);
+    if (x < x2) {
+      left = std::min(left, x);
+      right = std::max(right, find_last_pixel_in_row<ImageTraits>(image, y2, x, x2, refpixel)+1);
+      break;
     }
-    --bounds.h;
   }
-  return (!bounds.isEmpty());
+  ++y2;
+
+  // Shrink left and right sides with the rows in the middle
+  for (int y=y1+1; y<y2-1 && (left > x1 || right < x2); ++y) {
+    left = find_first_pixel_in_row<ImageTraits>(image, y, x1, left, refpixel);
+    right = find_last_pixel_in_row<ImageTraits>(image, y, right, x2, refpixel)+1;
+  }
+
+  bounds = gfx::Rect(left, y1, right-left, y2-y1);
+  return true;
 }
 
 template<typename ImageTraits>
 bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
-  // Pixels per row
-  const int rowPixels = image->rowPixels();
-  const int canvasSize = image->width()*image->height();
-  if ((std::thread::hardware_concurrency() >= 4) &&
-      ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
-       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
-    gfx::Rect
-      leftBounds(bounds), rightBounds(bounds),
-      topBounds(bounds), bottomBounds(bounds);
-
-    // TODO use a base::thread_pool and a base::task for each border
-
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowPixels); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowPixels); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
-    bounds = leftBounds;
-    bounds &= rightBounds;
-    bounds &= topBounds;
-    bounds &= bottomBounds;
-    return !bounds.isEmpty();
+  const int canvasSize = bounds.w*bounds.h;
+  const int nthreads = 4;
+  if (std::thread::hardware_concurrency() < nthreads ||
+      bounds.h < nthreads ||
+      (image->pixelFormat() == IMAGE_RGB && canvasSize < 800*800) ||
+      (image->pixelFormat() != IMAGE_RGB && canvasSize < 500*500)) {
+    return shrink_bounds_rows_templ<ImageTraits>(image, bounds, refpixel);
+  }
+
+  // Big images are divided in horizontal bands which are shrunk in
+  // parallel, and then we join the bounds of all bands (e.g. when the
+  // content is just a few pixels in the middle of the image, each
+  // thread scans only a part of the image).
+  std::vector<gfx::Rect> bands(nthreads);
+  for (int i=0; i<nthreads; ++i) {
+    const int y1 = bounds.y + bounds.h*i/nthreads;
+    const int y2 = bounds.y + bounds.h*(i+1)/nthreads;
+    bands[i] = gfx::Rect(bounds.x, y1, bounds.w, y2-y1);
+  }
+
+  std::vector<std::thread> threads;
+  for (int i=1; i<nthreads; ++i) {
+    threads.emplace_back(
+      [image, refpixel, &band = bands[i]]{
+        if (!shrink_bounds_rows_templ<ImageTraits>(image, band, refpixel))
+          band = gfx::Rect();
+      });
+  }
+  if (!shrink_bounds_rows_templ<ImageTraits>(image, bands[0], refpixel))
+    bands[0] = gfx::Rect();
+  for (auto& thread : threads)
+    thread.join();
+
+  gfx::Rect result;
+  for (const gfx::Rect& band : bands)
+    result |= band;
+  if (result.isEmpty()) {
+    bounds = gfx::Rect(bounds.x, bounds.y2(), 0, 0);
+    return false;
+  }
+  bounds = result;
+  return true;
+}
+
+// Shrinks the bounds of the whole image using the cached content
+// bounds of each band of rows of the image (see
+// Image::getContentBounds()), so only the bands modified since the
+// last call are scanned again.
+template<typename ImageTraits>
+bool shrink_image_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  ASSERT(bounds == image->bounds());
+
+  const int nbands = image->contentBands();
+  std::vector<gfx::Rect> bands(nbands);
+  std::vector<int> modified;
+  int modifiedSize = 0;
+  for (int i=0; i<nbands; ++i) {
+    if (!image->getContentBounds(i, refpixel, bands[i])) {
+      const int y = i*Image::kContentBandHeight;
+      bands[i] = gfx::Rect(0, y, image->width(),
+                           std::min(Image::kContentBandHeight, image->height()-y));
+      modified.push_back(i);
+      modifiedSize += bands[i].w*bands[i].h;
+    }
+  }
+
+  // Scans a modified band
+  auto shrinkBand = [image, refpixel, &bands, &modified](const int i) {
+    gfx::Rect& band = bands[modified[i]];
+    if (!shrink_bounds_rows_templ<ImageTraits>(image, band, refpixel))
+      band = gfx::Rect();
+    image->setContentBounds(modified[i], refpixel, band);
+  };
+
+  // Big modified areas are scanned in several threads
+  const int n = int(modified.size());
+  const int nthreads = std::min<int>(4, n);
+  if (std::thread::hardware_concurrency() < 4 ||
+      nthreads < 2 ||
+      (image->pixelFormat() == IMAGE_RGB && modifiedSize < 800*800) ||
+      (image->pixelFormat() != IMAGE_RGB && modifiedSize < 500*500)) {
+    for (int i=0; i<n; ++i)
+      shrinkBand(i);
   }
   else {
-    return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowPixels) &&
-      shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+    std::vector<std::thread> threads;
+    for (int t=1; t<nthreads; ++t) {
+      threads.emplace_back(
+        [t, n, nthreads, &shrinkBand]{
+          for (int i=t; i<n; i+=nthreads)
+            shrinkBand(i);
+        });
+    }
+    for (int i=0; i<n; i+=nthreads)
+      shrinkBand(i);
+    for (auto& thread : threads)
+      thread.join();
+  }
+
+  gfx::Rect result;
+  for (const gfx::Rect& band : bands)
+    result |= band;
+  if (result.isEmpty()) {
+    bounds = gfx::Rect(bounds.x, bounds.y2(), 0, 0);
+    return false;
   }
+  bounds = result;
+  return true;
 }
 
 template<typename ImageTraits>
@@ -343,6 +445,18 @@ bool shrink_bounds(const Image* image,
                    gfx::Rect& bounds)
 {
   bounds = (startBounds & image->bounds());
+
+  // Use the cached bounds of each band of the image
+  if (bounds == image->bounds()) {
+    switch (image->pixelFormat()) {
+      case IMAGE_RGB:       return shrink_image_bounds_templ<RgbTraits>(image, bounds, refpixel);
+      case IMAGE_GRAYSCALE: return shrink_image_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
+      case IMAGE_INDEXED:   return shrink_image_bounds_templ<IndexedTraits>(image, bounds, refpixel);
+      case IMAGE_BITMAP:    return shrink_image_bounds_templ<BitmapTraits>(image, bounds, refpixel);
+      default:              break;
+    }
+  }
+
   switch (image->pixelFormat()) {
     case IMAGE_RGB:       return shrink_bounds_templ<RgbTraits>(image, bounds, refpixel);
     case IMAGE_GRAYSCALE: return shrink_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
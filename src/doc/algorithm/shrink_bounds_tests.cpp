@@ -0,0 +1,210 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/shrink_bounds.h"
+
+#include "doc/color.h"
+#include "doc/image.h"
+#include "doc/image_bits.h"
+#include "doc/image_impl.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+
+using namespace doc;
+using namespace gfx;
+
+static color_t solid_color(const PixelFormat pf)
+{
+  switch (pf) {
+    case IMAGE_RGB:       return rgba(255, 0, 0, 255);
+    case IMAGE_GRAYSCALE: return graya(128, 255);
+    case IMAGE_INDEXED:   return 4;
+    case IMAGE_BITMAP:    return 1;
+    default:              return 0;
+  }
+}
+
+TEST(ShrinkBounds, EmptyImage)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    ImageRef img(Image::create(pf, 32, 16));
+    clear_image(img.get(), 0);
+
+    Rect bounds;
+    EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+    EXPECT_TRUE(bounds.isEmpty());
+  }
+
+  // Transparent pixels with different RGB values are the same color
+  ImageRef img(Image::create(IMAGE_RGB, 32, 16));
+  clear_image(img.get(), 0);
+  put_pixel(img.get(), 4, 5, rgba(255, 255, 255, 0));
+
+  Rect bounds;
+  EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+}
+
+TEST(ShrinkBounds, RandomPixels)
+{
+  std::srand(1);
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP }) {
+    for (int h=1; h<100; h+=7) {
+      for (int w=1; w<100; w+=7) {
+        for (int n=1; n<=4; ++n) {
+          ImageRef img(Image::create(pf, w, h));
+          clear_image(img.get(), 0);
+
+          const Rect startBounds(1, 1, w-1, h-1);
+          Rect expected, expectedInStart;
+          for (int i=0; i<n; ++i) {
+            const int x = std::rand() % w;
+            const int y = std::rand() % h;
+            put_pixel(img.get(), x, y, solid_color(pf));
+            expected |= Rect(x, y, 1, 1);
+            if (startBounds.contains(Point(x, y)))
+              expectedInStart |= Rect(x, y, 1, 1);
+          }
+
+          Rect bounds;
+          ASSERT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+          ASSERT_EQ(expected, bounds)
+            << "Pixel format=" << pf << " Size=" << w << "x" << h;
+
+          // Pixels outside the start bounds are ignored
+          ASSERT_EQ(!expectedInStart.isEmpty(),
+                    doc::algorithm::shrink_bounds(img.get(), 0, nullptr,
+                                                  startBounds, bounds));
+          if (!expectedInStart.isEmpty()) {
+            ASSERT_EQ(expectedInStart, bounds)
+              << "Pixel format=" << pf << " Size=" << w << "x" << h;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(ShrinkBounds, BigImages)
+{
+  // Images big enough to be shrunk in several threads
+  std::srand(2);
+  for (auto pf : { IMAGE_RGB, IMAGE_INDEXED }) {
+    const int w = 1000, h = 900;
+    ImageRef img(Image::create(pf, w, h));
+    clear_image(img.get(), 0);
+
+    Rect bounds;
+    EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+    EXPECT_TRUE(bounds.isEmpty());
+
+    for (int n=1; n<=8; ++n) {
+      clear_image(img.get(), 0);
+      Rect expected;
+      for (int i=0; i<n; ++i) {
+        const int x = std::rand() % w;
+        const int y = std::rand() % h;
+        put_pixel(img.get(), x, y, solid_color(pf));
+        expected |= Rect(x, y, 1, 1);
+      }
+
+      ASSERT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+      ASSERT_EQ(expected, bounds) << "Pixel format=" << pf;
+    }
+  }
+}
+
+static int valid_bands(const Image* img)
+{
+  int n = 0;
+  Rect rc;
+  for (int i=0; i<img->contentBands(); ++i)
+    if (img->getContentBounds(i, 0, rc))
+      ++n;
+  return n;
+}
+
+TEST(ShrinkBounds, CachedBands)
+{
+  const int h = 5*Image::kContentBandHeight;
+  ImageRef img(Image::create(IMAGE_RGB, 100, h));
+  clear_image(img.get(), 0);
+  EXPECT_EQ(5, img->contentBands());
+  EXPECT_EQ(0, valid_bands(img.get()));
+
+  Rect bounds;
+  EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(5, valid_bands(img.get()));
+  EXPECT_TRUE(is_empty_image(img.get()));
+
+  // Only the band of the modified row is invalidated
+  put_pixel(img.get(), 10, 2*Image::kContentBandHeight+3, rgba(255, 0, 0, 255));
+  EXPECT_EQ(4, valid_bands(img.get()));
+  EXPECT_FALSE(is_empty_image(img.get()));
+  EXPECT_EQ(5, valid_bands(img.get()));
+
+  EXPECT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(10, 2*Image::kContentBandHeight+3, 1, 1), bounds);
+
+  // Reading pixels doesn't invalidate bands
+  {
+    const LockImageBits<RgbTraits> bits(img.get());
+    int n = 0;
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      if (*it)
+        ++n;
+    EXPECT_EQ(1, n);
+    EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(img.get(), 10, 2*Image::kContentBandHeight+3));
+    EXPECT_EQ(5, valid_bands(img.get()));
+  }
+
+  // Each primitive invalidates the modified rows
+  fill_rect(img.get(), 50, 10, 60, 20, rgba(0, 255, 0, 255));
+  EXPECT_EQ(4, valid_bands(img.get()));
+  EXPECT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(10, 10, 51, 2*Image::kContentBandHeight-6), bounds);
+
+  ImageRef src(Image::create(IMAGE_RGB, 2, 2));
+  clear_image(src.get(), rgba(0, 0, 255, 255));
+  copy_image(img.get(), src.get(), 98, h-2);
+  EXPECT_EQ(4, valid_bands(img.get()));
+  EXPECT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(10, 10, 90, h-10), bounds);
+
+  {
+    LockImageBits<RgbTraits> bits(img.get(), Image::WriteLock,
+                                  Rect(0, h-1, 100, 1));
+    for (auto it=bits.begin(), end=bits.end(); it!=end; ++it)
+      *it = 0;
+  }
+  EXPECT_EQ(4, valid_bands(img.get()));
+  EXPECT_TRUE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(10, 10, 90, h-11), bounds);
+
+  // The address from getPixelAddress() can be used to modify any
+  // pixel, so all bands are invalidated
+  std::fill_n((color_t*)img->getPixelAddress(0, 0), img->rowPixels()*h, 0);
+  EXPECT_EQ(0, valid_bands(img.get()));
+  EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_TRUE(is_empty_image(img.get()));
+
+  // Other reference pixel
+  clear_image(img.get(), rgba(0, 0, 0, 255));
+  EXPECT_EQ(0, valid_bands(img.get()));
+  EXPECT_FALSE(doc::algorithm::shrink_bounds(img.get(), rgba(0, 0, 0, 255), nullptr, bounds));
+  EXPECT_EQ(0, valid_bands(img.get()));
+  EXPECT_FALSE(is_empty_image(img.get()));
+  EXPECT_EQ(5, valid_bands(img.get()));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +13,9 @@
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +57,39 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+// Blends a row of 4096 pixels calling the BlendFunc for each pixel
+// (as BlenderHelper did), or using the row blender function.
+static void BM_RgbaRow(benchmark::State& state) {
+  const auto blendMode = BlendMode(state.range(0));
+  const bool useRowFunc = (state.range(1) != 0);
+  const int n = 4096;
+  std::vector<color_t> src(n, rgba(32, 128, 200, 128));
+  std::vector<color_t> dst(n);
+  BlendFunc func = get_rgba_blender(blendMode, true);
+  RgbaBlendRowFunc rowFunc = get_rgba_row_blender(blendMode, true);
+  while (state.KeepRunning()) {
+    std::fill(dst.begin(), dst.end(), rgba(200, 128, 64, 255));
+    if (useRowFunc) {
+      rowFunc(&dst[0], &src[0], n, 128, 0);
+    }
+    else {
+      for (int x=0; x<n; ++x)
+        if (src[x] != 0)
+          dst[x] = func(dst[x], src[x], 128);
+    }
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK(BM_RgbaRow)
+  ->Args({ int(BlendMode::NORMAL), 0 })
+  ->Args({ int(BlendMode::NORMAL), 1 })
+  ->Args({ int(BlendMode::MULTIPLY), 0 })
+  ->Args({ int(BlendMode::MULTIPLY), 1 })
+  ->Args({ int(BlendMode::OVERLAY), 0 })
+  ->Args({ int(BlendMode::OVERLAY), 1 })
+  ->Args({ int(BlendMode::DIFFERENCE), 0 })
+  ->Args({ int(BlendMode::DIFFERENCE), 1 });
+
 BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -124,6 +124,20 @@ inline uint32_t blend_soft_light(uint32_t _b, uint32_t _s)
   return (uint32_t)(r * 255 + 0.5);
 }
 
+// Blends a whole row with the given blend function. As "blend" is a
+// template argument (and the blend functions are defined in this same
+// file), the compiler can inline it in the loop.
+template<typename T, doc::BlendFunc blend>
+void blend_row_templ(T* dst, const T* src,
+                     const int n, const int opacity,
+                     const doc::color_t maskColor)
+{
+  for (int x=0; x<n; ++x, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = blend(*dst, *src, opacity);
+  }
+}
+
 } // annonymous namespace
 
 namespace doc {
@@ -830,4 +844,88 @@ BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend)
   return indexed_blender_src;
 }
 
+#define RGBA_ROW(name)    blend_row_templ<uint32_t, rgba_blender_##name>
+#define RGBA_ROW_N(name)  (newBlend? RGBA_ROW(name##_n): RGBA_ROW(name))
+#define GRAYA_ROW(name)   blend_row_templ<uint16_t, graya_blender_##name>
+#define GRAYA_ROW_N(name) (newBlend? GRAYA_ROW(name##_n): GRAYA_ROW(name))
+
+RgbaBlendRowFunc get_rgba_row_blender(BlendMode blendmode, const bool newBlend)
+{
+  switch (blendmode) {
+    case BlendMode::SRC:            return RGBA_ROW(src);
+    case BlendMode::MERGE:          return RGBA_ROW(merge);
+    case BlendMode::NEG_BW:         return RGBA_ROW(neg_bw);
+    case BlendMode::RED_TINT:       return RGBA_ROW(red_tint);
+    case BlendMode::BLUE_TINT:      return RGBA_ROW(blue_tint);
+    case BlendMode::DST_OVER:       return RGBA_ROW(normal_dst_over);
+
+    case BlendMode::NORMAL:         return RGBA_ROW(normal);
+    case BlendMode::MULTIPLY:       return RGBA_ROW_N(multiply);
+    case BlendMode::SCREEN:         return RGBA_ROW_N(screen);
+    case BlendMode::OVERLAY:        return RGBA_ROW_N(overlay);
+    case BlendMode::DARKEN:         return RGBA_ROW_N(darken);
+    case BlendMode::LIGHTEN:        return RGBA_ROW_N(lighten);
+    case BlendMode::COLOR_DODGE:    return RGBA_ROW_N(color_dodge);
+    case BlendMode::COLOR_BURN:     return RGBA_ROW_N(color_burn);
+    case BlendMode::HARD_LIGHT:     return RGBA_ROW_N(hard_light);
+    case BlendMode::SOFT_LIGHT:     return RGBA_ROW_N(soft_light);
+    case BlendMode::DIFFERENCE:     return RGBA_ROW_N(difference);
+    case BlendMode::EXCLUSION:      return RGBA_ROW_N(exclusion);
+    case BlendMode::HSL_HUE:        return RGBA_ROW_N(hsl_hue);
+    case BlendMode::HSL_SATURATION: return RGBA_ROW_N(hsl_saturation);
+    case BlendMode::HSL_COLOR:      return RGBA_ROW_N(hsl_color);
+    case BlendMode::HSL_LUMINOSITY: return RGBA_ROW_N(hsl_luminosity);
+    case BlendMode::ADDITION:       return RGBA_ROW_N(addition);
+    case BlendMode::SUBTRACT:       return RGBA_ROW_N(subtract);
+    case BlendMode::DIVIDE:         return RGBA_ROW_N(divide);
+  }
+  ASSERT(false);
+  return RGBA_ROW(src);
+}
+
+// The same blend functions returned by get_graya_blender()
+GrayaBlendRowFunc get_graya_row_blender(BlendMode blendmode, const bool newBlend)
+{
+  switch (blendmode) {
+    case BlendMode::SRC:            return GRAYA_ROW(src);
+    case BlendMode::MERGE:          return GRAYA_ROW(merge);
+    case BlendMode::NEG_BW:         return GRAYA_ROW(neg_bw);
+    case BlendMode::RED_TINT:       return GRAYA_ROW(normal);
+    case BlendMode::BLUE_TINT:      return GRAYA_ROW(normal);
+    case BlendMode::DST_OVER:       return GRAYA_ROW(normal_dst_over);
+
+    case BlendMode::NORMAL:         return GRAYA_ROW(normal);
+    case BlendMode::MULTIPLY:       return GRAYA_ROW_N(multiply);
+    case BlendMode::SCREEN:         return GRAYA_ROW_N(screen);
+    case BlendMode::OVERLAY:        return GRAYA_ROW_N(overlay);
+    case BlendMode::DARKEN:         return GRAYA_ROW_N(darken);
+    case BlendMode::LIGHTEN:        return GRAYA_ROW_N(lighten);
+    case BlendMode::COLOR_DODGE:    return GRAYA_ROW_N(color_dodge);
+    case BlendMode::COLOR_BURN:     return GRAYA_ROW_N(color_burn);
+    case BlendMode::HARD_LIGHT:     return GRAYA_ROW_N(hard_light);
+    case BlendMode::SOFT_LIGHT:     return GRAYA_ROW_N(soft_light);
+    case BlendMode::DIFFERENCE:     return GRAYA_ROW_N(difference);
+    case BlendMode::EXCLUSION:      return GRAYA_ROW_N(exclusion);
+    case BlendMode::HSL_HUE:        return GRAYA_ROW(normal);
+    case BlendMode::HSL_SATURATION: return GRAYA_ROW(normal);
+    case BlendMode::HSL_COLOR:      return GRAYA_ROW(normal);
+    case BlendMode::HSL_LUMINOSITY: return GRAYA_ROW(normal);
+    case BlendMode::ADDITION:       return (newBlend? GRAYA_ROW(exclusion_n): GRAYA_ROW(addition));
+    case BlendMode::SUBTRACT:       return GRAYA_ROW_N(subtract);
+    case BlendMode::DIVIDE:         return GRAYA_ROW_N(divide);
+  }
+  ASSERT(false);
+  return GRAYA_ROW(src);
+}
+
+IndexedBlendRowFunc get_indexed_row_blender(BlendMode blendmode, const bool newBlend)
+{
+  return blend_row_templ<uint8_t, indexed_blender_src>;
+}
+
+RgbaBlendRowFunc get_tilemap_row_blender(BlendMode blendmode, const bool newBlend)
+{
+  return blend_row_templ<uint32_t, indexed_blender_src>;
+}
+
 } // namespace doc
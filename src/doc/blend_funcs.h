@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -16,6 +16,18 @@ namespace doc {
 
   typedef color_t (*BlendFunc)(color_t backdrop, color_t src, int opacity);
 
+  // Functions to blend a whole row of "n" pixels, it's the same as
+  // calling the BlendFunc for each pixel (dst[i] = blend(dst[i],
+  // src[i], opacity)) but skipping src pixels equal to the mask color.
+  // The blend function is inlined in the loop, so this is faster than
+  // calling the BlendFunc through a pointer for each pixel.
+  typedef void (*RgbaBlendRowFunc)(uint32_t* dst, const uint32_t* src,
+                                   int n, int opacity, color_t maskColor);
+  typedef void (*GrayaBlendRowFunc)(uint16_t* dst, const uint16_t* src,
+                                    int n, int opacity, color_t maskColor);
+  typedef void (*IndexedBlendRowFunc)(uint8_t* dst, const uint8_t* src,
+                                      int n, int opacity, color_t maskColor);
+
   color_t rgba_blender_src(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_merge(color_t backdrop, color_t src, int opacity);
   color_t rgba_blender_neg_bw(color_t backdrop, color_t src, int opacity);
@@ -68,6 +80,11 @@ namespace doc {
   BlendFunc get_graya_blender(BlendMode blendmode, const bool newBlend);
   BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend);
 
+  RgbaBlendRowFunc get_rgba_row_blender(BlendMode blendmode, const bool newBlend);
+  GrayaBlendRowFunc get_graya_row_blender(BlendMode blendmode, const bool newBlend);
+  IndexedBlendRowFunc get_indexed_row_blender(BlendMode blendmode, const bool newBlend);
+  RgbaBlendRowFunc get_tilemap_row_blender(BlendMode blendmode, const bool newBlend);
+
 } // namespace doc
 
 #endif
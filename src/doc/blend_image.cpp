@@ -12,6 +12,8 @@
 
 #include "doc/blend_internals.h"
 #include "doc/image_impl.h"
+#include "doc/primitives_fast.h"
+#include "gfx/clip.h"
 
 namespace doc {
 
@@ -31,13 +33,14 @@ void blend_image_templ(Image* dst,
       return;
   }
   BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, true);
-  LockImageBits<DstTraits> dstBits(dst);
-  const LockImageBits<SrcTraits> srcBits(src);
-  auto dstIt = dstBits.begin_area(area.dstBounds());
-  auto srcIt = srcBits.begin_area(area.srcBounds());
-  auto dstEnd = dstBits.end_area(area.dstBounds());
-  for (; dstIt < dstEnd; ++dstIt, ++srcIt)
-    *dstIt = blender(*dstIt, *srcIt, opacity);
+  const gfx::Rect dstBounds = area.dstBounds();
+  const gfx::Rect srcBounds = area.srcBounds();
+  for (int y=0; y<dstBounds.h; ++y) {
+    blender.blendRow(
+      get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstBounds.y+y),
+      get_pixel_read_address_fast<SrcTraits>(src, srcBounds.x, srcBounds.y+y),
+      dstBounds.w, opacity);
+  }
 }
 
 void blend_image(Image* dst,
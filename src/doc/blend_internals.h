@@ -22,17 +22,26 @@
 #include "doc/image_traits.h"
 #include "doc/palette.h"
 
+#include <type_traits>
+
 namespace doc {
 
+  // Each BlenderHelper has an operator() to blend one pixel, and a
+  // blendRow() member function to blend a whole row of "n" pixels
+  // (which must give the same result as calling operator() for each
+  // pixel).
+
   template<class DstTraits, class SrcTraits>
   class BlenderHelper {
     BlendFunc m_blendFunc;
+    decltype(SrcTraits::get_row_blender(BlendMode::NORMAL, true)) m_blendRowFunc;
     color_t m_maskColor;
   public:
     BlenderHelper(Image* dst, const Image* src, const Palette* pal,
                   const BlendMode blendMode, const bool newBlend)
     {
       m_blendFunc = SrcTraits::get_blender(blendMode, newBlend);
+      m_blendRowFunc = SrcTraits::get_row_blender(blendMode, newBlend);
       m_maskColor = src->maskColor();
     }
 
@@ -46,8 +55,34 @@ namespace doc {
       else
         return dst;
     }
+
+    inline void blendRow(typename DstTraits::address_t dst,
+                         typename SrcTraits::const_address_t src,
+                         const int n,
+                         const int opacity)
+    {
+      if constexpr (std::is_same_v<DstTraits, SrcTraits>) {
+        (*m_blendRowFunc)(dst, src, n, opacity, m_maskColor);
+      }
+      else {
+        for (int x=0; x<n; ++x, ++dst, ++src)
+          *dst = operator()(*dst, *src, opacity);
+      }
+    }
   };
 
+  // Default blendRow() implementation for the BlenderHelper
+  // specializations that convert between pixel formats.
+#define BLENDER_HELPER_BLEND_ROW(DstTraits, SrcTraits)          \
+    inline void blendRow(DstTraits::address_t dst,              \
+                         SrcTraits::const_address_t src,        \
+                         const int n,                           \
+                         const int opacity)                     \
+    {                                                           \
+      for (int x=0; x<n; ++x, ++dst, ++src)                     \
+        *dst = operator()(*dst, *src, opacity);                 \
+    }
+
   //////////////////////////////////////////////////////////////////////
   // X -> Rgb
 
@@ -75,6 +110,8 @@ namespace doc {
       else
         return dst;
     }
+
+    BLENDER_HELPER_BLEND_ROW(RgbTraits, GrayscaleTraits)
   };
 
   template<>
@@ -109,6 +146,8 @@ namespace doc {
           return dst;
       }
     }
+
+    BLENDER_HELPER_BLEND_ROW(RgbTraits, IndexedTraits)
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -132,6 +171,8 @@ namespace doc {
       // TODO we should be able to configure this function
       return rgba_to_graya_using_luma(src);
     }
+
+    BLENDER_HELPER_BLEND_ROW(GrayscaleTraits, RgbTraits)
   };
 
   //////////////////////////////////////////////////////////////////////
@@ -171,6 +212,8 @@ namespace doc {
                                 rgba_geta(src),
                                 m_maskColor);
     }
+
+    BLENDER_HELPER_BLEND_ROW(IndexedTraits, RgbTraits)
   };
 
   template<>
@@ -208,8 +251,12 @@ namespace doc {
           return dst;
       }
     }
+
+    BLENDER_HELPER_BLEND_ROW(IndexedTraits, IndexedTraits)
   };
 
+#undef BLENDER_HELPER_BLEND_ROW
+
 } // namespace doc
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -172,8 +172,9 @@ Grid Cel::grid() const
 
 void Cel::fixupImage()
 {
-  // Change the mask color to the sprite mask color
-  if (m_layer && image()) {
+  // Change the mask color to the sprite mask color (images that
+  // aren't loaded yet must be created with the correct mask color)
+  if (m_layer && m_data->isImageLoaded() && image()) {
     image()->setMaskColor((image()->pixelFormat() == IMAGE_TILEMAP) ?
                             notile : m_layer->sprite()->transparentColor());
     ASSERT(m_data);
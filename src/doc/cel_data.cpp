@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -33,7 +33,7 @@ CelData::CelData(const ImageRef& image)
 
 CelData::CelData(const CelData& celData)
   : WithUserData(ObjectType::CelData)
-  , m_image(celData.m_image)
+  , m_image(celData.imageRef())
   , m_opacity(celData.m_opacity)
   , m_bounds(celData.m_bounds)
   , m_boundsF(celData.m_boundsF ? std::make_unique<gfx::RectF>(*celData.m_boundsF):
@@ -50,9 +50,54 @@ void CelData::setImage(const ImageRef& image, Layer* layer)
   ASSERT(image.get());
 
   m_image = image;
+  m_lazyImage.reset();
   adjustBounds(layer);
 }
 
+void CelData::setImageLoader(const gfx::Size& imageSize,
+                             std::unique_ptr<CelImageLoader>&& loader)
+{
+  ASSERT(!m_image);
+  ASSERT(loader);
+
+  m_lazyImage = std::make_unique<LazyImage>();
+  m_lazyImage->size = imageSize;
+  m_lazyImage->loader = std::move(loader);
+  m_bounds.setSize(imageSize);
+}
+
+int CelData::getMemSize() const
+{
+  if (!isImageLoaded()) {
+    // The loader can be destroyed by other thread loading the image
+    // (e.g. a render thread), so we have to check it again with the
+    // lock held.
+    const std::lock_guard lock(m_lazyImage->mutex);
+    if (!m_lazyImage->loaded)
+      return sizeof(CelData) + m_lazyImage->loader->getMemSize();
+  }
+
+  ASSERT(m_image);
+  return sizeof(CelData) + m_image->getMemSize();
+}
+
+void CelData::loadImageFromLoader() const
+{
+  ASSERT(m_lazyImage);
+
+  const std::lock_guard lock(m_lazyImage->mutex);
+  if (m_lazyImage->loaded)      // Loaded from other thread
+    return;
+
+  ImageRef image = m_lazyImage->loader->loadImage();
+  ASSERT(image);
+  ASSERT(image->size() == m_lazyImage->size);
+
+  const_cast<CelData*>(this)->m_image = image;
+  m_lazyImage->loader.reset();
+  m_lazyImage->loaded.store(true, std::memory_order_release);
+}
+
 void CelData::setPosition(const gfx::Point& pos)
 {
   m_bounds.setOrigin(pos);
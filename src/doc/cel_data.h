@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,14 +13,27 @@
 #include "doc/object.h"
 #include "doc/with_user_data.h"
 #include "gfx/rect.h"
+#include "gfx/size.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 namespace doc {
 
   class Layer;
   class Tileset;
 
+  // Creates the image of a cel the first time it's needed (e.g. to
+  // decode the pixels from a file only when the cel is rendered).
+  class CelImageLoader {
+  public:
+    virtual ~CelImageLoader() { }
+    virtual ImageRef loadImage() = 0;
+    // Memory used by the loader (e.g. compressed pixels)
+    virtual int getMemSize() const = 0;
+  };
+
   class CelData : public WithUserData {
   public:
     CelData(const ImageRef& image);
@@ -30,14 +43,22 @@ namespace doc {
     gfx::Point position() const { return m_bounds.origin(); }
     const gfx::Rect& bounds() const { return m_bounds; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    Image* image() const { loadImage(); return const_cast<Image*>(m_image.get()); };
+    ImageRef imageRef() const { loadImage(); return m_image; }
+
+    // Returns false if the image will be created by a
+    // CelImageLoader the first time it's accessed.
+    bool isImageLoaded() const {
+      return (!m_lazyImage || m_lazyImage->loaded.load(std::memory_order_acquire));
+    }
 
     // Returns a rectangle with the bounds of the image (width/height
     // of the image) in the position of the cel (useful to compare
     // active tilemap bounds when we have to change the tilemap cel
     // bounds).
     gfx::Rect imageBounds() const {
+      if (!isImageLoaded())
+        return gfx::Rect(m_bounds.origin(), m_lazyImage->size);
       return gfx::Rect(m_bounds.x,
                        m_bounds.y,
                        m_image->width(),
@@ -45,6 +66,13 @@ namespace doc {
     }
 
     void setImage(const ImageRef& image, Layer* layer);
+
+    // The image of the given size will be created by the loader the
+    // first time it's accessed through image() or imageRef(). This
+    // function can be used only when the CelData is created (before
+    // it's accessible from other threads).
+    void setImageLoader(const gfx::Size& imageSize,
+                        std::unique_ptr<CelImageLoader>&& loader);
     void setPosition(const gfx::Point& pos);
 
     void setOpacity(int opacity) {
@@ -80,14 +108,24 @@ namespace doc {
       return m_boundsF != nullptr;
     }
 
-    virtual int getMemSize() const override {
-      ASSERT(m_image);
-      return sizeof(CelData) + m_image->getMemSize();
-    }
+    virtual int getMemSize() const override;
 
     void adjustBounds(Layer* layer);
 
   private:
+    struct LazyImage {
+      gfx::Size size;
+      std::unique_ptr<CelImageLoader> loader;
+      std::mutex mutex;
+      std::atomic<bool> loaded = false;
+    };
+
+    void loadImage() const {
+      if (!isImageLoaded())
+        loadImageFromLoader();
+    }
+    void loadImageFromLoader() const;
+
     ImageRef m_image;
     int m_opacity;
     gfx::Rect m_bounds;
@@ -95,6 +133,9 @@ namespace doc {
     // Special bounds for reference layers that can have subpixel
     // position.
     mutable std::unique_ptr<gfx::RectF> m_boundsF;
+
+    // Loader of m_image when it's not created yet.
+    std::unique_ptr<LazyImage> m_lazyImage;
   };
 
   typedef std::shared_ptr<CelData> CelDataRef;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -18,11 +18,55 @@
 #include "doc/primitives.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+
 namespace doc {
 
+static Image* create_image_impl(const ImageSpec& spec,
+                                const ImageBufferPtr& buffer,
+                                const bool clearPixels)
+{
+  switch (spec.colorMode()) {
+    case ColorMode::RGB:       return new ImageImpl<RgbTraits>(spec, buffer, clearPixels);
+    case ColorMode::GRAYSCALE: return new ImageImpl<GrayscaleTraits>(spec, buffer, clearPixels);
+    case ColorMode::INDEXED:   return new ImageImpl<IndexedTraits>(spec, buffer, clearPixels);
+    case ColorMode::BITMAP:    return new ImageImpl<BitmapTraits>(spec, buffer, clearPixels);
+    case ColorMode::TILEMAP:   return new ImageImpl<TilemapTraits>(spec, buffer, clearPixels);
+  }
+  return nullptr;
+}
+
+template<typename Traits>
+static Image* create_shared_copy(const Image* image)
+{
+  return ImageImpl<Traits>::createSharedCopy(
+    static_cast<const ImageImpl<Traits>*>(image));
+}
+
+static Image* create_shared_copy_impl(const Image* image)
+{
+  switch (image->colorMode()) {
+    case ColorMode::RGB:       return create_shared_copy<RgbTraits>(image);
+    case ColorMode::GRAYSCALE: return create_shared_copy<GrayscaleTraits>(image);
+    case ColorMode::INDEXED:   return create_shared_copy<IndexedTraits>(image);
+    case ColorMode::BITMAP:    return create_shared_copy<BitmapTraits>(image);
+    case ColorMode::TILEMAP:   return create_shared_copy<TilemapTraits>(image);
+  }
+  return nullptr;
+}
+
+std::mutex Image::s_sharedBufferMutex;
+
+// Protects the refpixel/bounds of all Image::ContentBand (images can
+// be shrunk from several threads, e.g. in DocExporter).
+static std::mutex g_contentBandsMutex;
+
 Image::Image(const ImageSpec& spec)
   : Object(ObjectType::Image)
+  , m_sharedBuffer(false)
   , m_spec(spec)
+  , m_contentBands(std::make_unique<ContentBand[]>(contentBands()))
+  , m_hasContentBounds(false)
 {
 }
 
@@ -35,6 +79,32 @@ int Image::getMemSize() const
   return sizeof(Image) + rowBytes()*height();
 }
 
+bool Image::getContentBounds(const int band,
+                             const color_t refpixel,
+                             gfx::Rect& bounds) const
+{
+  ASSERT(band >= 0 && band < contentBands());
+  const ContentBand& b = m_contentBands[band];
+  const std::lock_guard lock(g_contentBandsMutex);
+  if (!b.valid || b.refpixel != refpixel)
+    return false;
+  bounds = b.bounds;
+  return true;
+}
+
+void Image::setContentBounds(const int band,
+                             const color_t refpixel,
+                             const gfx::Rect& bounds) const
+{
+  ASSERT(band >= 0 && band < contentBands());
+  ContentBand& b = m_contentBands[band];
+  const std::lock_guard lock(g_contentBandsMutex);
+  b.refpixel = refpixel;
+  b.bounds = bounds;
+  m_hasContentBounds = true;
+  b.valid = true;
+}
+
 // static
 Image* Image::create(PixelFormat format, int width, int height,
                      const ImageBufferPtr& buffer)
@@ -50,22 +120,35 @@ Image* Image::create(const ImageSpec& spec,
   if (spec.width() < 1 || spec.height() < 1)
     return nullptr;
 
-  switch (spec.colorMode()) {
-    case ColorMode::RGB:       return new ImageImpl<RgbTraits>(spec, buffer);
-    case ColorMode::GRAYSCALE: return new ImageImpl<GrayscaleTraits>(spec, buffer);
-    case ColorMode::INDEXED:   return new ImageImpl<IndexedTraits>(spec, buffer);
-    case ColorMode::BITMAP:    return new ImageImpl<BitmapTraits>(spec, buffer);
-    case ColorMode::TILEMAP:   return new ImageImpl<TilemapTraits>(spec, buffer);
-  }
-  return nullptr;
+  return create_image_impl(spec, buffer, true);
 }
 
 // static
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
-  return crop_image(image, 0, 0, image->width(), image->height(),
-                    image->maskColor(), buffer);
+
+  // Share the pixels with the original image, so the pixels are
+  // copied only if they are accessed (e.g. undo copies or
+  // duplicated frames that are not edited/displayed don't use more
+  // memory).
+  if (!buffer) {
+    if (Image* copy = create_shared_copy_impl(image))
+      return copy;
+  }
+
+  // The new image doesn't need to be cleared because all pixels are
+  // copied from the source image. As both images have the same
+  // format and size, the rows have the same stride and are
+  // contiguous in memory, so we can copy all pixels at once (instead
+  // of clearing the image and copying row by row as crop_image()).
+  Image* copy = create_image_impl(image->spec(), buffer, false);
+
+  ASSERT(copy->rowBytes() == image->rowBytes());
+  const uint8_t* src = image->getPixelAddress(0, 0);
+  std::copy(src, src + size_t(image->rowBytes())*image->height(),
+            copy->getPixelAddress(0, 0));
+  return copy;
 }
 
 } // namespace doc
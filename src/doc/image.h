@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,6 +19,10 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
@@ -38,6 +42,9 @@ namespace doc {
                          const ImageBufferPtr& buffer = ImageBufferPtr());
     static Image* create(const ImageSpec& spec,
                          const ImageBufferPtr& buffer = ImageBufferPtr());
+    // Creates a copy of the given image. If no buffer is specified,
+    // the copy shares the pixels with the original image until one
+    // of them is accessed to read/write pixels (copy-on-write).
     static Image* createCopy(const Image* image,
                              const ImageBufferPtr& buffer = ImageBufferPtr());
 
@@ -72,6 +79,23 @@ namespace doc {
 
     virtual int getMemSize() const override;
 
+    // Bounds of the pixels different from a reference pixel in each
+    // band of kContentBandHeight rows, cached by
+    // algorithm::shrink_bounds() so only the modified bands are
+    // scanned again. A band is invalidated each time one of its rows
+    // is accessed to modify pixels (getPixelAddress(), putPixel(),
+    // mutable iterators, etc.).
+    static constexpr int kContentBandHeight = 64;
+    int contentBands() const {
+      return (height() + kContentBandHeight - 1) / kContentBandHeight;
+    }
+    bool getContentBounds(const int band,
+                          const color_t refpixel,
+                          gfx::Rect& bounds) const;
+    void setContentBounds(const int band,
+                          const color_t refpixel,
+                          const gfx::Rect& bounds) const;
+
     template<typename ImageTraits>
     ImageBits<ImageTraits> lockBits(LockType lockType, const gfx::Rect& bounds) {
       return ImageBits<ImageTraits>(this, bounds);
@@ -105,8 +129,47 @@ namespace doc {
     // Number of bytes for each row.
     size_t m_rowBytes;
 
+    // True if the pixels buffer is shared with other images created
+    // with createCopy(). The buffer must be copied (unshared) before
+    // accessing the pixels.
+    mutable std::atomic<bool> m_sharedBuffer;
+
+    // Used to share/unshare buffers between different threads
+    // (e.g. when the same image is rendered from several threads).
+    static std::mutex s_sharedBufferMutex;
+
+    // Invalidates the cached content bounds of the band of the given
+    // row (called before modifying pixels of the row).
+    void invalidateContentBounds(const int y) const {
+      std::atomic<bool>& valid = m_contentBands[y / kContentBandHeight].valid;
+      if (valid.load(std::memory_order_relaxed))
+        valid.store(false, std::memory_order_relaxed);
+    }
+
+    // Invalidates the cached content bounds of all bands (called when
+    // any pixel of the image can be modified, e.g. from the address
+    // returned by getPixelAddress()).
+    void invalidateAllContentBounds() const {
+      if (m_hasContentBounds.load(std::memory_order_relaxed)) {
+        m_hasContentBounds.store(false, std::memory_order_relaxed);
+        for (int band=0; band<contentBands(); ++band)
+          m_contentBands[band].valid.store(false, std::memory_order_relaxed);
+      }
+    }
+
   private:
+    struct ContentBand {
+      std::atomic<bool> valid = false;
+      color_t refpixel = 0;
+      gfx::Rect bounds;         // Empty if all pixels are refpixel
+    };
+
     ImageSpec m_spec;
+    std::unique_ptr<ContentBand[]> m_contentBands;
+
+    // True if setContentBounds() was called for any band (to avoid
+    // iterating all bands in invalidateAllContentBounds()).
+    mutable std::atomic<bool> m_hasContentBounds;
   };
 
 } // namespace doc
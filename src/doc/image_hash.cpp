@@ -0,0 +1,97 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_hash.h"
+
+#include "doc/image.h"
+#include "doc/image_impl.h"
+#include "doc/primitives_fast.h"
+
+#include <city.h>
+
+namespace doc {
+
+ImageHash::ImageHash()
+  : m_value(initialValue(gfx::Size(0, 0)))
+{
+}
+
+ImageHash::ImageHash(const Image* image, const gfx::Rect& bounds)
+{
+  reset(image, bounds);
+}
+
+void ImageHash::reset(const Image* image, const gfx::Rect& bounds)
+{
+  ASSERT(image->bounds().contains(bounds) || bounds.isEmpty());
+
+  m_bounds = bounds;
+  m_rows.resize(bounds.h);
+  for (int y=0; y<bounds.h; ++y)
+    m_rows[y] = hashRow(image, bounds.x, bounds.y+y, bounds.w);
+  calculateValue();
+}
+
+void ImageHash::update(const Image* image, const gfx::Rect& modifiedBounds)
+{
+  const gfx::Rect rc = (m_bounds & modifiedBounds);
+  if (rc.isEmpty())
+    return;
+
+  for (int y=rc.y; y<rc.y2(); ++y)
+    m_rows[y-m_bounds.y] = hashRow(image, m_bounds.x, y, m_bounds.w);
+  calculateValue();
+}
+
+void ImageHash::calculateValue()
+{
+  m_value = initialValue(m_bounds.size());
+  for (const uint64_t rowHash : m_rows)
+    m_value = combine(m_value, rowHash);
+}
+
+// static
+uint64_t ImageHash::initialValue(const gfx::Size& size)
+{
+  return Hash128to64(uint128(size.w, size.h));
+}
+
+// static
+uint64_t ImageHash::hashRow(const Image* image, int x, int y, int w)
+{
+  ASSERT(x >= 0 && x+w <= image->width());
+  ASSERT(y >= 0 && y < image->height());
+
+  // Bitmaps have 8 pixels per byte, and the row can start in the
+  // middle of a byte, so we hash groups of 64 pixels.
+  if (image->pixelFormat() == IMAGE_BITMAP) {
+    uint64_t hash = w;
+    for (int u=0; u<w; u+=64) {
+      uint64_t bits = 0;
+      for (int i=0; i<64 && u+i<w; ++i) {
+        if (get_pixel_fast<BitmapTraits>(image, x+u+i, y))
+          bits |= (uint64_t(1) << i);
+      }
+      hash = Hash128to64(uint128(hash, bits));
+    }
+    return hash;
+  }
+
+  return CityHash64((const char*)image->getPixelAddress(x, y),
+                    size_t(w) * image->bytesPerPixel());
+}
+
+// static
+uint64_t ImageHash::combine(const uint64_t value, const uint64_t rowHash)
+{
+  return Hash128to64(uint128(value, rowHash));
+}
+
+} // namespace doc
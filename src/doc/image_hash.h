@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_HASH_H_INCLUDED
+#define DOC_IMAGE_HASH_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+
+  class Image;
+
+  // 64-bit hash of the pixels of a region of an image. Each row is
+  // hashed directly from the image pixels (without copying them),
+  // and the hash of each row is kept, so when a part of the image is
+  // modified only the modified rows are hashed again with update().
+  //
+  // The value() is the same as calculate_image_hash() with the same
+  // image/bounds.
+  class ImageHash {
+  public:
+    ImageHash();
+    ImageHash(const Image* image, const gfx::Rect& bounds);
+
+    const gfx::Rect& bounds() const { return m_bounds; }
+    uint64_t value() const { return m_value; }
+
+    // Hashes all rows of the given region of the image.
+    void reset(const Image* image, const gfx::Rect& bounds);
+
+    // Hashes again the rows of the image that intersect the given
+    // modified region.
+    void update(const Image* image, const gfx::Rect& modifiedBounds);
+
+    // Functions used to calculate the hash of a region: the initial
+    // value depends on the region size, and then each row is
+    // combined with the previous value.
+    static uint64_t initialValue(const gfx::Size& size);
+    static uint64_t hashRow(const Image* image, int x, int y, int w);
+    static uint64_t combine(const uint64_t value, const uint64_t rowHash);
+
+  private:
+    void calculateValue();
+
+    gfx::Rect m_bounds;
+    std::vector<uint64_t> m_rows;
+    uint64_t m_value;
+  };
+
+} // namespace doc
+
+#endif
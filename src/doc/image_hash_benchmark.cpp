@@ -0,0 +1,88 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_hash.h"
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace doc;
+
+// Hashes each tile of tileSize x tileSize pixels of a big image
+// (e.g. to find the tiles of a tilemap in a tileset).
+void BM_ImageHashTiles(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int tileSize = state.range(1);
+  const int w = 1024;
+  const int h = 1024;
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  uint64_t result = 0;
+  while (state.KeepRunning()) {
+    for (int y=0; y<h; y+=tileSize)
+      for (int x=0; x<w; x+=tileSize)
+        result ^= calculate_image_hash(a.get(), gfx::Rect(x, y, tileSize, tileSize));
+  }
+  benchmark::DoNotOptimize(result);
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+void BM_ImageHashWholeImage(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(calculate_image_hash(a.get(), a->bounds()));
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+// Updates the hash of a big image when a small region is modified.
+void BM_ImageHashUpdate(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  ImageHash hash(a.get(), a->bounds());
+  int y = 0;
+  while (state.KeepRunning()) {
+    hash.update(a.get(), gfx::Rect(0, y, 32, 32));
+    y = (y+32) % (h-32);
+  }
+  benchmark::DoNotOptimize(hash.value());
+}
+
+BENCHMARK(BM_ImageHashTiles)
+  ->Args({ IMAGE_RGB, 8 })
+  ->Args({ IMAGE_RGB, 16 })
+  ->Args({ IMAGE_RGB, 32 })
+  ->Args({ IMAGE_INDEXED, 8 })
+  ->Args({ IMAGE_INDEXED, 16 })
+  ->Args({ IMAGE_INDEXED, 32 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_ImageHashWholeImage)
+  ->Args({ IMAGE_RGB, 256, 256 })
+  ->Args({ IMAGE_RGB, 4096, 4096 })
+  ->Args({ IMAGE_INDEXED, 4096, 4096 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK(BM_ImageHashUpdate)
+  ->Args({ IMAGE_RGB, 4096, 4096 })
+  ->Args({ IMAGE_INDEXED, 4096, 4096 })
+  ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,81 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_hash.h"
+
+#include "doc/algorithm/random_image.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+
+using namespace doc;
+
+TEST(ImageHash, SubRectangleEqualsCopy)
+{
+  for (auto pf : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED, IMAGE_BITMAP, IMAGE_TILEMAP }) {
+    ImageRef a(Image::create(pf, 97, 61));
+    doc::algorithm::random_image(a.get());
+
+    for (const gfx::Rect& rc : { gfx::Rect(0, 0, 97, 61),
+                                 gfx::Rect(3, 5, 16, 16),
+                                 gfx::Rect(7, 0, 90, 1),
+                                 gfx::Rect(96, 60, 1, 1) }) {
+      ImageRef b(crop_image(a.get(), rc, 0));
+      EXPECT_EQ(calculate_image_hash(b.get(), b->bounds()),
+                calculate_image_hash(a.get(), rc))
+        << "Pixel format=" << pf;
+      EXPECT_EQ(calculate_image_hash(a.get(), rc),
+                ImageHash(a.get(), rc).value());
+    }
+  }
+}
+
+TEST(ImageHash, DifferentPixelsOrSizes)
+{
+  ImageRef a(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(a.get(), rgba(0, 0, 0, 255));
+
+  const uint64_t hash = calculate_image_hash(a.get(), a->bounds());
+  put_pixel(a.get(), 15, 15, rgba(0, 0, 0, 254));
+  EXPECT_NE(hash, calculate_image_hash(a.get(), a->bounds()));
+
+  // Same bytes with a different width/height
+  clear_image(a.get(), 0);
+  EXPECT_NE(calculate_image_hash(a.get(), gfx::Rect(0, 0, 16, 4)),
+            calculate_image_hash(a.get(), gfx::Rect(0, 0, 8, 8)));
+}
+
+TEST(ImageHash, Update)
+{
+  ImageRef a(Image::create(IMAGE_RGB, 64, 64));
+  doc::algorithm::random_image(a.get());
+
+  const gfx::Rect bounds(8, 8, 48, 48);
+  ImageHash hash(a.get(), bounds);
+  EXPECT_EQ(bounds, hash.bounds());
+
+  fill_rect(a.get(), 20, 30, 25, 40, rgba(255, 0, 0, 255));
+  hash.update(a.get(), gfx::Rect(20, 30, 6, 11));
+  EXPECT_EQ(calculate_image_hash(a.get(), bounds), hash.value());
+
+  // Modifications outside the bounds don't change the hash
+  const uint64_t value = hash.value();
+  fill_rect(a.get(), 0, 0, 7, 63, rgba(0, 255, 0, 255));
+  hash.update(a.get(), gfx::Rect(0, 0, 8, 64));
+  EXPECT_EQ(value, hash.value());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -31,18 +31,67 @@ namespace doc {
     using const_address_t = typename traits_t::const_address_t;
 
   private:
-    ImageBufferPtr m_buffer;
-    address_t* m_rows;
-    address_t m_bits;
-
-    inline address_t getLineAddress(int y) {
+    // The buffer/rows can be modified from const member functions
+    // when the buffer is unshared (see unshareBuffer()).
+    mutable ImageBufferPtr m_buffer;
+    mutable address_t* m_rows;
+    mutable address_t m_bits;
+
+    // True if the buffer was allocated by this image, so it can be
+    // shared with copies of this image (a buffer specified by the
+    // user can be re-used by the user for other images).
+    bool m_ownBuffer;
+
+    // Returns the address of a row to read its pixels.
+    inline const_address_t getReadLineAddress(int y) const {
       ASSERT(y >= 0 && y < height());
+      if (m_sharedBuffer.load(std::memory_order_acquire))
+        unshareBuffer();
       return m_rows[y];
     }
 
-    inline const_address_t getLineAddress(int y) const {
-      ASSERT(y >= 0 && y < height());
-      return m_rows[y];
+    // Returns the address of a row that can be used to modify its
+    // pixels (so the cached content bounds of the row are
+    // invalidated).
+    inline address_t getLineAddress(int y) const {
+      invalidateContentBounds(y);
+      return (address_t)getReadLineAddress(y);
+    }
+
+    std::size_t rowsSize() const {
+      return doc_align_size(sizeof(address_t) * height());
+    }
+
+    std::size_t requiredSize() const {
+      return rowsSize() + m_rowBytes * height();
+    }
+
+    void setupRows() const {
+      m_rows = (address_t*)m_buffer->buffer();
+      m_bits = (address_t)(m_buffer->buffer() + rowsSize());
+
+      auto addr = (uint8_t*)m_bits;
+      for (int y=0; y<height(); ++y) {
+        m_rows[y] = (address_t)addr;
+        addr += m_rowBytes;
+      }
+    }
+
+    // Copies the pixels to a new buffer that is not shared with
+    // other images (or just marks the buffer as not shared if the
+    // other images were already unshared/deleted).
+    void unshareBuffer() const {
+      const std::lock_guard lock(s_sharedBufferMutex);
+      if (!m_sharedBuffer)        // Unshared from other thread
+        return;
+
+      if (m_buffer.use_count() > 1) {
+        auto oldBits = (const uint8_t*)m_bits;
+        m_buffer = std::make_shared<ImageBuffer>(requiredSize());
+        setupRows();
+        std::copy(oldBits, oldBits + m_rowBytes*height(), (uint8_t*)m_bits);
+      }
+      m_sharedBuffer.store(false, std::memory_order_release);
     }
 
   public:
@@ -55,49 +104,71 @@ namespace doc {
       }
     }
 
+    // Same as address() but the pixel can be used only to read it.
+    inline const_address_t readAddress(int x, int y) const {
+      if constexpr (Traits::pixels_per_byte == 0) {
+        return getReadLineAddress(y) + x;
+      }
+      else {
+        return getReadLineAddress(y) + x / Traits::pixels_per_byte;
+      }
+    }
+
+    // If "clearPixels" is false, the pixels are not initialized
+    // (used when all pixels will be overwritten, e.g. in
+    // Image::createCopy()).
     ImageImpl(const ImageSpec& spec,
-              const ImageBufferPtr& buffer)
+              const ImageBufferPtr& buffer,
+              const bool clearPixels = true)
       : Image(spec)
       , m_buffer(buffer)
+      , m_ownBuffer(!buffer)
     {
       ASSERT(Traits::color_mode == spec.colorMode());
 
       m_rowBytes = Traits::rowstride_bytes(width());
 
-      const std::size_t for_rows = doc_align_size(sizeof(address_t) * height());
-      const std::size_t for_pixels = m_rowBytes * height();
-      const std::size_t required_size = for_pixels + for_rows;
-
+      const std::size_t required_size = requiredSize();
       if (!m_buffer)
         m_buffer = std::make_shared<ImageBuffer>(required_size);
       else
         m_buffer->resizeIfNecessary(required_size);
 
-      std::fill(m_buffer->buffer(),
-                m_buffer->buffer()+required_size, 0);
+      if (clearPixels) {
+        std::fill(m_buffer->buffer(),
+                  m_buffer->buffer()+required_size, 0);
+      }
 
-      m_rows = (address_t*)m_buffer->buffer();
-      m_bits = (address_t)(m_buffer->buffer() + for_rows);
+      setupRows();
+    }
 
-      auto addr = (uint8_t*)m_bits;
-      for (int y=0; y<height(); ++y) {
-        m_rows[y] = (address_t)addr;
-        addr += m_rowBytes;
-      }
+    // Creates a copy of the given image sharing its buffer (the
+    // buffer is copied when the pixels of one of the images are
+    // accessed). Returns nullptr if the buffer cannot be shared.
+    static ImageImpl* createSharedCopy(const ImageImpl* src) {
+      if (!src->m_ownBuffer)
+        return nullptr;
+
+      const std::lock_guard lock(s_sharedBufferMutex);
+      return new ImageImpl(src);
     }
 
+    // The returned address can be used to access any pixel of the
+    // image (e.g. the whole buffer from getPixelAddress(0, 0)), so
+    // the content bounds of all rows are invalidated.
     uint8_t* getPixelAddress(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
-      return (uint8_t*)address(x, y);
+      invalidateAllContentBounds();
+      return (uint8_t*)readAddress(x, y);
     }
 
     color_t getPixel(int x, int y) const override {
       ASSERT(x >= 0 && x < width());
       ASSERT(y >= 0 && y < height());
 
-      return *address(x, y);
+      return *readAddress(x, y);
     }
 
     void putPixel(int x, int y, color_t color) override {
@@ -118,7 +189,7 @@ namespace doc {
 
     void copy(const Image* _src, gfx::Clip area) override {
       const ImageImpl<Traits>* src = (const ImageImpl<Traits>*)_src;
-      address_t src_address;
+      const_address_t src_address;
       address_t dst_address;
 
       if (!area.clip(width(), height(), src->width(), src->height()))
@@ -127,7 +198,7 @@ namespace doc {
       for (int end_y=area.dst.y+area.size.h;
            area.dst.y<end_y;
            ++area.dst.y, ++area.src.y) {
-        src_address = src->address(area.src.x, area.src.y);
+        src_address = src->readAddress(area.src.x, area.src.y);
         dst_address = address(area.dst.x, area.dst.y);
 
         std::copy(src_address,
@@ -161,6 +232,19 @@ namespace doc {
     }
 
   private:
+    // Used by createSharedCopy() with s_sharedBufferMutex locked.
+    explicit ImageImpl(const ImageImpl* src)
+      : Image(src->spec())
+      , m_buffer(src->m_buffer)
+      , m_rows(src->m_rows)
+      , m_bits(src->m_bits)
+      , m_ownBuffer(true)
+    {
+      m_rowBytes = src->m_rowBytes;
+      m_sharedBuffer = true;
+      src->m_sharedBuffer = true;
+    }
+
     bool clip_rects(const Image* src, int& dst_x, int& dst_y, int& src_x, int& src_y, int& w, int& h) const {
       // Clip with destionation image
       if (dst_x < 0) {
@@ -222,13 +306,13 @@ namespace doc {
 
   template<>
   inline void ImageImpl<IndexedTraits>::clear(color_t color) {
-    uint8_t* p = address(0, 0);
+    uint8_t* p = getPixelAddress(0, 0);
     std::fill(p, p+rowBytes()*height(), color);
   }
 
   template<>
   inline void ImageImpl<BitmapTraits>::clear(color_t color) {
-    uint8_t* p = address(0, 0);
+    uint8_t* p = getPixelAddress(0, 0);
     std::fill(p, p+rowBytes()*height(), (color ? 0xff: 0x00));
   }
 
@@ -238,7 +322,7 @@ namespace doc {
     ASSERT(y >= 0 && y < height());
 
     std::div_t d = std::div(x, 8);
-    return ((*(getLineAddress(y) + d.quot)) & (1<<d.rem)) ? 1: 0;
+    return ((*(getReadLineAddress(y) + d.quot)) & (1<<d.rem)) ? 1: 0;
   }
 
   template<>
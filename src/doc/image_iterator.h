@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "gfx/rect.h"
 
 #include <cstdlib>
+#include <type_traits>
 
 #include <iostream>
 
@@ -48,7 +49,7 @@ namespace doc {
 
     ImageIteratorT(const Image* image, const gfx::Rect& bounds, int x, int y) :
       m_image(const_cast<Image*>(image)),
-      m_ptr(get_pixel_address_fast<ImageTraits>(image, x, y)),
+      m_ptr(getAddress(image, x, y)),
       m_x(x),
       m_y(y),
       m_xbegin(bounds.x),
@@ -102,7 +103,7 @@ namespace doc {
         ++m_y;
 
         if (m_y < m_image->height())
-          m_ptr = get_pixel_address_fast<ImageTraits>(m_image, m_x, m_y);
+          m_ptr = getAddress(m_image, m_x, m_y);
       }
 
       return *this;
@@ -126,6 +127,15 @@ namespace doc {
     int y() const { return m_y; }
 
   private:
+    // Const iterators only read pixels, so they don't invalidate the
+    // cached content bounds of the image.
+    static pointer getAddress(const Image* image, int x, int y) {
+      if constexpr (std::is_const_v<std::remove_pointer_t<pointer>>)
+        return get_pixel_read_address_fast<ImageTraits>(image, x, y);
+      else
+        return get_pixel_address_fast<ImageTraits>(image, x, y);
+    }
+
     Image* m_image = nullptr;
     pointer m_ptr = nullptr;
     int m_x = 0, m_y = 0;
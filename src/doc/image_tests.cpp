@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,8 @@
 #include "doc/primitives.h"
 
 #include <memory>
+#include <thread>
+#include <vector>
 
 using namespace base;
 using namespace doc;
@@ -225,6 +227,105 @@ TYPED_TEST(ImageAllTypes, FillRect)
   }
 }
 
+TYPED_TEST(ImageAllTypes, CreateCopy)
+{
+  typedef TypeParam ImageTraits;
+
+  for (int w : { 1, 7, 8, 9, 33 }) {
+    for (int h : { 1, 5, 32 }) {
+      std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+      image->setMaskColor(ImageTraits::max_value);
+      image->setColorSpace(gfx::ColorSpace::MakeSRGB());
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          put_pixel_fast<ImageTraits>(image.get(), x, y, rand() & ImageTraits::max_value);
+
+      std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+      EXPECT_EQ(image->spec(), copy->spec());
+      EXPECT_EQ(image->rowBytes(), copy->rowBytes());
+      EXPECT_TRUE(is_same_image(image.get(), copy.get()));
+
+      // The copy doesn't share pixels with the original image
+      put_pixel_fast<ImageTraits>(copy.get(), 0, 0, get_pixel_fast<ImageTraits>(image.get(), 0, 0) ^ 1);
+      EXPECT_FALSE(is_same_image(image.get(), copy.get()));
+    }
+  }
+}
+
+TYPED_TEST(ImageAllTypes, CopyOnWrite)
+{
+  typedef TypeParam ImageTraits;
+
+  std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, 9, 5));
+  for (int y=0; y<5; ++y)
+    for (int x=0; x<9; ++x)
+      put_pixel_fast<ImageTraits>(image.get(), x, y, (x+y) & ImageTraits::max_value);
+
+  // Modify the original image after creating copies
+  std::unique_ptr<Image> copy1(Image::createCopy(image.get()));
+  std::unique_ptr<Image> copy2(Image::createCopy(copy1.get()));
+  std::unique_ptr<Image> copy3(Image::createCopy(image.get()));
+  const color_t c = get_pixel(image.get(), 4, 2);
+  image->putPixel(4, 2, c ^ 1);
+  EXPECT_EQ(c ^ 1, get_pixel(image.get(), 4, 2));
+  EXPECT_EQ(c, get_pixel(copy1.get(), 4, 2));
+  EXPECT_EQ(c, get_pixel(copy2.get(), 4, 2));
+  EXPECT_EQ(c, get_pixel(copy3.get(), 4, 2));
+
+  // Modify one copy
+  *copy1->getPixelAddress(0, 0) ^= 1;
+  EXPECT_FALSE(is_same_image(copy1.get(), copy2.get()));
+  EXPECT_TRUE(is_same_image(copy2.get(), copy3.get()));
+
+  // Delete the copies that share the pixels
+  copy3.reset();
+  clear_image(copy2.get(), 0);
+  EXPECT_EQ(c ^ 1, get_pixel(image.get(), 4, 2));
+  EXPECT_EQ(c, get_pixel(copy1.get(), 4, 2));
+  EXPECT_EQ(0, get_pixel(copy2.get(), 4, 2));
+}
+
+TEST(Image, CopyOnWriteUserBuffer)
+{
+  // Images with a buffer specified by the user are always copied
+  // (as the buffer can be re-used by the user for other images)
+  ImageBufferPtr buffer = std::make_shared<ImageBuffer>();
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, 4, 4, buffer));
+  clear_image(image.get(), rgba(255, 0, 0, 255));
+  std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+  std::unique_ptr<Image> image2(Image::create(IMAGE_RGB, 4, 4, buffer));
+  EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(copy.get(), 2, 2));
+  EXPECT_EQ(0, get_pixel(image2.get(), 2, 2));
+}
+
+TEST(Image, CopyOnWriteThreads)
+{
+  // The same copy can be read from several threads (e.g. rendering
+  // tiles of the canvas in parallel)
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, 64, 64));
+  for (int y=0; y<64; ++y)
+    for (int x=0; x<64; ++x)
+      put_pixel_fast<RgbTraits>(image.get(), x, y, rgba(x, y, 0, 255));
+
+  for (int i=0; i<32; ++i) {
+    std::unique_ptr<Image> copy(Image::createCopy(image.get()));
+    std::vector<std::thread> threads;
+    std::vector<int> errors(8, 0);
+    for (int t=0; t<8; ++t) {
+      threads.emplace_back([&copy, &errors, t]{
+        for (int y=0; y<64; ++y)
+          for (int x=0; x<64; ++x)
+            if (get_pixel_fast<RgbTraits>(copy.get(), x, y) != rgba(x, y, 0, 255))
+              ++errors[t];
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    for (int t=0; t<8; ++t)
+      EXPECT_EQ(0, errors[t]);
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -49,6 +49,10 @@ namespace doc {
       return get_rgba_blender(blend_mode, newBlend);
     }
 
+    static inline RgbaBlendRowFunc get_row_blender(BlendMode blend_mode, bool newBlend) {
+      return get_rgba_row_blender(blend_mode, newBlend);
+    }
+
     static inline bool same_color(const pixel_t a, const pixel_t b) {
       if (rgba_geta(a) == 0) {
         if (rgba_geta(b) == 0)
@@ -92,6 +96,10 @@ namespace doc {
       return get_graya_blender(blend_mode, newBlend);
     }
 
+    static inline GrayaBlendRowFunc get_row_blender(BlendMode blend_mode, bool newBlend) {
+      return get_graya_row_blender(blend_mode, newBlend);
+    }
+
     static inline bool same_color(const pixel_t a, const pixel_t b) {
       if (graya_geta(a) == 0) {
         if (graya_geta(b) == 0)
@@ -135,6 +143,10 @@ namespace doc {
       return get_indexed_blender(blend_mode, newBlend);
     }
 
+    static inline IndexedBlendRowFunc get_row_blender(BlendMode blend_mode, bool newBlend) {
+      return get_indexed_row_blender(blend_mode, newBlend);
+    }
+
     static inline bool same_color(const pixel_t a, const pixel_t b) {
       return a == b;
     }
@@ -203,6 +215,10 @@ namespace doc {
       return get_indexed_blender(blend_mode, newBlend);
     }
 
+    static inline RgbaBlendRowFunc get_row_blender(BlendMode blend_mode, bool newBlend) {
+      return get_tilemap_row_blender(blend_mode, newBlend);
+    }
+
     static inline bool same_color(const pixel_t a, const pixel_t b) {
       return a == b;
     }
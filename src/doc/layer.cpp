@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -253,8 +253,11 @@ int LayerImage::getMemSize() const
     const Cel* cel = *it;
     size += cel->getMemSize();
 
-    const Image* image = cel->image();
-    size += image->getMemSize();
+    // Don't load images just to get their size
+    if (cel->data()->isImageLoaded()) {
+      const Image* image = cel->image();
+      size += image->getMemSize();
+    }
   }
 
   return size;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,8 +12,10 @@
 #include "doc/primitives.h"
 
 #include "doc/algo.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/brush.h"
 #include "doc/dispatch.h"
+#include "doc/image_hash.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/remap.h"
@@ -21,8 +23,6 @@
 #include "doc/tile.h"
 #include "gfx/region.h"
 
-#include <city.h>
-
 #include <stdexcept>
 
 #if defined(__x86_64__) || defined(_WIN64)
@@ -449,7 +449,13 @@ bool is_empty_image(const Image* img)
   color_t c = 0;                // alpha = 0
   if (img->colorMode() == ColorMode::INDEXED)
     c = img->maskColor();
-  return is_plain_image(img, c);
+  if (img->isTilemap())
+    return is_plain_image(img, c);
+
+  // Use the cached content bounds of the image (only modified rows
+  // are scanned again)
+  gfx::Rect bounds;
+  return !algorithm::shrink_bounds(img, c, nullptr, bounds);
 }
 
 int count_diff_between_images(const Image* i1, const Image* i2)
@@ -539,47 +545,16 @@ void remap_image(Image* image, const Remap& remap)
   }
 }
 
-// TODO test this hash routine and find a better alternative
-
-template <typename ImageTraits, uint32_t Mask>
-static uint32_t calculate_image_hash_templ(const Image* image,
-                                           const gfx::Rect& bounds)
+uint64_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
 {
-#if defined(__LP64__) || defined(__x86_64__) || defined(_WIN64)
-  #define CITYHASH(buf, len) (CityHash64(buf, len) & 0xffffffff)
-  static_assert(sizeof(void*) == 8, "This CPU is not 64-bit");
-#else
-  #define CITYHASH(buf, len) CityHash32(buf, len)
-  static_assert(sizeof(void*) == 4, "This CPU is not 32-bit");
-#endif
+  ASSERT(img->bounds().contains(bounds) || bounds.isEmpty());
 
-  const uint32_t widthBytes = ImageTraits::bytes_per_pixel * bounds.w;
-  const uint32_t len = widthBytes * bounds.h;
-  if (bounds == image->bounds() &&
-      widthBytes == image->rowBytes()) {
-    return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
-  }
-  else {
-    std::vector<uint8_t> buf(len);
-    uint8_t* dst = &buf[0];
-    for (int y=0; y<bounds.h; ++y, dst+=widthBytes) {
-      auto src = (const uint8_t*)image->getPixelAddress(bounds.x, bounds.y+y);
-      std::copy(src, src+widthBytes, dst);
-    }
-    return CITYHASH((const char*)&buf[0], buf.size());
-  }
-}
-
-uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
-{
-  switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_rgb_mask>(img, bounds);
-    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_v_mask>(img, bounds);
-    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits, 0xff>(img, bounds);
-    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits, 1>(img, bounds);
-  }
-  ASSERT(false);
-  return 0;
+  // Hash row by row (the same as ImageHash) so we don't need to copy
+  // the pixels of a sub-rectangle in a temporary buffer.
+  uint64_t hash = ImageHash::initialValue(bounds.size());
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    hash = ImageHash::combine(hash, ImageHash::hashRow(img, bounds.x, y, bounds.w));
+  return hash;
 }
 
 void preprocess_transparent_pixels(Image* image)
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -50,7 +50,10 @@ namespace doc {
 
   void remap_image(Image* image, const Remap& remap);
 
-  uint32_t calculate_image_hash(const Image* image,
+  // 64-bit hash of the pixels inside the given bounds (the hash of a
+  // sub-rectangle is the same as the hash of a copy of that part of
+  // the image). See ImageHash to update a hash incrementally.
+  uint64_t calculate_image_hash(const Image* image,
                                 const gfx::Rect& bounds);
 
   // Sets RGB values to 0 when alpha=0 (to match images with alpha=0
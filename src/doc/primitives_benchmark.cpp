@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -41,6 +41,31 @@ void BM_IsSameImageNew(benchmark::State& state) {
   }
 }
 
+// Old Image::createCopy() implementation
+void BM_CopyWithCropImage(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  while (state.KeepRunning()) {
+    ImageRef b(crop_image(a.get(), 0, 0, w, h, a->maskColor()));
+  }
+}
+
+void BM_CreateCopy(benchmark::State& state) {
+  const auto pf = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+  ImageRef a(Image::create(pf, w, h));
+  doc::algorithm::random_image(a.get());
+  while (state.KeepRunning()) {
+    // Modify the copy to copy the pixels (copy-on-write)
+    ImageRef b(Image::createCopy(a.get()));
+    b->putPixel(0, 0, 0);
+  }
+}
+
 #define DEFARGS()                                                \
    ->Args({ IMAGE_RGB, 16, 16 })                                 \
    ->Args({ IMAGE_RGB, 1024, 1024 })                             \
@@ -60,4 +85,12 @@ BENCHMARK(BM_IsSameImageNew)
   DEFARGS()
   ->UseRealTime();
 
+BENCHMARK(BM_CopyWithCropImage)
+  DEFARGS()
+  ->UseRealTime();
+
+BENCHMARK(BM_CreateCopy)
+  DEFARGS()
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
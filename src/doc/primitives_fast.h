@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -24,12 +24,22 @@ namespace doc {
     return (((ImageImpl<Traits>*)image)->address(x, y));
   }
 
+  // Same as get_pixel_address_fast() but the address can be used only
+  // to read pixels (so the image is not considered modified).
+  template<class Traits>
+  inline typename Traits::const_address_t get_pixel_read_address_fast(const Image* image, int x, int y) {
+    ASSERT(x >= 0 && x < image->width());
+    ASSERT(y >= 0 && y < image->height());
+
+    return (((const ImageImpl<Traits>*)image)->readAddress(x, y));
+  }
+
   template<class Traits>
   inline typename Traits::pixel_t get_pixel_fast(const Image* image, int x, int y) {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    return *(((ImageImpl<Traits>*)image)->address(x, y));
+    return *(((const ImageImpl<Traits>*)image)->readAddress(x, y));
   }
 
   template<class Traits>
@@ -48,7 +58,7 @@ namespace doc {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    return (*image->getPixelAddress(x, y)) & (1 << (x % 8)) ? 1: 0;
+    return image->getPixel(x, y);
   }
 
   template<>
@@ -56,10 +66,7 @@ namespace doc {
     ASSERT(x >= 0 && x < image->width());
     ASSERT(y >= 0 && y < image->height());
 
-    if (color)
-      *image->getPixelAddress(x, y) |= (1 << (x % 8));
-    else
-      *image->getPixelAddress(x, y) &= ~(1 << (x % 8));
+    image->putPixel(x, y, color);
   }
 
 } // namespace doc
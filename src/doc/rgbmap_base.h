@@ -27,10 +27,9 @@ public:
     m_fitCriteria = fitCriteria;
   }
 
-private:
+protected:
   void rgbToOtherSpace(double& r, double& g, double& b) const;
 
-protected:
   FitCriteria m_fitCriteria;
   const Palette* m_palette = nullptr;
   int m_modifications = 0;
@@ -0,0 +1,187 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/rgbmap_kdtree.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace doc {
+
+RgbMapKdTree::RgbMapKdTree()
+  : m_cache(new std::atomic<uint64_t>[1 << kCacheBits])
+{
+  for (int i=0; i<(1 << kCacheBits); ++i)
+    m_cache[i].store(0, std::memory_order_relaxed);
+}
+
+void RgbMapKdTree::regenerateMap(const Palette* palette,
+                                 const int maskIndex,
+                                 const FitCriteria fitCriteria)
+{
+  // Skip useless regenerations
+  if (m_palette == palette &&
+      m_modifications == palette->getModifications() &&
+      m_maskIndex == maskIndex &&
+      m_fitCriteria == fitCriteria)
+    return;
+
+  m_palette = palette;
+  m_fitCriteria = fitCriteria;
+  m_modifications = palette->getModifications();
+  m_maskIndex = maskIndex;
+
+  // Indexed images can reference only the first 256 entries (the
+  // same limit used in Palette::findBestfit())
+  const int size = std::min(256, palette->size());
+  m_points.clear();
+  m_points.reserve(size);
+  for (int i=0; i<size; ++i) {
+    if (i == maskIndex)
+      continue;
+    Point p;
+    toPoint(palette->getEntry(i), p.v);
+    p.index = i;
+    m_points.push_back(p);
+  }
+  m_axis.resize(m_points.size());
+  buildTree(0, int(m_points.size()));
+
+  for (int i=0; i<(1 << kCacheBits); ++i)
+    m_cache[i].store(0, std::memory_order_relaxed);
+}
+
+int RgbMapKdTree::findNearest(const color_t rgba) const
+{
+  if (rgba_geta(rgba) == 0 && m_maskIndex >= 0)
+    return m_maskIndex;
+
+  double q[4];
+  toPoint(rgba, q);
+
+  int best = 0;
+  double bestDist = std::numeric_limits<double>::max();
+  search(q, 0, int(m_points.size()), best, bestDist);
+  return best;
+}
+
+// Converts the color to a point where the squared Euclidean distance
+// is the metric of the given fit criteria. For criteria other than
+// DEFAULT, all operations are the same ones used in
+// RgbMapBase::findBestfit(), so distances compare exactly in the same
+// way as in the linear search.
+void RgbMapKdTree::toPoint(const color_t rgba, double v[4]) const
+{
+  const int r = rgba_getr(rgba);
+  const int g = rgba_getg(rgba);
+  const int b = rgba_getb(rgba);
+  const int a = rgba_geta(rgba);
+
+  if (m_fitCriteria == FitCriteria::DEFAULT) {
+    // Same weights used in Palette::initBestfit()
+    v[0] = 30 * r;
+    v[1] = 59 * g;
+    v[2] = 11 * b;
+    v[3] = 8 * a;
+  }
+  else {
+    v[0] = double(r);
+    v[1] = double(g);
+    v[2] = double(b);
+    rgbToOtherSpace(v[0], v[1], v[2]);
+    v[3] = double(a) / 128.0;
+  }
+}
+
+void RgbMapKdTree::buildTree(const int lo, const int hi)
+{
+  if (hi - lo <= 1) {
+    if (lo < hi)
+      m_axis[lo] = 0;
+    return;
+  }
+
+  // Split by the axis with the widest spread
+  int axis = 0;
+  double widest = -1.0;
+  for (int k=0; k<4; ++k) {
+    double min = m_points[lo].v[k];
+    double max = min;
+    for (int i=lo+1; i<hi; ++i) {
+      min = std::min(min, m_points[i].v[k]);
+      max = std::max(max, m_points[i].v[k]);
+    }
+    if (max - min > widest) {
+      widest = max - min;
+      axis = k;
+    }
+  }
+
+  const int mid = (lo + hi) / 2;
+  std::nth_element(m_points.begin()+lo,
+                   m_points.begin()+mid,
+                   m_points.begin()+hi,
+                   [axis](const Point& a, const Point& b) {
+                     return a.v[axis] < b.v[axis];
+                   });
+  m_axis[mid] = axis;
+
+  buildTree(lo, mid);
+  buildTree(mid+1, hi);
+}
+
+void RgbMapKdTree::search(const double q[4], const int lo, const int hi,
+                          int& best, double& bestDist) const
+{
+  if (lo >= hi)
+    return;
+
+  const int mid = (lo + hi) / 2;
+  const Point& p = m_points[mid];
+  const double d0 = q[0] - p.v[0];
+  const double d1 = q[1] - p.v[1];
+  const double d2 = q[2] - p.v[2];
+  const double d3 = q[3] - p.v[3];
+  const double dist = d0*d0 + d1*d1 + d2*d2 + d3*d3;
+  if (dist < bestDist || (dist == bestDist && p.index < best)) {
+    best = p.index;
+    bestDist = dist;
+  }
+
+  // Visit the side of the splitting plane that contains the query
+  // first. The other side is visited only if it might contain a
+  // closer point (or an equidistant one with a lower index).
+  const int axis = m_axis[mid];
+  const double diff = q[axis] - p.v[axis];
+  if (diff < 0.0) {
+    search(q, lo, mid, best, bestDist);
+    if (diff*diff <= bestDist)
+      search(q, mid+1, hi, best, bestDist);
+  }
+  else {
+    search(q, mid+1, hi, best, bestDist);
+    if (diff*diff <= bestDist)
+      search(q, lo, mid, best, bestDist);
+  }
+}
+
+int RgbMapKdTree::generateEntry(const color_t rgba) const
+{
+  const int index = findNearest(rgba);
+  ASSERT(index >= 0 && index < 256);
+  m_cache[cacheIndex(rgba)].store(
+    kValidEntry | (uint64_t(index & 0xff) << 32) | rgba,
+    std::memory_order_relaxed);
+  return index;
+}
+
+} // namespace doc
@@ -0,0 +1,91 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_RGBMAP_KDTREE_H_INCLUDED
+#define DOC_RGBMAP_KDTREE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/ints.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_base.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace doc {
+
+  // Finds the nearest palette entry for each color using a k-d tree
+  // of the palette entries, so each lookup visits only a few nodes
+  // instead of the whole palette. The result is exact: for
+  // FitCriteria::DEFAULT it uses the weighted RGBA distance of
+  // Palette::findBestfit() but with 8-bit precision (instead of 5
+  // bits), and for other criteria it returns the same index as
+  // RgbMapBase::findBestfit(). In both cases ties are resolved with
+  // the first palette index. Recently mapped colors are cached.
+  class RgbMapKdTree : public RgbMapBase {
+  public:
+    RgbMapKdTree();
+
+    // RgbMap impl
+    void regenerateMap(const Palette* palette,
+                       const int maskIndex,
+                       const FitCriteria fitCriteria) override;
+    void regenerateMap(const Palette* palette,
+                       const int maskIndex) override {
+      regenerateMap(palette, maskIndex, m_fitCriteria);
+    }
+
+    int mapColor(const color_t rgba) const override {
+      const uint64_t entry =
+        m_cache[cacheIndex(rgba)].load(std::memory_order_relaxed);
+      if ((entry & kValidEntry) && uint32_t(entry) == rgba)
+        return int((entry >> 32) & 0xff);
+      return generateEntry(rgba);
+    }
+
+    RgbMapAlgorithm rgbmapAlgorithm() const override {
+      return RgbMapAlgorithm::KDTREE;
+    }
+
+    // Searches the nearest palette entry without using the cache.
+    int findNearest(const color_t rgba) const;
+
+  private:
+    // Each cache entry contains the RGBA color in the lower 32 bits
+    // and the palette index in the next 8 bits.
+    static constexpr uint64_t kValidEntry = (uint64_t(1) << 40);
+    static constexpr int kCacheBits = 16;
+
+    static int cacheIndex(const color_t rgba) {
+      return int((rgba * 2654435761u) >> (32 - kCacheBits));
+    }
+
+    struct Point {
+      double v[4];
+      int index;
+    };
+
+    void toPoint(const color_t rgba, double v[4]) const;
+    void buildTree(const int lo, const int hi);
+    void search(const double q[4], const int lo, const int hi,
+                int& best, double& bestDist) const;
+    int generateEntry(const color_t rgba) const;
+
+    // Palette entries sorted as an implicit k-d tree: the node of
+    // the range [lo,hi) is the point in (lo+hi)/2, and it splits the
+    // range in the m_axis[(lo+hi)/2] coordinate.
+    std::vector<Point> m_points;
+    std::vector<int> m_axis;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_cache;
+
+    DISABLE_COPYING(RgbMapKdTree);
+  };
+
+} // namespace doc
+
+#endif
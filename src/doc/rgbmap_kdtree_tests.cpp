@@ -0,0 +1,117 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/rgbmap_kdtree.h"
+
+#include <limits>
+#include <random>
+
+using namespace doc;
+
+// Linear search with the FitCriteria::DEFAULT metric in 8-bit precision
+static int linear_bestfit(const Palette& pal, const color_t c, const int maskIndex)
+{
+  if (rgba_geta(c) == 0 && maskIndex >= 0)
+    return maskIndex;
+
+  int best = 0;
+  int lowest = std::numeric_limits<int>::max();
+  for (int i=0; i<pal.size(); ++i) {
+    const color_t p = pal.getEntry(i);
+    const int dr = 30 * (rgba_getr(c) - rgba_getr(p));
+    const int dg = 59 * (rgba_getg(c) - rgba_getg(p));
+    const int db = 11 * (rgba_getb(c) - rgba_getb(p));
+    const int da = 8 * (rgba_geta(c) - rgba_geta(p));
+    const int diff = dr*dr + dg*dg + db*db + da*da;
+    if (diff < lowest && i != maskIndex) {
+      lowest = diff;
+      best = i;
+    }
+  }
+  return best;
+}
+
+static Palette random_palette(std::mt19937& rng, const int n)
+{
+  Palette pal(frame_t(0), n);
+  for (int i=0; i<n; ++i)
+    pal.setEntry(i, rng());
+  return pal;
+}
+
+TEST(RgbMapKdTree, DefaultCriteria)
+{
+  std::mt19937 rng(1);
+  for (int maskIndex : { -1, 0, 17 }) {
+    Palette pal = random_palette(rng, 256);
+    RgbMapKdTree map;
+    map.regenerateMap(&pal, maskIndex, FitCriteria::DEFAULT);
+
+    for (int i=0; i<20000; ++i) {
+      const color_t c = (i < 256 ? pal.getEntry(i): color_t(rng()));
+      ASSERT_EQ(linear_bestfit(pal, c, maskIndex), map.mapColor(c));
+      // Second time uses the cache
+      ASSERT_EQ(linear_bestfit(pal, c, maskIndex), map.mapColor(c));
+    }
+  }
+}
+
+TEST(RgbMapKdTree, OtherCriteria)
+{
+  std::mt19937 rng(2);
+  for (auto fc : { FitCriteria::RGB,
+                   FitCriteria::linearizedRGB,
+                   FitCriteria::CIEXYZ,
+                   FitCriteria::CIELAB }) {
+    Palette pal = random_palette(rng, 256);
+    RgbMapKdTree map;
+    map.regenerateMap(&pal, 0, fc);
+
+    for (int i=0; i<5000; ++i) {
+      const color_t c = rng();
+      EXPECT_EQ(map.findBestfit(rgba_getr(c), rgba_getg(c),
+                                rgba_getb(c), rgba_geta(c), 0),
+                map.mapColor(c));
+    }
+  }
+}
+
+TEST(RgbMapKdTree, TiesUseFirstIndex)
+{
+  Palette pal(frame_t(0), 6);
+  pal.setEntry(0, rgba(0, 0, 0, 0));
+  pal.setEntry(1, rgba(10, 10, 10, 255));
+  pal.setEntry(2, rgba(50, 60, 70, 255));
+  pal.setEntry(3, rgba(10, 10, 10, 255));
+  pal.setEntry(4, rgba(50, 60, 70, 255));
+  pal.setEntry(5, rgba(30, 35, 40, 255));
+
+  RgbMapKdTree map;
+  map.regenerateMap(&pal, 0, FitCriteria::DEFAULT);
+  EXPECT_EQ(0, map.mapColor(rgba(10, 10, 10, 0)));
+  EXPECT_EQ(1, map.mapColor(rgba(10, 10, 10, 255)));
+  EXPECT_EQ(2, map.mapColor(rgba(50, 60, 70, 255)));
+  EXPECT_EQ(2, map.mapColor(rgba(52, 61, 70, 255)));
+  EXPECT_EQ(5, map.mapColor(rgba(30, 35, 40, 255)));
+
+  // Palette modifications are detected
+  pal.setEntry(1, rgba(255, 255, 255, 255));
+  map.regenerateMap(&pal, 0, FitCriteria::DEFAULT);
+  EXPECT_EQ(3, map.mapColor(rgba(10, 10, 10, 255)));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
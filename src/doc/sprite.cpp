@@ -23,6 +23,7 @@
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/render_plan.h"
+#include "doc/rgbmap_kdtree.h"
 #include "doc/rgbmap_rgb5a3.h"
 #include "doc/tag.h"
 #include "doc/tile_primitives.h"
@@ -447,15 +448,9 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
   if (!m_rgbMap ||
       m_rgbMap->rgbmapAlgorithm() != mapAlgo ||
       m_rgbMap->fitCriteria() != fitCriteria) {
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
-      case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
-      default:
-        m_rgbMap.reset(nullptr);
-        ASSERT(false);
-        return nullptr;
-    }
+    m_rgbMap.reset(MakeRgbMap(mapAlgo));
+    if (!m_rgbMap)
+      return nullptr;
     m_rgbMap->fitCriteria(fitCriteria);
   }
   int maskIndex = palette(frame)->findMaskColor();
@@ -465,6 +460,19 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
   return m_rgbMap.get();
 }
 
+// static
+RgbMap* Sprite::MakeRgbMap(const RgbMapAlgorithm mapAlgo)
+{
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3: return new RgbMapRGB5A3;
+    case RgbMapAlgorithm::DEFAULT:
+    case RgbMapAlgorithm::OCTREE: return new OctreeMap;
+    case RgbMapAlgorithm::KDTREE: return new RgbMapKdTree;
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Frames
 
@@ -542,7 +550,9 @@ void Sprite::setDurationForAllFrames(int msecs)
 ImageRef Sprite::getImageRef(ObjectId imageId)
 {
   for (Cel* cel : cels()) {
-    if (cel->image()->id() == imageId)
+    // Images that are not loaded yet cannot be referenced by ID
+    if (cel->data()->isImageLoaded() &&
+        cel->image()->id() == imageId)
       return cel->imageRef();
   }
   if (hasTilesets()) {
@@ -171,6 +171,10 @@ namespace doc {
                    const RgbMapAlgorithm mapAlgo,
                    const FitCriteria fitCriteria = FitCriteria::DEFAULT) const;
 
+    // Creates a new RgbMap with the given algorithm (the map must be
+    // regenerated before using it).
+    static RgbMap* MakeRgbMap(const RgbMapAlgorithm mapAlgo);
+
     ////////////////////////////////////////
     // Frames
 
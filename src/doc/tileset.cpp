@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -259,10 +259,25 @@ bool Tileset::findTileIndex(const ImageRef& tileImage,
     return false;
   }
 
+  return findTileIndex(tileImage,
+                       calculate_image_hash(tileImage.get(), tileImage->bounds()),
+                       ti);
+}
+
+bool Tileset::findTileIndex(const ImageRef& tileImage,
+                            const uint64_t hash,
+                            tile_index& ti)
+{
+  ASSERT(tileImage);
+  if (!tileImage) {
+    ti = notile;
+    return false;
+  }
+
   auto& h = hashTable(); // Don't use m_hash directly in case that
                          // we've to regenerate the hash table.
 
-  auto it = h.find(tileImage);
+  auto it = h.find(details::hashed_image(tileImage, hash));
   if (it != h.end()) {
     ti = it->second;
     return true;
@@ -363,7 +378,7 @@ void Tileset::assertValidHashTable()
       // If the hash doesn't match, it is because other tile is equal
       // to this one.
       if (it->second != ti) {
-        ASSERT(is_same_image(it->first.get(), m_tiles[it->second].image.get()));
+        ASSERT(is_same_image(it->first.image.get(), m_tiles[it->second].image.get()));
       }
     }
   }
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -127,6 +127,13 @@ namespace doc {
     bool findTileIndex(const ImageRef& tileImage,
                        tile_index& ti);
 
+    // Same as findTileIndex() when the hash of the tileImage was
+    // already calculated with calculate_image_hash() (e.g. in other
+    // thread).
+    bool findTileIndex(const ImageRef& tileImage,
+                       const uint64_t hash,
+                       tile_index& ti);
+
     // Must be called when a tile image was modified externally, so
     // the hash elements are re-calculated for that specific tile.
     void notifyTileContentChange(const tile_index ti);
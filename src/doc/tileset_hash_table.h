@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,21 +8,56 @@
 #define DOC_TILESET_HASH_TABLE_H_INCLUDED
 #pragma once
 
+#include "base/debug.h"
 #include "doc/image.h"
 #include "doc/image_ref.h"
-#include "doc/images_map.h"
 #include "doc/primitives.h"
 #include "doc/tile.h"
 
+#include <cstdint>
 #include <unordered_map>
 
 namespace doc {
+  namespace details {
+
+    // A tile image with its hash, so the hash can be calculated just
+    // once (e.g. from other thread before looking up the tile).
+    struct hashed_image {
+      ImageRef image;
+      uint64_t hash;
+
+      hashed_image(const ImageRef& image)
+        : image(image)
+        , hash(calculate_image_hash(image.get(), image->bounds())) {
+      }
+
+      hashed_image(const ImageRef& image, const uint64_t hash)
+        : image(image)
+        , hash(hash) {
+        ASSERT(hash == calculate_image_hash(image.get(), image->bounds()));
+      }
+    };
+
+    struct hashed_image_hash {
+      size_t operator()(const hashed_image& i) const {
+        return size_t(i.hash);
+      }
+    };
+
+    struct hashed_image_eq {
+      bool operator()(const hashed_image& a, const hashed_image& b) const {
+        return (a.hash == b.hash &&
+                is_same_image(a.image.get(), b.image.get()));
+      }
+    };
+
+  }
 
   // A hash table used to match Image pixels data <-> tileset index
-  typedef std::unordered_map<ImageRef,
+  typedef std::unordered_map<details::hashed_image,
                              tile_index,
-                             details::image_hash,
-                             details::image_eq> TilesetHashTable;
+                             details::hashed_image_hash,
+                             details::hashed_image_eq> TilesetHashTable;
 
 } // namespace doc
 
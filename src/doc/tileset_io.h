@@ -38,9 +38,11 @@ namespace doc {
   class Sprite;
   class Tileset;
 
+  // The compression level of tile images (see write_image()).
   bool write_tileset(std::ostream& os,
                      const Tileset* tileset,
-                     CancelIO* cancel = nullptr);
+                     CancelIO* cancel = nullptr,
+                     const int compressionLevel = -1);
 
   Tileset* read_tileset(std::istream& is,
                         Sprite* sprite,
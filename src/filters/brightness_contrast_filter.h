@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2017  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +32,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr) override;
     void applyToGrayscale(FilterManager* filterMgr) override;
     void applyToIndexed(FilterManager* filterMgr) override;
+    bool canApplyToRowsInParallel() const override { return true; }
 
   private:
     void onApplyToPalette(FilterManager* filterMgr,
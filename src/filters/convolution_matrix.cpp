@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,9 @@
 
 #include "filters/convolution_matrix.h"
 
+#include <cstdlib>
+#include <numeric>
+
 namespace filters {
 
 ConvolutionMatrix::ConvolutionMatrix(int width, int height)
@@ -24,4 +28,45 @@ ConvolutionMatrix::ConvolutionMatrix(int width, int height)
 {
 }
 
+bool ConvolutionMatrix::getSeparableFactors(std::vector<int>& xFactors,
+                                            std::vector<int>& yFactors) const
+{
+  // Find the first row with a non-zero value
+  int x0 = -1, y0 = -1;
+  for (int y=0; y<m_height && y0 < 0; ++y) {
+    for (int x=0; x<m_width; ++x) {
+      if (value(x, y)) {
+        x0 = x;
+        y0 = y;
+        break;
+      }
+    }
+  }
+  if (y0 < 0)
+    return false;
+
+  // The X factors are the values of that row divided by their GCD,
+  // so if the matrix is separable all Y factors are integers too.
+  int gcd = 0;
+  for (int x=0; x<m_width; ++x)
+    gcd = std::gcd(gcd, std::abs(value(x, y0)));
+
+  xFactors.resize(m_width);
+  for (int x=0; x<m_width; ++x)
+    xFactors[x] = value(x, y0) / gcd;
+
+  yFactors.resize(m_height);
+  for (int y=0; y<m_height; ++y) {
+    if (value(x0, y) % xFactors[x0] != 0)
+      return false;
+
+    yFactors[y] = value(x0, y) / xFactors[x0];
+    for (int x=0; x<m_width; ++x) {
+      if (value(x, y) != xFactors[x] * yFactors[y])
+        return false;
+    }
+  }
+  return true;
+}
+
 } // namespace filters
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -54,6 +55,12 @@ namespace filters {
     int& value(int x, int y) { return m_data[y*m_width+x]; }
     const int& value(int x, int y) const { return m_data[y*m_width+x]; }
 
+    // Returns true if the matrix is separable, i.e. each value(x, y)
+    // is equal to xFactors[x]*yFactors[y]. In that case the
+    // convolution can be calculated with two 1D passes.
+    bool getSeparableFactors(std::vector<int>& xFactors,
+                             std::vector<int>& yFactors) const;
+
   private:
     std::string m_name;          // Name
     int m_width, m_height;       // Size of the matrix
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -19,12 +19,49 @@
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define FILTERS_HAVE_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define FILTERS_HAVE_NEON 1
+  #include <arm_neon.h>
+#endif
+
 namespace filters {
 
 using namespace doc;
 
 namespace {
 
+  // dst[i] += f * src[i] for each i in [0, n)
+  void mul_add_row(int* dst, const int* src, const int f, const int n)
+  {
+    int i = 0;
+#if FILTERS_HAVE_SSE2
+    // SSE2 doesn't have _mm_mullo_epi32(), so we multiply the even
+    // and odd elements with _mm_mul_epu32() (the low 32 bits of the
+    // product are the same for signed values).
+    const __m128i fv = _mm_set1_epi32(f);
+    for (; i+4 <= n; i += 4) {
+      const __m128i a = _mm_loadu_si128((const __m128i*)(src+i));
+      const __m128i even = _mm_mul_epu32(a, fv);
+      const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), fv);
+      const __m128i prod =
+        _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                           _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+      _mm_storeu_si128((__m128i*)(dst+i),
+                       _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst+i)), prod));
+    }
+#elif FILTERS_HAVE_NEON
+    for (; i+4 <= n; i += 4)
+      vst1q_s32(dst+i, vmlaq_n_s32(vld1q_s32(dst+i), vld1q_s32(src+i), f));
+#endif
+    for (; i<n; ++i)
+      dst[i] += f * src[i];
+  }
+
   struct GetPixelsDelegate {
     int div;
     const int* matrixData;
@@ -35,7 +72,12 @@ namespace {
     }
   };
 
+  // Each delegate has N sums for the separable passes: one for each
+  // channel and the last one is the weight of transparent pixels
+  // (which is subtracted from "div").
+
   struct GetPixelsDelegateRgba : public GetPixelsDelegate {
+    static constexpr int N = 5;
     int r, g, b, a;
 
     void reset(const ConvolutionMatrix* matrix) {
@@ -56,9 +98,27 @@ namespace {
       }
       matrixData++;
     }
+
+    void channels(RgbTraits::pixel_t color, int* values) const {
+      const int opaque = (rgba_geta(color) != 0);
+      values[0] = rgba_getr(color) * opaque;
+      values[1] = rgba_getg(color) * opaque;
+      values[2] = rgba_getb(color) * opaque;
+      values[3] = rgba_geta(color);
+      values[4] = 1 - opaque;
+    }
+
+    void set(const int matrixDiv, const int* sums) {
+      r = sums[0];
+      g = sums[1];
+      b = sums[2];
+      a = sums[3];
+      div = matrixDiv - sums[4];
+    }
   };
 
   struct GetPixelsDelegateGrayscale : public GetPixelsDelegate {
+    static constexpr int N = 3;
     int v, a;
 
     void reset(const ConvolutionMatrix* matrix) {
@@ -77,9 +137,23 @@ namespace {
       }
       matrixData++;
     }
+
+    void channels(GrayscaleTraits::pixel_t color, int* values) const {
+      const int opaque = (graya_geta(color) != 0);
+      values[0] = graya_getv(color) * opaque;
+      values[1] = graya_geta(color);
+      values[2] = 1 - opaque;
+    }
+
+    void set(const int matrixDiv, const int* sums) {
+      v = sums[0];
+      a = sums[1];
+      div = matrixDiv - sums[2];
+    }
   };
 
   struct GetPixelsDelegateIndexed : public GetPixelsDelegate {
+    static constexpr int N = 6;
     const Palette* pal;
     int r, g, b, a, index;
 
@@ -105,19 +179,362 @@ namespace {
       }
       matrixData++;
     }
+
+    void channels(IndexedTraits::pixel_t color, int* values) const {
+      const color_t rgba = pal->getEntry(color);
+      const int opaque = (rgba_geta(rgba) != 0);
+      values[0] = color;
+      values[1] = rgba_getr(rgba) * opaque;
+      values[2] = rgba_getg(rgba) * opaque;
+      values[3] = rgba_getb(rgba) * opaque;
+      values[4] = rgba_geta(rgba);
+      values[5] = 1 - opaque;
+    }
+
+    void set(const int matrixDiv, const int* sums) {
+      index = sums[0];
+      r = sums[1];
+      g = sums[2];
+      b = sums[3];
+      a = sums[4];
+      div = matrixDiv - sums[5];
+    }
+  };
+
+  // Calculates the sums of the matrix for each pixel iterating all
+  // the neighboring pixels (the original algorithm).
+  template<typename Traits, typename Delegate>
+  class GenericSums {
+  public:
+    GenericSums(const Image* src,
+                const ConvolutionMatrix* matrix,
+                const TiledMode tiledMode,
+                const Delegate& delegate)
+      : m_src(src)
+      , m_matrix(matrix)
+      , m_tiledMode(tiledMode)
+      , m_delegate(delegate) {
+    }
+
+    void beginRow(int, int, int) { }
+
+    Delegate& at(const int x, const int y) {
+      m_delegate.reset(m_matrix);
+      get_neighboring_pixels<Traits>(m_src, x, y,
+                                     m_matrix->getWidth(),
+                                     m_matrix->getHeight(),
+                                     m_matrix->getCenterX(),
+                                     m_matrix->getCenterY(),
+                                     m_tiledMode, m_delegate);
+      return m_delegate;
+    }
+
+  private:
+    const Image* m_src;
+    const ConvolutionMatrix* m_matrix;
+    const TiledMode m_tiledMode;
+    Delegate m_delegate;
+  };
+
+  // Calculates the sums of a whole row with two 1D passes when the
+  // matrix is separable. First a vertical pass for each column
+  // (including the columns at the left/right of the row needed by
+  // the matrix), and then a horizontal pass over those columns. The
+  // sums are stored in planar arrays of ints (one array for each sum)
+  // so the horizontal pass can be vectorized (see mul_add_row()).
+  //
+  // Pixels outside the image are taken in the same way as
+  // get_neighboring_pixels(), but the matrix cannot be wider than
+  // the image without tiled mode in the X axis (see
+  // ConvolutionMatrixFilter::useSeparablePasses()).
+  template<typename Traits, typename Delegate>
+  class SeparableSums {
+    static constexpr int N = Delegate::N;
+
+  public:
+    SeparableSums(const Image* src,
+                  const ConvolutionMatrix* matrix,
+                  const std::vector<int>& xFactors,
+                  const std::vector<int>& yFactors,
+                  const TiledMode tiledMode,
+                  const Delegate& delegate)
+      : m_src(src)
+      , m_matrix(matrix)
+      , m_xFactors(xFactors)
+      , m_yFactors(yFactors)
+      , m_tiledMode(tiledMode)
+      , m_delegate(delegate) {
+    }
+
+    void beginRow(const int x, const int width, const int y) {
+      const int kw = int(m_xFactors.size());
+      const int kh = int(m_yFactors.size());
+      const int ncolumns = width + kw - 1;
+      m_x = x;
+
+      m_srcX.resize(ncolumns);
+      for (int i=0; i<ncolumns; ++i)
+        m_srcX[i] = wrap(x - m_matrix->getCenterX() + i, m_src->width(),
+                         int(m_tiledMode) & int(TiledMode::X_AXIS));
+
+      for (int c=0; c<N; ++c) {
+        m_columns[c].assign(ncolumns, 0);
+        m_sums[c].assign(width, 0);
+      }
+
+      // Vertical pass
+      for (int dy=0; dy<kh; ++dy) {
+        const int f = m_yFactors[dy];
+        if (f == 0)
+          continue;
+
+        const int sy = wrap(y - m_matrix->getCenterY() + dy, m_src->height(),
+                            int(m_tiledMode) & int(TiledMode::Y_AXIS));
+        auto row = (typename Traits::const_address_t)m_src->getPixelAddress(0, sy);
+        int* columns[N];
+        for (int c=0; c<N; ++c)
+          columns[c] = m_columns[c].data();
+        for (int i=0; i<ncolumns; ++i) {
+          int values[N];
+          m_delegate.channels(row[m_srcX[i]], values);
+          for (int c=0; c<N; ++c)
+            columns[c][i] += f * values[c];
+        }
+      }
+
+      // Horizontal pass
+      for (int dx=0; dx<kw; ++dx) {
+        const int f = m_xFactors[dx];
+        if (f == 0)
+          continue;
+
+        for (int c=0; c<N; ++c)
+          mul_add_row(m_sums[c].data(), m_columns[c].data() + dx, f, width);
+      }
+    }
+
+    Delegate& at(const int x, const int y) {
+      int sums[N];
+      for (int c=0; c<N; ++c)
+        sums[c] = m_sums[c][x - m_x];
+      m_delegate.set(m_matrix->getDiv(), sums);
+      return m_delegate;
+    }
+
+  private:
+    static int wrap(const int v, const int size, const bool tiled) {
+      if (tiled)
+        return ((v % size) + size) % size;
+      else
+        return std::clamp(v, 0, size-1);
+    }
+
+    const Image* m_src;
+    const ConvolutionMatrix* m_matrix;
+    const std::vector<int>& m_xFactors;
+    const std::vector<int>& m_yFactors;
+    const TiledMode m_tiledMode;
+    Delegate m_delegate;
+    int m_x = 0;
+    std::vector<int> m_srcX;
+    std::vector<int> m_columns[N];
+    std::vector<int> m_sums[N];
   };
 
+  template<typename Sums>
+  void apply_convolution_to_rgba(FilterManager* filterMgr,
+                                 const ConvolutionMatrix* matrix,
+                                 Sums& sums)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    uint32_t color;
+
+    sums.beginRow(filterMgr->x(), filterMgr->getWidth(), filterMgr->y());
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+      auto& delegate = sums.at(x, y);
+
+      color = get_pixel_fast<RgbTraits>(src, x, y);
+      if (delegate.div == 0) {
+        *dst_address = color;
+        continue;
+      }
+
+      if (target & TARGET_RED_CHANNEL) {
+        delegate.r = delegate.r / delegate.div + matrix->getBias();
+        delegate.r = std::clamp(delegate.r, 0, 255);
+      }
+      else
+        delegate.r = rgba_getr(color);
+
+      if (target & TARGET_GREEN_CHANNEL) {
+        delegate.g = delegate.g / delegate.div + matrix->getBias();
+        delegate.g = std::clamp(delegate.g, 0, 255);
+      }
+      else
+        delegate.g = rgba_getg(color);
+
+      if (target & TARGET_BLUE_CHANNEL) {
+        delegate.b = delegate.b / delegate.div + matrix->getBias();
+        delegate.b = std::clamp(delegate.b, 0, 255);
+      }
+      else
+        delegate.b = rgba_getb(color);
+
+      if (target & TARGET_ALPHA_CHANNEL) {
+        delegate.a = delegate.a / matrix->getDiv() + matrix->getBias();
+        delegate.a = std::clamp(delegate.a, 0, 255);
+      }
+      else
+        delegate.a = rgba_geta(color);
+
+      *dst_address = rgba(delegate.r, delegate.g, delegate.b, delegate.a);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+  template<typename Sums>
+  void apply_convolution_to_grayscale(FilterManager* filterMgr,
+                                      const ConvolutionMatrix* matrix,
+                                      Sums& sums)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    uint16_t color;
+
+    sums.beginRow(filterMgr->x(), filterMgr->getWidth(), filterMgr->y());
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
+      auto& delegate = sums.at(x, y);
+
+      color = get_pixel_fast<GrayscaleTraits>(src, x, y);
+      if (delegate.div == 0) {
+        *dst_address = color;
+        continue;
+      }
+
+      if (target & TARGET_GRAY_CHANNEL) {
+        delegate.v = delegate.v / delegate.div + matrix->getBias();
+        delegate.v = std::clamp(delegate.v, 0, 255);
+      }
+      else
+        delegate.v = graya_getv(color);
+
+      if (target & TARGET_ALPHA_CHANNEL) {
+        delegate.a = delegate.a / matrix->getDiv() + matrix->getBias();
+        delegate.a = std::clamp(delegate.a, 0, 255);
+      }
+      else
+        delegate.a = graya_geta(color);
+
+      *dst_address = graya(delegate.v, delegate.a);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+  template<typename Sums>
+  void apply_convolution_to_indexed(FilterManager* filterMgr,
+                                    const ConvolutionMatrix* matrix,
+                                    Sums& sums)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    const Palette* pal = filterMgr->getIndexedData()->getPalette();
+    const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
+    uint8_t color;
+
+    sums.beginRow(filterMgr->x(), filterMgr->getWidth(), filterMgr->y());
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+      auto& delegate = sums.at(x, y);
+
+      color = get_pixel_fast<IndexedTraits>(src, x, y);
+      if (delegate.div == 0) {
+        *dst_address = color;
+        continue;
+      }
+
+      if (target & TARGET_INDEX_CHANNEL) {
+        delegate.index = delegate.index / matrix->getDiv() + matrix->getBias();
+        delegate.index = std::clamp(delegate.index, 0, 255);
+
+        *dst_address = delegate.index;
+      }
+      else {
+        color = pal->getEntry(color);
+
+        if (target & TARGET_RED_CHANNEL) {
+          delegate.r = delegate.r / delegate.div + matrix->getBias();
+          delegate.r = std::clamp(delegate.r, 0, 255);
+        }
+        else
+          delegate.r = rgba_getr(color);
+
+        if (target & TARGET_GREEN_CHANNEL) {
+          delegate.g =  delegate.g / delegate.div + matrix->getBias();
+          delegate.g = std::clamp(delegate.g, 0, 255);
+        }
+        else
+          delegate.g = rgba_getg(color);
+
+        if (target & TARGET_BLUE_CHANNEL) {
+          delegate.b = delegate.b / delegate.div + matrix->getBias();
+          delegate.b = std::clamp(delegate.b, 0, 255);
+        }
+        else
+          delegate.b = rgba_getb(color);
+
+        if (target & TARGET_ALPHA_CHANNEL) {
+          delegate.a = delegate.a / delegate.div + matrix->getBias();
+          delegate.a = std::clamp(delegate.a, 0, 255);
+        }
+        else
+          delegate.a = rgba_geta(color);
+
+        *dst_address = rgbmap->mapColor(delegate.r, delegate.g, delegate.b, delegate.a);
+      }
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+  // Each value of the 1D passes costs about twice as much as a value
+  // of the matrix in the generic algorithm (all the sums are stored
+  // in arrays), so e.g. the generic algorithm is still faster for 3x3
+  // matrices.
+  bool separablePassesAreFaster(const ConvolutionMatrix* matrix,
+                                const std::vector<int>& xFactors,
+                                const std::vector<int>& yFactors)
+  {
+    auto nonzero = [](int v){ return v != 0; };
+    const int n =
+      std::count_if(xFactors.begin(), xFactors.end(), nonzero) +
+      std::count_if(yFactors.begin(), yFactors.end(), nonzero);
+    const int matrixValues =
+      std::count_if(&matrix->value(0, 0),
+                    &matrix->value(0, 0) + matrix->getWidth()*matrix->getHeight(),
+                    nonzero);
+    return (2*n < matrixValues);
+  }
+
 }
 
 ConvolutionMatrixFilter::ConvolutionMatrixFilter()
   : m_matrix(NULL)
   , m_tiledMode(TiledMode::NONE)
+  , m_algorithm(Algorithm::Separable)
 {
 }
 
 void ConvolutionMatrixFilter::setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
+
+  m_xFactors.clear();
+  m_yFactors.clear();
+  if (m_matrix &&
+      (!m_matrix->getSeparableFactors(m_xFactors, m_yFactors) ||
+       !separablePassesAreFaster(m_matrix.get(), m_xFactors, m_yFactors))) {
+    m_xFactors.clear();
+    m_yFactors.clear();
+  }
 }
 
 void ConvolutionMatrixFilter::setTiledMode(TiledMode tiledMode)
@@ -136,55 +553,18 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
     return;
 
   const Image* src = filterMgr->getSourceImage();
-  uint32_t color;
   GetPixelsDelegateRgba delegate;
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
-
-    color = get_pixel_fast<RgbTraits>(src, x, y);
-    if (delegate.div == 0) {
-      *dst_address = color;
-      continue;
-    }
-
-    if (target & TARGET_RED_CHANNEL) {
-      delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-      delegate.r = std::clamp(delegate.r, 0, 255);
-    }
-    else
-      delegate.r = rgba_getr(color);
-
-    if (target & TARGET_GREEN_CHANNEL) {
-      delegate.g = delegate.g / delegate.div + m_matrix->getBias();
-      delegate.g = std::clamp(delegate.g, 0, 255);
-    }
-    else
-      delegate.g = rgba_getg(color);
-
-    if (target & TARGET_BLUE_CHANNEL) {
-      delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-      delegate.b = std::clamp(delegate.b, 0, 255);
-    }
-    else
-      delegate.b = rgba_getb(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = std::clamp(delegate.a, 0, 255);
-    }
-    else
-      delegate.a = rgba_geta(color);
-
-    *dst_address = rgba(delegate.r, delegate.g, delegate.b, delegate.a);
+  if (useSeparablePasses(src)) {
+    SeparableSums<RgbTraits, GetPixelsDelegateRgba>
+      sums(src, m_matrix.get(), m_xFactors, m_yFactors, m_tiledMode, delegate);
+    apply_convolution_to_rgba(filterMgr, m_matrix.get(), sums);
+  }
+  else {
+    GenericSums<RgbTraits, GetPixelsDelegateRgba>
+      sums(src, m_matrix.get(), m_tiledMode, delegate);
+    apply_convolution_to_rgba(filterMgr, m_matrix.get(), sums);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
@@ -193,41 +573,18 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
     return;
 
   const Image* src = filterMgr->getSourceImage();
-  uint16_t color;
   GetPixelsDelegateGrayscale delegate;
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
-
-    color = get_pixel_fast<GrayscaleTraits>(src, x, y);
-    if (delegate.div == 0) {
-      *dst_address = color;
-      continue;
-    }
-
-    if (target & TARGET_GRAY_CHANNEL) {
-      delegate.v = delegate.v / delegate.div + m_matrix->getBias();
-      delegate.v = std::clamp(delegate.v, 0, 255);
-    }
-    else
-      delegate.v = graya_getv(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      delegate.a = delegate.a / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.a = std::clamp(delegate.a, 0, 255);
-    }
-    else
-      delegate.a = graya_geta(color);
-
-    *dst_address = graya(delegate.v, delegate.a);
+  if (useSeparablePasses(src)) {
+    SeparableSums<GrayscaleTraits, GetPixelsDelegateGrayscale>
+      sums(src, m_matrix.get(), m_xFactors, m_yFactors, m_tiledMode, delegate);
+    apply_convolution_to_grayscale(filterMgr, m_matrix.get(), sums);
+  }
+  else {
+    GenericSums<GrayscaleTraits, GetPixelsDelegateGrayscale>
+      sums(src, m_matrix.get(), m_tiledMode, delegate);
+    apply_convolution_to_grayscale(filterMgr, m_matrix.get(), sums);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void ConvolutionMatrixFilter::applyToIndexed(FilterManager* filterMgr)
@@ -237,66 +594,29 @@ void ConvolutionMatrixFilter::applyToIndexed(FilterManager* filterMgr)
 
   const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  uint8_t color;
   GetPixelsDelegateIndexed delegate(pal);
 
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<IndexedTraits>(src, x, y,
-                                          m_matrix->getWidth(),
-                                          m_matrix->getHeight(),
-                                          m_matrix->getCenterX(),
-                                          m_matrix->getCenterY(),
-                                          m_tiledMode, delegate);
-
-    color = get_pixel_fast<IndexedTraits>(src, x, y);
-    if (delegate.div == 0) {
-      *dst_address = color;
-      continue;
-    }
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      delegate.index = delegate.index / m_matrix->getDiv() + m_matrix->getBias();
-      delegate.index = std::clamp(delegate.index, 0, 255);
-
-      *dst_address = delegate.index;
-    }
-    else {
-      color = pal->getEntry(color);
-
-      if (target & TARGET_RED_CHANNEL) {
-        delegate.r = delegate.r / delegate.div + m_matrix->getBias();
-        delegate.r = std::clamp(delegate.r, 0, 255);
-      }
-      else
-        delegate.r = rgba_getr(color);
-
-      if (target & TARGET_GREEN_CHANNEL) {
-        delegate.g =  delegate.g / delegate.div + m_matrix->getBias();
-        delegate.g = std::clamp(delegate.g, 0, 255);
-      }
-      else
-        delegate.g = rgba_getg(color);
-
-      if (target & TARGET_BLUE_CHANNEL) {
-        delegate.b = delegate.b / delegate.div + m_matrix->getBias();
-        delegate.b = std::clamp(delegate.b, 0, 255);
-      }
-      else
-        delegate.b = rgba_getb(color);
-
-      if (target & TARGET_ALPHA_CHANNEL) {
-        delegate.a = delegate.a / delegate.div + m_matrix->getBias();
-        delegate.a = std::clamp(delegate.a, 0, 255);
-      }
-      else
-        delegate.a = rgba_geta(color);
-
-      *dst_address = rgbmap->mapColor(delegate.r, delegate.g, delegate.b, delegate.a);
-    }
+  if (useSeparablePasses(src)) {
+    SeparableSums<IndexedTraits, GetPixelsDelegateIndexed>
+      sums(src, m_matrix.get(), m_xFactors, m_yFactors, m_tiledMode, delegate);
+    apply_convolution_to_indexed(filterMgr, m_matrix.get(), sums);
+  }
+  else {
+    GenericSums<IndexedTraits, GetPixelsDelegateIndexed>
+      sums(src, m_matrix.get(), m_tiledMode, delegate);
+    apply_convolution_to_indexed(filterMgr, m_matrix.get(), sums);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
+}
+
+bool ConvolutionMatrixFilter::useSeparablePasses(const Image* src) const
+{
+  // Without tiled mode in the X axis, get_neighboring_pixels() takes
+  // the columns after the right edge of the image in a special way
+  // when the matrix is wider than the image.
+  return (m_algorithm == Algorithm::Separable &&
+          isSeparable() &&
+          ((int(m_tiledMode) & int(TiledMode::X_AXIS)) ||
+           m_matrix->getWidth() <= src->width()));
 }
 
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,11 @@
 #include "filters/tiled_mode.h"
 
 #include <memory>
+#include <vector>
+
+namespace doc {
+  class Image;
+}
 
 namespace filters {
 
@@ -20,23 +25,46 @@ namespace filters {
 
   class ConvolutionMatrixFilter : public Filter {
   public:
+    enum class Algorithm {
+      // Iterates all the values of the matrix for each pixel (the
+      // original implementation, kept to compare results)
+      Generic,
+      // Two 1D passes (vertical and horizontal) if the matrix is
+      // separable (see isSeparable()), in other case it fallbacks to
+      // Generic
+      Separable,
+    };
+
     ConvolutionMatrixFilter();
 
+    // The matrix must not be modified after calling setMatrix()
+    // (because its separable factors are calculated here).
     void setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix);
     void setTiledMode(TiledMode tiledMode);
+    void setAlgorithm(Algorithm algorithm) { m_algorithm = algorithm; }
 
     std::shared_ptr<ConvolutionMatrix> getMatrix() { return m_matrix; }
     TiledMode getTiledMode() const { return m_tiledMode; }
+    Algorithm getAlgorithm() const { return m_algorithm; }
+    // Returns true if the matrix is separable and the two 1D passes
+    // are faster than the generic algorithm.
+    bool isSeparable() const { return !m_xFactors.empty(); }
 
     // Filter implementation
     const char* getName();
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool canApplyToRowsInParallel() const { return true; }
 
   private:
+    bool useSeparablePasses(const doc::Image* src) const;
+
     std::shared_ptr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
+    Algorithm m_algorithm;
+    std::vector<int> m_xFactors;
+    std::vector<int> m_yFactors;
   };
 
 } // namespace filters
@@ -0,0 +1,85 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "filters/image_filter_manager.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+// Creates a size x size "pyramid" blur matrix (like the blur-3x3
+// matrix from convmatr.def, which is separable).
+static std::shared_ptr<ConvolutionMatrix> create_blur_matrix(const int size)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(size, size);
+  int div = 0;
+  for (int y=0; y<size; ++y) {
+    for (int x=0; x<size; ++x) {
+      matrix->value(x, y) =
+        (size/2 + 1 - std::abs(x - size/2)) *
+        (size/2 + 1 - std::abs(y - size/2));
+      div += matrix->value(x, y);
+    }
+  }
+  matrix->setDiv(div);
+  return matrix;
+}
+
+static void Bm_ConvolutionMatrixFilter(benchmark::State& state)
+{
+  const auto algorithm = ConvolutionMatrixFilter::Algorithm(state.range(0));
+  const int matrixSize = state.range(1);
+  const int w = 512;
+  const int h = 512;
+
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, w, h));
+  ImageRef dst(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y, rng());
+
+  ConvolutionMatrixFilter filter;
+  filter.setAlgorithm(algorithm);
+  filter.setMatrix(create_blur_matrix(matrixSize));
+
+  while (state.KeepRunning()) {
+    ImageFilterManager(src.get(), dst.get(), TARGET_ALL_CHANNELS)
+      .apply(&filter);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+  state.SetLabel(algorithm == ConvolutionMatrixFilter::Algorithm::Separable &&
+                 filter.isSeparable() ? "Separable": "Generic");
+}
+
+static void MatrixSizeArguments(benchmark::internal::Benchmark* b)
+{
+  for (int size : { 3, 5, 7, 9, 17 }) {
+    b->Args({ int(ConvolutionMatrixFilter::Algorithm::Generic), size });
+    b->Args({ int(ConvolutionMatrixFilter::Algorithm::Separable), size });
+  }
+}
+
+BENCHMARK(Bm_ConvolutionMatrixFilter)
+  ->Apply(MatrixSizeArguments)
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
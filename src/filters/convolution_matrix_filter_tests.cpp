@@ -0,0 +1,153 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "filters/convolution_matrix.h"
+#include "filters/convolution_matrix_filter.h"
+#include "filters/filter_test_utils.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace filters;
+
+// Creates a matrix with value(x, y) = xFactors[x] * yFactors[y]
+static std::shared_ptr<ConvolutionMatrix>
+separable_matrix(const std::vector<int>& xFactors,
+                 const std::vector<int>& yFactors,
+                 const int cx, const int cy,
+                 const int bias)
+{
+  auto matrix = std::make_shared<ConvolutionMatrix>(int(xFactors.size()),
+                                                    int(yFactors.size()));
+  int div = 0;
+  for (int y=0; y<matrix->getHeight(); ++y) {
+    for (int x=0; x<matrix->getWidth(); ++x) {
+      matrix->value(x, y) = xFactors[x] * yFactors[y];
+      div += matrix->value(x, y);
+    }
+  }
+  matrix->setCenterX(cx);
+  matrix->setCenterY(cy);
+  matrix->setDiv(div != 0 ? div: 1);
+  matrix->setBias(bias);
+  return matrix;
+}
+
+static void test_separable(const PixelFormat pf,
+                           const int imageW, const int imageH,
+                           const std::shared_ptr<ConvolutionMatrix>& matrix,
+                           const TiledMode tiledMode,
+                           const Target target)
+{
+  SCOPED_TRACE(testing::Message()
+               << "matrix=" << matrix->getWidth() << "x" << matrix->getHeight()
+               << " tiledMode=" << int(tiledMode));
+
+  std::mt19937 rng(imageW*imageH);
+  // Transparent pixels/entries are ignored by the filter
+  ImageRef src = random_image(pf, imageW, imageH, rng, 0xffffffff, 4);
+  const Palette palette = random_palette(rng, 5);
+
+  ConvolutionMatrixFilter filter;
+  filter.setMatrix(matrix);
+  filter.setTiledMode(tiledMode);
+  ASSERT_TRUE(filter.isSeparable());
+
+  expect_same_filter_algorithms(filter,
+                                ConvolutionMatrixFilter::Algorithm::Generic,
+                                ConvolutionMatrixFilter::Algorithm::Separable,
+                                src.get(), target, palette);
+}
+
+static void test_all_matrices(const PixelFormat pf, const Target target)
+{
+  const std::shared_ptr<ConvolutionMatrix> matrices[] = {
+    separable_matrix({ 1, 4, 6, 4, 1 }, { 1, 4, 6, 4, 1 }, 2, 2, 0),
+    separable_matrix({ 1, 2, 3, 4, 5, 4, 3, 2, 1 }, { 1, 2, 1 }, 4, 1, 0),
+    // Negative values and the center outside the middle of the matrix
+    separable_matrix({ 1, -2, 3, 0, 5, 1, 1 }, { 2, 0, -1, 3, 1 }, 1, 4, 9),
+    separable_matrix({ 14, 16, 13, 12, 10, 8, 6, 4, 3, 2, 1, 0 }, { 1, 1, 1 }, 0, 1, 0),
+  };
+
+  for (auto tiledMode : { TiledMode::NONE, TiledMode::X_AXIS,
+                          TiledMode::Y_AXIS, TiledMode::BOTH }) {
+    for (const auto& matrix : matrices) {
+      test_separable(pf, 32, 24, matrix, tiledMode, target);
+      test_separable(pf, 3, 30, matrix, tiledMode, target);
+      test_separable(pf, 40, 2, matrix, tiledMode, target);
+      test_separable(pf, 1, 1, matrix, tiledMode, target);
+    }
+  }
+}
+
+TEST(ConvolutionMatrix, SeparableFactors)
+{
+  std::vector<int> xFactors, yFactors;
+
+  ConvolutionMatrix blur(3, 3);
+  const int blurValues[] = { 2, 4, 2,
+                             4, 8, 4,
+                             2, 4, 2 };
+  for (int i=0; i<9; ++i)
+    blur.value(i % 3, i / 3) = blurValues[i];
+  EXPECT_TRUE(blur.getSeparableFactors(xFactors, yFactors));
+  EXPECT_EQ(std::vector<int>({ 1, 2, 1 }), xFactors);
+  EXPECT_EQ(std::vector<int>({ 2, 4, 2 }), yFactors);
+
+  ConvolutionMatrix edges(3, 2);
+  const int edgesValues[] = { 0,  0, 0,
+                              3, -6, 9 };
+  for (int i=0; i<6; ++i)
+    edges.value(i % 3, i / 3) = edgesValues[i];
+  EXPECT_TRUE(edges.getSeparableFactors(xFactors, yFactors));
+  EXPECT_EQ(std::vector<int>({ 1, -2, 3 }), xFactors);
+  EXPECT_EQ(std::vector<int>({ 0, 3 }), yFactors);
+
+  ConvolutionMatrix sharpen(3, 3);
+  const int sharpenValues[] = { -1, -1, -1,
+                                -1, 16, -1,
+                                -1, -1, -1 };
+  for (int i=0; i<9; ++i)
+    sharpen.value(i % 3, i / 3) = sharpenValues[i];
+  EXPECT_FALSE(sharpen.getSeparableFactors(xFactors, yFactors));
+
+  ConvolutionMatrix zero(3, 3);
+  EXPECT_FALSE(zero.getSeparableFactors(xFactors, yFactors));
+}
+
+TEST(ConvolutionMatrixFilter, Rgba)
+{
+  test_all_matrices(IMAGE_RGB, TARGET_ALL_CHANNELS);
+  test_all_matrices(IMAGE_RGB, TARGET_RED_CHANNEL | TARGET_ALPHA_CHANNEL);
+}
+
+TEST(ConvolutionMatrixFilter, Grayscale)
+{
+  test_all_matrices(IMAGE_GRAYSCALE, TARGET_ALL_CHANNELS);
+  test_all_matrices(IMAGE_GRAYSCALE, TARGET_GRAY_CHANNEL);
+}
+
+TEST(ConvolutionMatrixFilter, Indexed)
+{
+  Palette::initBestfit();
+  test_all_matrices(IMAGE_INDEXED, TARGET_INDEX_CHANNEL);
+  test_all_matrices(IMAGE_INDEXED, TARGET_ALL_CHANNELS);
+  test_all_matrices(IMAGE_INDEXED, TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -44,6 +44,12 @@ namespace filters {
 
     // Applies the filter to the color palette.
     virtual void applyToPalette(FilterManager* filterMgr) { }
+
+    // Returns true if applyToRgba/Grayscale/Indexed() don't modify
+    // the filter state, so different rows can be processed at the
+    // same time from different threads (each one with its own
+    // FilterManager).
+    virtual bool canApplyToRowsInParallel() const { return false; }
   };
 
   // Filter that support applying it only to palette colors.
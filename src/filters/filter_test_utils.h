@@ -0,0 +1,108 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_FILTER_TEST_UTILS_H_INCLUDED
+#define FILTERS_FILTER_TEST_UTILS_H_INCLUDED
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "filters/image_filter_manager.h"
+#include "filters/target.h"
+
+#include <random>
+
+namespace filters {
+
+  // Creates an image with random pixels. The "colorMask" is applied
+  // to each pixel (e.g. to get a lot of repeated values), and if
+  // "transparentRate" > 0, 1 of each "transparentRate" pixels (on
+  // average) is transparent.
+  inline doc::ImageRef random_image(const doc::PixelFormat pf,
+                                    const int w, const int h,
+                                    std::mt19937& rng,
+                                    const doc::color_t colorMask = 0xffffffff,
+                                    const int transparentRate = 0)
+  {
+    doc::ImageRef image(doc::Image::create(pf, w, h));
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        doc::color_t c = rng() & colorMask;
+        if (transparentRate > 0 && (rng() % transparentRate) == 0)
+          c &= (pf == doc::IMAGE_GRAYSCALE ? doc::graya_v_mask:
+                                             doc::rgba_rgb_mask);
+        if (pf == doc::IMAGE_INDEXED)
+          c &= 0xff;
+        else if (pf == doc::IMAGE_GRAYSCALE)
+          c &= 0xffff;
+        put_pixel(image.get(), x, y, c);
+      }
+    }
+    return image;
+  }
+
+  // Creates a palette of 256 random colors, 1 of each
+  // "transparentRate" entries is transparent (if it's > 0).
+  inline doc::Palette random_palette(std::mt19937& rng,
+                                     const int transparentRate = 0)
+  {
+    doc::Palette palette(doc::frame_t(0), 256);
+    for (int i=0; i<palette.size(); ++i) {
+      if (transparentRate > 0 && (i % transparentRate) == 0)
+        palette.setEntry(i, rng() & doc::rgba_rgb_mask);
+      else
+        palette.setEntry(i, rng());
+    }
+    return palette;
+  }
+
+  // Applies the filter to "src" with the "expectedAlgorithm" (the
+  // old/reference implementation) and with the given "algorithm",
+  // and checks that both results are the same.
+  template<typename FilterType>
+  void expect_same_filter_algorithms(
+    FilterType& filter,
+    const typename FilterType::Algorithm expectedAlgorithm,
+    const typename FilterType::Algorithm algorithm,
+    const doc::Image* src,
+    const Target target,
+    const doc::Palette& palette)
+  {
+    const int w = src->width();
+    const int h = src->height();
+    doc::ImageRef expected(doc::Image::create(src->pixelFormat(), w, h));
+    doc::ImageRef result(doc::Image::create(src->pixelFormat(), w, h));
+
+    doc::RgbMapRGB5A3 rgbmap;
+    rgbmap.regenerateMap(&palette, 0);
+
+    filter.setAlgorithm(expectedAlgorithm);
+    ImageFilterManager(src, expected.get(), target,
+                       &palette, &rgbmap).apply(&filter);
+
+    filter.setAlgorithm(algorithm);
+    ImageFilterManager(src, result.get(), target,
+                       &palette, &rgbmap).apply(&filter);
+
+    for (int y=0; y<h; ++y) {
+      for (int x=0; x<w; ++x) {
+        ASSERT_EQ(get_pixel(expected.get(), x, y),
+                  get_pixel(result.get(), x, y))
+          << "pixel=" << x << "," << y
+          << " image=" << w << "x" << h
+          << " target=" << target;
+      }
+    }
+  }
+
+} // namespace filters
+
+#endif
@@ -0,0 +1,81 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_IMAGE_FILTER_MANAGER_H_INCLUDED
+#define FILTERS_IMAGE_FILTER_MANAGER_H_INCLUDED
+#pragma once
+
+#include "doc/image.h"
+#include "doc/palette_picks.h"
+#include "filters/filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+namespace filters {
+
+  // Simple FilterManager to apply a filter to a whole image without
+  // selection (used in tests and benchmarks, the app uses
+  // app::FilterManagerImpl).
+  class ImageFilterManager : public FilterManager
+                           , public FilterIndexedData {
+  public:
+    ImageFilterManager(const doc::Image* src,
+                       doc::Image* dst,
+                       const Target target,
+                       const doc::Palette* palette = nullptr,
+                       const doc::RgbMap* rgbmap = nullptr)
+      : m_src(src)
+      , m_dst(dst)
+      , m_target(target)
+      , m_palette(palette)
+      , m_rgbmap(rgbmap) {
+    }
+
+    void apply(Filter* filter) {
+      for (m_y=0; m_y<m_src->height(); ++m_y) {
+        switch (m_src->pixelFormat()) {
+          case doc::IMAGE_RGB:       filter->applyToRgba(this); break;
+          case doc::IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+          case doc::IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+          default: break;
+        }
+      }
+    }
+
+    // FilterManager impl
+    doc::PixelFormat pixelFormat() const override { return m_src->pixelFormat(); }
+    const void* getSourceAddress() override { return m_src->getPixelAddress(0, m_y); }
+    void* getDestinationAddress() override { return m_dst->getPixelAddress(0, m_y); }
+    int getWidth() override { return m_src->width(); }
+    Target getTarget() override { return m_target; }
+    FilterIndexedData* getIndexedData() override { return this; }
+    bool skipPixel() override { return false; }
+    const doc::Image* getSourceImage() override { return m_src; }
+    int x() const override { return 0; }
+    int y() const override { return m_y; }
+    bool isFirstRow() const override { return m_y == 0; }
+    bool isMaskActive() const override { return false; }
+    base::task_token& taskToken() const override { return m_token; }
+
+    // FilterIndexedData impl
+    const doc::Palette* getPalette() const override { return m_palette; }
+    const doc::RgbMap* getRgbMap() const override { return m_rgbmap; }
+    doc::Palette* getNewPalette() override { return nullptr; }
+    doc::PalettePicks getPalettePicks() override { return doc::PalettePicks(); }
+
+  private:
+    const doc::Image* m_src;
+    doc::Image* m_dst;
+    Target m_target;
+    const doc::Palette* m_palette;
+    const doc::RgbMap* m_rgbmap;
+    mutable base::task_token m_token;
+    int m_y = 0;
+  };
+
+} // namespace filters
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "filters/tiled_mode.h"
 
 #include <algorithm>
+#include <iterator>
 
 namespace filters {
 
@@ -87,13 +88,333 @@ namespace {
       c++;
     }
   };
-};
+
+  // Median of a window obtained sorting all the pixels of the window
+  // for each pixel (the original algorithm).
+  template<typename Traits, typename Delegate>
+  class SortWindow {
+  public:
+    SortWindow(const Image* src,
+               const int width, const int height,
+               const TiledMode tiledMode,
+               std::vector<std::vector<uint8_t> >& channel,
+               const Delegate& delegate)
+      : m_src(src)
+      , m_width(width)
+      , m_height(height)
+      , m_tiledMode(tiledMode)
+      , m_channel(channel)
+      , m_delegate(delegate) {
+    }
+
+    void moveTo(const int x, const int y) {
+      m_delegate.reset();
+      get_neighboring_pixels<Traits>(m_src, x, y, m_width, m_height,
+                                     m_width/2, m_height/2,
+                                     m_tiledMode, m_delegate);
+    }
+
+    int median(const int c) {
+      std::sort(m_channel[c].begin(), m_channel[c].end());
+      return m_channel[c][m_channel[c].size()/2];
+    }
+
+  private:
+    const Image* m_src;
+    const int m_width;
+    const int m_height;
+    const TiledMode m_tiledMode;
+    std::vector<std::vector<uint8_t> >& m_channel;
+    Delegate m_delegate;
+  };
+
+  // Histogram of the values of one channel in the window. The coarse
+  // histogram (16 bins of 16 values) is used to find the median with
+  // at most 32 steps.
+  class ChannelHistogram {
+  public:
+    ChannelHistogram() {
+      std::fill(std::begin(m_fine), std::end(m_fine), 0);
+      std::fill(std::begin(m_coarse), std::end(m_coarse), 0);
+    }
+
+    void add(const int v) {
+      ++m_fine[v];
+      ++m_coarse[v >> 4];
+    }
+
+    void remove(const int v) {
+      --m_fine[v];
+      --m_coarse[v >> 4];
+    }
+
+    // Returns the k-th value (starting from 0) as if the values of
+    // the window were sorted.
+    int nth(int k) const {
+      int c = 0;
+      for (; c<15 && k >= m_coarse[c]; ++c)
+        k -= m_coarse[c];
+      int v = c*16;
+      for (; v<255 && k >= m_fine[v]; ++v)
+        k -= m_fine[v];
+      return v;
+    }
+
+  private:
+    int m_fine[256];
+    int m_coarse[16];
+  };
+
+  // Median of a window using the Huang et al. sliding histogram: when
+  // the window moves one pixel to the right, only the pixels of the
+  // first column are removed from the channel histograms and the
+  // pixels of the new column are added. The result is the same as
+  // SortWindow (pixels outside the image are taken in the same way as
+  // get_neighboring_pixels()).
+  template<typename Traits, int N, typename ToChannels>
+  class HistogramWindow {
+  public:
+    HistogramWindow(const Image* src,
+                    const int width, const int height,
+                    const TiledMode tiledMode,
+                    const ToChannels& toChannels)
+      : m_src(src)
+      , m_width(width)
+      , m_height(height)
+      , m_tiledMode(tiledMode)
+      , m_toChannels(toChannels)
+      , m_rows(height)
+      , m_canSlide((int(tiledMode) & int(TiledMode::X_AXIS)) ||
+                   width <= src->width()) {
+    }
+
+    void moveTo(const int x, const int y) {
+      if (m_y != y) {
+        m_y = y;
+        m_valid = false;
+        for (int dy=0; dy<m_height; ++dy) {
+          const int sy = wrap(y - m_height/2 + dy, m_src->height(),
+                              int(m_tiledMode) & int(TiledMode::Y_AXIS));
+          m_rows[dy] = (typename Traits::const_address_t)m_src->getPixelAddress(0, sy);
+        }
+      }
+
+      // Slide the window from the previous position if it's faster
+      // than filling the whole histogram again
+      if (m_valid && m_canSlide && x > m_x && 2*(x - m_x) < m_width) {
+        for (; m_x < x; ++m_x) {
+          updateColumn(sourceX(m_x, 0), -1);
+          updateColumn(sourceX(m_x+1, m_width-1), +1);
+        }
+      }
+      else {
+        for (int c=0; c<N; ++c)
+          m_hist[c] = ChannelHistogram();
+        for (int dx=0; dx<m_width; ++dx)
+          updateColumn(sourceX(x, dx), +1);
+        m_x = x;
+        m_valid = true;
+      }
+    }
+
+    int median(const int c) const {
+      return m_hist[c].nth(m_width*m_height/2);
+    }
+
+  private:
+    static int wrap(const int v, const int size, const bool tiled) {
+      if (tiled)
+        return ((v % size) + size) % size;
+      else
+        return std::clamp(v, 0, size-1);
+    }
+
+    // Returns the same X coordinate used by get_neighboring_pixels()
+    // for the "dx" column of the window centered in "x". Without
+    // tiled mode, if the window is wider than the image and starts
+    // before the first column, the columns after the right edge don't
+    // map to the last column of the image (that's why we cannot slide
+    // the window in that case, see m_canSlide).
+    int sourceX(const int x, const int dx) const {
+      const int w = m_src->width();
+      const int s = x - m_width/2;
+      if (int(m_tiledMode) & int(TiledMode::X_AXIS))
+        return wrap(s + dx, w, true);
+      else if (s < 0)
+        return std::max(0, std::min(dx, w-1) + s);
+      else
+        return std::min(s + dx, w-1);
+    }
+
+    void updateColumn(const int sx, const int delta) {
+      int values[N];
+      for (int dy=0; dy<m_height; ++dy) {
+        m_toChannels(m_rows[dy][sx], values);
+        for (int c=0; c<N; ++c) {
+          if (delta > 0)
+            m_hist[c].add(values[c]);
+          else
+            m_hist[c].remove(values[c]);
+        }
+      }
+    }
+
+    const Image* m_src;
+    const int m_width;
+    const int m_height;
+    const TiledMode m_tiledMode;
+    ToChannels m_toChannels;
+    std::vector<typename Traits::const_address_t> m_rows;
+    const bool m_canSlide;
+    ChannelHistogram m_hist[N];
+    int m_x = 0;
+    int m_y = -1;
+    bool m_valid = false;
+  };
+
+  struct RgbaToChannels {
+    void operator()(RgbTraits::pixel_t color, int* values) const {
+      values[0] = rgba_getr(color);
+      values[1] = rgba_getg(color);
+      values[2] = rgba_getb(color);
+      values[3] = rgba_geta(color);
+    }
+  };
+
+  struct GrayscaleToChannels {
+    void operator()(GrayscaleTraits::pixel_t color, int* values) const {
+      values[0] = graya_getv(color);
+      values[1] = graya_geta(color);
+    }
+  };
+
+  struct IndexToChannels {
+    void operator()(IndexedTraits::pixel_t color, int* values) const {
+      values[0] = color;
+    }
+  };
+
+  struct PaletteToChannels {
+    const Palette* pal;
+    void operator()(IndexedTraits::pixel_t color, int* values) const {
+      RgbaToChannels()(pal->getEntry(color), values);
+    }
+  };
+
+  template<typename Window>
+  void apply_median_to_rgba(FilterManager* filterMgr, Window& window)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    int color, r, g, b, a;
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+      window.moveTo(x, y);
+
+      color = get_pixel_fast<RgbTraits>(src, x, y);
+
+      if (target & TARGET_RED_CHANNEL)
+        r = window.median(0);
+      else
+        r = rgba_getr(color);
+
+      if (target & TARGET_GREEN_CHANNEL)
+        g = window.median(1);
+      else
+        g = rgba_getg(color);
+
+      if (target & TARGET_BLUE_CHANNEL)
+        b = window.median(2);
+      else
+        b = rgba_getb(color);
+
+      if (target & TARGET_ALPHA_CHANNEL)
+        a = window.median(3);
+      else
+        a = rgba_geta(color);
+
+      *dst_address = rgba(r, g, b, a);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+  template<typename Window>
+  void apply_median_to_grayscale(FilterManager* filterMgr, Window& window)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    int color, k, a;
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
+      window.moveTo(x, y);
+
+      color = get_pixel_fast<GrayscaleTraits>(src, x, y);
+
+      if (target & TARGET_GRAY_CHANNEL)
+        k = window.median(0);
+      else
+        k = graya_getv(color);
+
+      if (target & TARGET_ALPHA_CHANNEL)
+        a = window.median(1);
+      else
+        a = graya_geta(color);
+
+      *dst_address = graya(k, a);
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+  template<typename Window>
+  void apply_median_to_indexed(FilterManager* filterMgr, Window& window)
+  {
+    const Image* src = filterMgr->getSourceImage();
+    const Palette* pal = filterMgr->getIndexedData()->getPalette();
+    const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
+    int color, r, g, b, a;
+
+    FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+      window.moveTo(x, y);
+
+      if (target & TARGET_INDEX_CHANNEL) {
+        *dst_address = window.median(0);
+      }
+      else {
+        color = get_pixel_fast<IndexedTraits>(src, x, y);
+        color = pal->getEntry(color);
+
+        if (target & TARGET_RED_CHANNEL)
+          r = window.median(0);
+        else
+          r = rgba_getr(color);
+
+        if (target & TARGET_GREEN_CHANNEL)
+          g = window.median(1);
+        else
+          g = rgba_getg(pal->getEntry(color));
+
+        if (target & TARGET_BLUE_CHANNEL)
+          b = window.median(2);
+        else
+          b = rgba_getb(color);
+
+        if (target & TARGET_ALPHA_CHANNEL)
+          a = window.median(3);
+        else
+          a = rgba_geta(color);
+
+        *dst_address = rgbmap->mapColor(r, g, b, a);
+      }
+    }
+    FILTER_LOOP_THROUGH_ROW_END()
+  }
+
+} // anonymous namespace
 
 MedianFilter::MedianFilter()
   : m_tiledMode(TiledMode::NONE)
   , m_width(1)
   , m_height(1)
   , m_ncolors(0)
+  , m_algorithm(Algorithm::Histogram)
   , m_channel(4)
 {
 }
@@ -124,134 +445,56 @@ const char* MedianFilter::getName()
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
-  int color, r, g, b, a;
-  GetPixelsDelegateRgba delegate(m_channel);
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                      m_tiledMode, delegate);
-
-    color = get_pixel_fast<RgbTraits>(src, x, y);
-
-    if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
-    }
-    else
-      r = rgba_getr(color);
-
-    if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
-    }
-    else
-      g = rgba_getg(color);
-
-    if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
-    }
-    else
-      b = rgba_getb(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
-    }
-    else
-      a = rgba_geta(color);
-
-    *dst_address = rgba(r, g, b, a);
+  if (m_algorithm == Algorithm::Sort) {
+    SortWindow<RgbTraits, GetPixelsDelegateRgba>
+      window(src, m_width, m_height, m_tiledMode, m_channel,
+             GetPixelsDelegateRgba(m_channel));
+    apply_median_to_rgba(filterMgr, window);
+  }
+  else {
+    HistogramWindow<RgbTraits, 4, RgbaToChannels>
+      window(src, m_width, m_height, m_tiledMode, RgbaToChannels());
+    apply_median_to_rgba(filterMgr, window);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
-  int color, k, a;
-  GetPixelsDelegateGrayscale delegate(m_channel);
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                            m_tiledMode, delegate);
-
-    color = get_pixel_fast<GrayscaleTraits>(src, x, y);
-
-    if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
-    }
-    else
-      k = graya_getv(color);
-
-    if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
-    }
-    else
-      a = graya_geta(color);
-
-    *dst_address = graya(k, a);
+  if (m_algorithm == Algorithm::Sort) {
+    SortWindow<GrayscaleTraits, GetPixelsDelegateGrayscale>
+      window(src, m_width, m_height, m_tiledMode, m_channel,
+             GetPixelsDelegateGrayscale(m_channel));
+    apply_median_to_grayscale(filterMgr, window);
+  }
+  else {
+    HistogramWindow<GrayscaleTraits, 2, GrayscaleToChannels>
+      window(src, m_width, m_height, m_tiledMode, GrayscaleToChannels());
+    apply_median_to_grayscale(filterMgr, window);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 void MedianFilter::applyToIndexed(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
-  const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int color, r, g, b, a;
-  GetPixelsDelegateIndexed delegate(pal, m_channel, filterMgr->getTarget());
-
-  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, m_width, m_height, m_width/2, m_height/2,
-                                          m_tiledMode, delegate);
-
-    if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *dst_address = m_channel[0][m_ncolors/2];
-    }
-    else {
-      color = get_pixel_fast<IndexedTraits>(src, x, y);
-      color = pal->getEntry(color);
-
-      if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
-      }
-      else
-        r = rgba_getr(color);
-
-      if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
-      }
-      else
-        g = rgba_getg(pal->getEntry(color));
-
-      if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
-      }
-      else
-        b = rgba_getb(color);
-
-      if (target & TARGET_ALPHA_CHANNEL) {
-        std::sort(m_channel[3].begin(), m_channel[3].end());
-        a = m_channel[3][m_ncolors/2];
-      }
-      else
-        a = rgba_geta(color);
-
-      *dst_address = rgbmap->mapColor(r, g, b, a);
-    }
+  const Target target = filterMgr->getTarget();
+  if (m_algorithm == Algorithm::Sort) {
+    SortWindow<IndexedTraits, GetPixelsDelegateIndexed>
+      window(src, m_width, m_height, m_tiledMode, m_channel,
+             GetPixelsDelegateIndexed(pal, m_channel, target));
+    apply_median_to_indexed(filterMgr, window);
+  }
+  else if (target & TARGET_INDEX_CHANNEL) {
+    HistogramWindow<IndexedTraits, 1, IndexToChannels>
+      window(src, m_width, m_height, m_tiledMode, IndexToChannels());
+    apply_median_to_indexed(filterMgr, window);
+  }
+  else {
+    HistogramWindow<IndexedTraits, 4, PaletteToChannels>
+      window(src, m_width, m_height, m_tiledMode, PaletteToChannels{ pal });
+    apply_median_to_indexed(filterMgr, window);
   }
-  FILTER_LOOP_THROUGH_ROW_END()
 }
 
 } // namespace filters
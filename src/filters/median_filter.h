@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -18,26 +19,42 @@ namespace filters {
 
   class MedianFilter : public Filter {
   public:
+    enum class Algorithm {
+      // Sorts all the pixels of the window for each pixel (the
+      // original implementation, kept to compare results)
+      Sort,
+      // Sliding window histogram (constant time per pixel for each
+      // row of the window)
+      Histogram,
+    };
+
     MedianFilter();
 
     void setTiledMode(TiledMode tiled);
     void setSize(int width, int height);
+    void setAlgorithm(Algorithm algorithm) { m_algorithm = algorithm; }
 
     TiledMode getTiledMode() const { return m_tiledMode; }
     int getWidth() const { return m_width; }
     int getHeight() const { return m_height; }
+    Algorithm getAlgorithm() const { return m_algorithm; }
 
     // Filter implementation
     const char* getName();
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool canApplyToRowsInParallel() const {
+      // The Sort algorithm uses m_channel to sort the window pixels
+      return (m_algorithm == Algorithm::Histogram);
+    }
 
   private:
     TiledMode m_tiledMode;
     int m_width;
     int m_height;
     int m_ncolors;
+    Algorithm m_algorithm;
     std::vector<std::vector<uint8_t> > m_channel;
   };
 
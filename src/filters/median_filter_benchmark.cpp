@@ -0,0 +1,67 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/median_filter.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "filters/image_filter_manager.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+static void Bm_MedianFilter(benchmark::State& state)
+{
+  const auto algorithm = MedianFilter::Algorithm(state.range(0));
+  const int filterSize = state.range(1);
+  const int w = 512;
+  const int h = 512;
+
+  std::mt19937 rng(1);
+  ImageRef src(Image::create(IMAGE_RGB, w, h));
+  ImageRef dst(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y, rng());
+
+  MedianFilter filter;
+  filter.setAlgorithm(algorithm);
+  filter.setSize(filterSize, filterSize);
+
+  while (state.KeepRunning()) {
+    ImageFilterManager(src.get(), dst.get(), TARGET_ALL_CHANNELS)
+      .apply(&filter);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+  state.SetLabel(algorithm == MedianFilter::Algorithm::Sort ? "Sort":
+                                                              "Histogram");
+}
+
+static void FilterSizeArguments(benchmark::internal::Benchmark* b)
+{
+  for (int size : { 3, 5, 7, 11, 15 }) {
+    b->Args({ int(MedianFilter::Algorithm::Sort), size });
+    b->Args({ int(MedianFilter::Algorithm::Histogram), size });
+  }
+  // Sorting is too slow for bigger sizes
+  for (int size : { 31, 63 })
+    b->Args({ int(MedianFilter::Algorithm::Histogram), size });
+}
+
+BENCHMARK(Bm_MedianFilter)
+  ->Apply(FilterSizeArguments)
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "filters/filter_test_utils.h"
+#include "filters/median_filter.h"
+
+#include <random>
+
+using namespace doc;
+using namespace filters;
+
+static void test_median(const PixelFormat pf,
+                        const int imageW, const int imageH,
+                        const int filterW, const int filterH,
+                        const TiledMode tiledMode,
+                        const Target target)
+{
+  SCOPED_TRACE(testing::Message()
+               << "filter=" << filterW << "x" << filterH
+               << " tiledMode=" << int(tiledMode));
+
+  std::mt19937 rng(imageW*imageH + filterW*filterH);
+  // Few different values so there are a lot of repeated values in
+  // each window
+  ImageRef src = random_image(pf, imageW, imageH, rng, 0xf0f0f0f0);
+  const Palette palette = random_palette(rng);
+
+  MedianFilter filter;
+  filter.setSize(filterW, filterH);
+  filter.setTiledMode(tiledMode);
+
+  expect_same_filter_algorithms(filter,
+                                MedianFilter::Algorithm::Sort,
+                                MedianFilter::Algorithm::Histogram,
+                                src.get(), target, palette);
+}
+
+static void test_all_sizes(const PixelFormat pf, const Target target)
+{
+  for (auto tiledMode : { TiledMode::NONE, TiledMode::X_AXIS,
+                          TiledMode::Y_AXIS, TiledMode::BOTH }) {
+    test_median(pf, 32, 24, 3, 3, tiledMode, target);
+    test_median(pf, 32, 24, 7, 5, tiledMode, target);
+    test_median(pf, 32, 24, 4, 6, tiledMode, target);
+    test_median(pf, 40, 8, 15, 15, tiledMode, target);
+    // Filter bigger than the image
+    test_median(pf, 5, 7, 11, 9, tiledMode, target);
+    test_median(pf, 1, 1, 3, 3, tiledMode, target);
+  }
+}
+
+TEST(MedianFilter, Rgba)
+{
+  test_all_sizes(IMAGE_RGB, TARGET_ALL_CHANNELS);
+  test_all_sizes(IMAGE_RGB, TARGET_RED_CHANNEL | TARGET_ALPHA_CHANNEL);
+}
+
+TEST(MedianFilter, Grayscale)
+{
+  test_all_sizes(IMAGE_GRAYSCALE, TARGET_ALL_CHANNELS);
+  test_all_sizes(IMAGE_GRAYSCALE, TARGET_GRAY_CHANNEL);
+}
+
+TEST(MedianFilter, Indexed)
+{
+  Palette::initBestfit();
+  test_all_sizes(IMAGE_INDEXED, TARGET_INDEX_CHANNEL);
+  test_all_sizes(IMAGE_INDEXED, TARGET_ALL_CHANNELS);
+  test_all_sizes(IMAGE_INDEXED, TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
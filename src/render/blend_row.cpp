@@ -0,0 +1,193 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/blend_row.h"
+
+#include "render/blend_row_kernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+  #define RENDER_HAVE_SSE2 1
+  #include <emmintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define RENDER_HAVE_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace render {
+
+#if RENDER_HAVE_AVX2
+// Defined in blend_row_avx2.cpp (compiled with AVX2 enabled)
+kernels::KernelFunc get_avx2_row_kernel(const int blendMode,
+                                        const bool newBlend);
+#endif
+
+namespace {
+
+#if RENDER_HAVE_SSE2
+
+struct SSE2 {
+  typedef __m128i type;
+  static constexpr int N = 4;
+
+  static type load(const uint32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+  static void store(uint32_t* p, const type a) { _mm_storeu_si128((__m128i*)p, a); }
+  static type zero() { return _mm_setzero_si128(); }
+  static type splat(const int v) { return _mm_set1_epi32(v); }
+  static type add(const type a, const type b) { return _mm_add_epi32(a, b); }
+  static type sub(const type a, const type b) { return _mm_sub_epi32(a, b); }
+  // Both values must fit in 16 bits, and one of them must be positive
+  static type mul(const type a, const type b) { return _mm_madd_epi16(a, b); }
+  static type div(const type a, const type b) {
+    return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(b)));
+  }
+  template<int S> static type srai(const type a) { return _mm_srai_epi32(a, S); }
+  template<int S> static type srli(const type a) { return _mm_srli_epi32(a, S); }
+  template<int S> static type slli(const type a) { return _mm_slli_epi32(a, S); }
+  static type and_(const type a, const type b) { return _mm_and_si128(a, b); }
+  static type or_(const type a, const type b) { return _mm_or_si128(a, b); }
+  // ~mask & b
+  static type andnot(const type mask, const type b) { return _mm_andnot_si128(mask, b); }
+  static type cmpeq(const type a, const type b) { return _mm_cmpeq_epi32(a, b); }
+  static type select(const type mask, const type a, const type b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+  }
+};
+
+#if RENDER_HAVE_AVX2
+bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  // Check that the OS saves the YMM registers (OSXSAVE + XCR0)
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 ||
+      (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // RENDER_HAVE_AVX2
+
+#endif // RENDER_HAVE_SSE2
+
+#if RENDER_HAVE_NEON
+
+struct NEON {
+  typedef int32x4_t type;
+  static constexpr int N = 4;
+
+  static type load(const uint32_t* p) { return vreinterpretq_s32_u32(vld1q_u32(p)); }
+  static void store(uint32_t* p, const type a) { vst1q_u32(p, vreinterpretq_u32_s32(a)); }
+  static type zero() { return vdupq_n_s32(0); }
+  static type splat(const int v) { return vdupq_n_s32(v); }
+  static type add(const type a, const type b) { return vaddq_s32(a, b); }
+  static type sub(const type a, const type b) { return vsubq_s32(a, b); }
+  static type mul(const type a, const type b) { return vmulq_s32(a, b); }
+  static type div(const type a, const type b) {
+    return vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(a), vcvtq_f32_s32(b)));
+  }
+  template<int S> static type srai(const type a) { return vshrq_n_s32(a, S); }
+  template<int S> static type srli(const type a) {
+    return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), S));
+  }
+  template<int S> static type slli(const type a) { return vshlq_n_s32(a, S); }
+  static type and_(const type a, const type b) { return vandq_s32(a, b); }
+  static type or_(const type a, const type b) { return vorrq_s32(a, b); }
+  // ~mask & b
+  static type andnot(const type mask, const type b) { return vbicq_s32(b, mask); }
+  static type cmpeq(const type a, const type b) {
+    return vreinterpretq_s32_u32(vceqq_s32(a, b));
+  }
+  static type select(const type mask, const type a, const type b) {
+    return vbslq_s32(vreinterpretq_u32_s32(mask), a, b);
+  }
+};
+
+#endif // RENDER_HAVE_NEON
+
+} // anonymous namespace
+
+RowBlenderImpl best_row_blender_impl()
+{
+  static RowBlenderImpl best = []{
+#if RENDER_HAVE_SSE2
+  #if RENDER_HAVE_AVX2
+    if (cpu_has_avx2())
+      return RowBlenderImpl::AVX2;
+  #endif
+    return RowBlenderImpl::SSE2;
+#elif RENDER_HAVE_NEON
+    return RowBlenderImpl::NEON;
+#else
+    return RowBlenderImpl::Scalar;
+#endif
+  }();
+  return best;
+}
+
+bool is_row_blender_impl_available(const RowBlenderImpl impl)
+{
+  switch (impl) {
+    case RowBlenderImpl::Scalar:
+      return true;
+#if RENDER_HAVE_SSE2
+    case RowBlenderImpl::SSE2:
+      return true;
+  #if RENDER_HAVE_AVX2
+    case RowBlenderImpl::AVX2:
+      return (best_row_blender_impl() == RowBlenderImpl::AVX2);
+  #endif
+#endif
+#if RENDER_HAVE_NEON
+    case RowBlenderImpl::NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+RowBlendKernel get_rgba_row_kernel(const doc::BlendMode blendMode,
+                                   const bool newBlend,
+                                   const RowBlenderImpl impl)
+{
+  if (!is_row_blender_impl_available(impl))
+    return nullptr;
+
+  switch (impl) {
+#if RENDER_HAVE_SSE2
+    case RowBlenderImpl::SSE2:
+      return kernels::get_kernel<SSE2>(int(blendMode), newBlend);
+  #if RENDER_HAVE_AVX2
+    case RowBlenderImpl::AVX2:
+      return get_avx2_row_kernel(int(blendMode), newBlend);
+  #endif
+#endif
+#if RENDER_HAVE_NEON
+    case RowBlenderImpl::NEON:
+      return kernels::get_kernel<NEON>(int(blendMode), newBlend);
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+} // namespace render
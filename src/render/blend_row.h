@@ -0,0 +1,83 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_BLEND_ROW_H_INCLUDED
+#define RENDER_BLEND_ROW_H_INCLUDED
+#pragma once
+
+#include "doc/blend_funcs.h"
+#include "doc/blend_mode.h"
+#include "doc/color.h"
+
+namespace render {
+
+  // Instruction sets that can be used to blend rows of RGBA pixels.
+  enum class RowBlenderImpl {
+    Scalar,
+    SSE2,
+    AVX2,
+    NEON,
+  };
+
+  // Blends the first pixels of a row of "n" pixels, and returns how
+  // many pixels were processed (always a multiple of the SIMD
+  // register width). The remaining pixels must be blended by the
+  // caller.
+  typedef int (*RowBlendKernel)(doc::color_t* dst,
+                                const doc::color_t* src,
+                                const int n,
+                                const int opacity,
+                                const doc::color_t maskColor);
+
+  // Returns the fastest implementation available in the current CPU.
+  RowBlenderImpl best_row_blender_impl();
+
+  // Returns true if the given implementation was compiled and can be
+  // used in the current CPU.
+  bool is_row_blender_impl_available(const RowBlenderImpl impl);
+
+  // Returns the SIMD kernel to blend RGBA rows with the given blend
+  // mode, or nullptr if there is no specific kernel for this blend
+  // mode/implementation (only NORMAL, MULTIPLY and SCREEN are
+  // vectorized).
+  RowBlendKernel get_rgba_row_kernel(const doc::BlendMode blendMode,
+                                     const bool newBlend,
+                                     const RowBlenderImpl impl);
+
+  // Blends a whole row of RGBA pixels from "src" into "dst". The
+  // result is the same as doc::get_rgba_row_blender(), but a SIMD
+  // kernel is used when it's possible.
+  class RgbaRowBlender {
+  public:
+    RgbaRowBlender(const doc::BlendMode blendMode,
+                   const bool newBlend,
+                   const RowBlenderImpl impl = best_row_blender_impl())
+      : m_blendRowFunc(doc::get_rgba_row_blender(blendMode, newBlend))
+      , m_kernel(get_rgba_row_kernel(blendMode, newBlend, impl)) {
+    }
+
+    bool isVectorized() const { return (m_kernel != nullptr); }
+
+    void operator()(doc::color_t* dst,
+                    const doc::color_t* src,
+                    const int n,
+                    const int opacity,
+                    const doc::color_t maskColor) const {
+      int x = 0;
+      if (m_kernel)
+        x = (*m_kernel)(dst, src, n, opacity, maskColor);
+      if (x < n)
+        (*m_blendRowFunc)(dst+x, src+x, n-x, opacity, maskColor);
+    }
+
+  private:
+    doc::RgbaBlendRowFunc m_blendRowFunc;
+    RowBlendKernel m_kernel;
+  };
+
+} // namespace render
+
+#endif
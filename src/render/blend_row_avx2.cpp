@@ -0,0 +1,60 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+//
+// This file is compiled with AVX2 enabled (-mavx2 or /arch:AVX2), so
+// it cannot include headers with inline functions that could be used
+// from other translation units (they would be compiled with AVX2
+// instructions too). The kernels are only used if the CPU supports
+// AVX2 (see render::best_row_blender_impl()).
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/blend_row_kernels.h"
+
+#include <immintrin.h>
+
+namespace render {
+
+namespace {
+
+struct AVX2 {
+  typedef __m256i type;
+  static constexpr int N = 8;
+
+  static type load(const uint32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+  static void store(uint32_t* p, const type a) { _mm256_storeu_si256((__m256i*)p, a); }
+  static type zero() { return _mm256_setzero_si256(); }
+  static type splat(const int v) { return _mm256_set1_epi32(v); }
+  static type add(const type a, const type b) { return _mm256_add_epi32(a, b); }
+  static type sub(const type a, const type b) { return _mm256_sub_epi32(a, b); }
+  static type mul(const type a, const type b) { return _mm256_mullo_epi32(a, b); }
+  static type div(const type a, const type b) {
+    return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a), _mm256_cvtepi32_ps(b)));
+  }
+  template<int S> static type srai(const type a) { return _mm256_srai_epi32(a, S); }
+  template<int S> static type srli(const type a) { return _mm256_srli_epi32(a, S); }
+  template<int S> static type slli(const type a) { return _mm256_slli_epi32(a, S); }
+  static type and_(const type a, const type b) { return _mm256_and_si256(a, b); }
+  static type or_(const type a, const type b) { return _mm256_or_si256(a, b); }
+  // ~mask & b
+  static type andnot(const type mask, const type b) { return _mm256_andnot_si256(mask, b); }
+  static type cmpeq(const type a, const type b) { return _mm256_cmpeq_epi32(a, b); }
+  static type select(const type mask, const type a, const type b) {
+    return _mm256_blendv_epi8(b, a, mask);
+  }
+};
+
+} // anonymous namespace
+
+kernels::KernelFunc get_avx2_row_kernel(const int blendMode,
+                                        const bool newBlend)
+{
+  return kernels::get_kernel<AVX2>(blendMode, newBlend);
+}
+
+} // namespace render
@@ -0,0 +1,209 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_BLEND_ROW_KERNELS_H_INCLUDED
+#define RENDER_BLEND_ROW_KERNELS_H_INCLUDED
+#pragma once
+
+// Generic SIMD implementation of the RGBA blenders from
+// doc/blend_funcs.cpp. These kernels are instantiated with a "V"
+// struct that wraps the intrinsics of a specific instruction set
+// (SSE2, AVX2, NEON), where each 32-bit lane contains one pixel.
+//
+// The results must be exactly the same as the scalar versions, so
+// we use the same integer arithmetic (MUL_UN8) and the integer
+// division of rgba_blender_normal() is done with floats: as
+// |(Sc-Bc)*Sa| <= 255*255 and 0 < Ra <= 255, a correctly rounded
+// float division never crosses an integer boundary, so truncating
+// its result gives the same value as the integer division.
+//
+// This file must not include other headers with inline functions,
+// because it's compiled with different target flags (e.g. -mavx2).
+
+#include <cstdint>
+
+namespace render {
+namespace kernels {
+
+  // Same as render::RowBlendKernel
+  typedef int (*KernelFunc)(uint32_t* dst,
+                            const uint32_t* src,
+                            const int n,
+                            const int opacity,
+                            const uint32_t maskColor);
+
+  template<typename V>
+  struct Pixels {
+    typename V::type r, g, b, a;
+  };
+
+  // MUL_UN8() macro from pixman-combine32.h
+  template<typename V>
+  inline typename V::type mul_un8(const typename V::type a,
+                                  const typename V::type b) {
+    const typename V::type t = V::add(V::mul(a, b), V::splat(0x80));
+    return V::template srai<8>(V::add(V::template srai<8>(t), t));
+  }
+
+  template<typename V>
+  inline Pixels<V> unpack(const typename V::type c) {
+    const typename V::type ff = V::splat(0xff);
+    return Pixels<V>{
+      V::and_(c, ff),
+      V::and_(V::template srli<8>(c), ff),
+      V::and_(V::template srli<16>(c), ff),
+      V::template srli<24>(c) };
+  }
+
+  template<typename V>
+  inline typename V::type pack(const typename V::type r,
+                               const typename V::type g,
+                               const typename V::type b,
+                               const typename V::type a) {
+    return V::or_(V::or_(r, V::template slli<8>(g)),
+                  V::or_(V::template slli<16>(b), V::template slli<24>(a)));
+  }
+
+  // rgba_blender_normal()
+  template<typename V>
+  inline typename V::type normal(const typename V::type backdrop,
+                                 const Pixels<V>& B,
+                                 const Pixels<V>& S,
+                                 const typename V::type opacity) {
+    using T = typename V::type;
+    const T zero = V::zero();
+    const T Sa = mul_un8<V>(S.a, opacity);
+    const T Ra = V::sub(V::add(Sa, B.a), mul_un8<V>(B.a, Sa));
+
+    // Avoid divisions by zero (these lanes are discarded anyway)
+    const T Rdiv = V::or_(Ra, V::and_(V::cmpeq(Ra, zero), V::splat(1)));
+
+    const T Rr = V::add(B.r, V::div(V::mul(V::sub(S.r, B.r), Sa), Rdiv));
+    const T Rg = V::add(B.g, V::div(V::mul(V::sub(S.g, B.g), Sa), Rdiv));
+    const T Rb = V::add(B.b, V::div(V::mul(V::sub(S.b, B.b), Sa), Rdiv));
+
+    T result = pack<V>(Rr, Rg, Rb, Ra);
+    result = V::select(V::cmpeq(S.a, zero), backdrop, result);
+    result = V::select(V::cmpeq(B.a, zero), pack<V>(S.r, S.g, S.b, Sa), result);
+    return result;
+  }
+
+  // rgba_blender_merge() with a different opacity for each pixel
+  template<typename V>
+  inline typename V::type merge(const Pixels<V>& B,
+                                const Pixels<V>& S,
+                                const typename V::type opacity) {
+    using T = typename V::type;
+    const T zero = V::zero();
+    const T Sa0 = V::cmpeq(S.a, zero);
+    const T Ba0 = V::cmpeq(B.a, zero);
+
+    T Rr = V::add(B.r, mul_un8<V>(V::sub(S.r, B.r), opacity));
+    T Rg = V::add(B.g, mul_un8<V>(V::sub(S.g, B.g), opacity));
+    T Rb = V::add(B.b, mul_un8<V>(V::sub(S.b, B.b), opacity));
+    Rr = V::select(Ba0, S.r, V::select(Sa0, B.r, Rr));
+    Rg = V::select(Ba0, S.g, V::select(Sa0, B.g, Rg));
+    Rb = V::select(Ba0, S.b, V::select(Sa0, B.b, Rb));
+
+    const T Ra = V::add(B.a, mul_un8<V>(V::sub(S.a, B.a), opacity));
+    const T rgb = V::andnot(V::cmpeq(Ra, zero),
+                            pack<V>(Rr, Rg, Rb, zero));
+    return V::or_(rgb, V::template slli<24>(Ra));
+  }
+
+  struct NormalBlend {
+    template<typename V>
+    static inline Pixels<V> apply(const Pixels<V>& B, const Pixels<V>& S) {
+      return S;
+    }
+  };
+
+  struct MultiplyBlend {
+    template<typename V>
+    static inline Pixels<V> apply(const Pixels<V>& B, const Pixels<V>& S) {
+      return Pixels<V>{
+        mul_un8<V>(B.r, S.r),
+        mul_un8<V>(B.g, S.g),
+        mul_un8<V>(B.b, S.b),
+        S.a };
+    }
+  };
+
+  struct ScreenBlend {
+    template<typename V>
+    static inline Pixels<V> apply(const Pixels<V>& B, const Pixels<V>& S) {
+      return Pixels<V>{
+        V::sub(V::add(B.r, S.r), mul_un8<V>(B.r, S.r)),
+        V::sub(V::add(B.g, S.g), mul_un8<V>(B.g, S.g)),
+        V::sub(V::add(B.b, S.b), mul_un8<V>(B.b, S.b)),
+        S.a };
+    }
+  };
+
+  // rgba_blender_*() (NewBlend=false) and rgba_blender_*_n()
+  // (NewBlend=true) for a whole row. Returns the number of processed
+  // pixels.
+  template<typename V, typename Blend, bool NewBlend>
+  int blend_row(uint32_t* dst,
+                const uint32_t* src,
+                const int n,
+                const int opacity,
+                const uint32_t maskColor)
+  {
+    using T = typename V::type;
+    const T op = V::splat(opacity);
+    const T mask = V::splat(int(maskColor));
+    const T zero = V::zero();
+    int x = 0;
+
+    for (; x+V::N<=n; x+=V::N, dst+=V::N, src+=V::N) {
+      const T b = V::load(dst);
+      const T s = V::load(src);
+      const Pixels<V> B = unpack<V>(b);
+      const Pixels<V> S = unpack<V>(s);
+      T result;
+
+      if constexpr (NewBlend) {
+        const T norm = normal<V>(b, B, S, op);
+        const T blend = normal<V>(b, B, Blend::apply(B, S), op);
+        const Pixels<V> blendPixels = unpack<V>(blend);
+        const T normalToBlendMerge = merge<V>(unpack<V>(norm), blendPixels, B.a);
+        const T compositeAlpha = mul_un8<V>(B.a, mul_un8<V>(S.a, op));
+        result = merge<V>(unpack<V>(normalToBlendMerge), blendPixels, compositeAlpha);
+        result = V::select(V::cmpeq(B.a, zero), norm, result);
+      }
+      else {
+        result = normal<V>(b, B, Blend::apply(B, S), op);
+      }
+
+      result = V::select(V::cmpeq(s, mask), b, result);
+      V::store(dst, result);
+    }
+    return x;
+  }
+
+  // Returns the kernel for the given blend mode (as a BlendMode int
+  // value to avoid including other headers).
+  template<typename V>
+  inline KernelFunc get_kernel(const int blendMode,
+                               const bool newBlend) {
+    switch (blendMode) {
+      case 0:                 // BlendMode::NORMAL
+        return blend_row<V, NormalBlend, false>;
+      case 1:                 // BlendMode::MULTIPLY
+        return (newBlend ? blend_row<V, MultiplyBlend, true>:
+                           blend_row<V, MultiplyBlend, false>);
+      case 2:                 // BlendMode::SCREEN
+        return (newBlend ? blend_row<V, ScreenBlend, true>:
+                           blend_row<V, ScreenBlend, false>);
+    }
+    return nullptr;
+  }
+
+} // namespace kernels
+} // namespace render
+
+#endif
@@ -0,0 +1,114 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/blend_row.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+using namespace render;
+
+static void test_row_blender(const BlendMode blendMode,
+                             const bool newBlend,
+                             const RowBlenderImpl impl)
+{
+  if (!is_row_blender_impl_available(impl))
+    return;
+
+  const RgbaRowBlender rowBlender(blendMode, newBlend, impl);
+  EXPECT_TRUE(rowBlender.isVectorized());
+
+  const BlendFunc blendFunc = get_rgba_blender(blendMode, newBlend);
+  const color_t maskColor = 0;
+  std::mt19937 rng(1);
+
+  for (int i=0; i<1000; ++i) {
+    const int n = 1 + rng() % 37;
+    const int opacity = (i < 256 ? i: rng() % 256);
+    std::vector<color_t> dst(n), src(n), expected(n);
+
+    for (int x=0; x<n; ++x) {
+      dst[x] = rng();
+      src[x] = rng();
+      // Test special cases (transparent pixels, opaque, mask color)
+      switch (rng() % 6) {
+        case 0: dst[x] &= rgba_rgb_mask; break;
+        case 1: src[x] &= rgba_rgb_mask; break;
+        case 2: src[x] = maskColor; break;
+        case 3: src[x] |= rgba_a_mask; break;
+        case 4: dst[x] |= rgba_a_mask; break;
+      }
+      expected[x] = (src[x] != maskColor ?
+                     blendFunc(dst[x], src[x], opacity): dst[x]);
+    }
+
+    rowBlender(&dst[0], &src[0], n, opacity, maskColor);
+    for (int x=0; x<n; ++x) {
+      ASSERT_EQ(expected[x], dst[x])
+        << "Blend mode " << blend_mode_to_string(blendMode)
+        << " newBlend=" << newBlend
+        << " opacity=" << opacity
+        << " pixel=" << x;
+    }
+  }
+}
+
+static void test_all_impls(const BlendMode blendMode)
+{
+  for (auto impl : { RowBlenderImpl::SSE2,
+                     RowBlenderImpl::AVX2,
+                     RowBlenderImpl::NEON }) {
+    test_row_blender(blendMode, false, impl);
+    test_row_blender(blendMode, true, impl);
+  }
+}
+
+TEST(BlendRow, Normal)
+{
+  test_all_impls(BlendMode::NORMAL);
+}
+
+TEST(BlendRow, Multiply)
+{
+  test_all_impls(BlendMode::MULTIPLY);
+}
+
+TEST(BlendRow, Screen)
+{
+  test_all_impls(BlendMode::SCREEN);
+}
+
+TEST(BlendRow, NonVectorizedModes)
+{
+  const RgbaRowBlender rowBlender(BlendMode::OVERLAY, true);
+  EXPECT_FALSE(rowBlender.isVectorized());
+
+  color_t dst[3] = { rgba(255, 0, 0, 255), rgba(0, 0, 0, 0), rgba(0, 0, 255, 128) };
+  color_t src[3] = { rgba(0, 255, 0, 128), rgba(0, 255, 0, 128), 0 };
+  color_t expected[3];
+  const BlendFunc blendFunc = get_rgba_blender(BlendMode::OVERLAY, true);
+  expected[0] = blendFunc(dst[0], src[0], 200);
+  expected[1] = blendFunc(dst[1], src[1], 200);
+  expected[2] = dst[2];
+
+  rowBlender(dst, src, 3, 200, 0);
+  EXPECT_EQ(expected[0], dst[0]);
+  EXPECT_EQ(expected[1], dst[1]);
+  EXPECT_EQ(expected[2], dst[2]);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
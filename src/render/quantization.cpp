@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -46,8 +46,11 @@ Palette* create_palette_from_sprite(
   RgbMapAlgorithm mapAlgo,
   const bool calculateWithTransparent)
 {
-   if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
-     mapAlgo = doc::RgbMapAlgorithm::OCTREE;
+  // The k-d tree is only used to map colors to palette entries, so
+  // we generate the palette with the octree (like the default).
+  if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT ||
+      mapAlgo == doc::RgbMapAlgorithm::KDTREE)
+    mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
   PaletteOptimizer optimizer;
   OctreeMap octreemap;
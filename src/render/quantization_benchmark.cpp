@@ -0,0 +1,89 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/quantization.h"
+
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "doc/rgbmap_kdtree.h"
+#include "doc/rgbmap_rgb5a3.h"
+#include "render/dithering.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+
+using namespace doc;
+using namespace render;
+
+static RgbMap* create_rgbmap(const RgbMapAlgorithm algo)
+{
+  switch (algo) {
+    case RgbMapAlgorithm::RGB5A3: return new RgbMapRGB5A3;
+    case RgbMapAlgorithm::OCTREE: return new OctreeMap;
+    case RgbMapAlgorithm::KDTREE: return new RgbMapKdTree;
+    default: return nullptr;
+  }
+}
+
+// Converts a RGB image with smooth gradients and some noise (so most
+// of the pixels are different colors) to an indexed image with a
+// random 256-color palette.
+static void Bm_ConvertRgbToIndexed(benchmark::State& state)
+{
+  const auto algo = RgbMapAlgorithm(state.range(0));
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  Palette::initBestfit();
+
+  std::mt19937 rng(1);
+  Palette palette(frame_t(0), 256);
+  for (int i=0; i<palette.size(); ++i)
+    palette.setEntry(i, rgba(rng() & 255, rng() & 255, rng() & 255, 255));
+
+  ImageRef src(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y,
+                rgba((x*255/w + rng() % 8) & 255,
+                     (y*255/h + rng() % 8) & 255,
+                     ((x+y)*127/(w+h) + rng() % 8) & 255, 255));
+
+  ImageRef dst(Image::create(IMAGE_INDEXED, w, h));
+  std::unique_ptr<RgbMap> rgbmap(create_rgbmap(algo));
+
+  while (state.KeepRunning()) {
+    // Regenerate the map from scratch in each iteration so the time
+    // includes the cache misses
+    palette.setEntry(0, palette.getEntry(0) ^ 1);
+    rgbmap->regenerateMap(&palette, -1);
+
+    convert_pixel_format(src.get(), dst.get(), IMAGE_INDEXED,
+                         Dithering(), rgbmap.get(), &palette,
+                         true, 0);
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+BENCHMARK(Bm_ConvertRgbToIndexed)
+  ->Args({ int(RgbMapAlgorithm::RGB5A3), 1024, 1024 })
+  ->Args({ int(RgbMapAlgorithm::OCTREE), 1024, 1024 })
+  ->Args({ int(RgbMapAlgorithm::KDTREE), 1024, 1024 })
+  ->Args({ int(RgbMapAlgorithm::RGB5A3), 4096, 4096 })
+  ->Args({ int(RgbMapAlgorithm::OCTREE), 4096, 4096 })
+  ->Args({ int(RgbMapAlgorithm::KDTREE), 4096, 4096 })
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
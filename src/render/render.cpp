@@ -22,8 +22,18 @@
 #include "doc/tilesets.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "render/blend_row.h"
+#include "render/render_cache.h"
 
+#include <city.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -50,44 +60,36 @@ void composite_image_without_scale(
   ASSERT(DstTraits::pixel_format == dst->pixelFormat());
   ASSERT(SrcTraits::pixel_format == src->pixelFormat());
 
-  BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
-
   gfx::Clip area(areaF);
   if (!area.clip(dst->width(), dst->height(),
                  src->width(), src->height()))
     return;
 
-  gfx::Rect srcBounds = area.srcBounds();
-  gfx::Rect dstBounds = area.dstBounds();
-  int bottom = dstBounds.y2()-1;
+  const gfx::Rect srcBounds = area.srcBounds();
+  const gfx::Rect dstBounds = area.dstBounds();
 
   ASSERT(!srcBounds.isEmpty());
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  auto src_it = srcBits.begin();
-#ifdef _DEBUG
-  auto src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
-
-  // For each line to draw of the source image...
-  dstBounds.h = 1;
-  for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
-
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      *dst_it = blender(*dst_it, *src_it, opacity);
-      ++src_it;
-      ++dst_it;
+  // RGBA -> RGBA uses SIMD kernels when they are available
+  if constexpr (std::is_same_v<DstTraits, RgbTraits> &&
+                std::is_same_v<SrcTraits, RgbTraits>) {
+    const RgbaRowBlender rowBlender(blendMode, newBlend);
+    const color_t maskColor = src->maskColor();
+    for (int y=0; y<srcBounds.h; ++y) {
+      rowBlender(
+        get_pixel_address_fast<RgbTraits>(dst, dstBounds.x, dstBounds.y+y),
+        get_pixel_read_address_fast<RgbTraits>(src, srcBounds.x, srcBounds.y+y),
+        srcBounds.w, opacity, maskColor);
+    }
+  }
+  else {
+    BlenderHelper<DstTraits, SrcTraits> blender(dst, src, pal, blendMode, newBlend);
+    for (int y=0; y<srcBounds.h; ++y) {
+      blender.blendRow(
+        get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstBounds.y+y),
+        get_pixel_read_address_fast<SrcTraits>(src, srcBounds.x, srcBounds.y+y),
+        srcBounds.w, opacity);
     }
-
-    if (++dstBounds.y > bottom)
-      break;
   }
 }
 
@@ -361,7 +363,7 @@ void composite_image_general(
     ASSERT(dstY >= 0 && dstY < dst->height());
 
     auto dstPtr = get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstY);
-    auto srcPtr = get_pixel_address_fast<SrcTraits>(src, int(srcX), srcY);
+    auto srcPtr = get_pixel_read_address_fast<SrcTraits>(src, int(srcX), srcY);
 
 #if _DEBUG
     int dstX = dstBounds.x;
@@ -468,7 +470,7 @@ void composite_image_general_with_tile_flags(
 
       if (srcX >= 0 && srcX < minSize.w &&
           srcY >= 0 && srcY < minSize.h) {
-        auto srcPtr = get_pixel_address_fast<SrcTraits>(src, srcX, srcY);
+        auto srcPtr = get_pixel_read_address_fast<SrcTraits>(src, srcX, srcY);
         *dstPtr = blender(*dstPtr, *srcPtr, opacity);
       }
       else {
@@ -481,6 +483,24 @@ void composite_image_general_with_tile_flags(
   }
 }
 
+// Returns true if composite_image_general() must be used for the
+// given projection (i.e. we cannot use a faster path that repeats
+// each source pixel an integer number of times).
+bool needs_general_composition(const Projection& proj,
+                               const bool finegrain)
+{
+  if (finegrain || !proj.zoom().isSimpleZoomLevel())
+    return true;
+
+  if ((proj.applyX(1) == 1 && proj.applyY(1) == 1) ||
+      (proj.scaleX() >= 1.0 && proj.scaleY() >= 1.0))
+    return false;
+
+  // Slower composite function for special cases with odd zoom and non-square pixel ratio
+  return (((proj.removeX(1) > 1) && (proj.removeX(1) & 1)) ||
+          ((proj.removeY(1) > 1) && (proj.removeY(1) & 1)));
+}
+
 template<class DstTraits, class SrcTraits>
 CompositeImageFunc get_fastest_composition_path(const Projection& proj,
                                                 const bool finegrain,
@@ -489,7 +509,7 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   if (tileFlags) {
     return composite_image_general_with_tile_flags<DstTraits, SrcTraits>;
   }
-  else if (finegrain || !proj.zoom().isSimpleZoomLevel()) {
+  else if (needs_general_composition(proj, finegrain)) {
     return composite_image_general<DstTraits, SrcTraits>;
   }
   else if (proj.applyX(1) == 1 && proj.applyY(1) == 1) {
@@ -498,11 +518,6 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   else if (proj.scaleX() >= 1.0 && proj.scaleY() >= 1.0) {
     return composite_image_scale_up<DstTraits, SrcTraits>;
   }
-  // Slower composite function for special cases with odd zoom and non-square pixel ratio
-  else if (((proj.removeX(1) > 1) && (proj.removeX(1) & 1)) ||
-           ((proj.removeY(1) > 1) && (proj.removeY(1) & 1))) {
-    return composite_image_general<DstTraits, SrcTraits>;
-  }
   else {
     return composite_image_scale_down<DstTraits, SrcTraits>;
   }
@@ -544,6 +559,10 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_threads(1)
+  , m_tileSize(256)
+  , m_cache(nullptr)
+  , m_groupCache(nullptr)
 {
 }
 
@@ -565,6 +584,25 @@ void Render::setNewBlend(const bool newBlend)
   m_newBlendMethod = newBlend;
 }
 
+void Render::setThreads(const int threads,
+                        const int tileSize)
+{
+  ASSERT(threads >= 0);
+  ASSERT(tileSize > 0);
+  m_threads = threads;
+  m_tileSize = std::max(1, tileSize);
+}
+
+void Render::setCache(RenderCache* cache)
+{
+  m_cache = cache;
+}
+
+void Render::setGroupCache(RenderCache* cache)
+{
+  m_groupCache = cache;
+}
+
 void Render::setProjection(const Projection& projection)
 {
   m_proj = projection;
@@ -682,6 +720,158 @@ void Render::renderSprite(
   const Sprite* sprite,
   frame_t frame,
   const gfx::ClipF& area)
+{
+  RenderCache::Key cacheKey;
+  if (m_cache && getCacheKey(dstImage, sprite, frame, area, cacheKey)) {
+    const gfx::Rect dstBounds = gfx::Clip(area).dstBounds();
+    if (ImageRef cached = m_cache->get(cacheKey)) {
+      dstImage->copy(cached.get(),
+                     gfx::Clip(dstBounds.origin(), cached->bounds()));
+      return;
+    }
+
+    renderSpriteWithoutCache(dstImage, sprite, frame, area);
+
+    m_cache->put(cacheKey,
+                 ImageRef(crop_image(dstImage, dstBounds, 0)));
+  }
+  else {
+    renderSpriteWithoutCache(dstImage, sprite, frame, area);
+  }
+}
+
+void Render::renderSpriteWithoutCache(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
+{
+  const int nthreads =
+    (m_threads > 0 ? m_threads:
+                     std::max(1, int(std::thread::hardware_concurrency())));
+
+  const gfx::Clip intArea(area);
+  if (nthreads > 1 && canRenderInTiles(dstImage, sprite, area))
+    renderSpriteTiles(dstImage, sprite, frame, intArea, nthreads);
+  else
+    renderSpriteArea(dstImage, sprite, frame, area);
+}
+
+bool Render::canRenderInTiles(
+  const Image* dstImage,
+  const Sprite* sprite,
+  const gfx::ClipF& area) const
+{
+  // The area must be in integer coordinates.
+  const gfx::Clip intArea(area);
+  if (area.dst.x != intArea.dst.x || area.dst.y != intArea.dst.y ||
+      area.src.x != intArea.src.x || area.src.y != intArea.src.y ||
+      area.size.w != intArea.size.w || area.size.h != intArea.size.h)
+    return false;
+
+  // The checkered background pattern depends on the destination
+  // position, and with the new blending method the background is
+  // composited in the whole destination image, so the area must
+  // cover the whole image.
+  if (m_bg.type == BgType::CHECKERED &&
+      intArea.dstBounds() != dstImage->bounds())
+    return false;
+
+  // With zoom out, cel positions are projected to fractional
+  // positions, and composite_image_general() maps destination pixels
+  // to source pixels with floating point arithmetic, in both cases
+  // the result depends on the start of the area, so tile seams could
+  // be different.
+  return
+    m_proj.scaleX() >= 1.0 &&
+    m_proj.scaleY() >= 1.0 &&
+    !needs_general_composition(m_proj, isFinegrain(sprite->root()));
+}
+
+void Render::renderSpriteTiles(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area,
+  int nthreads)
+{
+  m_sprite = sprite;
+
+  // Tiles are aligned to source pixels in the projected space (e.g.
+  // with zoom 300% a tile starts in a position multiple of 3), so
+  // each tile starts/ends in the same positions where a sprite pixel
+  // starts/ends.
+  const int pxW = std::max(1, m_proj.applyX(1));
+  const int pxH = std::max(1, m_proj.applyY(1));
+  const int tileW = pxW * ((m_tileSize+pxW-1) / pxW);
+  const int tileH = pxH * ((m_tileSize+pxH-1) / pxH);
+
+  // Returns the next tile boundary after "pos" (in source
+  // coordinates, which can be negative).
+  auto nextBoundary = [](const int pos, const int tileSize) {
+    const int q = (pos >= 0 ? pos / tileSize:
+                              -((-pos+tileSize-1) / tileSize));
+    return (q+1) * tileSize;
+  };
+
+  std::vector<gfx::Rect> tiles;
+  for (int y=area.src.y; y<area.src.y+area.size.h; ) {
+    const int y2 = std::min(nextBoundary(y, tileH), area.src.y+area.size.h);
+    for (int x=area.src.x; x<area.src.x+area.size.w; ) {
+      const int x2 = std::min(nextBoundary(x, tileW), area.src.x+area.size.w);
+      tiles.push_back(gfx::Rect(x-area.src.x, y-area.src.y, x2-x, y2-y));
+      x = x2;
+    }
+    y = y2;
+  }
+  if (tiles.size() < 2) {
+    renderSpriteArea(dstImage, sprite, frame, area);
+    return;
+  }
+
+  // Each thread renders tiles in its own tile image (with its own
+  // copy of the Render state), and then copies the tile image to its
+  // final position in dstImage (tiles don't overlap).
+  std::atomic<int> nextTile(0);
+  auto worker = [this, dstImage, sprite, frame, tileW, tileH,
+                 &area, &tiles, &nextTile]{
+    Render render(*this);
+    render.m_threads = 1;
+    render.m_tmpBuf.reset();
+    render.m_cache = nullptr;      // Used only in renderSprite()
+
+    ImageSpec spec = dstImage->spec();
+    spec.setSize(gfx::Size(tileW, tileH));
+    ImageRef tileImage(Image::create(spec));
+
+    for (int i=nextTile++; i<int(tiles.size()); i=nextTile++) {
+      const gfx::Rect& tile = tiles[i];
+      render.renderSpriteArea(
+        tileImage.get(), sprite, frame,
+        gfx::ClipF(0, 0,
+                   area.src.x+tile.x, area.src.y+tile.y,
+                   tile.w, tile.h));
+      dstImage->copy(
+        tileImage.get(),
+        gfx::Clip(area.dst.x+tile.x, area.dst.y+tile.y,
+                  0, 0, tile.w, tile.h));
+    }
+  };
+
+  nthreads = std::min(nthreads, int(tiles.size()));
+  std::vector<std::thread> threads;
+  for (int i=1; i<nthreads; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto& thread : threads)
+    thread.join();
+}
+
+void Render::renderSpriteArea(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area)
 {
   m_sprite = sprite;
 
@@ -715,7 +905,7 @@ void Render::renderSprite(
     fill_rect(dstImage, area.dstBounds(), bg_color);
 
     // Draw the Background layer - Onion skin behind the sprite - Transparent Layers
-    renderSpriteLayers(dstImage, area, frame, compositeImage);
+    renderSpriteLayers(dstImage, area, frame, bg_color, compositeImage);
 
     // In case that we need a special background (e.g. like the
     // checkered pattern), we can draw the background in a temporal
@@ -735,7 +925,7 @@ void Render::renderSprite(
   // Old Blending Method:
   else {
     renderBackground(dstImage, bgLayer, bg_color, area);
-    renderSpriteLayers(dstImage, area, frame, compositeImage);
+    renderSpriteLayers(dstImage, area, frame, bg_color, compositeImage);
   }
 
   // Draw onion skin in front of the sprite.
@@ -766,6 +956,7 @@ void Render::renderSprite(
 void Render::renderSpriteLayers(Image* dstImage,
                                 const gfx::ClipF& area,
                                 frame_t frame,
+                                const color_t bg_color,
                                 CompositeImageFunc compositeImage)
 {
   doc::RenderPlan plan;
@@ -783,13 +974,19 @@ void Render::renderSpriteLayers(Image* dstImage,
   if (m_onionskin.position() == OnionskinPosition::BEHIND)
     renderOnionskin(dstImage, area, frame, compositeImage);
 
-  // Draw the transparent layers.
+  // Draw the transparent layers (the first ones can be copied from
+  // the cache of pre-composited groups).
   m_globalOpacity = 255;
+  int firstItem = 0;
+  if (m_groupCache)
+    firstItem = renderCachedGroups(plan, dstImage, area, frame,
+                                   bg_color, compositeImage);
   renderPlan(plan, dstImage,
              area, frame, compositeImage,
              false,
              true,
-             BlendMode::UNSPECIFIED);
+             BlendMode::UNSPECIFIED,
+             firstItem);
 }
 
 void Render::renderBackground(Image* image,
@@ -993,9 +1190,14 @@ void Render::renderPlan(
   const CompositeImageFunc compositeImage,
   const bool render_background,
   const bool render_transparent,
-  const BlendMode blendMode)
+  const BlendMode blendMode,
+  const int firstItem,
+  const int lastItem)
 {
-  for (const auto& item : plan.items()) {
+  const auto& items = plan.items();
+  const int endItem = (lastItem < 0 ? int(items.size()): lastItem);
+  for (int i=firstItem; i<endItem; ++i) {
+    const auto& item = items[i];
     const Cel* cel = item.cel;
     const Layer* layer = item.layer;
 
@@ -1341,17 +1543,13 @@ void Render::renderImage(
     tileFlags);
 }
 
-CompositeImageFunc Render::getImageComposition(
-  const PixelFormat dstFormat,
-  const PixelFormat srcFormat,
-  const Layer* layer,
-  const tile_flags tileFlags)
+bool Render::isFinegrain(const Layer* layer) const
 {
   // True if we need blending pixel by pixel. If this is false we can
   // blend src+dst one time and repeat the resulting color in dst
   // image n-times (where n is the zoom scale).
   double intpart;
-  const bool finegrain =
+  return
     (!m_bg.zoom && (m_bg.stripeSize.w < m_proj.applyX(1) ||
                     m_bg.stripeSize.h < m_proj.applyY(1) ||
                     std::modf(double(m_bg.stripeSize.w) / m_proj.applyX(1.0), &intpart) != 0.0 ||
@@ -1359,6 +1557,15 @@ CompositeImageFunc Render::getImageComposition(
     (layer &&
      layer->isGroup() &&
      has_visible_reference_layers(static_cast<const LayerGroup*>(layer)));
+}
+
+CompositeImageFunc Render::getImageComposition(
+  const PixelFormat dstFormat,
+  const PixelFormat srcFormat,
+  const Layer* layer,
+  const tile_flags tileFlags)
+{
+  const bool finegrain = isFinegrain(layer);
 
   switch (srcFormat) {
 
@@ -1416,6 +1623,286 @@ bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
   return false;
 }
 
+namespace {
+
+uint64_t double_bits(const double value)
+{
+  uint64_t bits;
+  static_assert(sizeof(bits) == sizeof(value), "Invalid double size");
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+void add_cel_to_cache_key(const Layer* layer,
+                          const Cel* cel,
+                          RenderCache::Key& key)
+{
+  key.push_back(layer->id());
+  key.push_back(int(layer->flags()));
+
+  if (!layer->isImage())
+    return;
+
+  const auto imageLayer = static_cast<const LayerImage*>(layer);
+  key.push_back(imageLayer->opacity());
+  key.push_back(int(imageLayer->blendMode()));
+
+  if (layer->isTilemap()) {
+    const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset();
+    key.push_back(tileset ? tileset->id(): 0);
+    key.push_back(tileset ? tileset->version(): 0);
+  }
+
+  if (cel) {
+    const gfx::RectF& bounds = cel->boundsF();
+    key.push_back(cel->id());
+    key.push_back(cel->version());
+    key.push_back(double_bits(bounds.x));
+    key.push_back(double_bits(bounds.y));
+    key.push_back(double_bits(bounds.w));
+    key.push_back(double_bits(bounds.h));
+    key.push_back(cel->opacity());
+    key.push_back(cel->zIndex());
+    key.push_back(cel->image()->id());
+    key.push_back(cel->image()->version());
+  }
+  else {
+    key.push_back(0);
+  }
+}
+
+void add_layer_to_cache_key(const Layer* layer,
+                            const frame_t frame,
+                            RenderCache::Key& key)
+{
+  add_cel_to_cache_key(layer, layer->cel(frame), key);
+
+  if (layer->isGroup()) {
+    const auto group = static_cast<const LayerGroup*>(layer);
+    key.push_back(group->layersCount());
+    for (const Layer* child : group->layers())
+      add_layer_to_cache_key(child, frame, key);
+  }
+}
+
+// Returns the child of the root layer that contains the given layer.
+const Layer* get_root_child(const Layer* layer)
+{
+  while (layer->parent() && layer->parent()->parent())
+    layer = layer->parent();
+  return layer;
+}
+
+} // anonymous namespace
+
+// Returns false if the given frame cannot be cached (e.g. it
+// includes the preview of a modified cel).
+bool Render::getCacheKey(
+  const Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::ClipF& area,
+  RenderCache::Key& key) const
+{
+  if (m_extraType != ExtraType::NONE ||
+      m_previewImage ||
+      m_onionskin.type() != OnionskinType::NONE)
+    return false;
+
+  const Palette* palette = sprite->palette(frame);
+
+  key.clear();
+  key.push_back(sprite->id());
+  key.push_back(sprite->version());
+  key.push_back(frame);
+  key.push_back(sprite->pixelFormat());
+  key.push_back(sprite->width());
+  key.push_back(sprite->height());
+  key.push_back(sprite->transparentColor());
+  key.push_back(palette->size());
+  key.push_back(CityHash64((const char*)palette->rawColorsData(),
+                           palette->size()*sizeof(color_t)));
+
+  // Render options
+  key.push_back(dstImage->pixelFormat());
+  key.push_back(double_bits(area.dst.x));
+  key.push_back(double_bits(area.dst.y));
+  key.push_back(double_bits(area.src.x));
+  key.push_back(double_bits(area.src.y));
+  key.push_back(double_bits(area.size.w));
+  key.push_back(double_bits(area.size.h));
+  key.push_back(double_bits(m_proj.scaleX()));
+  key.push_back(double_bits(m_proj.scaleY()));
+  key.push_back(m_proj.pixelRatio().w);
+  key.push_back(m_proj.pixelRatio().h);
+  key.push_back(m_flags);
+  key.push_back(m_nonactiveLayersOpacity);
+  key.push_back(m_selectedLayerForOpacity ? m_selectedLayerForOpacity->id(): 0);
+  key.push_back(m_newBlendMethod);
+  key.push_back(int(m_bg.type));
+  key.push_back(m_bg.zoom);
+  key.push_back(m_bg.colorPixelFormat);
+  key.push_back(m_bg.color1);
+  key.push_back(m_bg.color2);
+  key.push_back(m_bg.stripeSize.w);
+  key.push_back(m_bg.stripeSize.h);
+
+  add_layer_to_cache_key(sprite->root(), frame, key);
+  return true;
+}
+
+// Copies the first layers of the plan (from the bottom up to the end
+// of a group) from the cache of pre-composited groups to dstImage,
+// and returns the number of plan items that were copied. The cache
+// contains one image for each cell of m_tileSize x m_tileSize sprite
+// pixels (the same cells used by renderSpriteTiles() without zoom),
+// and only cells in the given area that are not in the cache yet are
+// composited and added to the cache.
+int Render::renderCachedGroups(
+  RenderPlan& plan,
+  Image* dstImage,
+  const gfx::ClipF& area,
+  frame_t frame,
+  const color_t bg_color,
+  CompositeImageFunc compositeImage)
+{
+  // Only for sprite pixels without zoom (so each pixel of the area
+  // is the same pixel of the whole sprite image), and when the
+  // onion skin doesn't modify the background of transparent layers.
+  const gfx::Clip intArea(area);
+  if (!m_newBlendMethod ||
+      m_proj.scaleX() != 1.0 ||
+      m_proj.scaleY() != 1.0 ||
+      m_onionskin.type() != OnionskinType::NONE ||
+      area.src.x != intArea.src.x || area.src.y != intArea.src.y ||
+      area.dst.x != intArea.dst.x || area.dst.y != intArea.dst.y ||
+      area.size.w != intArea.size.w || area.size.h != intArea.size.h ||
+      !m_sprite->bounds().contains(intArea.srcBounds()))
+    return 0;
+
+  const Palette* palette = m_sprite->palette(frame);
+
+  RenderCache::Key key;
+  key.push_back(m_sprite->pixelFormat());
+  key.push_back(m_sprite->width());
+  key.push_back(m_sprite->height());
+  key.push_back(m_sprite->transparentColor());
+  key.push_back(palette->size());
+  key.push_back(CityHash64((const char*)palette->rawColorsData(),
+                           palette->size()*sizeof(color_t)));
+  key.push_back(dstImage->pixelFormat());
+  key.push_back(bg_color);
+  key.push_back(m_flags);
+  key.push_back(m_nonactiveLayersOpacity);
+  key.push_back(m_selectedLayerForOpacity ? m_selectedLayerForOpacity->id(): 0);
+
+  // Find the end of each group and the key to render all layers up
+  // to that point. We stop in the first layer that uses a
+  // preview/extra image (e.g. the layer being edited) or in
+  // reference layers (which can be rendered with sub-pixels).
+  const auto& items = plan.items();
+  std::vector<int> ends;
+  std::vector<RenderCache::Key> keys;
+  for (int i=0; i<int(items.size()); ++i) {
+    const Layer* layer = items[i].layer;
+    if ((m_previewImage && m_selectedLayer == layer) ||
+        (m_extraCel && m_extraImage && m_currentLayer == layer) ||
+        layer->isReference())
+      break;
+
+    key.push_back(items[i].order);
+    add_cel_to_cache_key(layer, items[i].cel, key);
+
+    const Layer* group = get_root_child(layer);
+    if (group->isGroup() &&
+        (i+1 == int(items.size()) ||
+         get_root_child(items[i+1].layer) != group)) {
+      ends.push_back(i+1);
+      keys.push_back(key);
+    }
+  }
+  if (ends.empty())
+    return 0;
+
+  // Returns the image of the given cell with all groups composited,
+  // using the last group of the cell that is in the cache
+  auto getCellImage = [&](const gfx::Rect& cell) -> ImageRef {
+    std::vector<RenderCache::Key> cellKeys(keys);
+    for (auto& cellKey : cellKeys) {
+      cellKey.push_back(cell.x);
+      cellKey.push_back(cell.y);
+      cellKey.push_back(cell.w);
+      cellKey.push_back(cell.h);
+    }
+
+    int hit = int(ends.size())-1;
+    ImageRef image;
+    for (; hit>=0; --hit) {
+      image = m_groupCache->get(cellKeys[hit]);
+      if (image)
+        break;
+    }
+    if (hit == int(ends.size())-1)
+      return image;
+
+    // Composite the rest of the groups in the cell
+    const gfx::Clip cellArea(0, 0, cell.x, cell.y, cell.w, cell.h);
+    ImageRef cellImage(Image::create(dstImage->pixelFormat(),
+                                     cell.w, cell.h));
+    int first = 0;
+    if (image) {
+      cellImage->copy(image.get(), gfx::Clip(cellImage->bounds()));
+      first = ends[hit];
+    }
+    else {
+      // The same steps as renderSpriteArea()/renderSpriteLayers()
+      // before drawing the transparent layers
+      fill_rect(cellImage.get(), cellImage->bounds(), bg_color);
+      renderPlan(plan, cellImage.get(),
+                 cellArea, frame, compositeImage,
+                 true,
+                 false,
+                 BlendMode::UNSPECIFIED);
+    }
+
+    for (++hit; hit<int(ends.size()); ++hit) {
+      renderPlan(plan, cellImage.get(),
+                 cellArea, frame, compositeImage,
+                 false,
+                 true,
+                 BlendMode::UNSPECIFIED,
+                 first, ends[hit]);
+      first = ends[hit];
+
+      // The last image can be added without a copy
+      if (hit == int(ends.size())-1)
+        image = cellImage;
+      else
+        image.reset(Image::createCopy(cellImage.get()));
+      m_groupCache->put(cellKeys[hit], image);
+    }
+    return image;
+  };
+
+  // Copy the cells in the area (cells are aligned to the sprite
+  // origin, and the area is inside the sprite bounds)
+  const gfx::Rect srcBounds = intArea.srcBounds();
+  const int cellSize = m_tileSize;
+  for (int y=cellSize*(srcBounds.y/cellSize); y<srcBounds.y2(); y+=cellSize) {
+    for (int x=cellSize*(srcBounds.x/cellSize); x<srcBounds.x2(); x+=cellSize) {
+      const gfx::Rect cell = (gfx::Rect(x, y, cellSize, cellSize) & m_sprite->bounds());
+      const gfx::Rect rc = (cell & srcBounds);
+      ImageRef image = getCellImage(cell);
+      dstImage->copy(image.get(),
+                     gfx::Clip(intArea.dst.x + rc.x - srcBounds.x,
+                               intArea.dst.y + rc.y - srcBounds.y,
+                               rc.x - cell.x, rc.y - cell.y,
+                               rc.w, rc.h));
+    }
+  }
+  return ends.back();
+}
+
 void composite_image(Image* dst,
                      const Image* src,
                      const Palette* pal,
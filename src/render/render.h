@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -24,6 +24,9 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace doc {
   class Cel;
   class Image;
@@ -37,6 +40,8 @@ namespace doc {
 namespace render {
   using namespace doc;
 
+  class RenderCache;
+
   typedef void (*CompositeImageFunc)(
     Image* dst,
     const Image* src,
@@ -64,6 +69,31 @@ namespace render {
     void setBgOptions(const BgOptions& bg);
     void setSelectedLayer(const Layer* layer);
 
+    // Number of threads used by renderSprite() to render the given
+    // area, divided in tiles of tileSize x tileSize pixels (aligned
+    // to the projected sprite pixels). With 1 thread (the default)
+    // the whole area is rendered in the current thread, and with 0
+    // threads we use one thread per CPU core. The output is the same
+    // as rendering the whole area at once (so zoom out and
+    // projections that need composite_image_general() are rendered
+    // in one thread).
+    void setThreads(const int threads,
+                    const int tileSize = 256);
+
+    // Cache used by renderSprite() to reuse frames rendered with the
+    // same layers/cels versions and options. The cache is not used
+    // when there is a preview/extra image or onion skinning.
+    void setCache(RenderCache* cache);
+
+    // Cache of pre-composited groups used by renderSprite() (with the
+    // new blending method and without zoom). Each image is the result
+    // of compositing all layers from the bottom up to the last layer
+    // of a group (a child of the root layer) in a cell of the sprite
+    // (cells of the tile size of setThreads()), so only groups above a
+    // modified layer, and only cells that are rendered, are composited
+    // again. The cache can be used with several threads.
+    void setGroupCache(RenderCache* cache);
+
     // Sets the preview image. This preview image is an alternative
     // image to be used for the given layer/frame.
     void setPreviewImage(const Layer* layer,
@@ -139,10 +169,43 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    void renderSpriteWithoutCache(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
+    void renderSpriteArea(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area);
+
+    bool canRenderInTiles(
+      const Image* dstImage,
+      const Sprite* sprite,
+      const gfx::ClipF& area) const;
+
+    void renderSpriteTiles(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area,
+      int nthreads);
+
     void renderSpriteLayers(
       Image* dstImage,
       const gfx::ClipF& area,
       frame_t frame,
+      const color_t bg_color,
+      CompositeImageFunc compositeImage);
+
+    int renderCachedGroups(
+      doc::RenderPlan& plan,
+      Image* dstImage,
+      const gfx::ClipF& area,
+      frame_t frame,
+      const color_t bg_color,
       CompositeImageFunc compositeImage);
 
     void renderBackground(
@@ -169,7 +232,9 @@ namespace render {
       const CompositeImageFunc compositeImage,
       const bool render_background,
       const bool render_transparent,
-      const BlendMode blendMode);
+      const BlendMode blendMode,
+      const int firstItem = 0,
+      const int lastItem = -1);
 
     void renderCel(
       Image* dst_image,
@@ -194,6 +259,8 @@ namespace render {
       const BlendMode blendMode,
       const tile_flags tileFlags = notile);
 
+    bool isFinegrain(const Layer* layer) const;
+
     CompositeImageFunc getImageComposition(
       const PixelFormat dstFormat,
       const PixelFormat srcFormat,
@@ -202,6 +269,13 @@ namespace render {
 
     bool checkIfWeShouldUsePreview(const Cel* cel) const;
 
+    bool getCacheKey(
+      const Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::ClipF& area,
+      std::vector<uint64_t>& key) const;
+
     int m_flags;
     int m_nonactiveLayersOpacity;
     const Sprite* m_sprite;
@@ -224,6 +298,10 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+    int m_threads;
+    int m_tileSize;
+    RenderCache* m_cache;
+    RenderCache* m_groupCache;
   };
 
   void composite_image(Image* dst,
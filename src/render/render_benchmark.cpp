@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,15 +10,23 @@
 
 #include "render/render.h"
 
+#include "doc/blend_mode.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "render/blend_row.h"
+#include "render/render_cache.h"
 
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
 using namespace doc;
 using namespace render;
 
@@ -79,4 +87,215 @@ BENCHMARK(Bm_Render)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+// Renders 3 layers with the given blend mode and reports the number
+// of composited pixels per second.
+static void Bm_RenderBlendMode(benchmark::State& state)
+{
+  const auto blendMode = BlendMode(state.range(0));
+  const int w = state.range(1);
+  const int h = state.range(2);
+  const int nlayers = 3;
+
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  std::mt19937 rng(1);
+  for (int i=0; i<nlayers; ++i) {
+    LayerImage* lay;
+    if (i == 0) {
+      lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+    }
+    else {
+      lay = new LayerImage(spr.get());
+      spr->root()->addLayer(lay);
+      lay->addCel(new Cel(frame_t(0), ImageRef(Image::create(spr->pixelFormat(), w, h))));
+    }
+    lay->setBlendMode(blendMode);
+    lay->setOpacity(200);
+
+    Image* img = lay->cel(0)->image();
+    for (int y=0; y<h; ++y)
+      for (int x=0; x<w; ++x)
+        put_pixel(img, x, y, rng());
+  }
+
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
+  Render render;
+  render.setBgOptions(BgOptions::MakeTransparent());
+
+  while (state.KeepRunning()) {
+    clear_image(dst.get(), 0);
+    render.renderSprite(
+      dst.get(), spr.get(), frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+  }
+  state.SetItemsProcessed(state.iterations() * w * h * nlayers);
+  state.SetLabel(blend_mode_to_string(blendMode));
+}
+
+static void BlendModeArguments(benchmark::internal::Benchmark* b)
+{
+  for (int mode=int(BlendMode::NORMAL); mode<=int(BlendMode::DIVIDE); ++mode)
+    b->Args({ mode, 4096, 2160 });
+}
+
+BENCHMARK(Bm_RenderBlendMode)
+  ->Apply(BlendModeArguments)
+  ->Unit(benchmark::kMillisecond);
+
+// Renders a sprite with 40 layers in tiles using different number of
+// threads (see Render::setThreads()).
+static void Bm_RenderThreads(benchmark::State& state)
+{
+  const int threads = state.range(0);
+  const int w = 2048;
+  const int h = 2048;
+  const int nlayers = 40;
+
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  std::mt19937 rng(1);
+  for (int i=0; i<nlayers; ++i) {
+    LayerImage* lay;
+    if (i == 0) {
+      lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+    }
+    else {
+      lay = new LayerImage(spr.get());
+      spr->root()->addLayer(lay);
+      lay->addCel(new Cel(frame_t(0), ImageRef(Image::create(spr->pixelFormat(), w, h))));
+    }
+    lay->setOpacity(128 + (i % 128));
+
+    Image* img = lay->cel(0)->image();
+    clear_image(img, 0);
+    fill_rect(img, (i*37) % w, (i*53) % h, w-1, h-1, rng() | 0x80000000);
+  }
+
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
+  Render render;
+  render.setBgOptions(BgOptions::MakeTransparent());
+  render.setThreads(threads);
+
+  while (state.KeepRunning()) {
+    render.renderSprite(dst.get(), spr.get(), frame_t(0));
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+BENCHMARK(Bm_RenderThreads)
+  ->Arg(1)
+  ->Arg(2)
+  ->Arg(4)
+  ->Arg(8)
+  ->Arg(0) // One thread per CPU core
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime();
+
+// Renders a sprite with 2 groups of 20 layers each and one layer on
+// top of them which is modified on each iteration (like when we are
+// painting in the top layer), with/without the cache of
+// pre-composited groups, and with the given number of threads (the
+// editor uses the cache with one thread per CPU core).
+static void Bm_RenderGroupCache(benchmark::State& state)
+{
+  const bool useCache = (state.range(0) != 0);
+  const int threads = state.range(1);
+  const int w = state.range(2);
+  const int h = state.range(3);
+  const int ngroups = 2;
+  const int nlayers = 20;
+
+  std::unique_ptr<Sprite> spr(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  std::mt19937 rng(1);
+  auto addLayer = [&spr, &rng, w, h](LayerGroup* parent, const int i) {
+    LayerImage* lay = new LayerImage(spr.get());
+    parent->addLayer(lay);
+    lay->setOpacity(128 + (i % 128));
+
+    ImageRef img(Image::create(spr->pixelFormat(), w, h));
+    clear_image(img.get(), 0);
+    fill_rect(img.get(), (i*37) % w, (i*53) % h, w-1, h-1, rng() | 0x80000000);
+    lay->addCel(new Cel(frame_t(0), img));
+    return lay;
+  };
+  for (int g=0; g<ngroups; ++g) {
+    LayerGroup* group = new LayerGroup(spr.get());
+    spr->root()->addLayer(group);
+    for (int i=0; i<nlayers; ++i)
+      addLayer(group, g*nlayers+i);
+  }
+  Image* topImage = addLayer(spr->root(), 0)->cel(0)->image();
+
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
+  RenderCache cache(1024*1024*1024);
+  Render render;
+  render.setBgOptions(BgOptions::MakeTransparent());
+  render.setThreads(threads);
+  if (useCache)
+    render.setGroupCache(&cache);
+
+  int i = 0;
+  while (state.KeepRunning()) {
+    put_pixel(topImage, (i++) % w, 0, rng());
+    topImage->incrementVersion();
+
+    render.renderSprite(dst.get(), spr.get(), frame_t(0));
+  }
+  state.SetItemsProcessed(state.iterations() * w * h);
+}
+
+BENCHMARK(Bm_RenderGroupCache)
+  ->Args({ 0, 1, 256, 256 })
+  ->Args({ 1, 1, 256, 256 })
+  ->Args({ 1, 0, 256, 256 })
+  ->Args({ 0, 1, 1024, 1024 })
+  ->Args({ 1, 1, 1024, 1024 })
+  ->Args({ 0, 0, 1024, 1024 })
+  ->Args({ 1, 0, 1024, 1024 })
+  ->Args({ 0, 1, 4096, 4096 })
+  ->Args({ 1, 1, 4096, 4096 })
+  ->Args({ 0, 0, 4096, 4096 })
+  ->Args({ 1, 0, 4096, 4096 })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
+// Compares the different row blender implementations (scalar, SSE2,
+// AVX2, NEON) with a row of 4096 pixels.
+static void Bm_BlendRow(benchmark::State& state)
+{
+  const auto impl = RowBlenderImpl(state.range(0));
+  const auto blendMode = BlendMode(state.range(1));
+  const bool newBlend = (state.range(2) != 0);
+  const int w = 4096;
+
+  if (!is_row_blender_impl_available(impl)) {
+    state.SkipWithError("Implementation not available");
+    return;
+  }
+
+  std::mt19937 rng(1);
+  std::vector<color_t> src(w), dst(w), backdrop(w);
+  for (int x=0; x<w; ++x) {
+    src[x] = rng();
+    backdrop[x] = rng();
+  }
+
+  const RgbaRowBlender rowBlender(blendMode, newBlend, impl);
+  while (state.KeepRunning()) {
+    std::copy(backdrop.begin(), backdrop.end(), dst.begin());
+    rowBlender(&dst[0], &src[0], w, 200, 0);
+    benchmark::DoNotOptimize(dst[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * w);
+}
+
+static void BlendRowArguments(benchmark::internal::Benchmark* b)
+{
+  for (int impl=int(RowBlenderImpl::Scalar); impl<=int(RowBlenderImpl::NEON); ++impl)
+    for (auto mode : { BlendMode::NORMAL, BlendMode::MULTIPLY, BlendMode::SCREEN })
+      for (int newBlend=0; newBlend<2; ++newBlend)
+        b->Args({ impl, int(mode), newBlend });
+}
+
+BENCHMARK(Bm_BlendRow)
+  ->Apply(BlendRowArguments);
+
 BENCHMARK_MAIN();
@@ -0,0 +1,123 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/render_cache.h"
+
+#include "doc/image.h"
+
+#include <city.h>
+
+#include <iterator>
+
+namespace render {
+
+RenderCache::RenderCache(const std::size_t maxMemSize)
+  : m_memSize(0)
+  , m_maxMemSize(maxMemSize)
+{
+}
+
+std::size_t RenderCache::maxMemSize() const
+{
+  const std::lock_guard lock(m_mutex);
+  return m_maxMemSize;
+}
+
+std::size_t RenderCache::memSize() const
+{
+  const std::lock_guard lock(m_mutex);
+  return m_memSize;
+}
+
+int RenderCache::size() const
+{
+  const std::lock_guard lock(m_mutex);
+  return int(m_items.size());
+}
+
+void RenderCache::setMaxMemSize(const std::size_t maxMemSize)
+{
+  const std::lock_guard lock(m_mutex);
+  m_maxMemSize = maxMemSize;
+  shrinkToMaxMemSize();
+}
+
+doc::ImageRef RenderCache::get(const Key& key)
+{
+  const uint64_t hash = hashKey(key);
+  const std::lock_guard lock(m_mutex);
+  auto range = m_index.equal_range(hash);
+  for (auto it=range.first; it!=range.second; ++it) {
+    Items::iterator item = it->second;
+    if (item->key == key) {
+      // Move the item to the front of the list (most recently used)
+      m_items.splice(m_items.begin(), m_items, item);
+      return item->image;
+    }
+  }
+  return nullptr;
+}
+
+void RenderCache::put(const Key& key, const doc::ImageRef& image)
+{
+  const std::size_t memSize = image->getMemSize();
+  const uint64_t hash = hashKey(key);
+  const std::lock_guard lock(m_mutex);
+  if (memSize > m_maxMemSize)
+    return;
+
+  auto range = m_index.equal_range(hash);
+  for (auto it=range.first; it!=range.second; ++it) {
+    if (it->second->key == key) {
+      removeItem(it->second);
+      break;
+    }
+  }
+
+  m_items.push_front(Item{ key, image, memSize });
+  m_index.emplace(hash, m_items.begin());
+  m_memSize += memSize;
+  shrinkToMaxMemSize();
+}
+
+void RenderCache::clear()
+{
+  const std::lock_guard lock(m_mutex);
+  m_items.clear();
+  m_index.clear();
+  m_memSize = 0;
+}
+
+void RenderCache::removeItem(Items::iterator item)
+{
+  auto range = m_index.equal_range(hashKey(item->key));
+  for (auto it=range.first; it!=range.second; ++it) {
+    if (it->second == item) {
+      m_index.erase(it);
+      break;
+    }
+  }
+  m_memSize -= item->memSize;
+  m_items.erase(item);
+}
+
+void RenderCache::shrinkToMaxMemSize()
+{
+  while (m_memSize > m_maxMemSize && !m_items.empty())
+    removeItem(std::prev(m_items.end()));
+}
+
+// static
+uint64_t RenderCache::hashKey(const Key& key)
+{
+  return CityHash64((const char*)key.data(), key.size()*sizeof(uint64_t));
+}
+
+} // namespace render
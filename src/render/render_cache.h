@@ -0,0 +1,79 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_RENDER_CACHE_H_INCLUDED
+#define RENDER_RENDER_CACHE_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace render {
+
+  // LRU cache of rendered images (e.g. composited frames) used to
+  // avoid rendering the same frame again when nothing has changed
+  // (e.g. when an animation is played in a loop).
+  //
+  // Each image is identified by a key with all the information
+  // needed to render it (sprite/layers/cels IDs and versions, render
+  // options, etc.). This class is thread-safe, so the same cache can
+  // be used from the threads of Render::renderSpriteTiles().
+  class RenderCache {
+  public:
+    typedef std::vector<uint64_t> Key;
+
+    // The memory budget is the maximum number of bytes used by the
+    // cached images (least recently used images are removed first).
+    explicit RenderCache(const std::size_t maxMemSize = 0);
+
+    std::size_t maxMemSize() const;
+    std::size_t memSize() const;
+    int size() const;
+
+    void setMaxMemSize(const std::size_t maxMemSize);
+
+    // Returns the image rendered with the given key, or nullptr if
+    // it isn't in the cache.
+    doc::ImageRef get(const Key& key);
+
+    // Adds the image to the cache (images bigger than the memory
+    // budget are not added). The image must not be modified after
+    // this call.
+    void put(const Key& key, const doc::ImageRef& image);
+
+    void clear();
+
+  private:
+    struct Item {
+      Key key;
+      doc::ImageRef image;
+      std::size_t memSize;
+    };
+    typedef std::list<Item> Items;
+
+    void removeItem(Items::iterator it);
+    void shrinkToMaxMemSize();
+
+    static uint64_t hashKey(const Key& key);
+
+    mutable std::mutex m_mutex;
+
+    // Most recently used items first
+    Items m_items;
+    std::unordered_multimap<uint64_t, Items::iterator> m_index;
+    std::size_t m_memSize;
+    std::size_t m_maxMemSize;
+  };
+
+} // namespace render
+
+#endif
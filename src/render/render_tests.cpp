@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include <gtest/gtest.h>
 
 #include "render/render.h"
+#include "render/render_cache.h"
 
 #include "doc/cel.h"
 #include "doc/document.h"
@@ -21,6 +22,7 @@
 #include "doc/primitives.h"
 
 #include <memory>
+#include <vector>
 
 using namespace doc;
 using namespace render;
@@ -277,6 +279,354 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+// Creates a sprite with 3 layers with different blend modes/opacity
+// and cel positions to compare single/multi-threaded renders.
+static void make_threads_test_sprite(Document* doc, const int w, const int h)
+{
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+
+  const BlendMode blendModes[] = { BlendMode::NORMAL,
+                                   BlendMode::MULTIPLY,
+                                   BlendMode::OVERLAY };
+  for (int i=0; i<3; ++i) {
+    LayerImage* lay;
+    if (i == 0)
+      lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+    else {
+      lay = new LayerImage(spr);
+      spr->root()->addLayer(lay);
+      lay->addCel(new Cel(frame_t(0), ImageRef(Image::create(IMAGE_RGB, w-20*i, h-10*i))));
+      lay->cel(0)->setPosition(7*i, 3*i);
+    }
+    lay->setBlendMode(blendModes[i]);
+    lay->setOpacity(255 - 50*i);
+
+    Image* img = lay->cel(0)->image();
+    for (int y=0; y<img->height(); ++y)
+      for (int x=0; x<img->width(); ++x)
+        put_pixel(img, x, y, rgba((x*7+i*50) & 255, (y*5) & 255, (x*y) & 255, (x+y+i*80) & 255));
+  }
+}
+
+// Renders the given area with 1 thread and then with 4 threads
+// (with the given tile size), and returns the number of different
+// pixels in the rendered area (pixels outside the area are not
+// modified when we render in tiles).
+static int count_threads_render_diffs(Render& render,
+                                      const Sprite* spr,
+                                      const gfx::Size& dstSize,
+                                      const gfx::Clip& area,
+                                      const int tileSize)
+{
+  std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, dstSize.w, dstSize.h));
+  std::unique_ptr<Image> result(Image::create(IMAGE_RGB, dstSize.w, dstSize.h));
+  clear_image(expected.get(), 0);
+  clear_image(result.get(), 0);
+
+  render.setThreads(1);
+  render.renderSprite(expected.get(), spr, frame_t(0), area);
+
+  render.setThreads(4, tileSize);
+  render.renderSprite(result.get(), spr, frame_t(0), area);
+
+  const gfx::Rect bounds = area.dstBounds();
+  int diffs = 0;
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    for (int x=bounds.x; x<bounds.x2(); ++x)
+      if (get_pixel(expected.get(), x, y) != get_pixel(result.get(), x, y))
+        ++diffs;
+  return diffs;
+}
+
+static BgOptions make_threads_test_checkered_bg()
+{
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  return bg;
+}
+
+TEST(Render, ThreadsGiveSameResult)
+{
+  const int w = 300, h = 200;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  make_threads_test_sprite(doc.get(), w, h);
+  const Sprite* spr = doc->sprite();
+
+  // Checkered background (the area must cover the whole image)
+  {
+    Render render;
+    render.setBgOptions(make_threads_test_checkered_bg());
+    EXPECT_EQ(0, count_threads_render_diffs(render, spr, gfx::Size(w, h),
+                                            gfx::Clip(0, 0, 0, 0, w, h), 64));
+    EXPECT_EQ(0, count_threads_render_diffs(render, spr, gfx::Size(w-50, h-40),
+                                            gfx::Clip(0, 0, 13, 27, w-50, h-40), 64));
+  }
+
+  // Transparent background in any position of the destination image
+  {
+    Render render;
+    render.setBgOptions(BgOptions::MakeTransparent());
+    EXPECT_EQ(0, count_threads_render_diffs(render, spr, gfx::Size(w, h),
+                                            gfx::Clip(0, 0, 13, 27, w-50, h-40), 64));
+    EXPECT_EQ(0, count_threads_render_diffs(render, spr, gfx::Size(w+20, h+10),
+                                            gfx::Clip(17, 5, 3, 9, w-30, h-20), 37));
+  }
+}
+
+TEST(Render, ThreadsGiveSameResultWithZoom)
+{
+  const int w = 120, h = 90;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  make_threads_test_sprite(doc.get(), w, h);
+  const Sprite* spr = doc->sprite();
+
+  const Projection projections[] = {
+    Projection(PixelRatio(1, 1), Zoom(2, 1)),
+    Projection(PixelRatio(1, 1), Zoom(3, 1)),
+    Projection(PixelRatio(1, 1), Zoom(8, 1)),
+    Projection(PixelRatio(2, 1), Zoom(1, 1)),
+    Projection(PixelRatio(1, 2), Zoom(3, 1)),
+    // These ones are rendered in one thread (zoom out or
+    // composite_image_general()), but must give the same result
+    Projection(PixelRatio(1, 1), Zoom(1, 2)),
+    Projection(PixelRatio(1, 1), Zoom(1, 3)),
+    Projection(PixelRatio(1, 1), Zoom(3, 2)),
+    Projection(PixelRatio(2, 1), Zoom(1, 2)),
+  };
+
+  for (const Projection& proj : projections) {
+    const gfx::Size size(proj.applyX(w), proj.applyY(h));
+
+    for (const int tileSize : { 5, 16, 64 }) {
+      // Checkered background with the whole image
+      {
+        Render render;
+        render.setBgOptions(make_threads_test_checkered_bg());
+        render.setProjection(proj);
+        EXPECT_EQ(0, count_threads_render_diffs(
+                    render, spr, size,
+                    gfx::Clip(0, 0, 0, 0, size.w, size.h), tileSize))
+          << "scale " << proj.scaleX() << "x" << proj.scaleY()
+          << " tileSize " << tileSize;
+      }
+
+      // Transparent background with areas that don't start in a
+      // sprite pixel boundary
+      {
+        Render render;
+        render.setBgOptions(BgOptions::MakeTransparent());
+        render.setProjection(proj);
+        EXPECT_EQ(0, count_threads_render_diffs(
+                    render, spr, size,
+                    gfx::Clip(3, 1, 7, 5, size.w-11, size.h-9), tileSize))
+          << "scale " << proj.scaleX() << "x" << proj.scaleY()
+          << " tileSize " << tileSize;
+      }
+    }
+  }
+}
+
+TEST(Render, Cache)
+{
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, 4, 4)));
+  Sprite* spr = doc->sprite();
+  spr->setTotalFrames(frame_t(2));
+
+  LayerImage* lay = static_cast<LayerImage*>(spr->root()->firstLayer());
+  ImageRef img1(Image::create(IMAGE_RGB, 4, 4));
+  clear_image(img1.get(), rgba(0, 0, 255, 255));
+  lay->addCel(new Cel(frame_t(1), img1));
+
+  Image* img0 = lay->cel(0)->image();
+  clear_image(img0, rgba(255, 0, 0, 255));
+
+  const color_t r = rgba(255, 0, 0, 255);
+  const color_t b = rgba(0, 0, 255, 255);
+  const color_t g = rgba(0, 255, 0, 255);
+
+  RenderCache cache(1024*1024);
+  Render render;
+  render.setCache(&cache);
+
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 4, 4));
+  render.renderSprite(dst.get(), spr, frame_t(0));
+  render.renderSprite(dst.get(), spr, frame_t(1));
+  EXPECT_EQ(2, cache.size());
+
+  // Rendered from the cache
+  clear_image(dst.get(), 0);
+  render.renderSprite(dst.get(), spr, frame_t(0));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_2X2_PIXELS(dst.get(), r, r, r, r);
+
+  // A new version of the image is rendered again
+  put_pixel(img0, 1, 0, g);
+  img0->incrementVersion();
+  render.renderSprite(dst.get(), spr, frame_t(0));
+  EXPECT_EQ(3, cache.size());
+  EXPECT_2X2_PIXELS(dst.get(), r, g, r, r);
+
+  // Layer properties are part of the key
+  lay->setVisible(false);
+  render.renderSprite(dst.get(), spr, frame_t(1));
+  EXPECT_EQ(4, cache.size());
+  EXPECT_2X2_PIXELS(dst.get(), 0, 0, 0, 0);
+  lay->setVisible(true);
+  render.renderSprite(dst.get(), spr, frame_t(1));
+  EXPECT_EQ(4, cache.size());
+  EXPECT_2X2_PIXELS(dst.get(), b, b, b, b);
+
+  // Onion skinning isn't cached
+  OnionskinOptions onionskin(OnionskinType::MERGE);
+  onionskin.prevFrames(1);
+  render.setOnionskin(onionskin);
+  render.renderSprite(dst.get(), spr, frame_t(1));
+  render.disableOnionskin();
+  EXPECT_EQ(4, cache.size());
+
+  // Least recently used images are removed first
+  cache.setMaxMemSize(cache.memSize() / 2);
+  EXPECT_EQ(2, cache.size());
+  render.renderSprite(dst.get(), spr, frame_t(1));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_2X2_PIXELS(dst.get(), b, b, b, b);
+
+  cache.clear();
+  EXPECT_EQ(0, cache.size());
+  EXPECT_EQ(0, int(cache.memSize()));
+}
+
+TEST(Render, GroupCache)
+{
+  const int w = 64, h = 48;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+
+  // Two groups with 3 layers each and a layer on top of them
+  const BlendMode blendModes[] = { BlendMode::NORMAL,
+                                   BlendMode::MULTIPLY,
+                                   BlendMode::SCREEN };
+  std::vector<LayerImage*> layers;
+  for (int g=0; g<2; ++g) {
+    LayerGroup* group = new LayerGroup(spr);
+    spr->root()->addLayer(group);
+    for (int i=0; i<3; ++i) {
+      LayerImage* lay = new LayerImage(spr);
+      lay->setBlendMode(blendModes[i]);
+      lay->setOpacity(200);
+      group->addLayer(lay);
+      layers.push_back(lay);
+    }
+  }
+  LayerImage* top = new LayerImage(spr);
+  spr->root()->addLayer(top);
+  layers.push_back(top);
+
+  for (int i=0; i<int(layers.size()); ++i) {
+    ImageRef img(Image::create(IMAGE_RGB, w-i*4, h-i*3));
+    for (int y=0; y<img->height(); ++y)
+      for (int x=0; x<img->width(); ++x)
+        put_pixel(img.get(), x, y, rgba((x*9+i*30) & 255, (y*7) & 255, (x*y+i) & 255, (x+y*3+i*40) & 255));
+    layers[i]->addCel(new Cel(frame_t(0), img));
+    layers[i]->cel(0)->setPosition(i*2, i);
+  }
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(8, 8);
+
+  RenderCache cache(16*1024*1024);
+  Render cachedRender;
+  cachedRender.setBgOptions(bg);
+  cachedRender.setGroupCache(&cache);
+
+  const Image* preview = nullptr;
+  LayerImage* previewLayer = layers[1];
+  auto expectSameRender = [&](const gfx::Clip& area) {
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, w, h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, w, h));
+    clear_image(expected.get(), 0);
+    clear_image(result.get(), 0);
+
+    Render render;
+    render.setBgOptions(bg);
+    if (preview) {
+      render.setPreviewImage(previewLayer, frame_t(0), preview, nullptr,
+                             previewLayer->cel(0)->position(), BlendMode::NORMAL);
+      cachedRender.setPreviewImage(previewLayer, frame_t(0), preview, nullptr,
+                                   previewLayer->cel(0)->position(), BlendMode::NORMAL);
+    }
+    else {
+      cachedRender.removePreviewImage();
+    }
+    render.renderSprite(expected.get(), spr, frame_t(0), area);
+    cachedRender.renderSprite(result.get(), spr, frame_t(0), area);
+    EXPECT_TRUE(is_same_image(expected.get(), result.get()));
+  };
+
+  // Both groups are added to the cache
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(2, cache.size());
+  expectSameRender(gfx::Clip(3, 4, 10, 12, 20, 15));
+  EXPECT_EQ(2, cache.size());
+
+  // Modifying the top layer doesn't invalidate the groups
+  Image* topImage = top->cel(0)->image();
+  put_pixel(topImage, 1, 2, rgba(255, 0, 0, 255));
+  topImage->incrementVersion();
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(2, cache.size());
+
+  // Modifying a layer in the second group composites that group again
+  Image* img = layers[4]->cel(0)->image();
+  put_pixel(img, 5, 6, rgba(0, 255, 0, 255));
+  img->incrementVersion();
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(3, cache.size());
+
+  // The layer being edited (preview image) isn't cached
+  ImageRef previewImage(Image::createCopy(img));
+  clear_image(previewImage.get(), rgba(0, 0, 255, 128));
+  preview = previewImage.get();
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(3, cache.size());
+  preview = nullptr;
+
+  // Hidden layers change the key
+  layers[0]->setVisible(false);
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(5, cache.size());
+
+  // Only the cells of the rendered area are composited (2 cells of
+  // 16x16 pixels with 2 groups each)
+  cache.clear();
+  cachedRender.setThreads(4, 16);
+  expectSameRender(gfx::Clip(0, 0, 0, 0, 20, 10));
+  EXPECT_EQ(2*2, cache.size());
+
+  // The cache is used from each thread rendering tiles (4x3 cells)
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(12*2, cache.size());
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(12*2, cache.size());
+
+  // Modifying a layer in the second group composites the second
+  // group in all cells again
+  put_pixel(img, 7, 8, rgba(255, 0, 255, 255));
+  img->incrementVersion();
+  expectSameRender(gfx::Clip(0, 0, 0, 0, w, h));
+  EXPECT_EQ(12*3, cache.size());
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -1,4 +1,4 @@
--- Copyright (C) 2019-2022  Igara Studio S.A.
+-- Copyright (C) 2019-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -135,6 +135,12 @@ do
                    2, 3 })
   app.undo()
 
+  app.command.ChangePixelFormat{ format="indexed", rgbmap="kdtree" }
+  bg = s.cels[1].image
+  expect_img(bg, { 0, 1,
+                   2, 3 })
+  app.undo()
+
   p:setColor(0, Color(0, 0, 0, 0))
   bg = s.cels[1].image
   array_to_pixels({ rgba(101, 90, 200, 0), rgba(101, 90, 200),
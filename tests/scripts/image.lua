@@ -534,3 +534,81 @@ do
                     2, 3 })
 
 end
+
+-- Bulk pixel access: Image:getPixels/setPixels/getBytes/setBytes/mapPixels
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  img:setPixels({ 1, 2, 3,
+                  4, 5, 6 })
+  expect_img(img, { 1, 2, 3,
+                    4, 5, 6 })
+
+  local px = img:getPixels()
+  assert(#px == 6)
+  for i=1,6 do expect_eq(i, px[i]) end
+
+  px = img:getPixels(Rectangle(1, 0, 2, 2))
+  assert(#px == 4)
+  expect_eq(2, px[1])
+  expect_eq(3, px[2])
+  expect_eq(5, px[3])
+  expect_eq(6, px[4])
+
+  img:setPixels({ 7, 8 }, Rectangle(0, 1, 2, 1))
+  expect_img(img, { 1, 2, 3,
+                    7, 8, 6 })
+
+  -- Invalid rectangles/sizes
+  assert(not pcall(function() img:getPixels(Rectangle(2, 0, 2, 1)) end))
+  assert(not pcall(function() img:setPixels({ 1, 2 }) end))
+  -- The image is not modified if some pixel is invalid
+  assert(not pcall(function() img:setPixels({ 1, 2, 3, 4, 5, "x" }) end))
+  expect_img(img, { 1, 2, 3,
+                    7, 8, 6 })
+
+  -- Bytes of a rectangle
+  expect_eq(string.char(2, 3, 5, 6), img:getBytes(Rectangle(1, 0, 2, 2)))
+  img:setBytes(string.char(9, 9), Rectangle(0, 0, 1, 2))
+  expect_img(img, { 9, 2, 3,
+                    9, 5, 6 })
+  assert(not pcall(function() img:setBytes(string.char(1, 2, 3)) end))
+  expect_eq(img.bytes, img:getBytes())
+
+  -- Map pixels with a table (lookup table)
+  img:mapPixels({ [9]=1, [5]=0 })
+  expect_img(img, { 1, 2, 3,
+                    1, 0, 6 })
+  img:mapPixels({ [1]=4 }, Rectangle(0, 1, 3, 1))
+  expect_img(img, { 1, 2, 3,
+                    4, 0, 6 })
+
+  -- Map pixels with a function
+  img:mapPixels(function(c, x, y) return c + x*10 + y*100 end)
+  expect_img(img, {   1,  12,  23,
+                    104, 110, 126 })
+  img:mapPixels(function(c, x, y)
+                  if x == 0 then return 0 end -- nil keeps the pixel
+                end)
+  expect_img(img, { 0,  12,  23,
+                    0, 110, 126 })
+  assert(not pcall(function() img:mapPixels(function() error("x") end) end))
+end
+
+-- Bulk pixel access in RGB images
+do
+  local img = Image(2, 2, ColorMode.RGB)
+  local r = rgba(255, 0, 0, 255)
+  local g = rgba(0, 255, 0, 255)
+  local b = rgba(0, 0, 255, 255)
+  img:setPixels({ r, g,
+                  b, 0 })
+  expect_img(img, { r, g,
+                    b, 0 })
+  local px = img:getPixels()
+  expect_eq(r, px[1])
+  expect_eq(0, px[4])
+
+  img:mapPixels({ [r]=g, [0]=b })
+  expect_img(img, { g, g,
+                    b, b })
+end